@@ -0,0 +1,161 @@
+#ifndef __ASYNC_HPP__
+#define __ASYNC_HPP__
+
+/**
+ * 异步操作的C++20协程封装
+ * co_await async_write/async_append等提交异步操作并挂起协程, 操作完成回调中恢复协程, 结果为errc
+ * 协程只在spifs::poll(spifs_async_poll)内恢复, 调用者循环poll并在闪存忙碌时执行其他工作
+ * 操作的数据缓冲区在co_await返回前保持有效即可(挂起期间协程帧内的变量有效)
+ * */
+
+#include <coroutine>
+#include <exception>
+#include "spifs.hpp"
+
+namespace spifs {
+
+/**
+ * 协程返回类型, 创建后立即执行到第一个挂起点, 结束后保留协程帧直至task析构
+ * */
+class task {
+public:
+    struct promise_type {
+        task get_return_object() noexcept { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    task(task &&other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    task &operator=(task &&other) noexcept {
+        if(this != &other) {
+            if(handle_) handle_.destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~task() {
+        if(handle_) handle_.destroy();
+    }
+
+    // 协程已执行完毕
+    bool done() const noexcept { return !handle_ || handle_.done(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+};
+
+// 访问文件句柄的追加写状态, 异步追加写与同步接口一样由句柄析构时完成
+struct async_access {
+    template<class Geometry>
+    static bool &appending(basic_file<Geometry> &file) noexcept { return file.appending_; }
+};
+
+/**
+ * 异步操作的awaitable, 挂起时提交操作, 完成回调中恢复等待的协程
+ * */
+class async_operation {
+public:
+    async_operation(std::uint8_t kind, File &file, std::uint8_t *buffer, std::uint32_t offset, std::uint32_t size) noexcept
+        : op_{}, waiter_() {
+        op_.kind = kind;
+        op_.file = &file;
+        op_.buffer = buffer;
+        op_.offset = offset;
+        op_.size = size;
+        op_.callback = &async_operation::resume;
+        op_.context = this;
+    }
+
+    async_operation(const async_operation &) = delete;
+    async_operation &operator=(const async_operation &) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> waiter) noexcept {
+        waiter_ = waiter;
+        spifs_async_submit(&op_);
+    }
+
+    errc await_resume() const noexcept { return to_errc(op_.result); }
+
+private:
+    AsyncOp op_;
+    std::coroutine_handle<> waiter_;
+
+    static void resume(AsyncOp *op) {
+        static_cast<async_operation *>(op->context)->waiter_.resume();
+    }
+};
+
+/**
+ * 异步写入文件全部内容
+ * @param &file 文件句柄
+ * @param data 文件内容
+ * */
+template<class Geometry, byte_range R>
+async_operation async_write(basic_file<Geometry> &file, R &&data) noexcept {
+    return async_operation(ASYNC_WRITE, file.native(), detail::bytes(data), 0, detail::size_bytes(data));
+}
+
+/**
+ * 异步追加写, 之后co_await async_finish或由句柄析构时完成
+ * @param &file 文件句柄
+ * @param data 追加内容
+ * */
+template<class Geometry, byte_range R>
+async_operation async_append(basic_file<Geometry> &file, R &&data) noexcept {
+    async_access::appending(file) = true;
+    return async_operation(ASYNC_APPEND, file.native(), detail::bytes(data), 0, detail::size_bytes(data));
+}
+
+/**
+ * 异步完成追加写
+ * @param &file 文件句柄
+ * */
+template<class Geometry>
+async_operation async_finish(basic_file<Geometry> &file) noexcept {
+    async_access::appending(file) = false;
+    return async_operation(ASYNC_FINISH, file.native(), nullptr, 0, 0);
+}
+
+/**
+ * 异步按偏移覆盖写, 不完成未结束的追加写
+ * @param &file 文件句柄
+ * @param offset 文件内偏移
+ * @param data 写入内容
+ * */
+template<class Geometry, byte_range R>
+async_operation async_pwrite(basic_file<Geometry> &file, std::uint32_t offset, R &&data) noexcept {
+    return async_operation(ASYNC_PWRITE, file.native(), detail::bytes(data), offset, detail::size_bytes(data));
+}
+
+/**
+ * 异步截断文件, 不完成未结束的追加写
+ * @param &file 文件句柄
+ * @param length 新的文件大小
+ * */
+template<class Geometry>
+async_operation async_truncate(basic_file<Geometry> &file, std::uint32_t length) noexcept {
+    return async_operation(ASYNC_TRUNCATE, file.native(), nullptr, length, 0);
+}
+
+/**
+ * 推进异步操作, 见spifs_async_poll
+ * @return true:仍有未完成的操作或命令
+ * */
+inline bool poll() noexcept {
+    return spifs_async_poll() != 0;
+}
+
+} // namespace spifs
+
+#endif // __ASYNC_HPP__
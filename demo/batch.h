@@ -0,0 +1,24 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 批处理最多同时暂存的索引扇区数, 超出时先提交已暂存的扇区
+#define BATCH_SECTOR_MAX 4
+// 批处理最多推迟完成的日志记录数, 达到时或日志记录表的剩余位置不足JOURNAL_NEST_MAX时先提交
+#define BATCH_DEFER_MAX 16
+
+void spifs_batch_begin();
+uint32_t spifs_batch_commit();
+
+// 文件系统内部接口
+void batch_discard();
+void batch_hold(uint32_t address);
+void batch_read(uint32_t address, uint8_t *buffer, uint32_t size);
+uint8_t batch_write(uint32_t address, uint8_t *buffer, uint32_t size);
+void batch_erase(uint32_t address);
+uint8_t batch_rewrite(uint32_t address, uint8_t *buffer);
+uint8_t batch_defer(uint32_t handle);
+
+#endif // __BATCH_H__
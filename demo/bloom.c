@@ -0,0 +1,144 @@
+#include "bloom.h"
+
+/**
+ * 根目录文件名布隆过滤器
+ * 记录根目录索引中全部文件名(文件名+拓展名12字节, 含已删除未回收的文件), 挂载时扫描建立,
+ * create_file时加入, 垃圾回收后重新建立; 过滤器判定不存在时open_file直接返回, 不扫描索引扇区
+ * 过滤器只会误判存在(随后照常扫描), 不会误判不存在; 未开启或未建立时不过滤
+ * */
+
+static uint8_t *bloom_bits = NULL;
+static uint32_t bloom_sum = 0;      // 位数
+static uint8_t bloom_hashes = 0;   // 哈希函数个数
+static uint8_t bloom_valid = 0;
+static BloomStats bloom_stats;
+
+static void bloom_hash(uint8_t *name, uint32_t *h1, uint32_t *h2);
+
+/**
+ * 设置过滤器占用的内存
+ * 哈希函数个数按根目录索引槽位全部占用时的最优值选取(1KB时为8个, 误判率约0.3%)
+ * 挂载后调用时立即扫描建立
+ * @param bytes 过滤器字节数, 0关闭
+ * @return 1:设置成功, 0:内存不足(过滤器关闭)
+ * */
+uint8_t spifs_bloom(uint32_t bytes) {
+    uint32_t hashes;
+    free(bloom_bits);
+    bloom_bits = NULL;
+    bloom_sum = 0;
+    bloom_valid = 0;
+    if(bytes == 0) {
+        return 1;
+    }
+    bloom_bits = (uint8_t *)malloc(sizeof(uint8_t) * bytes);
+    if(bloom_bits == NULL) {
+        return 0;
+    }
+    bloom_sum = bytes * 8;
+    // k = m / n * ln2
+    hashes = (bloom_sum * 693) / (BLOOM_SLOT_SUM * 1000);
+    bloom_hashes = (hashes < 1) ? 1 : ((hashes > BLOOM_HASH_MAX) ? BLOOM_HASH_MAX : hashes);
+    bloom_build();
+    return 1;
+}
+
+/**
+ * 读取过滤器统计
+ * @param *stats 统计数据
+ * */
+void spifs_bloom_stats(BloomStats *stats) {
+    *stats = bloom_stats;
+}
+
+/**
+ * 扫描根目录索引扇区建立过滤器, 每个槽位只读取文件名与拓展名
+ * */
+void bloom_build() {
+    uint8_t name[FILENAME_FULLSIZE];
+    if(bloom_sum == 0) {
+        return;
+    }
+    bulk_fill(bloom_bits, 0, (bloom_sum / 8));
+    bloom_valid = 1;
+    for(uint32_t i = FB_SECTOR_INIT; i < FB_SECTOR_END; i++) {
+        for(uint32_t offset = 0; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+            disk_read((i * SECTOR_SIZE + offset), name, FILENAME_FULLSIZE);
+            if(name[0] != 0x00 && !bulk_erased(name, FILENAME_FULLSIZE)) {
+                bloom_insert(name);
+            }
+        }
+    }
+}
+
+/**
+ * 过滤器失效(存储器被整体擦除), 挂载时重新建立
+ * */
+void bloom_invalidate() {
+    bloom_valid = 0;
+}
+
+/**
+ * 加入文件名
+ * @param *name 文件名+拓展名(12字节, 不足部分为0xFF)
+ * */
+void bloom_insert(uint8_t *name) {
+    uint32_t h1, h2, bit;
+    if(!bloom_valid) {
+        return;
+    }
+    bloom_hash(name, &h1, &h2);
+    for(uint8_t i = 0; i < bloom_hashes; i++) {
+        bit = (h1 + i * h2) % bloom_sum;
+        *(bloom_bits + bit / 8) |= (1 << (bit % 8));
+    }
+}
+
+/**
+ * 查询文件名
+ * @param *name 文件名+拓展名(12字节)
+ * @return 0:一定不存在, 1:可能存在(过滤器未开启时总为1)
+ * */
+uint8_t bloom_contains(uint8_t *name) {
+    uint32_t h1, h2, bit;
+    if(!bloom_valid) {
+        return 1;
+    }
+    bloom_stats.queries++;
+    bloom_hash(name, &h1, &h2);
+    for(uint8_t i = 0; i < bloom_hashes; i++) {
+        bit = (h1 + i * h2) % bloom_sum;
+        if((*(bloom_bits + bit / 8) & (1 << (bit % 8))) == 0) {
+            bloom_stats.rejected++;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 过滤器判定可能存在但扫描未找到, 由open_file调用
+ * */
+void bloom_miss() {
+    if(bloom_valid) {
+        bloom_stats.false_positives++;
+    }
+}
+
+/**
+ * 双重哈希: FNV-1a与其再混合的结果, 第i个哈希为h1 + i * h2
+ * */
+static void bloom_hash(uint8_t *name, uint32_t *h1, uint32_t *h2) {
+    uint32_t hash = 0x811C9DC5;
+    for(uint32_t i = 0; i < FILENAME_FULLSIZE; i++) {
+        hash = (hash ^ *(name + i)) * 0x01000193;
+    }
+    *h1 = hash;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+    // 步长取奇数, 不为0
+    *h2 = hash | 1;
+}
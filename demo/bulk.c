@@ -0,0 +1,98 @@
+#include <string.h>
+#include "bulk.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * 批量内存操作, 用于扇区/槽位大小的数据块
+ * 填充与复制使用C库memset/memcpy, 其实现已按字长或SIMD宽度处理
+ * 比较与擦除检测主机构建(SSE2)先按16字节处理, 其余部分按8字节处理, 剩余字节逐字节处理
+ * */
+
+/**
+ * 填充
+ * @param *dst 目标地址
+ * @param value 填充值
+ * @param size 字节数
+ * */
+void bulk_fill(uint8_t *dst, uint8_t value, uint32_t size) {
+    memset(dst, value, size);
+}
+
+/**
+ * 复制, 源与目标不能重叠
+ * @param *dst 目标地址
+ * @param *src 源地址
+ * @param size 字节数
+ * */
+void bulk_copy(uint8_t *dst, uint8_t *src, uint32_t size) {
+    memcpy(dst, src, size);
+}
+
+/**
+ * 比较两段数据是否相同
+ * @return 0:不同, 1:相同
+ * */
+uint8_t bulk_equal(uint8_t *a, uint8_t *b, uint32_t size) {
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    for(; (size - i) >= 16; i += 16) {
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(a + i)), _mm_loadu_si128((__m128i *)(b + i)))) != 0xFFFF) {
+            return 0;
+        }
+    }
+#endif
+    uint64_t x, y;
+    for(; (size - i) >= 8; i += 8) {
+        memcpy(&x, (a + i), 8);
+        memcpy(&y, (b + i), 8);
+        if(x != y) {
+            return 0;
+        }
+    }
+    for(; i < size; i++) {
+        if(*(a + i) != *(b + i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 检查数据是否全部为0xFF(擦除状态)
+ * @return 0:存在非0xFF字节, 1:全部为0xFF
+ * */
+uint8_t bulk_erased(uint8_t *data, uint32_t size) {
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_set1_epi8((char)0xFF);
+    for(; (size - i) >= 64; i += 64) {
+        acc = _mm_and_si128(acc, _mm_and_si128(
+                  _mm_and_si128(_mm_loadu_si128((__m128i *)(data + i)), _mm_loadu_si128((__m128i *)(data + i + 16))),
+                  _mm_and_si128(_mm_loadu_si128((__m128i *)(data + i + 32)), _mm_loadu_si128((__m128i *)(data + i + 48)))));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_set1_epi8((char)0xFF))) != 0xFFFF) {
+            return 0;
+        }
+    }
+    for(; (size - i) >= 16; i += 16) {
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(data + i)), _mm_set1_epi8((char)0xFF))) != 0xFFFF) {
+            return 0;
+        }
+    }
+#endif
+    uint64_t x;
+    for(; (size - i) >= 8; i += 8) {
+        memcpy(&x, (data + i), 8);
+        if(x != 0xFFFFFFFFFFFFFFFFULL) {
+            return 0;
+        }
+    }
+    for(; i < size; i++) {
+        if(*(data + i) != 0xFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,11 @@
+#ifndef __BULK_H__
+#define __BULK_H__
+
+#include "stdint.h"
+
+void bulk_fill(uint8_t *dst, uint8_t value, uint32_t size);
+void bulk_copy(uint8_t *dst, uint8_t *src, uint32_t size);
+uint8_t bulk_equal(uint8_t *a, uint8_t *b, uint32_t size);
+uint8_t bulk_erased(uint8_t *data, uint32_t size);
+
+#endif // __BULK_H__
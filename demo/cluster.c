@@ -0,0 +1,268 @@
+#include "cluster.h"
+
+/**
+ * 簇的占用标记与下一簇地址
+ * 默认格式保存在扇区内: 偏移0为占用标记(0xFF00), 数据域之后的最后4字节为下一簇地址
+ * 定义SPIFS_LINK_TABLE时保存在簇链接表中, 扇区内只有数据(与校验文件的封存槽位), 每簇数据域为4096字节
+ * 链接表为每个数据扇区保存一项, 每项LINK_SLOT_SUM个槽位依次使用, 最后一个写入了状态的槽位为当前槽位:
+ * 分配时写入下一个槽位的状态, 链接时写入当前槽位的下一簇地址, 重新链接时在下一个槽位先写地址再写状态,
+ * 状态写入后新地址生效, 释放(数据扇区擦除之后)时将当前槽位的状态写0
+ * 槽位用尽时经影子扇区重写所在链接表扇区, 每项只保留占用中的当前槽位
+ * */
+
+#ifdef SPIFS_LINK_TABLE
+// 槽位处于占用状态(分配时的状态写入不完整也视为占用, 与扇区内占用标记一致)
+#define LINK_USED(state) ((state) != 0xFFFF && ((state) & 0xFF00) == 0xFF00)
+
+static uint32_t link_read(uint32_t cluster, LinkSlot *entry);
+static void link_compact(uint32_t cluster);
+#endif
+
+/**
+ * 检查簇地址有效且扇区已被占用
+ * 用于遍历簇链时拦截已擦除或损坏的下一簇地址
+ * @param cluster 簇地址
+ * @return 0:无效地址或空闲扇区, 1:已占用
+ * */
+uint8_t cluster_inuse(uint32_t cluster) {
+#ifdef SPIFS_LINK_TABLE
+    LinkSlot entry[LINK_SLOT_SUM];
+    uint32_t current;
+#else
+    uint8_t sector_inuse;
+#endif
+    if((cluster % SECTOR_SIZE) != 0 || cluster < (FB_SECTOR_END * SECTOR_SIZE) || cluster >= (DATA_SECTOR_END * SECTOR_SIZE)) {
+        return 0;
+    }
+#ifdef SPIFS_LINK_TABLE
+    current = link_read(cluster, entry);
+    return (current < LINK_SLOT_SUM && LINK_USED(entry[current].state));
+#else
+    disk_read(cluster, &sector_inuse, 1);
+    return (sector_inuse != 0xFF);
+#endif
+}
+
+/**
+ * 读取下一簇地址
+ * @param cluster 簇地址
+ * @return 下一簇地址, FFFFFFFF表示结束簇(簇链接表格式下无效地址与空闲扇区同样返回FFFFFFFF)
+ * */
+uint32_t cluster_next(uint32_t cluster) {
+    uint32_t next;
+#ifdef SPIFS_LINK_TABLE
+    LinkSlot entry[LINK_SLOT_SUM];
+    if((cluster % SECTOR_SIZE) != 0 || cluster < (FB_SECTOR_END * SECTOR_SIZE) || cluster >= (DATA_SECTOR_END * SECTOR_SIZE)) {
+        return 0xFFFFFFFF;
+    }
+    next = link_read(cluster, entry);
+    return (next < LINK_SLOT_SUM && LINK_USED(entry[next].state)) ? entry[next].next : 0xFFFFFFFF;
+#else
+    disk_read((cluster + SECTOR_STATE_SIZE + DATA_AREA_SIZE), (uint8_t *)&next, 4);
+    return next;
+#endif
+}
+
+/**
+ * 从已读出的簇内容中取下一簇地址, 簇链接表格式下查询链接表
+ * @param cluster 簇地址
+ * @param *sector_buffer 簇内容(4096字节)
+ * */
+uint32_t image_next(uint32_t cluster, uint8_t *sector_buffer) {
+#ifdef SPIFS_LINK_TABLE
+    (void)sector_buffer;
+    return cluster_next(cluster);
+#else
+    (void)cluster;
+    return *(uint32_t *)(sector_buffer + SECTOR_STATE_SIZE + DATA_AREA_SIZE);
+#endif
+}
+
+/**
+ * 修改簇内容中的下一簇地址, 簇链接表格式下地址不在簇内, 不做处理
+ * 默认格式的下一簇地址受封存值保护, 需在重新计算封存值之前修改
+ * @param *sector_buffer 簇内容(4096字节)
+ * @param next 下一簇地址
+ * */
+void image_link(uint8_t *sector_buffer, uint32_t next) {
+#ifndef SPIFS_LINK_TABLE
+    *(uint32_t *)(sector_buffer + SECTOR_STATE_SIZE + DATA_AREA_SIZE) = next;
+#else
+    (void)sector_buffer;
+    (void)next;
+#endif
+}
+
+/**
+ * 写占用标记, 分配空闲扇区时调用
+ * @param cluster 簇地址
+ * */
+void cluster_mark(uint32_t cluster) {
+#ifdef SPIFS_LINK_TABLE
+    LinkSlot entry[LINK_SLOT_SUM];
+    uint32_t slot = link_read(cluster, entry);
+    slot = (slot == LINK_SLOT_SUM) ? 0 : (slot + 1);
+    if(slot == LINK_SLOT_SUM) {
+        link_compact(cluster);
+        slot = 0;
+    }
+    write_value((LINK_ENTRY_ADDRESS(cluster) + slot * 8 + 4), 0xFF00, 2);
+    statfs_alloc(cluster);
+#else
+    write_value(cluster, 0xFF00, SECTOR_STATE_SIZE);
+#endif
+}
+
+/**
+ * 写下一簇地址, 簇在分配后只链接一次
+ * @param cluster 簇地址
+ * @param next 下一簇地址
+ * */
+void cluster_link(uint32_t cluster, uint32_t next) {
+#ifdef SPIFS_LINK_TABLE
+    LinkSlot entry[LINK_SLOT_SUM];
+    uint32_t slot = link_read(cluster, entry);
+    if(slot == LINK_SLOT_SUM || !LINK_USED(entry[slot].state)) {
+        return;
+    }
+    write_value((LINK_ENTRY_ADDRESS(cluster) + slot * 8), next, 4);
+    statfs_next(cluster, next);
+#else
+    write_value((cluster + SECTOR_STATE_SIZE + DATA_AREA_SIZE), next, 4);
+#endif
+}
+
+#ifdef SPIFS_LINK_TABLE
+/**
+ * 修改已链接簇的下一簇地址, 新地址在下一个槽位的状态写入后生效, 掉电时新旧地址二者之一有效
+ * @param cluster 簇地址
+ * @param next 新的下一簇地址, FFFFFFFF表示改为结束簇
+ * */
+void cluster_relink(uint32_t cluster, uint32_t next) {
+    LinkSlot entry[LINK_SLOT_SUM];
+    uint32_t slot = link_read(cluster, entry), address;
+    if(slot == LINK_SLOT_SUM || !LINK_USED(entry[slot].state) || entry[slot].next == next) {
+        return;
+    }
+    if(slot == (LINK_SLOT_SUM - 1)) {
+        link_compact(cluster);
+        slot = 0;
+    }
+    address = LINK_ENTRY_ADDRESS(cluster) + (slot + 1) * 8;
+    if(next != 0xFFFFFFFF) {
+        write_value(address, next, 4);
+    }
+    write_value((address + 4), 0xFF00, 2);
+    statfs_next(cluster, next);
+}
+#endif
+
+/**
+ * 将完整的簇内容写入空闲扇区, 每次编程一整页
+ * 默认格式的簇内容已含占用标记与下一簇地址(见image_link), 簇链接表格式下先分配并链接
+ * @param cluster 簇地址(空闲扇区)
+ * @param *sector_buffer 簇内容(4096字节)
+ * @param next 下一簇地址
+ * */
+void cluster_program(uint32_t cluster, uint8_t *sector_buffer, uint32_t next) {
+#ifdef SPIFS_LINK_TABLE
+    cluster_mark(cluster);
+    if(next != 0xFFFFFFFF) {
+        cluster_link(cluster, next);
+    }
+#else
+    (void)next;
+#endif
+    for(uint32_t i = 0; i < (SECTOR_SIZE / PAGE_SIZE); i++) {
+        disk_write((cluster + i * PAGE_SIZE), (sector_buffer + i * PAGE_SIZE), PAGE_SIZE);
+    }
+}
+
+/**
+ * 释放已擦除的簇, 默认格式下擦除即释放
+ * 擦除完成后才能释放, 掉电后空闲的簇一定已被擦除
+ * @param cluster 簇地址
+ * */
+void cluster_release(uint32_t cluster) {
+#ifdef SPIFS_LINK_TABLE
+    LinkSlot entry[LINK_SLOT_SUM];
+    uint32_t slot = link_read(cluster, entry);
+    if(slot == LINK_SLOT_SUM || !LINK_USED(entry[slot].state)) {
+        return;
+    }
+    write_value((LINK_ENTRY_ADDRESS(cluster) + slot * 8 + 4), 0x0000, 2);
+    statfs_release(cluster);
+#else
+    (void)cluster;
+#endif
+}
+
+/**
+ * 擦除并释放簇
+ * @param cluster 簇地址
+ * */
+void cluster_erase(uint32_t cluster) {
+    sector_erase(cluster);
+    cluster_release(cluster);
+}
+
+/**
+ * 读取日志记录的引用字段(文件块首簇地址、目录表头的next字段或CLUSTER_LINK_REF)
+ * @param ref 引用字段地址
+ * */
+uint32_t reference_read(uint32_t ref) {
+    uint32_t value;
+#ifdef SPIFS_LINK_TABLE
+    // 目录表内的引用字段不会位于扇区最后4字节
+    if(ref >= (FB_SECTOR_END * SECTOR_SIZE) && ref < (DATA_SECTOR_END * SECTOR_SIZE) && (ref % SECTOR_SIZE) == (SECTOR_SIZE - 4)) {
+        return cluster_next(ref - (SECTOR_SIZE - 4));
+    }
+#endif
+    disk_read(ref, (uint8_t *)&value, 4);
+    return value;
+}
+
+#ifdef SPIFS_LINK_TABLE
+/**
+ * 读取链接表项
+ * @param cluster 簇地址(有效的数据扇区地址)
+ * @param *entry 输出链接表项
+ * @return 当前槽位序号, LINK_SLOT_SUM表示全部槽位未使用
+ * */
+static uint32_t link_read(uint32_t cluster, LinkSlot *entry) {
+    disk_read(LINK_ENTRY_ADDRESS(cluster), (uint8_t *)entry, LINK_ENTRY_SIZE);
+    for(uint32_t i = LINK_SLOT_SUM; i > 0; i--) {
+        if(entry[i - 1].state != 0xFFFF) {
+            return (i - 1);
+        }
+    }
+    return LINK_SLOT_SUM;
+}
+
+/**
+ * 整理簇所在的链接表扇区, 经影子扇区重写
+ * 占用中的项只保留当前槽位(移至第一个槽位), 其余项恢复为未使用
+ * @param cluster 簇地址
+ * */
+static void link_compact(uint32_t cluster) {
+    uint32_t sector = (LINK_ENTRY_ADDRESS(cluster) / SECTOR_SIZE) * SECTOR_SIZE, current;
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    LinkSlot *entry;
+
+    disk_read(sector, sector_buffer, SECTOR_SIZE);
+    for(uint32_t offset = 0; offset < SECTOR_SIZE; offset += LINK_ENTRY_SIZE) {
+        entry = (LinkSlot *)(sector_buffer + offset);
+        for(current = LINK_SLOT_SUM; current > 0 && entry[current - 1].state == 0xFFFF; current--);
+        if(current > 0 && LINK_USED(entry[current - 1].state)) {
+            entry[0].next = entry[current - 1].next;
+            entry[0].state = 0xFF00;
+            entry[0].reserved = 0xFFFF;
+            array_fill((uint8_t *)(entry + 1), 0xFF, (LINK_ENTRY_SIZE - 8));
+        }else {
+            array_fill((uint8_t *)entry, 0xFF, LINK_ENTRY_SIZE);
+        }
+    }
+    journal_rewrite_sector(sector, sector_buffer);
+    free(sector_buffer);
+}
+#endif
@@ -0,0 +1,41 @@
+#ifndef __CLUSTER_H__
+#define __CLUSTER_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 日志记录中的下一簇地址引用字段, 簇链接表格式下由reference_read转换为查询链接表
+#define CLUSTER_LINK_REF(cluster) ((cluster) + SECTOR_SIZE - 4)
+
+#ifdef SPIFS_LINK_TABLE
+// 簇链接表槽位结构(8字节)
+typedef struct link_slot {
+    uint32_t next;      // 下一簇地址
+    uint16_t state;    // FFFF:未使用, 高字节为FF:占用, 其余:已释放
+    uint16_t reserved;
+} LinkSlot;
+
+// 每个数据扇区的槽位数量
+#define LINK_SLOT_SUM 4
+// 每个数据扇区的链接表项大小(字节)
+#define LINK_ENTRY_SIZE (LINK_SLOT_SUM * 8)
+// 数据扇区对应的链接表项地址
+#define LINK_ENTRY_ADDRESS(cluster) (LINK_SECTOR_INIT * SECTOR_SIZE + ((cluster) / SECTOR_SIZE - FB_SECTOR_END) * LINK_ENTRY_SIZE)
+#endif
+
+// 文件系统内部接口
+uint8_t cluster_inuse(uint32_t cluster);
+uint32_t cluster_next(uint32_t cluster);
+uint32_t image_next(uint32_t cluster, uint8_t *sector_buffer);
+void image_link(uint8_t *sector_buffer, uint32_t next);
+void cluster_mark(uint32_t cluster);
+void cluster_link(uint32_t cluster, uint32_t next);
+#ifdef SPIFS_LINK_TABLE
+void cluster_relink(uint32_t cluster, uint32_t next);
+#endif
+void cluster_program(uint32_t cluster, uint8_t *sector_buffer, uint32_t next);
+void cluster_release(uint32_t cluster);
+void cluster_erase(uint32_t cluster);
+uint32_t reference_read(uint32_t ref);
+
+#endif // __CLUSTER_H__
@@ -0,0 +1,8 @@
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include "stdint.h"
+
+uint32_t crc32c(uint32_t crc, uint8_t *data, uint32_t size);
+
+#endif // __CRC32C_H__
@@ -0,0 +1,224 @@
+#include "defrag.h"
+
+/**
+ * 碎片整理
+ * 每次调用最多搬移budget个簇, 空闲时反复调用直至返回0; 搬移经RELINK日志记录, 掉电后挂载时回滚或完成
+ * 文件的第二个连续段能整段放入首个连续段之后的空闲扇区时搬移到该处接续,
+ * 否则整个文件能放入最长的连续空闲区时先搬移文件开头, 之后的调用再逐段接续; 两者都不满足时跳过该文件
+ * 搬移复用覆盖写的簇链段替换(relink_clusters), 校验文件搬移前先校验涉及的簇, 不为损坏的数据重新封存
+ * */
+
+static uint32_t defrag_slot(FileBlock *fb, uint32_t fbaddr, uint32_t budget);
+static uint32_t defrag_table(uint32_t table, uint32_t budget);
+static uint32_t defrag_file(File *file, uint32_t budget);
+static uint8_t defrag_verify(File *file, uint32_t *list, uint32_t count);
+static uint32_t free_after(uint32_t cluster, uint32_t limit);
+static void free_longest();
+
+// 本次整理找到的最长连续空闲区(首扇区地址与扇区数), 需要时才查找
+static uint32_t longest_start = 0xFFFFFFFF;
+static uint32_t longest_sum = 0;
+
+/**
+ * 碎片整理一步
+ * @param *file 整理的文件, 搬移首簇时同步更新; NULL表示整个卷, 依次查找首个可整理的文件(之后需重新打开已打开的文件)
+ * @param budget 本次最多搬移的簇数
+ * @return 搬移的簇数, 0表示已全部连续或空闲区不足以继续整理
+ * */
+uint32_t spifs_defrag(File *file, uint32_t budget) {
+    FileBlock fb;
+    File current;
+    uint32_t moved = 0;
+    uint8_t *sector_buffer;
+
+    longest_start = 0xFFFFFFFF;
+    longest_sum = 0;
+    if(budget == 0) {
+        return 0;
+    }
+    if(file) {
+        // 以存储器上的索引记录为准
+        disk_read(file->block, (uint8_t *)&fb, FILEBLOCK_SIZE);
+        if(fileblock_empty(&fb) || (FILE_FLAGS(fb.state) & (FSTATE_DELETED | FSTATE_DIRECTORY)) != (FSTATE_DELETED | FSTATE_DIRECTORY)) {
+            return 0;
+        }
+        current.block = file->block;
+        current.cluster = fb.cluster;
+        current.length = fb.length;
+        current.state = fb.state;
+        moved = defrag_file(&current, budget);
+        file->cluster = current.cluster;
+        file->length = current.length;
+        return moved;
+    }
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    for(uint32_t sector = FB_SECTOR_INIT; sector < FB_SECTOR_END && moved == 0; sector++) {
+        disk_read(sector * SECTOR_SIZE, sector_buffer, SECTOR_SIZE);
+        for(uint32_t offset = 0; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE && moved == 0; offset += FILEBLOCK_SIZE) {
+            moved = defrag_slot((FileBlock *)(sector_buffer + offset), (sector * SECTOR_SIZE + offset), budget);
+        }
+    }
+    free(sector_buffer);
+    return moved;
+}
+
+/**
+ * 整理索引槽位中的文件, 目录则整理其下的文件
+ * @param *fb 索引记录
+ * @param fbaddr 索引记录地址
+ * @param budget 最多搬移的簇数
+ * @return 搬移的簇数
+ * */
+static uint32_t defrag_slot(FileBlock *fb, uint32_t fbaddr, uint32_t budget) {
+    File file;
+    uint8_t flags = FILE_FLAGS(fb->state);
+
+    if(fileblock_empty(fb) || fileblock_continuation(fb) || (flags & FSTATE_DELETED) == 0) {
+        return 0;
+    }
+    if((flags & FSTATE_DIRECTORY) == 0) {
+        return defrag_table(fb->cluster, budget);
+    }
+    file.block = fbaddr;
+    file.cluster = fb->cluster;
+    file.length = fb->length;
+    file.state = fb->state;
+    return defrag_file(&file, budget);
+}
+
+/**
+ * 整理目录下的文件
+ * @param table 首个目录表扇区地址
+ * @param budget 最多搬移的簇数
+ * @return 搬移的簇数
+ * */
+static uint32_t defrag_table(uint32_t table, uint32_t budget) {
+    uint32_t moved = 0;
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+
+    while(cluster_inuse(table) && moved == 0) {
+        disk_read(table, sector_buffer, SECTOR_SIZE);
+        for(uint32_t offset = DIR_HEADER_SIZE; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE && moved == 0; offset += FILEBLOCK_SIZE) {
+            moved = defrag_slot((FileBlock *)(sector_buffer + offset), (table + offset), budget);
+        }
+        table = ((DirHeader *)sector_buffer)->next;
+    }
+    free(sector_buffer);
+    return moved;
+}
+
+/**
+ * 整理单个文件
+ * 内联文件、空文件、追加写未完成的文件与环形文件(簇在环内轮流重用, 整理后很快又不连续)不整理
+ * @param *file 文件指针
+ * @param budget 最多搬移的簇数
+ * @return 搬移的簇数
+ * */
+static uint32_t defrag_file(File *file, uint32_t budget) {
+    uint32_t count = 0, run, next, first = 0, move = 0, start = 0xFFFFFFFF;
+    uint32_t cluster = file->cluster, prev = 0xFFFFFFFF;
+    uint32_t *chain, *new_list;
+
+    if(!cluster_inuse(cluster) || journal_find(JOURNAL_APPEND, file->block) != 0xFFFFFFFF
+            || (FILE_FLAGS(file->state) & FSTATE_RING) == 0) {
+        return 0;
+    }
+    chain = (uint32_t *)malloc(sizeof(uint32_t) * (DATA_SECTOR_END - FB_SECTOR_END));
+    while(cluster_inuse(cluster) && count < (DATA_SECTOR_END - FB_SECTOR_END)) {
+        *(chain + count) = cluster;
+        count++;
+        cluster = cluster_next(cluster);
+    }
+    // 首个连续段与第二个连续段的长度
+    for(run = 1; run < count && *(chain + run) == *(chain + run - 1) + SECTOR_SIZE; run++);
+    for(next = run + 1; next < count && *(chain + next) == *(chain + next - 1) + SECTOR_SIZE; next++);
+    next -= run;
+
+    if(run < count && free_after(*(chain + run - 1), next) == next) {
+        // 第二段接续到首段之后
+        first = run;
+        prev = *(chain + run - 1);
+        start = prev + SECTOR_SIZE;
+        move = next;
+    }else if(run < count) {
+        if(longest_start == 0xFFFFFFFF) {
+            free_longest();
+        }
+        if(longest_sum >= count) {
+            start = longest_start;
+            move = count;
+        }
+    }
+    move = (move > budget) ? budget : move;
+    if(move && defrag_verify(file, (chain + first), move)) {
+        new_list = (uint32_t *)malloc(sizeof(uint32_t) * move);
+        for(uint32_t i = 0; i < move; i++) {
+            *(new_list + i) = start + i * SECTOR_SIZE;
+        }
+        relink_clusters(file, prev, (chain + first), new_list, move, 0, NULL, 0);
+        free(new_list);
+        // 最长空闲区已被占用
+        longest_start = 0xFFFFFFFF;
+        longest_sum = 0;
+    }else {
+        move = 0;
+    }
+    free(chain);
+    return move;
+}
+
+/**
+ * 搬移前校验簇, 非校验文件直接通过
+ * @param *list 簇地址列表
+ * @param count 簇数
+ * @return 1:可以搬移, 0:存在校验失败的簇
+ * */
+static uint8_t defrag_verify(File *file, uint32_t *list, uint32_t count) {
+    uint8_t result = 1;
+    uint8_t *sector_buffer;
+    if(FILE_FLAGS(file->state) & FSTATE_CHECKSUM) {
+        return 1;
+    }
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    for(uint32_t i = 0; i < count && result; i++) {
+        result = (verify_cluster(*(list + i), file->block, sector_buffer) != 0);
+    }
+    free(sector_buffer);
+    return result;
+}
+
+/**
+ * 统计簇之后相邻的空闲扇区数
+ * @param cluster 簇地址
+ * @param limit 最多统计的扇区数
+ * */
+static uint32_t free_after(uint32_t cluster, uint32_t limit) {
+    uint32_t count = 0;
+    for(uint32_t sector = cluster / SECTOR_SIZE + 1; sector < DATA_SECTOR_END && count < limit; sector++) {
+        if(cluster_inuse(sector * SECTOR_SIZE)) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * 查找最长的连续空闲区
+ * */
+static void free_longest() {
+    uint32_t start = 0, sum = 0;
+    longest_sum = 0;
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        if(cluster_inuse(sector * SECTOR_SIZE)) {
+            sum = 0;
+            continue;
+        }
+        start = (sum == 0) ? sector : start;
+        sum++;
+        if(sum > longest_sum) {
+            longest_start = start * SECTOR_SIZE;
+            longest_sum = sum;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef __DIR_H__
+#define __DIR_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 目录表头结构(16字节)
+typedef struct dir_header {
+    uint16_t state;    // 扇区占用标记, 同文件簇
+    uint16_t magic;   // 目录表标识
+    uint32_t next;   // 下一目录表扇区地址, FFFFFFFF表示无
+    uint32_t parent; // 父目录索引记录地址
+    uint32_t reserved;
+} DirHeader;
+
+// 目录表标识
+#define DIR_MAGIC 0xD1E5
+// 目录表头大小(字节)
+#define DIR_HEADER_SIZE 16
+// 每个目录表扇区的索引槽位数量
+#define DIR_SLOT_SUM 170
+
+Result create_dir(File *dir, File *parent, FileState fstate);
+Result create_file_at(File *dir, File *file, FileState fstate);
+uint8_t open_file_at(File *dir, File *file, char *filename, char *extname);
+FileList *list_dir(File *dir);
+
+void dir_gc(uint32_t table, uint8_t reclaim);
+uint32_t dir_gc_table(uint32_t table, uint8_t reclaim);
+void dir_scrub(uint32_t table, ScrubReport *report);
+
+#endif // __DIR_H__
@@ -3,8 +3,102 @@
 
 #include "stdint.h"
 #include "w25q32.h"
+#include "trace.h"
 #include "spifs.h"
 
+// ͳ
+typedef struct disk_cache_stats {
+    uint32_t hits;           // еʴ
+    uint32_t misses;        // δеʴ
+    uint32_t prefetches;   // Ԥ
+    uint32_t prefetch_hits; // ʵԤ
+} DiskCacheStats;
+
+// 첽ͳ
+typedef struct disk_async_stats {
+    uint32_t commands;  // Ŷӵ
+    uint32_t stalls;   // , ȴһĴ
+} DiskAsyncStats;
+
+// ˮͳ
+typedef struct disk_pipeline_stats {
+    uint32_t programs;       // ˮ̵߱ҳ
+    uint32_t stalls;        // ݴһҳȴһҳɵĴ
+    uint32_t reads;        // ȡ(Ԥ)
+    uint32_t prefetches;   // Ԥ
+    uint32_t prefetch_hits; // ԤĶȡ
+} DiskPipelineStats;
+
+// ȡռͳ
+typedef struct disk_suspend_stats {
+    uint32_t suspends;  // Ĵ
+    uint32_t reads;    // ڼִеĶȡ
+    uint32_t waits;   // еȴɵĶȡ(ȼȡ, ȡڲ)
+} DiskSuspendStats;
+
+// 洢豸(豸ΪһƬϵ), ַΪ豸ڵַ
+// 豸æʱŶӺ; ȡȴ豸ŶӵĲɺִ, waitȴ豸ȫ
+// busyΪNULL; NULLʱ豸DMA: ȡ̷, ڼbuffer뱣Ч, busyѯ豸Ĳ
+// (æµ)Ƿڽ, ˮ߾ݴصCPU봫; ˮ֮diskioڽbufferǰȴ
+typedef struct disk_device {
+    void *context;  // ص豸
+    uint32_t (*read)(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+    uint8_t (*write_page)(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+    uint8_t (*sector_erase)(void *context, uint32_t address);
+    uint8_t (*chip_erase)(void *context);
+    void (*wait)(void *context);
+    uint8_t (*busy)(void *context);
+} DiskDevice;
+
+// 弶ֵ֧Ķȡʽ(disk_read_modes), ɰλ, Read Data(0x03)֧
+// Fast Read(0x0B)
+#define DISK_READ_FAST 0x01
+// Dual Output(0x3B), IO1
+#define DISK_READ_DUAL 0x02
+// Quad Output(0x6B), IO2/IO3λQE
+#define DISK_READ_QUAD 0x04
+// Quad I/O(0xEB), ַҲߴ
+#define DISK_READ_QUAD_IO 0x08
+// ȡ󱣳CSȡ, ζȡ֮䱣CS
+#define DISK_READ_CONTINUOUS 0x10
+
+// 豸
+#define DISK_STRIPE_MAX 8
+
+// شԤ
+#define CACHE_READAHEAD 4
+
+// ˮ߶ÿζȡС(ֽ)
+#define PIPELINE_WINDOW 1024
+
+uint8_t disk_cache(uint32_t sectors);
+void disk_cache_invalidate();
+void disk_cache_stats(DiskCacheStats *stats);
+
+uint8_t disk_async(uint32_t commands);
+uint8_t disk_async_step();
+void disk_async_flush();
+void disk_async_discard();
+uint32_t disk_async_queued();
+uint32_t disk_async_completed();
+void disk_async_stats(DiskAsyncStats *stats);
+
+void disk_suspend(uint32_t progress_us);
+uint8_t disk_priority(uint8_t high);
+void disk_suspend_stats(DiskSuspendStats *stats);
+
+uint8_t disk_pipeline(uint8_t enable);
+DiskDevice *disk_device_w25q32();
+void disk_pipeline_flush();
+void disk_pipeline_stats(DiskPipelineStats *stats);
+
+uint8_t disk_read_modes(uint8_t supported);
+
+uint8_t disk_stripe(DiskDevice *devices, uint32_t count);
+uint32_t disk_stripes();
+void disk_overlap_begin();
+void disk_overlap_end();
+
 uint32_t disk_read(uint32_t address, uint8_t *buffer, uint32_t size);
 uint8_t disk_write(uint32_t address, uint8_t *buffer, uint32_t size);
 
@@ -0,0 +1,354 @@
+#include "journal.h"
+
+/**
+ * 意图日志
+ * 两个日志扇区交替使用, 扇区首条记录为扇区头, 有效扇区头中序号较大者为当前日志扇区
+ * 可能被掉电打断的操作在开始前写入记录, 完成后将记录state字段写0
+ * 挂载时只重放未完成的记录, 耗时与掉电时进行中的操作数量成正比, 与存储器容量无关
+ * 扇区重写先将新内容完整写入影子扇区再写日志记录, 掉电后由影子扇区恢复目标扇区
+ * */
+
+// 进行中的记录
+typedef struct journal_pending {
+    uint32_t address;      // 记录地址, FFFFFFFF表示空闲
+    JournalRecord record;
+} JournalPending;
+
+// 当前日志扇区地址, FFFFFFFF表示未挂载, 此时不记录日志
+static uint32_t journal_sector = 0xFFFFFFFF;
+static uint32_t journal_seq = 0;
+// 下一条记录在日志扇区内的序号
+static uint32_t journal_cursor = 0;
+// 挂载时重放记录中, 此时环形文件不写入新的状态记录
+static uint8_t journal_replaying = 0;
+static JournalPending pending[JOURNAL_PENDING_MAX];
+
+static uint16_t record_check(JournalRecord *record);
+static uint8_t record_valid(JournalRecord *record, uint8_t type);
+static void journal_program(uint32_t address, JournalRecord *record);
+static void journal_format();
+static void journal_rotate();
+static void replay_rewrite(uint32_t address);
+static uint8_t journal_idle();
+static uint32_t journal_vacant();
+
+/**
+ * 挂载日志, 重放未完成的记录
+ * @return 重放的记录数
+ * */
+uint32_t journal_mount() {
+    JournalRecord head[2], *record;
+    uint32_t sector[2];
+    uint32_t count = 0, replayed = 0, last = 0;
+    uint8_t *sector_buffer;
+
+    sector[0] = JOURNAL_SECTOR_INIT * SECTOR_SIZE;
+    sector[1] = (JOURNAL_SECTOR_INIT + 1) * SECTOR_SIZE;
+    disk_read(sector[0], (uint8_t *)&head[0], sizeof(JournalRecord));
+    disk_read(sector[1], (uint8_t *)&head[1], sizeof(JournalRecord));
+
+    for(uint32_t i = 0; i < JOURNAL_PENDING_MAX; i++) {
+        pending[i].address = 0xFFFFFFFF;
+    }
+    journal_replaying = 0;
+
+    if(record_valid(&head[0], JOURNAL_HEAD) && record_valid(&head[1], JOURNAL_HEAD)) {
+        // 序号回绕时按差值比较
+        journal_sector = ((int32_t)(head[1].arg0 - head[0].arg0) > 0) ? sector[1] : sector[0];
+    }else if(record_valid(&head[0], JOURNAL_HEAD)) {
+        journal_sector = sector[0];
+    }else if(record_valid(&head[1], JOURNAL_HEAD)) {
+        journal_sector = sector[1];
+    }else {
+        journal_format();
+        return 0;
+    }
+    journal_seq = (journal_sector == sector[0]) ? head[0].arg0 : head[1].arg0;
+
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    disk_read(journal_sector, sector_buffer, SECTOR_SIZE);
+    for(uint32_t i = 1; i < JOURNAL_RECORD_SUM; i++) {
+        record = (JournalRecord *)(sector_buffer + i * sizeof(JournalRecord));
+        if(!bulk_erased((uint8_t *)record, sizeof(JournalRecord))) {
+            last = i;
+        }
+        // 写入不完整的记录校验失败, 其对应的操作尚未开始
+        if(record_valid(record, record->type) && record->type != JOURNAL_HEAD
+                && record->state == 0xFF && count < JOURNAL_PENDING_MAX) {
+            pending[count].address = journal_sector + i * sizeof(JournalRecord);
+            pending[count].record = *record;
+            count++;
+        }
+    }
+    free(sector_buffer);
+    journal_cursor = last + 1;
+
+    // 先由影子扇区恢复被打断的扇区重写, 其余记录依赖一致的索引扇区
+    for(uint32_t i = 0; i < count; i++) {
+        if(pending[i].record.type == JOURNAL_REWRITE) {
+            replay_rewrite(pending[i].record.arg0);
+            journal_end(i);
+            replayed++;
+        }
+    }
+    // 环形文件的状态记录不结束, 同一文件只保留最后一条, 登记后其余记录按其首簇地址与文件大小重放
+    for(uint32_t i = 0; i < count; i++) {
+        if(pending[i].address == 0xFFFFFFFF || pending[i].record.type != JOURNAL_RING) {
+            continue;
+        }
+        for(uint32_t j = i + 1; j < count; j++) {
+            if(pending[j].address != 0xFFFFFFFF && pending[j].record.type == JOURNAL_RING
+                    && pending[j].record.arg0 == pending[i].record.arg0) {
+                journal_end(i);
+                break;
+            }
+        }
+        if(pending[i].address != 0xFFFFFFFF) {
+            ring_restore(i, &pending[i].record);
+            replayed++;
+        }
+    }
+    journal_replaying = 1;
+    for(uint32_t i = 0; i < count; i++) {
+        if(pending[i].address != 0xFFFFFFFF && pending[i].record.type != JOURNAL_RING) {
+            spifs_recover(&pending[i].record);
+            journal_end(i);
+            replayed++;
+        }
+    }
+    journal_replaying = 0;
+    return replayed;
+}
+
+/**
+ * 写入日志记录, 标记操作开始
+ * 顶层操作开始时(除环形文件的状态记录外无进行中记录)若剩余空间不足JOURNAL_RESERVE则切换日志扇区
+ * 扇区重写不嵌套其他记录, 最后一个空闲位置只留给扇区重写, 其他记录占满记录表时扇区重写仍可记录;
+ * 环形文件的状态记录(每个缓存项一条, 丢弃首簇时多一条)另外保留RING_CACHE_SUM + 1个位置, 写入状态记录不会失败
+ * @param type 记录类型
+ * @return 记录句柄, FFFFFFFF表示未记录(未挂载或进行中记录已满)
+ * */
+uint32_t journal_begin(uint8_t type, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    uint32_t handle;
+
+    if(journal_sector == 0xFFFFFFFF) {
+        return 0xFFFFFFFF;
+    }
+    for(handle = 0; handle < JOURNAL_PENDING_MAX; handle++) {
+        if(pending[handle].address == 0xFFFFFFFF) {
+            break;
+        }
+    }
+    if(handle == JOURNAL_PENDING_MAX || (type == JOURNAL_RING && journal_vacant() < 2)
+            || (type != JOURNAL_REWRITE && type != JOURNAL_RING && journal_room() == 0)) {
+        return 0xFFFFFFFF;
+    }
+    if((journal_cursor > (JOURNAL_RECORD_SUM - JOURNAL_RESERVE) && journal_idle())
+            || journal_cursor >= JOURNAL_RECORD_SUM) {
+        journal_rotate();
+    }
+
+    pending[handle].record.type = type;
+    pending[handle].record.state = 0xFF;
+    pending[handle].record.arg0 = arg0;
+    pending[handle].record.arg1 = arg1;
+    pending[handle].record.arg2 = arg2;
+    pending[handle].address = journal_sector + journal_cursor * sizeof(JournalRecord);
+    journal_program(pending[handle].address, &pending[handle].record);
+    journal_cursor++;
+    return handle;
+}
+
+/**
+ * 标记操作完成
+ * @param handle 记录句柄, FFFFFFFF时忽略
+ * */
+void journal_end(uint32_t handle) {
+    if(handle >= JOURNAL_PENDING_MAX || pending[handle].address == 0xFFFFFFFF) {
+        return;
+    }
+    // 批处理中的索引修改提交后才标记完成, 擦除组不涉及索引且其扇区随后可能被重新分配, 立即标记;
+    // 环形文件的状态记录由同一文件的新记录代替, 同样立即标记(写回文件块时由ring_forget推迟)
+    if(pending[handle].record.type != JOURNAL_ERASE && pending[handle].record.type != JOURNAL_RING && batch_defer(handle)) {
+        return;
+    }
+    write_value(pending[handle].address + 1, 0x00, 1);
+    pending[handle].address = 0xFFFFFFFF;
+}
+
+/**
+ * 扇区重写与环形文件的状态记录以外的记录还可写入的数量, 批处理据此在记录表占满前提交
+ * @return 空闲位置数(不含留给扇区重写与状态记录的位置, 重放记录时不再为状态记录保留)
+ * */
+uint32_t journal_room() {
+    uint32_t vacant = journal_vacant();
+    uint32_t reserved = journal_replaying ? 1 : (RING_CACHE_SUM + 2);
+    return (vacant > reserved) ? (vacant - reserved) : 0;
+}
+
+/**
+ * 查找进行中的记录
+ * @param type 记录类型
+ * @param arg0 记录参数0
+ * @return 记录句柄, FFFFFFFF表示未找到
+ * */
+uint32_t journal_find(uint8_t type, uint32_t arg0) {
+    for(uint32_t i = 0; i < JOURNAL_PENDING_MAX; i++) {
+        if(pending[i].address != 0xFFFFFFFF && pending[i].record.type == type && pending[i].record.arg0 == arg0) {
+            return i;
+        }
+    }
+    return 0xFFFFFFFF;
+}
+
+/**
+ * 掉电安全的扇区重写
+ * 擦除影子扇区并写入新内容, 写日志记录后擦除目标扇区并回写; 批处理暂存的扇区只替换内存镜像
+ * 已挂载而无法写入日志记录时不擦除目标扇区
+ * @param address 目标扇区首地址
+ * @param buffer 新扇区内容(4096字节)
+ * @return 1:已重写, 0:进行中记录已满, 目标扇区未改变
+ * */
+uint8_t journal_rewrite_sector(uint32_t address, uint8_t *buffer) {
+    uint32_t handle = 0xFFFFFFFF;
+
+    if(batch_rewrite(address, buffer)) {
+        return 1;
+    }
+    if(journal_sector != 0xFFFFFFFF) {
+        sector_erase(SHADOW_SECTOR * SECTOR_SIZE);
+        for(uint32_t i = 0; i < 16; i++) {
+            disk_write((SHADOW_SECTOR * SECTOR_SIZE + i * PAGE_SIZE), (buffer + i * PAGE_SIZE), PAGE_SIZE);
+        }
+        handle = journal_begin(JOURNAL_REWRITE, address, 0, 0);
+        if(handle == 0xFFFFFFFF) {
+            return 0;
+        }
+    }
+    statfs_rewrite(address);
+    sector_erase(address);
+    for(uint32_t i = 0; i < 16; i++) {
+        disk_write((address + i * PAGE_SIZE), (buffer + i * PAGE_SIZE), PAGE_SIZE);
+    }
+    journal_end(handle);
+    return 1;
+}
+
+/**
+ * 记录校验, CRC-16/CCITT, 不含state与check字段
+ * 未写完的记录其余字节保持0xFF, 校验需能区分0x00与0xFF
+ * */
+static uint16_t record_check(JournalRecord *record) {
+    uint8_t *data = (uint8_t *)record;
+    uint16_t crc = 0xFFFF;
+    for(uint32_t i = 0; i < sizeof(JournalRecord); i++) {
+        if(i == 1 || i == 2 || i == 3) {
+            continue;
+        }
+        crc ^= (uint16_t)(*(data + i)) << 8;
+        for(uint8_t j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t record_valid(JournalRecord *record, uint8_t type) {
+    if(record->type != type || type < JOURNAL_HEAD || type > JOURNAL_RING) {
+        return 0;
+    }
+    if(record->check != record_check(record)) {
+        return 0;
+    }
+    return (type != JOURNAL_HEAD) || (record->arg1 == JOURNAL_MAGIC);
+}
+
+static void journal_program(uint32_t address, JournalRecord *record) {
+    record->check = record_check(record);
+    disk_write(address, (uint8_t *)record, sizeof(JournalRecord));
+}
+
+/**
+ * 初始化日志扇区
+ * */
+static void journal_format() {
+    JournalRecord head;
+    sector_erase(JOURNAL_SECTOR_INIT * SECTOR_SIZE);
+    sector_erase((JOURNAL_SECTOR_INIT + 1) * SECTOR_SIZE);
+    journal_sector = JOURNAL_SECTOR_INIT * SECTOR_SIZE;
+    journal_seq = 1;
+    journal_cursor = 1;
+    array_fill((uint8_t *)&head, 0xFF, sizeof(JournalRecord));
+    head.type = JOURNAL_HEAD;
+    head.state = 0x00;
+    head.arg0 = journal_seq;
+    head.arg1 = JOURNAL_MAGIC;
+    journal_program(journal_sector, &head);
+}
+
+/**
+ * 切换日志扇区
+ * 先写入进行中的记录, 再写扇区头使新扇区生效, 最后擦除旧扇区
+ * */
+static void journal_rotate() {
+    JournalRecord head;
+    uint32_t target = (journal_sector == JOURNAL_SECTOR_INIT * SECTOR_SIZE) ?
+                      ((JOURNAL_SECTOR_INIT + 1) * SECTOR_SIZE) : (JOURNAL_SECTOR_INIT * SECTOR_SIZE);
+
+    sector_erase(target);
+    journal_cursor = 1;
+    for(uint32_t i = 0; i < JOURNAL_PENDING_MAX; i++) {
+        if(pending[i].address != 0xFFFFFFFF) {
+            pending[i].address = target + journal_cursor * sizeof(JournalRecord);
+            journal_program(pending[i].address, &pending[i].record);
+            journal_cursor++;
+        }
+    }
+    array_fill((uint8_t *)&head, 0xFF, sizeof(JournalRecord));
+    head.type = JOURNAL_HEAD;
+    head.state = 0x00;
+    head.arg0 = journal_seq + 1;
+    head.arg1 = JOURNAL_MAGIC;
+    journal_program(target, &head);
+
+    sector_erase(journal_sector);
+    journal_sector = target;
+    journal_seq++;
+}
+
+/**
+ * 除环形文件的状态记录外没有进行中的记录
+ * */
+static uint8_t journal_idle() {
+    for(uint32_t i = 0; i < JOURNAL_PENDING_MAX; i++) {
+        if(pending[i].address != 0xFFFFFFFF && pending[i].record.type != JOURNAL_RING) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 记录表的空闲位置数
+ * */
+static uint32_t journal_vacant() {
+    uint32_t vacant = 0;
+    for(uint32_t i = 0; i < JOURNAL_PENDING_MAX; i++) {
+        vacant += (pending[i].address == 0xFFFFFFFF);
+    }
+    return vacant;
+}
+
+/**
+ * 由影子扇区恢复目标扇区
+ * @param address 目标扇区首地址
+ * */
+static void replay_rewrite(uint32_t address) {
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    disk_read(SHADOW_SECTOR * SECTOR_SIZE, sector_buffer, SECTOR_SIZE);
+    sector_erase(address);
+    for(uint32_t i = 0; i < 16; i++) {
+        disk_write((address + i * PAGE_SIZE), (sector_buffer + i * PAGE_SIZE), PAGE_SIZE);
+    }
+    free(sector_buffer);
+}
@@ -0,0 +1,255 @@
+#include <string.h>
+#include "lz.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * LZ77块压缩, 格式与LZ4块格式相近, 压缩与解压只需块缓冲区与2 << LZ_HASH_BITS字节哈希表
+ * 序列: 标记字节(高4位字面量长度, 低4位匹配长度-4) + 字面量长度扩展 + 字面量 + 匹配偏移(2字节) + 匹配长度扩展
+ * 长度字段为15时由后续字节累加, 遇到非255字节结束; 输入在字面量之后结束即解压完成
+ * 主机构建(SSE2)使用16字节比较查找匹配长度, 解压使用16字节整块复制
+ * */
+
+// 哈希表, 存放4字节序列在块内最近一次出现的位置
+static uint16_t hash_table[1 << LZ_HASH_BITS];
+
+static inline uint32_t read32(uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+}
+
+static inline uint32_t hash32(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * 计算两段数据的相同前缀长度
+ * @param *a 较早位置
+ * @param *b 较晚位置
+ * @param *limit b的结束位置
+ * */
+static uint32_t match_length(uint8_t *a, uint8_t *b, uint8_t *limit) {
+    uint8_t *start = b;
+#if defined(__SSE2__)
+    uint32_t mask;
+    while((limit - b) >= 16) {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)a), _mm_loadu_si128((__m128i *)b)));
+        if(mask != 0xFFFF) {
+            return (uint32_t)(b - start) + __builtin_ctz(~mask);
+        }
+        a += 16;
+        b += 16;
+    }
+#elif defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    uint64_t x, y;
+    while((limit - b) >= 8) {
+        memcpy(&x, a, 8);
+        memcpy(&y, b, 8);
+        if(x != y) {
+            return (uint32_t)(b - start) + (__builtin_ctzll(x ^ y) >> 3);
+        }
+        a += 8;
+        b += 8;
+    }
+#endif
+    while(b < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return (uint32_t)(b - start);
+}
+
+/**
+ * 按16字节整块复制, 目标与源末尾最多越界15字节
+ * */
+static inline void wild_copy(uint8_t *dst, uint8_t *src, uint32_t size) {
+#if defined(__SSE2__)
+    uint8_t *end = dst + size;
+    while(dst < end) {
+        _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((__m128i *)src));
+        dst += 16;
+        src += 16;
+    }
+#else
+    memcpy(dst, src, size);
+#endif
+}
+
+// 长度扩展字节数
+static inline uint32_t length_cost(uint32_t length) {
+    return (length >= 15) ? ((length - 15) / 255 + 1) : 0;
+}
+
+static uint8_t *put_length(uint8_t *op, uint32_t length) {
+    length -= 15;
+    while(length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+/**
+ * 压缩数据块, 输出空间不足时只压缩能放下的前段数据
+ * @param *src 原始数据
+ * @param size 原始数据大小, 超过LZ_BLOCK_SIZE时只压缩前LZ_BLOCK_SIZE字节
+ * @param *dst 输出缓冲区
+ * @param capacity 输出缓冲区大小
+ * @param *consumed 输出: 实际压缩的原始数据字节数
+ * @return 压缩后大小(字节)
+ * */
+uint32_t lz_compress(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t capacity, uint32_t *consumed) {
+    uint8_t *ip = src, *anchor = src, *match, *token;
+    uint8_t *op = dst, *oend = dst + capacity;
+    uint8_t *iend, *mflimit;
+    uint32_t hash, literal, length, cost, misses = 0;
+
+    if(size > LZ_BLOCK_SIZE) {
+        size = LZ_BLOCK_SIZE;
+    }
+    iend = src + size;
+    mflimit = iend - LZ_MIN_MATCH;
+
+    if(size > LZ_MIN_MATCH) {
+        memset(hash_table, 0, sizeof(hash_table));
+        ip++;
+        while(ip <= mflimit) {
+            hash = hash32(read32(ip));
+            match = src + hash_table[hash];
+            hash_table[hash] = (uint16_t)(ip - src);
+            if(match >= ip || read32(match) != read32(ip)) {
+                // 连续未命中时加大步长, 快速跳过不可压缩数据
+                ip += 1 + (misses++ >> 5);
+                continue;
+            }
+            misses = 0;
+            while(ip > anchor && match > src && *(ip - 1) == *(match - 1)) {
+                ip--;
+                match--;
+            }
+            length = LZ_MIN_MATCH + match_length(match + LZ_MIN_MATCH, ip + LZ_MIN_MATCH, iend);
+            literal = (uint32_t)(ip - anchor);
+            cost = 1 + length_cost(literal) + literal + 2 + length_cost(length - LZ_MIN_MATCH);
+            if(cost > (uint32_t)(oend - op)) {
+                break;
+            }
+
+            token = op++;
+            *token = (uint8_t)(((literal >= 15) ? 15 : literal) << 4);
+            if(literal >= 15) {
+                op = put_length(op, literal);
+            }
+            memcpy(op, anchor, literal);
+            op += literal;
+            *op++ = (uint8_t)((ip - match) & 0xFF);
+            *op++ = (uint8_t)((ip - match) >> 8);
+            *token |= (uint8_t)(((length - LZ_MIN_MATCH) >= 15) ? 15 : (length - LZ_MIN_MATCH));
+            if((length - LZ_MIN_MATCH) >= 15) {
+                op = put_length(op, length - LZ_MIN_MATCH);
+            }
+
+            ip += length;
+            anchor = ip;
+            if(ip <= mflimit) {
+                hash_table[hash32(read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    // 结束序列只有字面量, 输出空间不足时截断
+    literal = (uint32_t)(iend - anchor);
+    cost = (uint32_t)(oend - op);
+    if(literal > 0 && cost >= 2) {
+        if((1 + length_cost(literal) + literal) > cost) {
+            literal = cost - 1;
+            while((1 + length_cost(literal) + literal) > cost) {
+                literal--;
+            }
+        }
+        *op++ = (uint8_t)(((literal >= 15) ? 15 : literal) << 4);
+        if(literal >= 15) {
+            op = put_length(op, literal);
+        }
+        memcpy(op, anchor, literal);
+        op += literal;
+    }else {
+        literal = 0;
+    }
+    *consumed = (uint32_t)(anchor + literal - src);
+    return (uint32_t)(op - dst);
+}
+
+/**
+ * 解压数据块
+ * 主机构建整块复制会越界读写, src与dst缓冲区末尾需预留LZ_SLACK字节
+ * @param *src 压缩数据
+ * @param size 压缩数据大小
+ * @param *dst 输出缓冲区
+ * @param capacity 输出缓冲区可用大小(不含预留空间)
+ * @return 解压后大小, 0表示数据损坏
+ * */
+uint32_t lz_decompress(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t capacity) {
+    uint8_t *ip = src, *iend = src + size;
+    uint8_t *op = dst, *oend = dst + capacity, *match;
+    uint32_t token, length, offset;
+    uint8_t byte;
+
+    while(ip < iend) {
+        token = *ip++;
+        length = token >> 4;
+        if(length == 15) {
+            do {
+                if(ip >= iend) return 0;
+                byte = *ip++;
+                length += byte;
+            }while(byte == 255);
+        }
+        if(length > (uint32_t)(iend - ip) || length > (uint32_t)(oend - op)) {
+            return 0;
+        }
+        wild_copy(op, ip, length);
+        op += length;
+        ip += length;
+        if(ip == iend) {
+            break;
+        }
+
+        if((iend - ip) < 2) return 0;
+        offset = *ip | ((uint32_t)*(ip + 1) << 8);
+        ip += 2;
+        if(offset == 0 || offset > (uint32_t)(op - dst)) {
+            return 0;
+        }
+        length = token & 0x0F;
+        if(length == 15) {
+            do {
+                if(ip >= iend) return 0;
+                byte = *ip++;
+                length += byte;
+            }while(byte == 255);
+        }
+        length += LZ_MIN_MATCH;
+        if(length > (uint32_t)(oend - op)) {
+            return 0;
+        }
+        match = op - offset;
+#if defined(__SSE2__)
+        if(offset >= 16) {
+#else
+        if(offset >= length) {
+#endif
+            wild_copy(op, match, length);
+            op += length;
+        }else {
+            // 重叠复制(重复模式)逐字节进行
+            for(uint32_t i = 0; i < length; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (uint32_t)(op - dst);
+}
@@ -0,0 +1,20 @@
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include "stdint.h"
+
+// 压缩块最大原始数据大小(字节), 块内匹配不跨块, 可独立解压
+#define LZ_BLOCK_SIZE 4096
+// 压缩块头大小(字节): 原始大小2字节 + 压缩后大小2字节
+#define LZ_HEADER_SIZE 4
+// 最短匹配长度(字节)
+#define LZ_MIN_MATCH 4
+// 哈希表索引位数, 哈希表占用(2 << LZ_HASH_BITS)字节
+#define LZ_HASH_BITS 12
+// 解压缓冲区尾部预留空间(字节), 用于16字节整块复制
+#define LZ_SLACK 16
+
+uint32_t lz_compress(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t capacity, uint32_t *consumed);
+uint32_t lz_decompress(uint8_t *src, uint32_t size, uint8_t *dst, uint32_t capacity);
+
+#endif // __LZ_H__
@@ -7,13 +7,25 @@
 
 void disp_name(uint8_t *buf, uint8_t max);
 void disp_list(FileList *list);
+void trace_output(uint8_t *data, uint32_t size);
+
+static FILE *trace_file = NULL;
 
 int main(int argc, char **argv) {
     puts("spifs test application");
     w25q32_allocate();
     puts("w25q32 flash space allocated");
+    w25q32_strict(1, NULL);
     w25q32_chip_erase();
     puts("chip erase finished (fill with 0xFF)");
+    trace_file = fopen("spifs.trace", "wb");
+    if(trace_file) {
+        trace_start(trace_output, NULL, 0);
+        puts("flash trace -> spifs.trace");
+    }
+    disk_cache(16);
+    spifs_mount();
+    puts("spifs mounted");
 
     putchar('\n');
 
@@ -26,6 +38,7 @@ int main(int argc, char **argv) {
 
     make_file(&file, "hello", "txt");
     make_fstate(&fstate, 2020, 2, 9);
+    fstate.state &= ~FSTATE_INLINE;
 
     result = create_file(&file, fstate);
     puts("create file helle.txt");
@@ -52,6 +65,8 @@ int main(int argc, char **argv) {
     putchar('\n');
 
     make_file(&file, "main", "java");
+    fstate.state |= FSTATE_INLINE;
+    fstate.state &= ~FSTATE_CHECKSUM;
     result = create_file(&file, fstate);
     puts("create file main.java");
     if(result == CREATE_FILEBLOCK_SUCCESS) {
@@ -79,8 +94,35 @@ int main(int argc, char **argv) {
     disp_list(list);
     recycle_filelist(list);
 
+    ScrubReport report;
+    clock_t start = clock();
+    spifs_scrub(&report);
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("scrub: files %u, clusters %u, unsealed %u, errors %u",
+           report.files, report.clusters, report.unsealed, report.errors);
+    if(elapsed > 0) {
+        printf(", %.1f MB/s", (report.clusters * SECTOR_SIZE) / elapsed / 1e6);
+    }
+    putchar('\n');
+
+    SpifsStat stat;
+    if(spifs_statfs(&stat)) {
+        printf("statfs: free %u/%u sectors (erased %u, deleted %u), slots %u/%u, fragments %u.%02u\n",
+               stat.free, stat.sectors, stat.erased, stat.deleted, stat.slots_used, stat.slots,
+               stat.fragments / 100, stat.fragments % 100);
+    }
+
     delete_file(&file);
     spifs_gc();
+    printf("strict mode violations: %u\n", w25q32_violations());
+    DiskCacheStats cache_stats;
+    disk_cache_stats(&cache_stats);
+    printf("sector cache: hits %u, misses %u, prefetch %u/%u\n", cache_stats.hits, cache_stats.misses,
+           cache_stats.prefetch_hits, cache_stats.prefetches);
+    if(trace_file) {
+        trace_stop();
+        fclose(trace_file);
+    }
 
     uint8_t code = w25q32_output("I:\\ramdisk", "wb+", 40960);
     if(code) {
@@ -88,11 +130,16 @@ int main(int argc, char **argv) {
     }
 
     free(buffer);
+    disk_cache(0);
     w25q32_destory();
 
     return 0;
 }
 
+void trace_output(uint8_t *data, uint32_t size) {
+    fwrite(data, 1, size, trace_file);
+}
+
 void disp_name(uint8_t *buf, uint8_t max) {
     uint8_t i = 0;
     while(*buf != 0xFF && i < max) {
@@ -2,9 +2,11 @@
 #define __MISC_H__
 
 #include "stdint.h"
+#include "bulk.h"
 
 void array_fill(uint8_t *buffer, uint8_t ch, uint32_t size);
 void array_copy(uint8_t *from, uint8_t *to, uint32_t size);
+uint8_t array_equal(uint8_t *a, uint8_t *b, uint32_t size);
 
 void copy_filename(char *src, uint8_t *target, uint32_t length, uint32_t max);
 uint8_t comp_filename(uint8_t *fname, char *str, uint8_t str_size);
@@ -0,0 +1,307 @@
+#include "ring.h"
+
+/**
+ * 环形文件
+ * 数据存放方式与普通文件相同, 首簇即最早数据所在的簇(头指针), read_file的偏移相对于头指针
+ * 追加写需要新簇而簇数已达预算时丢弃首簇: 首簇地址改为第二簇(同时提交之前追加的数据), 擦除原首簇后作为新的结束簇,
+ * 其余数据不移动; 各簇在环内轮流重用, 擦除次数均匀分布在环形文件的簇上, 达到预算后不再查找空闲扇区
+ * 首簇地址与文件大小不写入文件块, 由一条保持进行中的JOURNAL_RING记录代替: 丢弃首簇与append_finish各写入新记录并结束旧记录,
+ * 文件块只在创建、删除与经其他接口修改前改写, 索引扇区与影子扇区不随丢弃首簇擦除; 打开文件时按记录解析首簇地址与文件大小,
+ * 挂载时重新登记记录, 丢弃首簇被打断时完成原首簇的擦除, 未提交的追加写按记录的文件大小回滚
+ * 结束簇与簇数缓存在内存中, 追加写只访问结束簇, 耗时与文件大小无关; 挂载后首次追加写(或文件经其他接口修改后)遍历一次簇链
+ * 以记录代替文件块的文件不超过RING_CACHE_SUM个, 缓存项被替换时先将记录写回文件块;
+ * 日志记录表为状态记录保留位置, 未挂载(不记录日志)时丢弃首簇与提交失败, 不改写文件块
+ * */
+
+// JOURNAL_RING记录arg1中的首簇地址(扇区对齐)与丢弃中的原首簇地址(低12位为扇区号, 0表示无)
+#define RING_HEAD(arg) ((arg) & ~(uint32_t)(SECTOR_SIZE - 1))
+#define RING_DROPPED(arg) (((arg) & (SECTOR_SIZE - 1)) * SECTOR_SIZE)
+
+// 环形文件的结束簇缓存
+typedef struct ring_cache {
+    uint32_t block;     // 文件索引地址, FFFFFFFF表示空闲
+    uint32_t head;     // 首簇地址
+    uint32_t tail;    // 结束簇地址, FFFFFFFF表示需按簇链重新计算
+    uint32_t clusters; // 簇数
+    uint32_t length;  // 文件大小
+    uint32_t handle; // 代替文件块的JOURNAL_RING记录句柄, FFFFFFFF表示以文件块为准
+} RingCache;
+
+static RingCache ring_cache[RING_CACHE_SUM];
+// 缓存已满时下一个替换的项
+static uint32_t ring_victim = 0;
+
+static RingCache *ring_entry(uint32_t fbaddr);
+static RingCache *ring_locate(File *file, uint32_t area);
+static uint32_t ring_drop(File *file, RingCache *ring, uint32_t area);
+static uint8_t ring_record(RingCache *ring, uint32_t dropped);
+static void ring_settle(RingCache *ring);
+
+/**
+ * 环形文件追加写
+ * 在文件尾部添加数据, 簇数达到预算后每写满一簇丢弃最早的一簇, 文件保留最新的(clusters - 1)至clusters簇数据
+ * 与append_file相同, 追加完毕需调用append_finish提交; 丢弃首簇时同时提交之前追加的数据
+ * 簇预算由调用者传入(文件索引没有保存预算的字段), 簇数超出预算时先丢弃多余的首簇;
+ * 预算内空闲扇区不足时先垃圾回收, 仍不足则提前丢弃首簇
+ * 丢弃首簇后其他文件指针中的首簇地址失效, 读取前需重新打开文件
+ * @param *file 文件指针(状态字FSTATE_RING位为0的非压缩、非内联文件)
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数
+ * @param clusters 簇预算(不小于2)
+ * @return APPEND_FILE_SUCCESS, FILE_CANNOT_APPEND:不是环形文件或为压缩、内联文件, 或无法写入状态记录(已写入的部分保留),
+ *         FILE_OUT_OF_RANGE:簇预算小于2, NO_SECTOR_SPACE:只有一簇且没有空闲扇区(已写入的部分保留)
+ * */
+Result spifs_ring_append(File *file, uint8_t *buffer, uint32_t size, uint32_t clusters) {
+    RingCache *ring;
+    Result result;
+    uint32_t area, room, write_size, written = 0;
+    uint32_t sector_list[2];
+    uint8_t flags = FILE_FLAGS(file->state);
+
+    if(file->block == 0xFFFFFFFF) return FILE_UNALLOCATED;
+    if((flags & FSTATE_DIRECTORY) == 0) return FILE_IS_DIRECTORY;
+    if((flags & FSTATE_RING) || (flags & FSTATE_COMPRESSED) == 0 || (flags & FSTATE_INLINE) == 0) return FILE_CANNOT_APPEND;
+    if(clusters < 2) return FILE_OUT_OF_RANGE;
+    if(size == 0) return APPEND_FILE_SUCCESS;
+
+    area = FILE_AREA_SIZE(file->state);
+    // 空文件先写入首簇
+    if(file->cluster == 0xFFFFFFFF) {
+        written = (size > area) ? area : size;
+        result = write_data(file, buffer, written);
+        if(result != WRITE_FILE_SUCCESS) {
+            return result;
+        }
+    }
+    ring = ring_locate(file, area);
+    // 簇数超出预算(预算减小或经append_file追加)时先丢弃多余的首簇
+    while(ring->clusters > clusters) {
+        if(ring_drop(file, ring, area) == 0xFFFFFFFF) {
+            return FILE_CANNOT_APPEND;
+        }
+    }
+    while(written < size) {
+        room = ring->clusters * area - file->length;
+        if(room) {
+            write_size = ((size - written) > room) ? room : (size - written);
+            append_chain(file, &ring->tail, 1, (SECTOR_STATE_SIZE + area - room), (buffer + written), write_size);
+        }else {
+            // 结束簇已写满: 簇数达到预算时重用丢弃的首簇, 否则分配空闲扇区
+            sector_list[0] = ring->tail;
+            sector_list[1] = 0xFFFFFFFF;
+            if(ring->clusters >= clusters) {
+                sector_list[1] = ring_drop(file, ring, area);
+                if(sector_list[1] == 0xFFFFFFFF) {
+                    return FILE_CANNOT_APPEND;
+                }
+            }
+            if(sector_list[1] == 0xFFFFFFFF && find_free_sectors(&sector_list[1], 1) == 0) {
+                spifs_gc();
+                if(find_free_sectors(&sector_list[1], 1) == 0) {
+                    if(ring->clusters < 2) {
+                        return NO_SECTOR_SPACE;
+                    }
+                    sector_list[1] = ring_drop(file, ring, area);
+                    if(sector_list[1] == 0xFFFFFFFF) {
+                        return FILE_CANNOT_APPEND;
+                    }
+                }
+            }
+            write_size = ((size - written) > area) ? area : (size - written);
+            append_chain(file, sector_list, 2, (SECTOR_STATE_SIZE + area), (buffer + written), write_size);
+            ring->tail = sector_list[1];
+            ring->clusters++;
+        }
+        ring->length = file->length;
+        written += write_size;
+    }
+    trace_record(TRACE_USER_WRITE, file->block, size);
+    return APPEND_FILE_SUCCESS;
+}
+
+/**
+ * 清空结束簇缓存, 挂载时调用, 之后由journal_mount重新登记进行中的记录
+ * */
+void ring_invalidate() {
+    for(uint32_t i = 0; i < RING_CACHE_SUM; i++) {
+        ring_cache[i].block = 0xFFFFFFFF;
+        ring_cache[i].handle = 0xFFFFFFFF;
+    }
+}
+
+/**
+ * 文件的簇链被其他接口修改(覆盖写、按偏移覆盖写、截断、删除)前调用: 记录写回文件块, 之后丢弃缓存
+ * 其他接口的操作与日志重放均以文件块为准
+ * @param fbaddr 文件块地址, FFFFFFFF表示全部文件(删除目录时, 目录下的文件随目录回收)
+ * */
+void ring_forget(uint32_t fbaddr) {
+    for(uint32_t i = 0; i < RING_CACHE_SUM; i++) {
+        if(ring_cache[i].block != 0xFFFFFFFF && (fbaddr == 0xFFFFFFFF || ring_cache[i].block == fbaddr)) {
+            ring_settle(&ring_cache[i]);
+            ring_cache[i].block = 0xFFFFFFFF;
+        }
+    }
+}
+
+/**
+ * 提交环形文件的追加写, 由append_finish调用
+ * 首簇地址与文件大小写入新记录, 不改写文件块
+ * @param *file 文件指针
+ * @return 1:已提交, 0:无法写入记录, 追加写保持未提交
+ * */
+uint8_t ring_commit(File *file) {
+    RingCache *ring = ring_entry(file->block);
+    // 经append_file追加时结束簇已改变
+    if(ring->head != file->cluster || ring->length != file->length) {
+        ring->tail = 0xFFFFFFFF;
+    }
+    ring->head = file->cluster;
+    ring->length = file->length;
+    return ring_record(ring, 0);
+}
+
+/**
+ * 文件块中的首簇地址与文件大小存在代替的记录时改为记录的值, 由打开文件、列出目录、扫描与日志重放调用
+ * @param fbaddr 文件块地址
+ * @param *cluster 文件块中的首簇地址
+ * @param *length 文件块中的文件大小
+ * */
+void ring_resolve(uint32_t fbaddr, uint32_t *cluster, uint32_t *length) {
+    for(uint32_t i = 0; i < RING_CACHE_SUM; i++) {
+        if(ring_cache[i].block == fbaddr && ring_cache[i].handle != 0xFFFFFFFF) {
+            *cluster = ring_cache[i].head;
+            *length = ring_cache[i].length;
+            return;
+        }
+    }
+}
+
+/**
+ * 登记挂载时进行中的记录(同一文件只有最后一条), 由journal_mount在重放其余记录前调用
+ * 丢弃首簇被打断时重新擦除原首簇(此时尚未被重用), 再以不含原首簇的记录代替;
+ * 此时进行中的追加写会话已由该记录提交(丢弃首簇后的文件大小可能恰好等于会话开始时的大小), 不再回滚
+ * @param handle 记录句柄
+ * @param *record 日志记录
+ * */
+void ring_restore(uint32_t handle, JournalRecord *record) {
+    RingCache *ring = ring_entry(record->arg0);
+    ring->head = RING_HEAD(record->arg1);
+    ring->length = record->arg2;
+    ring->tail = 0xFFFFFFFF;
+    ring->handle = handle;
+    if(RING_DROPPED(record->arg1) != 0) {
+        journal_end(journal_find(JOURNAL_APPEND, record->arg0));
+        cluster_erase(RING_DROPPED(record->arg1));
+        ring_record(ring, 0);
+    }
+}
+
+/**
+ * 查找或分配文件的缓存项, 替换的缓存项先将记录写回文件块
+ * @param fbaddr 文件块地址
+ * */
+static RingCache *ring_entry(uint32_t fbaddr) {
+    RingCache *ring = NULL;
+    for(uint32_t i = 0; i < RING_CACHE_SUM; i++) {
+        if(ring_cache[i].block == fbaddr) {
+            return &ring_cache[i];
+        }
+    }
+    for(uint32_t i = 0; i < RING_CACHE_SUM && ring == NULL; i++) {
+        if(ring_cache[i].block == 0xFFFFFFFF) {
+            ring = &ring_cache[i];
+        }
+    }
+    if(ring == NULL) {
+        ring = &ring_cache[ring_victim];
+        ring_victim = (ring_victim + 1) % RING_CACHE_SUM;
+        ring_settle(ring);
+    }
+    ring->block = fbaddr;
+    ring->head = 0xFFFFFFFF;
+    ring->tail = 0xFFFFFFFF;
+    ring->length = 0xFFFFFFFF;
+    return ring;
+}
+
+/**
+ * 查找文件的结束簇缓存, 首簇地址或文件大小与缓存不一致(如经append_file追加)时按簇链重新计算
+ * @param *file 文件指针
+ * @param area 每簇的数据域大小
+ * */
+static RingCache *ring_locate(File *file, uint32_t area) {
+    RingCache *ring = ring_entry(file->block);
+    if(ring->tail != 0xFFFFFFFF && ring->head == file->cluster && ring->length == file->length) {
+        return ring;
+    }
+    ring->head = file->cluster;
+    ring->tail = POSITION_CLUSTER(chain_position(file->cluster, file->length, area));
+    ring->clusters = (file->length == 0) ? 1 : AREA_DIV((file->length + area - 1), area);
+    ring->length = file->length;
+    return ring;
+}
+
+/**
+ * 丢弃首簇(已写满)
+ * 新记录改为指向第二簇并提交当前文件大小, 之后擦除原首簇; 未提交的追加写会话随之结束
+ * 记录中带有原首簇, 擦除后再写入不含原首簇的记录, 掉电后挂载时完成原首簇的擦除
+ * @param *file 文件指针, 首簇地址与文件大小随之更新
+ * @param *ring 结束簇缓存
+ * @param area 每簇的数据域大小
+ * @return 原首簇地址(已擦除的空闲扇区), FFFFFFFF表示无法写入记录(未丢弃)
+ * */
+static uint32_t ring_drop(File *file, RingCache *ring, uint32_t area) {
+    uint32_t head = file->cluster, append = journal_find(JOURNAL_APPEND, file->block);
+
+    // 提交未完成的追加写前封存结束簇, 与append_finish相同
+    if(append != 0xFFFFFFFF) {
+        seal_cluster(ring->tail, file, 0);
+    }
+    ring->head = cluster_next(head);
+    ring->length = file->length - area;
+    if(!ring_record(ring, head)) {
+        ring->head = head;
+        ring->length = file->length;
+        return 0xFFFFFFFF;
+    }
+    file->cluster = ring->head;
+    file->length = ring->length;
+    journal_end(append);
+    cluster_erase(head);
+    ring_record(ring, 0);
+    ring->clusters--;
+    return head;
+}
+
+/**
+ * 以缓存中的首簇地址与文件大小写入新记录, 之后结束旧记录
+ * 日志记录表为状态记录保留了位置, 只在未挂载时无法写入, 此时保留旧记录
+ * @param *ring 缓存项
+ * @param dropped 丢弃中的原首簇地址, 0表示无
+ * @return 1:已写入, 0:无法写入
+ * */
+static uint8_t ring_record(RingCache *ring, uint32_t dropped) {
+    uint32_t handle = journal_begin(JOURNAL_RING, ring->block, (ring->head | (dropped / SECTOR_SIZE)), ring->length);
+    if(handle == 0xFFFFFFFF) {
+        return 0;
+    }
+    journal_end(ring->handle);
+    ring->handle = handle;
+    return 1;
+}
+
+/**
+ * 将记录的首簇地址与文件大小写回文件块, 之后结束记录(批处理中推迟到文件块提交后)
+ * @param *ring 缓存项
+ * */
+static void ring_settle(RingCache *ring) {
+    uint32_t handle = ring->handle;
+    if(handle == 0xFFFFFFFF) {
+        return;
+    }
+    ring->handle = 0xFFFFFFFF;
+    update_fileblock(ring->block, ring->head, ring->length);
+    if(!batch_defer(handle)) {
+        journal_end(handle);
+    }
+}
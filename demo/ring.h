@@ -0,0 +1,19 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 缓存结束簇(并以日志记录代替文件块)的环形文件数
+#define RING_CACHE_SUM 4
+
+Result spifs_ring_append(File *file, uint8_t *buffer, uint32_t size, uint32_t clusters);
+
+// 文件系统内部接口
+void ring_invalidate();
+void ring_forget(uint32_t fbaddr);
+uint8_t ring_commit(File *file);
+void ring_resolve(uint32_t fbaddr, uint32_t *cluster, uint32_t *length);
+void ring_restore(uint32_t handle, JournalRecord *record);
+
+#endif // __RING_H__
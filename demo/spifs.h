@@ -25,19 +25,24 @@ typedef struct file_state {
     uint8_t state; // 文件状态字
 } FileState;
 
-// 文件信息结构(24字节)
+// 文件信息结构(28字节)
 typedef struct file {
     uint8_t filename[8]; // 文件名
     uint8_t extname[4]; // 拓展名
     uint32_t block;    // 文件索引记录地址
-    uint32_t cluster; // 文件内容起始扇区地址
+    uint32_t cluster; // 文件内容起始扇区地址(目录为首个目录表扇区地址)
     uint32_t length; // 文件大小
+    uint32_t state; // 文件状态字
 } File;
 
 // 文件信息链表
-// 32bytes(64bit), 28bytes(32bit)
+// 36bytes(64bit), 32bytes(32bit)
 typedef struct file_list {
+#ifdef __cplusplus
+    ::File File;
+#else
     File File;
+#endif
     struct file_list *prev;
 } FileList;
 
@@ -52,10 +57,25 @@ typedef enum {
     NO_SECTOR_SPACE,
 
     FILE_UNALLOCATED,
-    FILE_CANNOT_APPEND
+    FILE_CANNOT_APPEND,
+
+    CREATE_DIR_SUCCESS,
+    FILE_IS_DIRECTORY,
+    FILE_ALREADY_EXISTS,
+    FILE_OUT_OF_RANGE
 } Result;
 
+// 卷校验结果
+typedef struct scrub_report {
+    uint32_t files;       // 校验文件数
+    uint32_t clusters;   // 已校验的簇数
+    uint32_t unsealed;  // 未封存(结束簇追加后未完成封存)的簇数
+    uint32_t errors;   // 校验失败的簇数
+} ScrubReport;
+
 #include "misc.h"
+#include "lz.h"
+#include "crc32c.h"
 #include "diskio.h"
 
 // 文件索引起始扇区号
@@ -64,6 +84,20 @@ typedef enum {
 #define FB_SECTOR_END 4
 // 文件索引占用扇区范围(FB_SECTOR_INIT ~ FB_SECTOR_END - 1)
 
+// 数据扇区结束扇区号
+#ifdef SPIFS_LINK_TABLE
+#define DATA_SECTOR_END 1013
+// 簇链接表起始扇区号, 簇链接表占用数据扇区之后、日志扇区之前的8个扇区
+#define LINK_SECTOR_INIT 1013
+#else
+#define DATA_SECTOR_END 1021
+#endif
+// 数据扇区范围(FB_SECTOR_END ~ DATA_SECTOR_END - 1)
+// 意图日志起始扇区号, 两个日志扇区交替使用
+#define JOURNAL_SECTOR_INIT 1021
+// 影子扇区号, 扇区重写前暂存新内容
+#define SHADOW_SECTOR 1023
+
 // 文件索引占用空间大小(字节)
 #define FILEBLOCK_SIZE 24
 // 文件名+拓展名占用空间大小(字节)
@@ -80,10 +114,73 @@ typedef enum {
 #define SECTOR_SIZE 4096
 // Flash大小(字节)
 #define FLASH_SIZE 4194304
+#ifdef SPIFS_LINK_TABLE
+// 簇链接表格式: 占用标记与下一簇地址保存在簇链接表中, 数据域占满整个扇区
+// 扇区内数据域大小(字节)
+#define DATA_AREA_SIZE 4096
+// 数据域大小以2为底的对数
+#define DATA_AREA_SHIFT 12
+// 扇区标记位大小(字节)
+#define SECTOR_STATE_SIZE 0
+// 校验文件扇区内数据域大小(字节), 数据域之后为封存槽位
+#define CHECKED_AREA_SIZE 4080
+// 簇内偏移换算, 非校验文件的数据域为2的幂, 以移位与掩码代替除法
+#define AREA_DIV(value, area) (((area) == DATA_AREA_SIZE) ? ((value) >> DATA_AREA_SHIFT) : ((value) / (area)))
+#define AREA_MOD(value, area) (((area) == DATA_AREA_SIZE) ? ((value) & (DATA_AREA_SIZE - 1)) : ((value) % (area)))
+// 日志记录中的簇内位置: 数据域写满时的结束位置与下一扇区首地址相同, 扇区号与簇内偏移分开记录
+#define CLUSTER_POSITION(cluster, offset) ((((cluster) / SECTOR_SIZE) << 13) | (offset))
+#define POSITION_CLUSTER(position) (((position) >> 13) * SECTOR_SIZE)
+#define POSITION_OFFSET(position) ((position) & 0x1FFF)
+#else
 // 扇区内数据域大小(字节)
 #define DATA_AREA_SIZE 4090
 // 扇区标记位大小(字节)
 #define SECTOR_STATE_SIZE 2
+// 校验文件扇区内数据域大小(字节), 数据域之后依次为封存槽位与下一簇地址
+#define CHECKED_AREA_SIZE 4074
+// 簇内偏移换算
+#define AREA_DIV(value, area) ((value) / (area))
+#define AREA_MOD(value, area) ((value) % (area))
+// 日志记录中的簇内位置, 即物理地址
+#define CLUSTER_POSITION(cluster, offset) ((cluster) + (offset))
+#define POSITION_CLUSTER(position) (((position) / SECTOR_SIZE) * SECTOR_SIZE)
+#define POSITION_OFFSET(position) ((position) % SECTOR_SIZE)
+#endif
+// 校验文件每簇的封存槽位数量(各4字节), 最后一个槽位在簇写满并链接下一簇时使用
+#define SEAL_SLOT_SUM 4
+// 封存槽位在扇区内的偏移
+#define SEAL_SLOT_OFFSET (SECTOR_STATE_SIZE + CHECKED_AREA_SIZE)
+
+// 文件状态字->标记位(低电平有效)
+// bit0: 0表示文件已删除
+#define FSTATE_DELETED 0x01
+// bit1: 0表示目录
+#define FSTATE_DIRECTORY 0x02
+// bit2: 0表示压缩文件, 数据按簇压缩存放, 文件大小为压缩前大小
+#define FSTATE_COMPRESSED 0x04
+// bit3: 0表示校验文件, 每簇保存CRC-32C封存值
+#define FSTATE_CHECKSUM 0x08
+// bit4: 0表示内联文件, 不超过INLINE_SIZE_MAX的数据存放在同一索引扇区的数据槽位中
+#define FSTATE_INLINE 0x10
+// bit5: 0表示环形文件, 由spifs_ring_append追加写, 超出簇预算时丢弃最早的簇
+#define FSTATE_RING 0x20
+// bit7: 0表示目录表槽位曾被占用, 哈希探测需继续
+#define FSTATE_PROBE 0x80
+// 取文件状态字中的标记位
+#define FILE_FLAGS(state) (((state) >> 24) & 0xFF)
+// 文件每簇的数据域大小
+#define FILE_AREA_SIZE(state) ((FILE_FLAGS(state) & FSTATE_CHECKSUM) ? DATA_AREA_SIZE : CHECKED_AREA_SIZE)
+
+// 内联文件数据槽位: 首字节为0x00, 其后23字节为文件数据
+#define INLINE_DATA_SIZE 23
+// 内联文件最多占用的数据槽位数
+#define INLINE_SLOT_MAX 12
+// 内联文件最大大小(字节)
+#define INLINE_SIZE_MAX (INLINE_DATA_SIZE * INLINE_SLOT_MAX)
+// 内联文件首簇地址字段: 首个数据槽位在扇区内的序号(高位)与数据槽位数(低4位)
+#define INLINE_CLUSTER(index, span) (((index) << 4) | (span))
+// 文件数据内联存放(首簇地址字段小于数据扇区起始地址)
+#define INLINE_STORED(state, cluster) (((FILE_FLAGS(state) & FSTATE_INLINE) == 0) && ((cluster) < (FB_SECTOR_END * SECTOR_SIZE)))
 
 void make_file(File *file, char *filename, char *extname);
 void make_fstate(FileState *fstate, uint32_t year, uint8_t month, uint8_t day);
@@ -92,15 +189,48 @@ Result create_file(File *file, FileState fstate);
 Result write_file(File *file, uint8_t *buffer, uint32_t size);
 Result append_file(File *file, uint8_t *buffer, uint32_t size);
 Result append_finish(File *file);
+Result spifs_pwrite(File *file, uint32_t offset, uint8_t *buffer, uint32_t size);
+Result spifs_truncate(File *file, uint32_t length);
 
 uint8_t open_file(File *file, char *filename, char *extname);
 uint8_t read_state(File *file, FileState *state);
 uint8_t read_file(File *file, uint8_t *buffer, uint32_t offset, uint32_t size);
+uint8_t read_file_verify(File *file, uint8_t *buffer, uint32_t offset, uint32_t size);
 
 void delete_file(File *file);
 void spifs_gc();
+uint32_t spifs_mount();
+uint32_t spifs_scrub(ScrubReport *report);
 
 FileList *list_file();
 void recycle_filelist(FileList *list);
 
+#include "journal.h"
+#include "dir.h"
+#include "batch.h"
+#include "statfs.h"
+#include "defrag.h"
+#include "bloom.h"
+#include "cluster.h"
+#include "async.h"
+#include "ring.h"
+
+// 文件系统内部接口
+uint32_t find_free_sectors(uint32_t *sector_list, uint32_t sectors);
+void erase_cluster_chain(uint32_t cluster);
+uint8_t fileblock_empty(FileBlock *fb);
+uint8_t fileblock_continuation(FileBlock *fb);
+void inline_mark(uint8_t *sector_buffer, uint32_t base, uint8_t *live);
+void update_fileblock(uint32_t fbaddr, uint32_t cluster, uint32_t length);
+Result write_data(File *file, uint8_t *buffer, uint32_t size);
+void append_chain(File *file, uint32_t *sector_list, uint32_t sectors, uint32_t position, uint8_t *buffer, uint32_t size);
+uint32_t chain_position(uint32_t cluster, uint32_t length, uint32_t area);
+void seal_cluster(uint32_t cluster, File *file, uint8_t close);
+void gc_fileblock_sector(uint32_t sector);
+void spifs_recover(JournalRecord *record);
+uint8_t verify_cluster(uint32_t cluster, uint32_t fbaddr, uint8_t *sector_buffer);
+void relink_clusters(File *file, uint32_t prev, uint32_t *old_list, uint32_t *new_list, uint32_t count,
+                     uint32_t offset, uint8_t *buffer, uint32_t size);
+void scrub_fileblock(FileBlock *fb, uint32_t fbaddr, ScrubReport *report);
+
 #endif
@@ -0,0 +1,410 @@
+#include "statfs.h"
+
+/**
+ * 卷空间统计
+ * 挂载后首次调用spifs_statfs时统计一次: 读取各数据扇区的占用标记与下一簇地址, 遍历根目录索引与目录树;
+ * 之后由diskio的编程/擦除、目录表分配与delete_file增量维护, spifs_statfs不再读取存储器
+ * 簇链接表格式下数据扇区的占用与链接由簇链接表的分配、链接与释放维护, 不再跟踪数据扇区的编程与擦除
+ * 每个数据扇区与根目录索引槽位各保存1字节状态, 共约1.7KB, 未调用spifs_statfs时不分配
+ * */
+
+// 数据扇区状态
+// 占用标记已写入
+#define STAT_ALLOCATED 0x01
+// 属于被删除的文件或目录
+#define STAT_DELETED 0x02
+// 目录表扇区
+#define STAT_TABLE 0x04
+// 下一簇地址已写入
+#define STAT_LINKED 0x08
+// 下一簇不是相邻扇区
+#define STAT_BROKEN 0x10
+
+// 根目录索引槽位状态, 低4位为内联文件的数据槽位数
+// 文件索引记录
+#define SLOT_HEAD 0x10
+// 内联文件数据槽位
+#define SLOT_DATA 0x20
+// 文件已删除
+#define SLOT_DELETED 0x40
+
+// 数据扇区数
+#define STAT_SECTOR_SUM (DATA_SECTOR_END - FB_SECTOR_END)
+// 每个根目录索引扇区的槽位数
+#define STAT_SECTOR_SLOTS (SECTOR_SIZE / FILEBLOCK_SIZE)
+// 下一簇地址在扇区内的偏移
+#define STAT_LINK_OFFSET (SECTOR_STATE_SIZE + DATA_AREA_SIZE)
+
+// 增量维护的计数
+typedef struct stat_count {
+    uint32_t allocated;
+    uint32_t deleted;
+    uint32_t tables;
+    uint32_t linked;
+    uint32_t broken;
+    uint32_t slots_used;
+    uint32_t slots_deleted;
+} StatCount;
+
+static uint8_t stat_valid = 0;
+// 正在经影子扇区重写的扇区, 擦除后用途不变
+static uint32_t stat_rewrite = 0xFFFFFFFF;
+static uint8_t *stat_sectors = NULL;
+static uint8_t *stat_slots = NULL;
+static StatCount count;
+
+static uint8_t statfs_census();
+static void statfs_slot(uint32_t index, uint8_t *data, uint32_t from, uint32_t to);
+static void statfs_link(uint32_t sector, uint32_t link);
+static void statfs_clear(uint32_t sector, uint8_t keep);
+static void statfs_mark(uint32_t cluster, uint32_t state, uint8_t deleted);
+
+/**
+ * 查询卷空间统计
+ * 挂载后首次调用时读取各扇区占用标记并遍历目录树, 之后不访问存储器
+ * 扇区数乘以FILE_AREA_SIZE即为可写入的字节数
+ * @param *stat 输出统计结果
+ * @return 1:成功, 0:内存不足
+ * */
+uint8_t spifs_statfs(SpifsStat *stat) {
+    if(!stat_valid && !statfs_census()) {
+        return 0;
+    }
+    stat->sectors = STAT_SECTOR_SUM;
+    stat->erased = STAT_SECTOR_SUM - count.allocated;
+    stat->deleted = count.deleted;
+    stat->used = count.allocated - count.deleted;
+    stat->free = stat->erased + stat->deleted;
+    stat->slots = FB_SECTOR_END * STAT_SECTOR_SLOTS;
+    stat->slots_used = count.slots_used;
+    stat->slots_deleted = count.slots_deleted;
+    // 不被其他簇引用的簇为链首
+    stat->chains = count.allocated - count.tables - count.linked;
+    stat->fragments = stat->chains ? ((stat->chains + count.broken) * 100 / stat->chains) : 0;
+    return 1;
+}
+
+/**
+ * 统计失效, 下次调用spifs_statfs时重新统计, 挂载与整片擦除时调用
+ * */
+void statfs_invalidate() {
+    stat_valid = 0;
+}
+
+/**
+ * 页编程后更新统计, 由disk_write调用
+ * @param address 地址(不跨页)
+ * @param buffer 编程数据
+ * @param size 字节数
+ * */
+void statfs_program(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint32_t sector = address / SECTOR_SIZE, offset = address % SECTOR_SIZE;
+    uint32_t slot, from, to, link = 0;
+    uint8_t *state;
+
+    if(!stat_valid) {
+        return;
+    }
+    if(sector < FB_SECTOR_END) {
+        for(slot = offset / FILEBLOCK_SIZE; slot < STAT_SECTOR_SLOTS && (slot * FILEBLOCK_SIZE) < (offset + size); slot++) {
+            from = (offset > slot * FILEBLOCK_SIZE) ? (offset - slot * FILEBLOCK_SIZE) : 0;
+            to = ((offset + size) < (slot + 1) * FILEBLOCK_SIZE) ? (offset + size - slot * FILEBLOCK_SIZE) : FILEBLOCK_SIZE;
+            statfs_slot((sector * STAT_SECTOR_SLOTS + slot), (buffer + slot * FILEBLOCK_SIZE + from - offset), from, to);
+        }
+        return;
+    }
+    // 簇链接表格式(扇区内没有占用标记)下数据扇区的统计由簇链接表维护
+    if(sector >= DATA_SECTOR_END || SECTOR_STATE_SIZE == 0) {
+        return;
+    }
+    state = stat_sectors + sector - FB_SECTOR_END;
+    if(offset == 0 && *buffer != 0xFF && (*state & STAT_ALLOCATED) == 0) {
+        *state |= STAT_ALLOCATED;
+        count.allocated++;
+    }
+    // 目录表扇区的该位置属于索引槽位
+    if((*state & STAT_TABLE) == 0 && offset <= STAT_LINK_OFFSET && (offset + size) >= (STAT_LINK_OFFSET + 4)) {
+        for(uint32_t i = 0; i < 4; i++) {
+            link |= (uint32_t)*(buffer + STAT_LINK_OFFSET - offset + i) << (i << 3);
+        }
+        statfs_link(sector, link);
+    }
+}
+
+/**
+ * 扇区擦除后更新统计, 由sector_erase调用
+ * @param address 扇区首地址
+ * */
+void statfs_erase(uint32_t address) {
+    uint32_t sector = address / SECTOR_SIZE;
+    uint8_t *slot;
+
+    if(!stat_valid) {
+        return;
+    }
+    if(sector < FB_SECTOR_END) {
+        slot = stat_slots + sector * STAT_SECTOR_SLOTS;
+        for(uint32_t i = 0; i < STAT_SECTOR_SLOTS; i++) {
+            count.slots_used -= ((*(slot + i) & (SLOT_HEAD | SLOT_DATA)) != 0);
+            count.slots_deleted -= (*(slot + i) & SLOT_DELETED) ? (1 + (*(slot + i) & 0x0F)) : 0;
+            *(slot + i) = 0;
+        }
+        return;
+    }
+    if(sector < DATA_SECTOR_END && SECTOR_STATE_SIZE != 0) {
+        statfs_clear(sector, (address == stat_rewrite));
+    }
+    stat_rewrite = 0xFFFFFFFF;
+}
+
+/**
+ * 扇区即将经影子扇区重写, 由journal_rewrite_sector在擦除目标扇区前调用
+ * 重写后的目录表仍为目录表, 其余状态由回写的内容重新统计
+ * @param address 扇区首地址
+ * */
+void statfs_rewrite(uint32_t address) {
+    stat_rewrite = address;
+}
+
+/**
+ * 标记新分配的目录表扇区, 由目录表分配在写入表头之前调用
+ * @param table 目录表扇区地址
+ * */
+void statfs_table(uint32_t table) {
+    uint8_t *state;
+    if(!stat_valid) {
+        return;
+    }
+    state = stat_sectors + (table / SECTOR_SIZE) - FB_SECTOR_END;
+    if((*state & STAT_TABLE) == 0) {
+        *state |= STAT_TABLE;
+        count.tables++;
+    }
+}
+
+/**
+ * 簇链接表格式下记录簇的分配, 由cluster_mark调用
+ * @param cluster 簇地址
+ * */
+void statfs_alloc(uint32_t cluster) {
+    uint8_t *state;
+    if(!stat_valid) {
+        return;
+    }
+    state = stat_sectors + (cluster / SECTOR_SIZE) - FB_SECTOR_END;
+    if((*state & STAT_ALLOCATED) == 0) {
+        *state |= STAT_ALLOCATED;
+        count.allocated++;
+    }
+}
+
+/**
+ * 簇链接表格式下记录簇的下一簇地址(链接或重新链接), 由cluster_link与cluster_relink调用
+ * @param cluster 簇地址
+ * @param next 下一簇地址
+ * */
+void statfs_next(uint32_t cluster, uint32_t next) {
+    uint32_t sector = cluster / SECTOR_SIZE;
+    uint8_t *state;
+    if(!stat_valid) {
+        return;
+    }
+    state = stat_sectors + sector - FB_SECTOR_END;
+    count.linked -= ((*state & STAT_LINKED) != 0);
+    count.broken -= ((*state & STAT_BROKEN) != 0);
+    *state &= ~(STAT_LINKED | STAT_BROKEN);
+    if((*state & STAT_TABLE) == 0) {
+        statfs_link(sector, next);
+    }
+}
+
+/**
+ * 簇链接表格式下记录簇的释放, 由cluster_release调用
+ * @param cluster 簇地址
+ * */
+void statfs_release(uint32_t cluster) {
+    if(!stat_valid) {
+        return;
+    }
+    statfs_clear((cluster / SECTOR_SIZE), 0);
+}
+
+/**
+ * 删除文件时将其簇链(目录为全部目录表与目录下的文件)计为待回收, 由delete_file调用
+ * 只遍历被删除文件自身的簇链或目录树
+ * @param fbaddr 文件索引记录地址
+ * */
+void statfs_delete(uint32_t fbaddr) {
+    FileBlock fb;
+    if(!stat_valid) {
+        return;
+    }
+    disk_read(fbaddr, (uint8_t *)&fb, FILEBLOCK_SIZE);
+    statfs_mark(fb.cluster, fb.state, 1);
+}
+
+/**
+ * 清除数据扇区状态
+ * @param sector 扇区号
+ * @param keep 1:扇区经影子扇区重写, 目录表仍为目录表
+ * */
+static void statfs_clear(uint32_t sector, uint8_t keep) {
+    uint8_t state = *(stat_sectors + sector - FB_SECTOR_END);
+    keep = keep ? (state & STAT_TABLE) : 0;
+    count.allocated -= ((state & STAT_ALLOCATED) != 0);
+    count.deleted -= ((state & STAT_DELETED) != 0);
+    count.tables -= ((state & STAT_TABLE) != 0) && !keep;
+    count.linked -= ((state & STAT_LINKED) != 0);
+    count.broken -= ((state & STAT_BROKEN) != 0);
+    *(stat_sectors + sector - FB_SECTOR_END) = keep;
+}
+
+/**
+ * 统计整个卷
+ * */
+static uint8_t statfs_census() {
+    uint8_t *sector_buffer;
+    FileBlock *fb;
+
+    if(stat_sectors == NULL) {
+        stat_sectors = (uint8_t *)malloc(sizeof(uint8_t) * STAT_SECTOR_SUM);
+        stat_slots = (uint8_t *)malloc(sizeof(uint8_t) * FB_SECTOR_END * STAT_SECTOR_SLOTS);
+    }
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    if(stat_sectors == NULL || stat_slots == NULL || sector_buffer == NULL) {
+        free(stat_sectors);
+        free(stat_slots);
+        free(sector_buffer);
+        stat_sectors = NULL;
+        stat_slots = NULL;
+        return 0;
+    }
+    bulk_fill(stat_sectors, 0x00, STAT_SECTOR_SUM);
+    bulk_fill(stat_slots, 0x00, FB_SECTOR_END * STAT_SECTOR_SLOTS);
+    bulk_fill((uint8_t *)&count, 0x00, sizeof(StatCount));
+    // 统计期间已开始维护, 遍历目录树时标记目录表与被删除的簇链
+    stat_valid = 1;
+
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        if(cluster_inuse(sector * SECTOR_SIZE)) {
+            *(stat_sectors + sector - FB_SECTOR_END) = STAT_ALLOCATED;
+            count.allocated++;
+        }
+    }
+    for(uint32_t sector = FB_SECTOR_INIT; sector < FB_SECTOR_END; sector++) {
+        disk_read(sector * SECTOR_SIZE, sector_buffer, SECTOR_SIZE);
+        for(uint32_t slot = 0; slot < STAT_SECTOR_SLOTS; slot++) {
+            fb = (FileBlock *)(sector_buffer + slot * FILEBLOCK_SIZE);
+            statfs_slot((sector * STAT_SECTOR_SLOTS + slot), (uint8_t *)fb, 0, FILEBLOCK_SIZE);
+            if(!fileblock_empty(fb) && !fileblock_continuation(fb)) {
+                statfs_mark(fb->cluster, fb->state, 0);
+            }
+        }
+    }
+    // 目录表标记完成后再读取各簇的下一簇地址
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        if((*(stat_sectors + sector - FB_SECTOR_END) & (STAT_ALLOCATED | STAT_TABLE)) == STAT_ALLOCATED) {
+            statfs_link(sector, cluster_next(sector * SECTOR_SIZE));
+        }
+    }
+    free(sector_buffer);
+    return 1;
+}
+
+/**
+ * 更新根目录索引槽位状态, 编程只会将1写为0, 重复写入相同内容不改变统计
+ * @param index 槽位序号
+ * @param *data 槽位第from个字节的内容
+ * @param from 写入的首个字节在槽位内的偏移
+ * @param to 写入的结束偏移(不含)
+ * */
+static void statfs_slot(uint32_t index, uint8_t *data, uint32_t from, uint32_t to) {
+    uint8_t *slot = stat_slots + index;
+    uint32_t cluster = 0;
+
+    if(from == 0 && *data != 0xFF && (*slot & (SLOT_HEAD | SLOT_DATA)) == 0) {
+        *slot |= (*data == 0x00) ? SLOT_DATA : SLOT_HEAD;
+        count.slots_used++;
+    }
+    if((*slot & SLOT_HEAD) == 0) {
+        return;
+    }
+    // 首簇地址字段小于数据扇区起始地址时为内联文件, 记录其数据槽位数
+    if(from <= 12 && to >= 16) {
+        for(uint32_t i = 0; i < 4; i++) {
+            cluster |= (uint32_t)*(data + 12 - from + i) << (i << 3);
+        }
+        if(cluster < (FB_SECTOR_END * SECTOR_SIZE) && (*slot & SLOT_DELETED) == 0) {
+            *slot = (*slot & 0xF0) | (cluster & 0x0F);
+        }
+    }
+    if(from <= 23 && to == FILEBLOCK_SIZE && (*(data + 23 - from) & FSTATE_DELETED) == 0 && (*slot & SLOT_DELETED) == 0) {
+        *slot |= SLOT_DELETED;
+        count.slots_deleted += 1 + (*slot & 0x0F);
+    }
+}
+
+/**
+ * 记录簇的下一簇地址
+ * @param sector 扇区号
+ * @param link 下一簇地址
+ * */
+static void statfs_link(uint32_t sector, uint32_t link) {
+    uint8_t *state = stat_sectors + sector - FB_SECTOR_END;
+    if(link == 0xFFFFFFFF || (*state & STAT_LINKED)) {
+        return;
+    }
+    *state |= STAT_LINKED;
+    count.linked++;
+    if(link != (sector + 1) * SECTOR_SIZE) {
+        *state |= STAT_BROKEN;
+        count.broken++;
+    }
+}
+
+/**
+ * 遍历文件的簇链或目录树, 标记目录表扇区与被删除的扇区
+ * @param cluster 首簇地址(目录为首个目录表扇区地址)
+ * @param state 文件状态字
+ * @param deleted 1:上级目录已被删除
+ * */
+static void statfs_mark(uint32_t cluster, uint32_t state, uint8_t deleted) {
+    uint32_t limit = STAT_SECTOR_SUM;
+    uint8_t *sector_buffer, *flags;
+    FileBlock *fb;
+
+    deleted |= ((FILE_FLAGS(state) & FSTATE_DELETED) == 0);
+    if((FILE_FLAGS(state) & FSTATE_DIRECTORY) == 0) {
+        sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+        while(cluster_inuse(cluster) && limit--) {
+            statfs_table(cluster);
+            flags = stat_sectors + (cluster / SECTOR_SIZE) - FB_SECTOR_END;
+            if(deleted && (*flags & STAT_DELETED) == 0) {
+                *flags |= STAT_DELETED;
+                count.deleted++;
+            }
+            disk_read(cluster, sector_buffer, SECTOR_SIZE);
+            for(uint32_t offset = DIR_HEADER_SIZE; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+                fb = (FileBlock *)(sector_buffer + offset);
+                if(!fileblock_empty(fb) && !fileblock_continuation(fb)) {
+                    statfs_mark(fb->cluster, fb->state, deleted);
+                }
+            }
+            cluster = ((DirHeader *)sector_buffer)->next;
+        }
+        free(sector_buffer);
+        return;
+    }
+    if(!deleted) {
+        return;
+    }
+    while(cluster_inuse(cluster) && limit--) {
+        flags = stat_sectors + (cluster / SECTOR_SIZE) - FB_SECTOR_END;
+        if(*flags & STAT_DELETED) {
+            break;
+        }
+        *flags |= STAT_DELETED;
+        count.deleted++;
+        cluster = cluster_next(cluster);
+    }
+}
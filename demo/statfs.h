@@ -0,0 +1,34 @@
+#ifndef __STATFS_H__
+#define __STATFS_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 卷空间统计
+typedef struct spifs_stat {
+    uint32_t sectors;        // 数据扇区总数
+    uint32_t erased;        // 已擦除, 可直接分配的扇区数
+    uint32_t used;         // 存活文件与目录表占用的扇区数
+    uint32_t deleted;     // 被删除文件占用, 垃圾回收后可分配的扇区数
+    uint32_t free;       // 可用扇区数(erased + deleted)
+    uint32_t slots;           // 根目录索引槽位总数
+    uint32_t slots_used;     // 已占用的根目录索引槽位数(含内联数据槽位)
+    uint32_t slots_deleted; // 垃圾回收后可释放的根目录索引槽位数
+    uint32_t chains;       // 簇链数(不含目录表)
+    uint32_t fragments;   // 每条簇链的平均片段数x100(相邻扇区为同一片段), 100表示全部连续, 0表示没有簇链
+} SpifsStat;
+
+uint8_t spifs_statfs(SpifsStat *stat);
+
+// 文件系统内部接口
+void statfs_invalidate();
+void statfs_program(uint32_t address, uint8_t *buffer, uint32_t size);
+void statfs_erase(uint32_t address);
+void statfs_rewrite(uint32_t address);
+void statfs_table(uint32_t table);
+void statfs_delete(uint32_t fbaddr);
+void statfs_alloc(uint32_t cluster);
+void statfs_next(uint32_t cluster, uint32_t next);
+void statfs_release(uint32_t cluster);
+
+#endif // __STATFS_H__
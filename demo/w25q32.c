@@ -1,8 +1,48 @@
 #include "w25q32.h"
+#include "bulk.h"
 
 uint8_t *w25q32_buffer = NULL;
 uint8_t erase_impl(uint32_t address, uint32_t erase_size);
 
+// 掉电模拟: 剩余编程/擦除操作次数, 0表示不模拟
+static uint32_t power_cut_countdown = 0;
+static void (*power_cut_handler)(void) = NULL;
+static uint8_t power_cut_tick();
+
+// 严格模式: 编程按位与写入并在页内回绕, 违例时计数并调用handler
+static uint8_t strict_mode = 0;
+static uint32_t strict_violations = 0;
+static void (*strict_handler)(uint32_t address, uint8_t kind) = NULL;
+static void program_strict(uint32_t address, uint8_t *buffer, uint32_t size);
+
+// 忙状态模拟: 虚拟时钟(us), 编程与擦除发出后闪存忙碌至busy_until, 忙碌期间的读取与新命令等待完成
+static uint32_t timing_program = 0;
+static uint32_t timing_erase = 0;
+static uint32_t clock_now = 0;
+static uint32_t busy_until = 0;
+// 挂起: 1:编程或擦除已挂起, 剩余忙碌时间(us), 上次恢复的时刻
+static uint8_t suspended = 0;
+static uint32_t suspend_remaining = 0;
+static uint32_t resumed_at = 0;
+static void suspend_exit();
+// 总线时序: 每字节传输时间(ns), 0表示传输不计时
+static uint32_t timing_byte_ns = 0;
+static uint32_t bus_time(uint32_t size);
+// 读取指令, 1:读取后保持CS以便顺序续读, Quad I/O下以连续读取模式(M7-0=0x20)省略下一条读取的指令
+static uint8_t read_command = W25Q32_READ_DATA;
+static uint8_t read_continuous = 0;
+// 1:已进入Quad I/O连续读取模式, 其他指令前须先复位
+static uint8_t read_mode_active = 0;
+// CS保持时下一次顺序读取的地址, 0xFFFFFFFF表示CS已释放
+static uint32_t read_stream = 0xFFFFFFFF;
+// 读取总线时间不足1us的部分(ns), 累计到下一次读取
+static uint32_t read_carry = 0;
+static uint32_t read_time(uint32_t address, uint32_t size);
+static uint32_t read_release();
+static uint32_t read_cycles(uint8_t command, uint32_t size, uint8_t header);
+static uint32_t read_byte_ns(uint8_t command);
+static uint8_t program_impl(uint32_t address, uint8_t *buffer, uint32_t size);
+
 void w25q32_allocate() {
     if(w25q32_buffer == NULL) {
         w25q32_buffer = (uint8_t *)malloc(sizeof(uint8_t) * 4194304);
@@ -37,6 +77,306 @@ uint8_t w25q32_output(const char *filePath, const char *mode, uint32_t size) {
     return 1;
 }
 
+/**
+ * 模拟掉电
+ * 第ops次编程/擦除操作只完成一半(编程写入前一半字节, 擦除只擦除前一半区域), 随后调用handler
+ * handler通常使用longjmp返回测试程序, 模拟掉电后重新上电
+ * @param ops 掉电前的编程/擦除操作次数, 0表示取消模拟
+ * @param handler 掉电回调
+ * */
+void w25q32_power_cut(uint32_t ops, void (*handler)(void)) {
+    power_cut_countdown = ops;
+    power_cut_handler = handler;
+}
+
+/**
+ * 严格模式, 按NOR闪存的实际行为编程
+ * 编程只能将1写为0(与原内容按位与), 超出页尾的部分回绕到页首
+ * 编程跨越页边界或需要将0写为1时记为违例, 每次编程最多记一次
+ * @param enable 1:开启, 0:关闭(编程直接覆盖原内容), 同时清零违例计数
+ * @param handler 违例回调, 参数为违例地址与违例类型, 可为NULL
+ * */
+void w25q32_strict(uint8_t enable, void (*handler)(uint32_t address, uint8_t kind)) {
+    strict_mode = enable;
+    strict_handler = handler;
+    strict_violations = 0;
+}
+
+/**
+ * 严格模式下的违例次数
+ * */
+uint32_t w25q32_violations() {
+    return strict_violations;
+}
+
+/**
+ * 忙状态模拟, 编程与擦除使闪存在虚拟时钟上忙碌对应的时间
+ * W25Q32典型值: 页编程0.7ms, 扇区擦除45ms
+ * @param program_us 页编程时间(us)
+ * @param erase_us 擦除时间(us), 两者均为0时关闭模拟
+ * */
+void w25q32_timing(uint32_t program_us, uint32_t erase_us) {
+    timing_program = program_us;
+    timing_erase = erase_us;
+    busy_until = clock_now;
+    suspended = 0;
+}
+
+/**
+ * 总线时序, 编程按字节数(另加4字节指令与地址)占用总线, 读取按w25q32_read_mode选择的指令计算
+ * 经CPU收发时虚拟时钟前进传输时间, 经DMA(w25q32_dma_read/w25q32_dma_page)时闪存忙碌至传输与编程完成
+ * 50MHz SPI约为160ns每字节, 104MHz约为77ns每字节
+ * @param byte_ns 每字节传输时间(ns), 0关闭
+ * */
+void w25q32_bus(uint32_t byte_ns) {
+    timing_byte_ns = byte_ns;
+    read_carry = 0;
+}
+
+/**
+ * 读取指令, 作用于w25q32_read与w25q32_dma_read, 各指令的总线周期数(n为字节数):
+ * 0x03 Read Data: 8指令+24地址+8n, 时钟最高50MHz(总线更快时按50MHz计)
+ * 0x0B Fast Read: 8指令+24地址+8空周期+8n
+ * 0x3B Dual Output: 8指令+24地址+8空周期+4n
+ * 0x6B Quad Output: 8指令+24地址+8空周期+2n
+ * 0xEB Quad I/O: 8指令+6地址+2模式+4空周期+2n, 连续读取模式下省略指令
+ * @param command 读取指令, 不支持时保持原指令
+ * @param continuous 1:读取后保持CS, 紧接上次结束地址的读取只需传输数据; Quad I/O时进入连续读取模式
+ * @return 1:成功, 0:不支持的指令
+ * */
+uint8_t w25q32_read_mode(uint8_t command, uint8_t continuous) {
+    if(read_cycles(command, 0, 1) == 0) {
+        return 0;
+    }
+    clock_now += (read_release() + 999) / 1000;
+    read_command = command;
+    read_continuous = continuous;
+    return 1;
+}
+
+/**
+ * 按当前总线时序以指定指令读取size字节的总线时间(ns), 含指令与地址, 不含连续读取的节省
+ * 用于比较各读取指令, 总线不计时时为0
+ * @return 总线时间(ns), 不支持的指令返回0xFFFFFFFF
+ * */
+uint32_t w25q32_read_ns(uint8_t command, uint32_t size) {
+    uint32_t cycles = read_cycles(command, size, 1);
+    if(cycles == 0) {
+        return 0xFFFFFFFF;
+    }
+    return (cycles * read_byte_ns(command) + 7) / 8;
+}
+
+/**
+ * 虚拟时钟(us), 只在等待闪存, CPU收发数据与w25q32_elapse时前进
+ * */
+uint32_t w25q32_clock() {
+    return clock_now;
+}
+
+/**
+ * 虚拟时钟前进, 模拟CPU执行其他工作的耗时
+ * @param us 时间(us)
+ * */
+void w25q32_elapse(uint32_t us) {
+    clock_now += us;
+}
+
+/**
+ * 读状态寄存器的BUSY位
+ * @return 1:编程或擦除进行中(挂起时为0)
+ * */
+uint8_t w25q32_busy() {
+    return ((int32_t)(busy_until - clock_now) > 0);
+}
+
+/**
+ * 等待进行中的编程或擦除完成, 虚拟时钟前进到完成时刻
+ * */
+void w25q32_wait() {
+    if(w25q32_busy()) {
+        clock_now = busy_until;
+    }
+}
+
+/**
+ * 挂起进行中的编程或擦除(Erase/Program Suspend, 75h), 挂起后可读取未在编程或擦除的区域
+ * 挂起需要W25Q32_SUSPEND_US完成, 期间操作完成时直接返回; 挂起期间BUSY为0
+ * 距上次恢复不足W25Q32_SUSPEND_US时不接受挂起; 挂起期间发出编程或擦除时先恢复并等待完成
+ * @return 1:已挂起或操作已完成, 0:没有进行中的操作或不接受挂起
+ * */
+uint8_t w25q32_suspend() {
+    if(suspended || !w25q32_busy() || (clock_now - resumed_at) < W25Q32_SUSPEND_US) {
+        return 0;
+    }
+    clock_now += bus_time(0) + W25Q32_SUSPEND_US;
+    if(!w25q32_busy()) {
+        clock_now = busy_until;
+        return 1;
+    }
+    suspend_remaining = busy_until - clock_now;
+    busy_until = clock_now;
+    suspended = 1;
+    return 1;
+}
+
+/**
+ * 恢复挂起的编程或擦除(Erase/Program Resume, 7Ah), 闪存继续忙碌剩余的时间
+ * @return 1:已恢复, 0:没有挂起的操作
+ * */
+uint8_t w25q32_resume() {
+    if(!suspended) {
+        return 0;
+    }
+    clock_now += bus_time(0);
+    busy_until = clock_now + suspend_remaining;
+    resumed_at = clock_now;
+    suspended = 0;
+    return 1;
+}
+
+/**
+ * 读状态寄存器的SUS位
+ * @return 1:编程或擦除已挂起
+ * */
+uint8_t w25q32_suspended() {
+    return suspended;
+}
+
+/**
+ * 发出编程或擦除前恢复挂起的操作
+ * */
+static void suspend_exit() {
+    if(suspended) {
+        w25q32_resume();
+    }
+}
+
+static uint8_t power_cut_tick() {
+    if(power_cut_countdown == 0) {
+        return 0;
+    }
+    power_cut_countdown--;
+    return (power_cut_countdown == 0);
+}
+
+/**
+ * 传输size字节数据的总线时间(us), 用于编程与擦除指令
+ * */
+static uint32_t bus_time(uint32_t size) {
+    return ((size + 4) * timing_byte_ns + read_release() + 999) / 1000;
+}
+
+/**
+ * 以当前读取指令读取的总线时间(us), 不足1us的部分累计到之后的读取
+ * CS保持且紧接上次读取结束地址时只传输数据, Quad I/O连续读取模式下省略指令
+ * */
+static uint32_t read_time(uint32_t address, uint32_t size) {
+    uint8_t header = 1;
+    uint32_t cycles;
+    if(read_continuous && address == read_stream) {
+        header = 0;
+    }else if(read_mode_active) {
+        header = 2;
+    }
+    cycles = read_cycles(read_command, size, header);
+    read_stream = read_continuous ? (address + size) : 0xFFFFFFFF;
+    read_mode_active = (read_continuous && read_command == W25Q32_QUAD_IO);
+    read_carry += (cycles * read_byte_ns(read_command) + 7) / 8;
+    cycles = read_carry / 1000;
+    read_carry %= 1000;
+    return cycles;
+}
+
+/**
+ * 释放CS, 处于连续读取模式时先复位(四线上8个周期的0xFF)
+ * @return 复位耗时(ns)
+ * */
+static uint32_t read_release() {
+    uint32_t ns = read_mode_active ? timing_byte_ns : 0;
+    read_mode_active = 0;
+    read_stream = 0xFFFFFFFF;
+    return ns;
+}
+
+/**
+ * 读取指令的总线周期数
+ * @param header 0:只传输数据(CS保持续读), 1:完整指令, 2:省略指令(Quad I/O连续读取模式)
+ * @return 周期数, 不支持的指令返回0
+ * */
+static uint32_t read_cycles(uint8_t command, uint32_t size, uint8_t header) {
+    switch(command) {
+    case W25Q32_READ_DATA:
+        return (header ? 32 : 0) + size * 8;
+    case W25Q32_FAST_READ:
+        return (header ? 40 : 0) + size * 8;
+    case W25Q32_DUAL_OUTPUT:
+        return (header ? 40 : 0) + size * 4;
+    case W25Q32_QUAD_OUTPUT:
+        return (header ? 40 : 0) + size * 2;
+    case W25Q32_QUAD_IO:
+        return ((header == 1) ? 20 : ((header == 2) ? 12 : 0)) + size * 2;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * 读取指令每8个周期的时间(ns), Read Data(0x03)的时钟最高50MHz
+ * */
+static uint32_t read_byte_ns(uint8_t command) {
+    if(command == W25Q32_READ_DATA && timing_byte_ns != 0 && timing_byte_ns < W25Q32_READ_DATA_NS) {
+        return W25Q32_READ_DATA_NS;
+    }
+    return timing_byte_ns;
+}
+
+/**
+ * 发出页编程后立即返回, 闪存忙碌期间(w25q32_busy)调用者可执行其他工作
+ * 忙碌时先等待上一条命令完成
+ * */
+uint8_t w25q32_issue_page(uint32_t address, uint8_t *buffer, uint32_t size) {
+    suspend_exit();
+    w25q32_wait();
+    clock_now += bus_time(size);
+    busy_until = clock_now + timing_program;
+    return program_impl(address, buffer, size);
+}
+
+/**
+ * 发出扇区擦除后立即返回
+ * @param address 扇区起始地址
+ * */
+uint8_t w25q32_issue_erase(uint32_t address) {
+    suspend_exit();
+    w25q32_wait();
+    clock_now += bus_time(0);
+    busy_until = clock_now + timing_erase;
+    return erase_impl(address, 4096);
+}
+
+/**
+ * 以DMA发出页编程后立即返回, 数据传输与编程期间闪存忙碌, buffer在完成前须保持不变
+ * 忙碌时先等待上一条命令完成
+ * */
+uint8_t w25q32_dma_page(uint32_t address, uint8_t *buffer, uint32_t size) {
+    suspend_exit();
+    w25q32_wait();
+    busy_until = clock_now + bus_time(size) + timing_program;
+    return program_impl(address, buffer, size);
+}
+
+/**
+ * 以DMA发出读取后立即返回, 传输期间闪存忙碌, 完成(w25q32_busy为0)后buffer中的数据才可使用
+ * 忙碌时先等待上一条命令完成
+ * */
+uint32_t w25q32_dma_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    w25q32_wait();
+    busy_until = clock_now + read_time(address, size);
+    bulk_copy(buffer, (w25q32_buffer + address), size);
+    return size;
+}
+
 /**
  * 整片擦除,擦除完成后为FF
  * W25Q16:25s
@@ -45,9 +385,10 @@ uint8_t w25q32_output(const char *filePath, const char *mode, uint32_t size) {
  * @return state register
  * */
 uint8_t w25q32_chip_erase() {
-	for(uint32_t i = 0; i < 4194304; i++) {
-        *(w25q32_buffer + i) = 0xFF;
-    }
+    suspend_exit();
+    w25q32_wait();
+    read_release();
+	bulk_fill(w25q32_buffer, 0xFF, 4194304);
 	return 0x2;
 }
 
@@ -57,7 +398,9 @@ uint8_t w25q32_chip_erase() {
  * @return state register
  * */
 uint8_t w25q32_sector_erase(uint32_t address) {
-	return erase_impl(address, 4096);
+    uint8_t state = w25q32_issue_erase(address);
+    w25q32_wait();
+    return state;
 }
 
 /**
@@ -66,6 +409,9 @@ uint8_t w25q32_sector_erase(uint32_t address) {
  * @return state register
  * */
 uint8_t w25q32_block_erase_32k(uint32_t address) {
+    suspend_exit();
+    w25q32_wait();
+    read_release();
 	return erase_impl(address, 32768);
 }
 
@@ -75,15 +421,19 @@ uint8_t w25q32_block_erase_32k(uint32_t address) {
  * @return state register
  * */
 uint8_t w25q32_block_erase_64k(uint32_t address) {
+    suspend_exit();
+    w25q32_wait();
+    read_release();
 	return erase_impl(address, 65536);
 }
 
 uint8_t erase_impl(uint32_t address, uint32_t size) {
+    uint8_t cut = power_cut_tick();
     uint32_t start = address / size;
     start *= size;
-    uint32_t end = start + size;
-    for(; start < end; start++) {
-        *(w25q32_buffer + start) = 0xFF;
+    bulk_fill((w25q32_buffer + start), 0xFF, (cut ? (size >> 1) : size));
+    if(cut && power_cut_handler != NULL) {
+        power_cut_handler();
     }
 	return 0x2;
 }
@@ -99,11 +449,10 @@ uint32_t w25q32_read(uint32_t address, uint8_t *buffer, uint32_t size) {
 	if(buffer == NULL || size <= 0) {
 		return 0x00;
 	}
-    uint32_t i = 0;
-    for(; i < size; i++) {
-        *(buffer + i) = *(w25q32_buffer + address + i);
-    }
-	return i;
+    w25q32_wait();
+    clock_now += read_time(address, size);
+    bulk_copy(buffer, (w25q32_buffer + address), size);
+	return size;
 }
 
 /**
@@ -115,12 +464,25 @@ uint32_t w25q32_read(uint32_t address, uint8_t *buffer, uint32_t size) {
  * @return state register
  * */
 uint8_t w25q32_write_page(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint8_t state = w25q32_issue_page(address, buffer, size);
+    w25q32_wait();
+    return state;
+}
+
+static uint8_t program_impl(uint32_t address, uint8_t *buffer, uint32_t size) {
 	if(buffer == NULL || size <= 0) {
 		return 0x00;
 	}
+	uint8_t cut = power_cut_tick();
 	size = (size > 256) ? 256 : size;
-    for(uint32_t i = 0; i < size; i++) {
-        *(w25q32_buffer + address + i) = *(buffer + i);
+	size = cut ? (size >> 1) : size;
+    if(strict_mode) {
+        program_strict(address, buffer, size);
+    }else {
+        bulk_copy((w25q32_buffer + address), buffer, size);
+    }
+    if(cut && power_cut_handler != NULL) {
+        power_cut_handler();
     }
 	return 0x2;
 }
@@ -146,3 +508,27 @@ uint8_t w25q32_write_multipage(uint32_t address, uint8_t *buffer, uint32_t size)
 	return 0x2;
 }
 
+
+static void program_strict(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint32_t page = address & ~(uint32_t)0xFF, column = address & 0xFF, target;
+    uint8_t kind = 0;
+    uint32_t where = address;
+
+    if((column + size) > 256) {
+        kind = W25Q32_PAGE_WRAP;
+    }
+    for(uint32_t i = 0; i < size; i++) {
+        target = page + ((column + i) & 0xFF);
+        if(kind == 0 && (*(w25q32_buffer + target) & *(buffer + i)) != *(buffer + i)) {
+            kind = W25Q32_NOT_ERASED;
+            where = target;
+        }
+        *(w25q32_buffer + target) &= *(buffer + i);
+    }
+    if(kind) {
+        strict_violations++;
+        if(strict_handler != NULL) {
+            strict_handler(where, kind);
+        }
+    }
+}
@@ -8,14 +8,54 @@
 
 extern uint8_t *w25q32_buffer;
 
+// 严格模式违例类型
+// 编程跨越页边界, 超出部分回绕到页首
+#define W25Q32_PAGE_WRAP 0x01
+// 编程需要将0写为1(目标字节未擦除)
+#define W25Q32_NOT_ERASED 0x02
+
+// 读取指令
+// Read Data, 单线, 时钟最高50MHz
+#define W25Q32_READ_DATA 0x03
+// Fast Read, 单线, 8个空周期
+#define W25Q32_FAST_READ 0x0B
+// Fast Read Dual Output, 数据经两线传输
+#define W25Q32_DUAL_OUTPUT 0x3B
+// Fast Read Quad Output, 数据经四线传输(须置位状态寄存器QE)
+#define W25Q32_QUAD_OUTPUT 0x6B
+// Fast Read Quad I/O, 地址与数据经四线传输, 支持连续读取模式
+#define W25Q32_QUAD_IO 0xEB
+// Read Data的最短字节时间(ns), 即50MHz
+#define W25Q32_READ_DATA_NS 160
+// 挂起延迟tSUS(us), 也是恢复后再次挂起的最短间隔
+#define W25Q32_SUSPEND_US 20
+
 void w25q32_allocate();
 void w25q32_destory();
 uint8_t * w25q32_getbuffer();
 uint8_t w25q32_output(const char *filePath, const char *mode, uint32_t size);
+void w25q32_power_cut(uint32_t ops, void (*handler)(void));
+void w25q32_strict(uint8_t enable, void (*handler)(uint32_t address, uint8_t kind));
+uint32_t w25q32_violations();
+void w25q32_timing(uint32_t program_us, uint32_t erase_us);
+void w25q32_bus(uint32_t byte_ns);
+uint8_t w25q32_read_mode(uint8_t command, uint8_t continuous);
+uint32_t w25q32_read_ns(uint8_t command, uint32_t size);
+uint32_t w25q32_clock();
+void w25q32_elapse(uint32_t us);
+uint8_t w25q32_busy();
+void w25q32_wait();
+uint8_t w25q32_suspend();
+uint8_t w25q32_resume();
+uint8_t w25q32_suspended();
 
 uint32_t w25q32_read(uint32_t address, uint8_t *buffer, uint32_t size);
 uint8_t w25q32_write_page(uint32_t address, uint8_t *buffer, uint32_t size);
 uint8_t w25q32_write_multipage(uint32_t address, uint8_t *buffer, uint32_t size);
+uint8_t w25q32_issue_page(uint32_t address, uint8_t *buffer, uint32_t size);
+uint8_t w25q32_issue_erase(uint32_t address);
+uint8_t w25q32_dma_page(uint32_t address, uint8_t *buffer, uint32_t size);
+uint32_t w25q32_dma_read(uint32_t address, uint8_t *buffer, uint32_t size);
 
 uint8_t w25q32_chip_erase();
 uint8_t w25q32_sector_erase(uint32_t address);
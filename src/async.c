@@ -0,0 +1,336 @@
+#include "async.h"
+
+/**
+ * 异步操作
+ * 文件系统的计算部分在spifs_async_poll中执行, 编程与擦除命令进入diskio的异步命令队列后立即返回,
+ * 之后每次调用spifs_async_poll在闪存空闲时发出下一条命令; 操作的全部命令完成后状态变为ASYNC_DONE并调用回调
+ * 闪存忙碌期间调用者可执行其他工作, 后续操作的计算部分也与前一操作的闪存忙碌时间重叠
+ * 调度: 前台操作先于后台操作, 同类别中截止时刻早的先执行, 其余按提交顺序; 同一文件的操作按提交顺序执行,
+ * 相邻的追加写(同一文件)与首尾相接的覆盖写合并为一次写入; 后台操作在命令队列全部完成后才执行一步,
+ * 一步的命令进入队列后, 之后提交的前台操作的命令排在其后(命令队列保持先后顺序, 掉电安全性不变)
+ * 没有发出命令的操作(如缓冲在文件句柄中的追加写)不等待队列中其他操作的命令, 只等待同一文件之前的操作完成
+ * 回调之前操作结果尚未持久化; 回调内不可调用spifs_async_poll, spifs_async_wait与spifs_async_yield
+ * */
+
+// 已提交未完成的操作(链表, 按提交顺序)
+static AsyncOp *async_first = NULL;
+static AsyncOp *async_last = NULL;
+
+static AsyncOp *async_next();
+static uint8_t async_class(AsyncOp *op);
+static uint8_t async_plugged(AsyncOp *op);
+static uint8_t async_before(AsyncOp *a, AsyncOp *b);
+static void async_run(AsyncOp *op);
+static AsyncOp *async_merge(AsyncOp *op, uint8_t **buffer, uint32_t *size);
+static void async_step(AsyncOp *op);
+static uint32_t async_sequence(AsyncOp *op, uint32_t before);
+static uint8_t async_retire();
+
+/**
+ * 开启异步操作, 设置diskio的异步命令队列
+ * 开启后同步接口的编程与擦除同样进入队列, 与异步操作按调用顺序写入闪存
+ * @param commands 命令队列长度, 0关闭(等待队列中的命令完成)
+ * @return 1:设置成功, 0:内存不足或已设置条带卷
+ * */
+uint8_t spifs_async(uint32_t commands) {
+    while(commands == 0 && spifs_async_poll()) {
+        w25q32_wait();
+    }
+    return disk_async(commands);
+}
+
+/**
+ * 提交异步操作, 立即返回
+ * 未开启异步操作时编程与擦除同步执行, 操作在下一次spifs_async_poll时完成
+ * @param *op 异步操作, 填写kind, file, buffer, offset, size, callback, context, priority, deadline
+ * */
+void spifs_async_submit(AsyncOp *op) {
+    op->state = ASYNC_PENDING;
+    op->next = NULL;
+    if(op->kind == ASYNC_GC || op->kind == ASYNC_DEFRAG) {
+        op->offset = 0;
+    }
+    if(async_last) {
+        async_last->next = op;
+    }else {
+        async_first = op;
+    }
+    async_last = op;
+}
+
+/**
+ * 推进异步操作, 不等待闪存
+ * 闪存空闲时发出下一条命令; 依次完成命令已全部完成的操作并调用回调,
+ * 每次回调前先执行等待中的操作的计算部分, 使闪存在回调的计算期间有命令可执行
+ * @return 1:仍有未完成的操作或命令, 0:全部完成
+ * */
+uint8_t spifs_async_poll() {
+    AsyncOp *op;
+    disk_async_step();
+    do {
+        while((op = async_next()) != NULL) {
+            async_run(op);
+            disk_async_step();
+        }
+    }while(async_retire());
+    return (disk_async_step() || async_first != NULL);
+}
+
+/**
+ * 等待操作完成, 期间闪存忙碌时阻塞
+ * @param *op 已提交的异步操作
+ * */
+void spifs_async_wait(AsyncOp *op) {
+    while(op->state != ASYNC_DONE && spifs_async_poll()) {
+        w25q32_wait();
+    }
+}
+
+/**
+ * 后台任务让出, 在同步执行的后台工作(如逐步调用spifs_defrag)的步骤之间调用
+ * 推进异步操作, 有未完成的前台操作(含超过截止时刻的后台操作)时返回1, 后台任务应暂停, 稍后再调用
+ * @return 1:应让出给前台操作, 0:可继续后台工作
+ * */
+uint8_t spifs_async_yield() {
+    spifs_async_poll();
+    for(AsyncOp *op = async_first; op != NULL; op = op->next) {
+        if(async_class(op) == ASYNC_FOREGROUND) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 丢弃未完成的操作(不调用回调)与排队的命令, 挂载时调用(视为重新上电)
+ * */
+void async_discard() {
+    async_first = NULL;
+    async_last = NULL;
+    disk_async_discard();
+}
+
+/**
+ * 选择下一个执行的操作: 前台先于后台, 同类别中截止时刻早的优先, 其余按提交顺序
+ * 同一文件的操作中只有最早提交的等待执行的操作可以执行; 追加写与覆盖写在同一文件之前的操作的命令完成前等待(截止时刻已过时除外),
+ * 期间提交的相邻写入可与之合并; 后台操作须等待命令队列全部完成
+ * @return 下一个执行的操作, NULL表示没有可执行的操作
+ * */
+static AsyncOp *async_next() {
+    AsyncOp *best = NULL, *earlier;
+    uint8_t blocked;
+    for(AsyncOp *op = async_first; op != NULL; op = op->next) {
+        if(op->state != ASYNC_PENDING) {
+            continue;
+        }
+        blocked = 0;
+        for(earlier = async_first; earlier != op && !blocked && op->file != NULL; earlier = earlier->next) {
+            if(earlier->file == op->file) {
+                blocked = (earlier->state == ASYNC_PENDING) || (async_plugged(op) && earlier->state == ASYNC_FLUSHING);
+            }
+        }
+        if(!blocked && (best == NULL || async_before(op, best))) {
+            best = op;
+        }
+    }
+    if(best != NULL && async_class(best) == ASYNC_BACKGROUND && disk_async_queued() != disk_async_completed()) {
+        return NULL;
+    }
+    return best;
+}
+
+/**
+ * 操作当前的优先级类别, 超过截止时刻的后台操作按前台执行
+ * */
+static uint8_t async_class(AsyncOp *op) {
+    if(op->priority == ASYNC_BACKGROUND && op->deadline != 0 && (int32_t)(w25q32_clock() - op->deadline) >= 0) {
+        return ASYNC_FOREGROUND;
+    }
+    return op->priority;
+}
+
+/**
+ * 可合并的写入(追加写, 覆盖写)是否等待同一文件之前的操作完成, 截止时刻已过时不等待
+ * */
+static uint8_t async_plugged(AsyncOp *op) {
+    if(op->kind != ASYNC_APPEND && op->kind != ASYNC_PWRITE) {
+        return 0;
+    }
+    return (op->deadline == 0 || (int32_t)(w25q32_clock() - op->deadline) < 0);
+}
+
+/**
+ * 操作a是否先于b执行(a在b之后提交), 有截止时刻的操作先于没有的
+ * */
+static uint8_t async_before(AsyncOp *a, AsyncOp *b) {
+    uint8_t class_a = async_class(a), class_b = async_class(b);
+    if(class_a != class_b) {
+        return (class_a < class_b);
+    }
+    if(a->deadline == 0 || b->deadline == 0) {
+        return (b->deadline == 0 && a->deadline != 0);
+    }
+    return ((int32_t)(a->deadline - b->deadline) < 0);
+}
+
+/**
+ * 执行操作的计算部分, 编程与擦除命令进入队列
+ * @param *op 异步操作
+ * */
+static void async_run(AsyncOp *op) {
+    AsyncOp *last = op;
+    uint8_t *buffer = op->buffer;
+    uint32_t size = op->size, before = disk_async_queued(), sequence;
+    if(op->kind == ASYNC_GC || op->kind == ASYNC_DEFRAG) {
+        async_step(op);
+        return;
+    }
+    if(op->kind == ASYNC_APPEND || op->kind == ASYNC_PWRITE) {
+        last = async_merge(op, &buffer, &size);
+    }
+    switch(op->kind) {
+        case ASYNC_WRITE:
+            op->result = write_file(op->file, op->buffer, op->size);
+            break;
+        case ASYNC_APPEND:
+            op->result = append_file(op->file, buffer, size);
+            break;
+        case ASYNC_FINISH:
+            op->result = append_finish(op->file);
+            break;
+        case ASYNC_PWRITE:
+            op->result = spifs_pwrite(op->file, op->offset, buffer, size);
+            break;
+        case ASYNC_TRUNCATE:
+            op->result = spifs_truncate(op->file, op->offset);
+            break;
+        default:
+            delete_file(op->file);
+            op->result = WRITE_FILE_SUCCESS;
+            break;
+    }
+    if(buffer != op->buffer) {
+        free(buffer);
+    }
+    sequence = async_sequence(op, before);
+    for(AsyncOp *merged = op; ; merged = merged->next) {
+        if(merged == op || (merged->state == ASYNC_PENDING && merged->file == op->file)) {
+            merged->result = op->result;
+            merged->sequence = sequence;
+            merged->state = ASYNC_FLUSHING;
+        }
+        if(merged == last) {
+            break;
+        }
+    }
+}
+
+/**
+ * 合并同一文件随后等待执行的相邻写入: 追加写与追加写合并, 覆盖写与首尾相接的覆盖写合并
+ * 合并的数据复制到新分配的缓冲区, 内存不足时不合并
+ * @param *op 首个操作
+ * @param **buffer 输出合并后的数据, 未合并时为op->buffer
+ * @param *size 输出合并后的字节数
+ * @return 最后一个被合并的操作, 未合并时为op
+ * */
+static AsyncOp *async_merge(AsyncOp *op, uint8_t **buffer, uint32_t *size) {
+    AsyncOp *last = op, *next;
+    uint32_t total = op->size, position = 0;
+    for(next = op->next; next != NULL; next = next->next) {
+        if(next->state != ASYNC_PENDING || next->file != op->file) {
+            continue;
+        }
+        if(next->kind != op->kind || (op->kind == ASYNC_PWRITE && next->offset != (op->offset + total))) {
+            break;
+        }
+        total += next->size;
+        last = next;
+    }
+    if(last == op || (*buffer = (uint8_t *)malloc(sizeof(uint8_t) * total)) == NULL) {
+        *buffer = op->buffer;
+        return op;
+    }
+    for(next = op; ; next = next->next) {
+        if(next == op || (next->state == ASYNC_PENDING && next->file == op->file)) {
+            bulk_copy((*buffer + position), next->buffer, next->size);
+            position += next->size;
+        }
+        if(next == last) {
+            break;
+        }
+    }
+    *size = total;
+    return last;
+}
+
+/**
+ * 执行后台操作的一步, 读取为低优先级(不挂起擦除); 全部步骤完成后进入ASYNC_FLUSHING
+ * */
+static void async_step(AsyncOp *op) {
+    uint8_t priority = disk_priority(op->priority == ASYNC_FOREGROUND);
+    uint8_t done;
+    uint32_t before = disk_async_queued();
+    if(op->kind == ASYNC_GC) {
+        gc_fileblock_sector((FB_SECTOR_INIT + op->offset) * SECTOR_SIZE);
+        done = ((FB_SECTOR_INIT + op->offset + 1) >= FB_SECTOR_END);
+    }else {
+        done = (spifs_defrag(op->file, (op->size == 0) ? 1 : op->size) == 0);
+    }
+    disk_priority(priority);
+    op->offset++;
+    op->result = WRITE_FILE_SUCCESS;
+    if(disk_async_queued() != before || op->offset == 1) {
+        op->sequence = async_sequence(op, before);
+    }
+    if(done) {
+        op->state = ASYNC_FLUSHING;
+    }
+}
+
+/**
+ * 操作完成所需等待的命令序号: 发出了命令时为其最后一条命令, 否则为同一文件之前未完成的操作的序号
+ * 没有发出命令的操作(如缓冲在文件句柄中的追加写)不等待其他文件的命令
+ * @param *op 刚执行的操作
+ * @param before 执行前的最后一条排队命令的序号
+ * */
+static uint32_t async_sequence(AsyncOp *op, uint32_t before) {
+    uint32_t sequence = disk_async_completed();
+    if(disk_async_queued() != before) {
+        return disk_async_queued();
+    }
+    for(AsyncOp *earlier = async_first; earlier != op && op->file != NULL; earlier = earlier->next) {
+        if(earlier->file == op->file && earlier->state == ASYNC_FLUSHING && (int32_t)(earlier->sequence - sequence) > 0) {
+            sequence = earlier->sequence;
+        }
+    }
+    return sequence;
+}
+
+/**
+ * 完成一个命令已全部完成的操作并调用回调
+ * 回调可能提交新的操作或释放op, 先出队再回调
+ * @return 1:完成了一个操作, 0:没有可完成的操作
+ * */
+static uint8_t async_retire() {
+    AsyncOp *op = async_first, *prev = NULL;
+    while(op != NULL && (op->state != ASYNC_FLUSHING || (int32_t)(op->sequence - disk_async_completed()) > 0)) {
+        prev = op;
+        op = op->next;
+    }
+    if(op == NULL) {
+        return 0;
+    }
+    if(prev) {
+        prev->next = op->next;
+    }else {
+        async_first = op->next;
+    }
+    if(async_last == op) {
+        async_last = prev;
+    }
+    op->state = ASYNC_DONE;
+    if(op->callback) {
+        op->callback(op);
+    }
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef __ASYNC_H__
+#define __ASYNC_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 异步操作种类
+#define ASYNC_WRITE 0x00
+#define ASYNC_APPEND 0x01
+#define ASYNC_FINISH 0x02
+#define ASYNC_PWRITE 0x03
+#define ASYNC_TRUNCATE 0x04
+#define ASYNC_DELETE 0x05
+// 回收(spifs_gc), 每一步回收一个文件索引扇区, file为NULL
+#define ASYNC_GC 0x06
+// 碎片整理(spifs_defrag), 每一步最多搬移size个簇, 直至整理完成; file为NULL时整理整个卷(完成后须重新打开文件)
+#define ASYNC_DEFRAG 0x07
+
+// 优先级类别
+// 前台: 提交后即执行, 先于后台操作
+#define ASYNC_FOREGROUND 0x00
+// 后台: 没有等待执行的前台操作且命令队列全部完成时才执行一步, 步骤之间让出给前台操作
+#define ASYNC_BACKGROUND 0x01
+
+// 异步操作状态
+// 等待执行
+#define ASYNC_PENDING 0x00
+// 已执行, 等待闪存命令完成
+#define ASYNC_FLUSHING 0x01
+// 已完成(回调已调用)
+#define ASYNC_DONE 0x02
+
+// 异步操作, 提交后到完成回调之前须保持有效
+typedef struct async_op {
+    uint8_t kind;        // 操作种类, 见ASYNC_WRITE等
+    uint8_t state;      // 操作状态, 由spifs_async_submit/poll更新
+    Result result;     // 操作结果, ASYNC_DELETE/ASYNC_GC/ASYNC_DEFRAG固定为WRITE_FILE_SUCCESS
+    File *file;       // 文件指针
+    uint8_t *buffer; // 写入数据, 进入ASYNC_FLUSHING后不再访问
+    uint32_t offset; // ASYNC_PWRITE的偏移, ASYNC_TRUNCATE的新文件大小, ASYNC_GC/ASYNC_DEFRAG已完成的步数
+    uint32_t size;   // 写入字节数, ASYNC_DEFRAG每一步的簇数
+    uint32_t sequence; // 最后一条闪存命令的序号(内部使用)
+    void (*callback)(struct async_op *op); // 完成回调, 可为NULL, 回调内可提交新的操作
+    void *context;   // 回调参数
+    uint8_t priority;  // 优先级类别, 见ASYNC_FOREGROUND等
+    uint32_t deadline; // 截止时刻(w25q32_clock, us), 同类别中先执行截止时刻早的操作, 后台操作超过截止时刻后按前台执行; 0表示无
+    struct async_op *next;
+} AsyncOp;
+
+uint8_t spifs_async(uint32_t commands);
+void spifs_async_submit(AsyncOp *op);
+uint8_t spifs_async_poll();
+void spifs_async_wait(AsyncOp *op);
+uint8_t spifs_async_yield();
+
+// 文件系统内部接口
+void async_discard();
+
+#endif // __ASYNC_H__
@@ -0,0 +1,295 @@
+#include "batch.h"
+
+/**
+ * 索引批处理(组提交)
+ * 批处理期间索引扇区(根目录索引扇区与目录表扇区)的修改暂存于内存镜像, 读取时叠加镜像内容,
+ * 提交时每个扇区只写一次: 修改只需将1写为0时按页编程变化的部分, 否则经影子扇区重写一次;
+ * 索引修改对应的日志记录推迟到提交后才标记完成, 提交前掉电由挂载时的日志重放回滚(新分配的簇被释放, 追加写被回滚)
+ * 擦除数据扇区或经影子扇区重写未暂存的扇区前先提交, 保证存储器上的索引不引用已擦除的数据
+ * */
+
+// 推迟的记录、环形文件的状态记录(每个缓存项一条, 丢弃首簇时多一条)、一次操作的嵌套记录与扇区重写须能同时进行中
+#if (BATCH_DEFER_MAX + RING_CACHE_SUM + 1 + JOURNAL_NEST_MAX + 1) > JOURNAL_PENDING_MAX
+#error "JOURNAL_PENDING_MAX is too small for BATCH_DEFER_MAX"
+#endif
+
+// 暂存的索引扇区
+typedef struct batch_sector {
+    uint32_t sector;  // 扇区地址, FFFFFFFF表示空闲
+    uint8_t *data;   // 扇区镜像
+} BatchSector;
+
+static uint8_t batch_active = 0;
+// 提交中, 此时写入直接落盘且不推迟日志记录
+static uint8_t batch_flushing = 0;
+static uint8_t *batch_data = NULL;
+static BatchSector held[BATCH_SECTOR_MAX];
+static uint32_t deferred[BATCH_DEFER_MAX];
+static uint32_t deferred_count = 0;
+// 本次批处理写入的索引扇区数
+static uint32_t written = 0;
+
+static BatchSector *batch_lookup(uint32_t sector);
+static void batch_flush();
+static uint8_t batch_store(uint32_t sector, uint8_t *image, uint8_t *sector_buffer);
+
+/**
+ * 开始批处理, 之后的create_file/write_file/append_finish/delete_file等操作的索引修改暂存于内存
+ * 内存不足时不开启批处理, 各操作照常直接写入
+ * */
+void spifs_batch_begin() {
+    if(batch_active) {
+        return;
+    }
+    batch_data = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE * BATCH_SECTOR_MAX);
+    if(batch_data == NULL) {
+        return;
+    }
+    for(uint32_t i = 0; i < BATCH_SECTOR_MAX; i++) {
+        held[i].sector = 0xFFFFFFFF;
+        held[i].data = batch_data + i * SECTOR_SIZE;
+    }
+    deferred_count = 0;
+    written = 0;
+    batch_active = 1;
+}
+
+/**
+ * 提交批处理, 写入暂存的索引扇区并结束批处理
+ * @return 批处理期间写入(编程或重写)的索引扇区数
+ * */
+uint32_t spifs_batch_commit() {
+    uint32_t count;
+    if(!batch_active) {
+        return 0;
+    }
+    batch_flush();
+    batch_active = 0;
+    free(batch_data);
+    batch_data = NULL;
+    count = written;
+    written = 0;
+    return count;
+}
+
+/**
+ * 丢弃未提交的批处理, 挂载时调用(掉电后内存中的镜像已失效)
+ * */
+void batch_discard() {
+    if(!batch_active) {
+        return;
+    }
+    batch_active = 0;
+    deferred_count = 0;
+    written = 0;
+    free(batch_data);
+    batch_data = NULL;
+}
+
+/**
+ * 暂存地址所在的索引扇区, 由写索引记录的操作调用, 未开启批处理时忽略
+ * 暂存扇区已满时先提交
+ * @param address 索引扇区内的地址
+ * */
+void batch_hold(uint32_t address) {
+    uint32_t sector = address - (address % SECTOR_SIZE);
+    BatchSector *entry;
+    if(!batch_active || batch_flushing || batch_lookup(sector)) {
+        return;
+    }
+    entry = batch_lookup(0xFFFFFFFF);
+    if(entry == NULL) {
+        batch_flush();
+        entry = &held[0];
+    }
+    disk_read(sector, entry->data, SECTOR_SIZE);
+    entry->sector = sector;
+}
+
+/**
+ * 读取时叠加暂存扇区的内容
+ * @param address 地址
+ * @param buffer 已从存储器读取的数据
+ * @param size 读取大小(字节)
+ * */
+void batch_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint32_t start, end;
+    if(!batch_active) {
+        return;
+    }
+    for(uint32_t i = 0; i < BATCH_SECTOR_MAX; i++) {
+        if(held[i].sector == 0xFFFFFFFF) {
+            continue;
+        }
+        start = (address > held[i].sector) ? address : held[i].sector;
+        end = ((address + size) < (held[i].sector + SECTOR_SIZE)) ? (address + size) : (held[i].sector + SECTOR_SIZE);
+        if(start < end) {
+            bulk_copy((buffer + start - address), (held[i].data + start - held[i].sector), (end - start));
+        }
+    }
+}
+
+/**
+ * 编程暂存的扇区时写入镜像, 按NOR闪存编程的规则与原内容按位与
+ * @param address 地址(不跨扇区)
+ * @param buffer 编程数据
+ * @param size 字节数
+ * @return 1:已写入镜像, 0:地址不在暂存扇区内
+ * */
+uint8_t batch_write(uint32_t address, uint8_t *buffer, uint32_t size) {
+    BatchSector *entry;
+    uint8_t *data;
+    if(!batch_active) {
+        return 0;
+    }
+    entry = batch_lookup(address - (address % SECTOR_SIZE));
+    if(entry == NULL) {
+        return 0;
+    }
+    data = entry->data + (address % SECTOR_SIZE);
+    for(uint32_t i = 0; i < size; i++) {
+        *(data + i) &= *(buffer + i);
+    }
+    return 1;
+}
+
+/**
+ * 擦除扇区前调用, 擦除日志扇区与影子扇区以外的扇区前先提交
+ * @param address 扇区首地址
+ * */
+void batch_erase(uint32_t address) {
+    uint32_t sector = address / SECTOR_SIZE;
+    if(!batch_active || batch_flushing || sector >= JOURNAL_SECTOR_INIT) {
+        return;
+    }
+    batch_flush();
+}
+
+/**
+ * 重写扇区, 暂存的扇区替换镜像, 其他扇区先提交再由调用者经影子扇区重写
+ * @param address 扇区首地址
+ * @param buffer 新扇区内容
+ * @return 1:已替换镜像, 0:需要重写存储器
+ * */
+uint8_t batch_rewrite(uint32_t address, uint8_t *buffer) {
+    BatchSector *entry;
+    if(!batch_active || batch_flushing) {
+        return 0;
+    }
+    entry = batch_lookup(address);
+    if(entry == NULL) {
+        batch_flush();
+        return 0;
+    }
+    bulk_copy(entry->data, buffer, SECTOR_SIZE);
+    return 1;
+}
+
+/**
+ * 推迟标记日志记录完成, 提交后再标记
+ * 推迟的记录仍占用日志记录表, 与追加写会话等其他进行中的记录共用, 剩余位置不足一次操作的嵌套层数时先提交
+ * @param handle 记录句柄
+ * @return 1:已推迟, 0:应立即标记
+ * */
+uint8_t batch_defer(uint32_t handle) {
+    if(!batch_active || batch_flushing || handle >= JOURNAL_PENDING_MAX) {
+        return 0;
+    }
+    deferred[deferred_count++] = handle;
+    if(deferred_count >= BATCH_DEFER_MAX || journal_room() < JOURNAL_NEST_MAX) {
+        batch_flush();
+    }
+    return 1;
+}
+
+static BatchSector *batch_lookup(uint32_t sector) {
+    for(uint32_t i = 0; i < BATCH_SECTOR_MAX; i++) {
+        if(held[i].sector == sector) {
+            return &held[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 写入全部暂存扇区后标记推迟的日志记录完成, 批处理继续
+ * */
+static void batch_flush() {
+    uint32_t sector;
+    uint8_t *sector_buffer = NULL;
+
+    batch_flushing = 1;
+    for(uint32_t i = 0; i < BATCH_SECTOR_MAX; i++) {
+        if(held[i].sector == 0xFFFFFFFF) {
+            continue;
+        }
+        if(sector_buffer == NULL) {
+            sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+        }
+        sector = held[i].sector;
+        held[i].sector = 0xFFFFFFFF;
+        written += batch_store(sector, held[i].data, sector_buffer);
+    }
+    free(sector_buffer);
+    for(uint32_t i = 0; i < deferred_count; i++) {
+        journal_end(deferred[i]);
+    }
+    deferred_count = 0;
+    batch_flushing = 0;
+}
+
+/**
+ * 写入一个暂存扇区
+ * 只需将1写为0时先写内联数据槽位(与未暂存时相同, 数据先于引用它的索引记录写入),
+ * 再每页编程一次(首个至最后一个变化的字节), 否则经影子扇区重写
+ * @param sector 扇区地址
+ * @param image 扇区镜像
+ * @param sector_buffer 扇区缓冲区(4096字节)
+ * @return 1:已写入, 0:内容未变化
+ * */
+static uint8_t batch_store(uint32_t sector, uint8_t *image, uint8_t *sector_buffer) {
+    uint32_t first, last, offset;
+    uint32_t base = (sector < FB_SECTOR_END * SECTOR_SIZE) ? 0 : DIR_HEADER_SIZE;
+    disk_read(sector, sector_buffer, SECTOR_SIZE);
+    if(bulk_equal(sector_buffer, image, SECTOR_SIZE)) {
+        return 0;
+    }
+    for(uint32_t i = 0; i < SECTOR_SIZE; i++) {
+        if((*(sector_buffer + i) & *(image + i)) != *(image + i)) {
+            journal_rewrite_sector(sector, image);
+            return 1;
+        }
+    }
+    // 连续的内联数据槽位合并写入
+    first = 0xFFFFFFFF;
+    for(offset = base; (offset + FILEBLOCK_SIZE) <= SECTOR_SIZE; offset += FILEBLOCK_SIZE) {
+        if(fileblock_continuation((FileBlock *)(image + offset))
+           && !bulk_equal((sector_buffer + offset), (image + offset), FILEBLOCK_SIZE)) {
+            first = (first == 0xFFFFFFFF) ? offset : first;
+            continue;
+        }
+        if(first != 0xFFFFFFFF) {
+            disk_write((sector + first), (image + first), (offset - first));
+            bulk_copy((sector_buffer + first), (image + first), (offset - first));
+            first = 0xFFFFFFFF;
+        }
+    }
+    if(first != 0xFFFFFFFF) {
+        disk_write((sector + first), (image + first), (offset - first));
+        bulk_copy((sector_buffer + first), (image + first), (offset - first));
+    }
+    for(uint32_t page = 0; page < SECTOR_SIZE; page += PAGE_SIZE) {
+        first = PAGE_SIZE;
+        last = 0;
+        for(uint32_t i = 0; i < PAGE_SIZE; i++) {
+            if(*(sector_buffer + page + i) != *(image + page + i)) {
+                first = (first == PAGE_SIZE) ? i : first;
+                last = i;
+            }
+        }
+        if(first != PAGE_SIZE) {
+            disk_write((sector + page + first), (image + page + first), (last - first + 1));
+        }
+    }
+    return 1;
+}
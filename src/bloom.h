@@ -0,0 +1,29 @@
+#ifndef __BLOOM_H__
+#define __BLOOM_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+// 根目录文件名过滤器统计
+typedef struct bloom_stats {
+    uint32_t queries;          // 经过过滤器的open_file次数
+    uint32_t rejected;        // 过滤器判定不存在, 未访问存储器的次数
+    uint32_t false_positives; // 过滤器判定可能存在但扫描未找到的次数
+} BloomStats;
+
+// 根目录索引槽位总数, 用于按容量选择哈希函数个数
+#define BLOOM_SLOT_SUM (FB_SECTOR_END * (SECTOR_SIZE / FILEBLOCK_SIZE))
+// 哈希函数最大个数
+#define BLOOM_HASH_MAX 8
+
+uint8_t spifs_bloom(uint32_t bytes);
+void spifs_bloom_stats(BloomStats *stats);
+
+// 文件系统内部接口
+void bloom_build();
+void bloom_invalidate();
+void bloom_insert(uint8_t *name);
+uint8_t bloom_contains(uint8_t *name);
+void bloom_miss();
+
+#endif // __BLOOM_H__
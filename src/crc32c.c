@@ -0,0 +1,95 @@
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define CRC32C_HW 1
+#endif
+
+/**
+ * CRC-32C(Castagnoli), 多项式0x82F63B78(反射)
+ * 软件实现为slice-by-8, 每次处理8字节, 查找表8KB在首次调用时生成
+ * x86主机构建在运行时检测SSE4.2, 支持时使用crc32指令
+ * */
+
+static uint32_t crc_table[8][256];
+static uint8_t table_ready = 0;
+
+static void crc32c_init_table() {
+    uint32_t crc;
+    for(uint32_t i = 0; i < 256; i++) {
+        crc = i;
+        for(uint8_t j = 0; j < 8; j++) {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+        }
+        crc_table[0][i] = crc;
+    }
+    for(uint32_t i = 0; i < 256; i++) {
+        for(uint32_t k = 1; k < 8; k++) {
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xFF];
+        }
+    }
+    table_ready = 1;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, uint8_t *data, uint32_t size) {
+    uint32_t low, high;
+    if(!table_ready) {
+        crc32c_init_table();
+    }
+    while(size >= 8) {
+        // 按小端拼接, 与逐字节处理顺序一致
+        low = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        high = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+        crc = crc_table[7][low & 0xFF] ^ crc_table[6][(low >> 8) & 0xFF]
+              ^ crc_table[5][(low >> 16) & 0xFF] ^ crc_table[4][low >> 24]
+              ^ crc_table[3][high & 0xFF] ^ crc_table[2][(high >> 8) & 0xFF]
+              ^ crc_table[1][(high >> 16) & 0xFF] ^ crc_table[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while(size--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HW
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, uint8_t *data, uint32_t size) {
+#if defined(__x86_64__)
+    uint64_t value, crc64 = crc;
+    while(size >= 8) {
+        memcpy(&value, data, 8);
+        crc64 = _mm_crc32_u64(crc64, value);
+        data += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+#endif
+    while(size--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * 计算CRC-32C
+ * @param crc 上一段数据的校验值, 首段为0
+ * @param *data 数据
+ * @param size 数据大小(字节)
+ * @return 校验值
+ * */
+uint32_t crc32c(uint32_t crc, uint8_t *data, uint32_t size) {
+#ifdef CRC32C_HW
+    static int8_t hardware = -1;
+    if(hardware < 0) {
+        hardware = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    }
+    if(hardware) {
+        return ~crc32c_hw(~crc, data, size);
+    }
+#endif
+    return ~crc32c_sw(~crc, data, size);
+}
@@ -0,0 +1,9 @@
+#ifndef __DEFRAG_H__
+#define __DEFRAG_H__
+
+#include "stdint.h"
+#include "spifs.h"
+
+uint32_t spifs_defrag(File *file, uint32_t budget);
+
+#endif // __DEFRAG_H__
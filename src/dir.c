@@ -0,0 +1,369 @@
+#include "dir.h"
+
+/**
+ * 目录表扇区大小 = 扇区大小 = 4KB
+ * 目录表: 表头16字节, 之后为170个文件索引槽位(24字节)
+ * 槽位以文件名+拓展名的哈希值为起点线性探测, 查找代价只与目录大小有关
+ * 目录表写满后追加新的目录表扇区, 通过表头next字段链接
+ * */
+
+static uint32_t hash_filename(uint8_t *name);
+static uint32_t dir_table_alloc(uint32_t parent, uint32_t ref);
+static uint32_t dir_lookup(uint32_t table, uint8_t *name, FileBlock *fb);
+static uint32_t dir_insert(uint32_t table, FileBlock *fb);
+
+/**
+ * 创建目录
+ * @param *dir 目录指针, 使用make_file创建, 拓展名可为空
+ * @param *parent 父目录指针, NULL表示根目录
+ * @param fstate 文件状态字
+ * */
+Result create_dir(File *dir, File *parent, FileState fstate) {
+    Result result;
+    uint32_t table;
+
+    fstate.state &= ~FSTATE_DIRECTORY;
+    result = create_file_at(parent, dir, fstate);
+    if(result != CREATE_FILEBLOCK_SUCCESS) {
+        return result;
+    }
+    // 首簇地址为空的索引项会在垃圾回收时被清除
+    write_fileblock_length(dir->block, 0);
+    table = dir_table_alloc(dir->block, (dir->block + 12));
+    if(table == 0xFFFFFFFF) {
+        return NO_SECTOR_SPACE;
+    }
+
+    dir->cluster = table;
+    dir->length = 0;
+    return CREATE_DIR_SUCCESS;
+}
+
+/**
+ * 在目录下创建文件
+ * @param *dir 目录指针, NULL表示根目录
+ * @param *file 文件指针
+ * @param fstate 文件状态字
+ * */
+Result create_file_at(File *dir, File *file, FileState fstate) {
+    FileBlock fb;
+    uint32_t slot;
+
+    if(dir == NULL) {
+        return create_file(file, fstate);
+    }
+    if((FILE_FLAGS(dir->state) & FSTATE_DIRECTORY) || !cluster_inuse(dir->cluster)) {
+        return FILE_UNALLOCATED;
+    }
+    if(dir_lookup(dir->cluster, file->filename, &fb) != 0xFFFFFFFF) {
+        return FILE_ALREADY_EXISTS;
+    }
+
+    array_fill((uint8_t *)&fb, 0xFF, FILEBLOCK_SIZE);
+    array_copy(file->filename, fb.filename, 8);
+    array_copy(file->extname, fb.extname, 4);
+    fstate.state &= ~FSTATE_PROBE;
+    fb.state = *(uint32_t *)&fstate;
+
+    slot = dir_insert(dir->cluster, &fb);
+    if(slot == 0xFFFFFFFF) {
+        return NO_FILEBLOCK_SPACE;
+    }
+
+    file->block = slot;
+    file->cluster = fb.cluster;
+    file->length = fb.length;
+    file->state = fb.state;
+    return CREATE_FILEBLOCK_SUCCESS;
+}
+
+/**
+ * 根据文件名+拓展名打开目录下的文件
+ * @param *dir 目录指针, NULL表示根目录
+ * @param *file 文件指针
+ * @param filename 文件名
+ * @param extname 拓展名
+ * @return 0:未找到该文件, 1:成功获取文件
+ * */
+uint8_t open_file_at(File *dir, File *file, char *filename, char *extname) {
+    FileBlock fb;
+    uint32_t slot;
+
+    if(dir == NULL) {
+        return open_file(file, filename, extname);
+    }
+    if((FILE_FLAGS(dir->state) & FSTATE_DIRECTORY) || !cluster_inuse(dir->cluster)) {
+        return 0;
+    }
+
+    make_file(file, filename, extname);
+    slot = dir_lookup(dir->cluster, file->filename, &fb);
+    if(slot == 0xFFFFFFFF) {
+        return 0;
+    }
+    file->block = slot;
+    file->cluster = fb.cluster;
+    file->length = fb.length;
+    file->state = fb.state;
+    ring_resolve(file->block, &file->cluster, &file->length);
+    return 1;
+}
+
+/**
+ * 返回目录下的文件列表, 仅访问该目录自身的目录表
+ * 使用完毕务必调用recycle_filelist()释放文件
+ * @param *dir 目录指针, NULL表示根目录
+ * */
+FileList *list_dir(File *dir) {
+    FileBlock fb;
+    FileList *index = NULL;
+    uint32_t table, addr_start, addr_end;
+
+    if(dir == NULL) {
+        return list_file();
+    }
+    if(FILE_FLAGS(dir->state) & FSTATE_DIRECTORY) {
+        return NULL;
+    }
+
+    table = dir->cluster;
+    while(cluster_inuse(table)) {
+        addr_start = table + DIR_HEADER_SIZE;
+        addr_end = table + SECTOR_SIZE;
+        while(addr_end - addr_start >= FILEBLOCK_SIZE) {
+            disk_read(addr_start, (uint8_t *)&fb, FILEBLOCK_SIZE);
+            if(!fileblock_empty(&fb) && !fileblock_continuation(&fb) && (fb.length != 0xFFFFFFFF)) {
+                FileList *item = (FileList *)malloc(sizeof(FileList));
+                array_copy(fb.filename, item->File.filename, 8);
+                array_copy(fb.extname, item->File.extname, 4);
+                item->File.block = addr_start;
+                item->File.cluster = fb.cluster;
+                item->File.length = fb.length;
+                item->File.state = fb.state;
+                ring_resolve(addr_start, &item->File.cluster, &item->File.length);
+                item->prev = index;
+                index = item;
+            }
+            addr_start += FILEBLOCK_SIZE;
+        }
+        disk_read(table + 4, (uint8_t *)&table, 4);
+    }
+    return index;
+}
+
+/**
+ * 目录垃圾回收
+ * 擦除被删除文件的数据扇区, 其槽位改写为墓碑(文件名为空, 保留FSTATE_PROBE标记)
+ * 墓碑槽位可被新文件复用, 同时不打断其他文件的探测链, 存活文件的索引地址保持不变
+ * 不属于存活内联文件的数据槽位同样改写为墓碑
+ * @param table 首个目录表扇区地址
+ * @param reclaim 1:目录已被删除, 回收全部文件并逆序擦除目录表扇区
+ * */
+void dir_gc(uint32_t table, uint8_t reclaim) {
+    uint32_t count = 0, *tables;
+
+    if(reclaim == 0) {
+        while(cluster_inuse(table)) {
+            table = dir_gc_table(table, 0);
+        }
+        return;
+    }
+    tables = (uint32_t *)malloc(sizeof(uint32_t) * (DATA_SECTOR_END - FB_SECTOR_END));
+    while(cluster_inuse(table) && count < (DATA_SECTOR_END - FB_SECTOR_END)) {
+        *(tables + count) = table;
+        count++;
+        table = dir_gc_table(table, 1);
+    }
+    // 首个目录表最后擦除, 掉电后重新回收仍可找到剩余目录表
+    while(count) {
+        count--;
+        cluster_erase(*(tables + count));
+    }
+    free(tables);
+}
+
+/**
+ * 回收单个目录表扇区
+ * @param table 目录表扇区地址
+ * @param reclaim 1:回收全部文件, 目录表扇区由调用者擦除
+ * @return 下一目录表扇区地址
+ * */
+uint32_t dir_gc_table(uint32_t table, uint8_t reclaim) {
+    FileBlock *fb;
+    uint8_t rewrite = 0, flags;
+    uint32_t offset, next, handle = 0xFFFFFFFF;
+    uint8_t live[DIR_SLOT_SUM];
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+
+    disk_read(table, sector_buffer, SECTOR_SIZE);
+    next = ((DirHeader *)sector_buffer)->next;
+    inline_mark(sector_buffer, DIR_HEADER_SIZE, live);
+
+    for(offset = DIR_HEADER_SIZE; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+        fb = (FileBlock *)(sector_buffer + offset);
+        if(fileblock_empty(fb)) {
+            continue;
+        }
+        if(fileblock_continuation(fb)) {
+            if(reclaim == 0 && live[(offset - DIR_HEADER_SIZE) / FILEBLOCK_SIZE] == 0) {
+                if(handle == 0xFFFFFFFF) {
+                    handle = journal_begin(JOURNAL_GC, table, 1, 0);
+                }
+                clear_fileblock(sector_buffer, offset);
+                *(sector_buffer + offset + FILEBLOCK_SIZE - 1) = (uint8_t)~FSTATE_PROBE;
+                rewrite = 1;
+            }
+            continue;
+        }
+        flags = FILE_FLAGS(fb->state);
+        if(reclaim || ((flags & FSTATE_DELETED) == 0) || (fb->cluster == 0xFFFFFFFF)) {
+            // 文件被删除或创建后未填充数据
+            if(reclaim == 0 && handle == 0xFFFFFFFF) {
+                handle = journal_begin(JOURNAL_GC, table, 1, 0);
+            }
+            if(fb->cluster != 0xFFFFFFFF) {
+                if((flags & FSTATE_DIRECTORY) == 0) {
+                    dir_gc(fb->cluster, 1);
+                }else {
+                    erase_cluster_chain(fb->cluster);
+                }
+            }
+            clear_fileblock(sector_buffer, offset);
+            *(sector_buffer + offset + FILEBLOCK_SIZE - 1) = (uint8_t)~FSTATE_PROBE;
+            rewrite = 1;
+        }else if((flags & FSTATE_DIRECTORY) == 0) {
+            dir_gc(fb->cluster, 0);
+        }
+    }
+
+    if(reclaim == 0 && rewrite) {
+        journal_rewrite_sector(table, sector_buffer);
+    }
+    journal_end(handle);
+    free(sector_buffer);
+    return next;
+}
+
+/**
+ * 文件名+拓展名(12字节)哈希, FNV-1a
+ * */
+static uint32_t hash_filename(uint8_t *name) {
+    uint32_t hash = 2166136261u;
+    for(uint32_t i = 0; i < FILENAME_FULLSIZE; i++) {
+        hash ^= *(name + i);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * 分配并初始化目录表扇区, 将扇区地址写入引用字段
+ * 写入引用字段前掉电, 挂载时擦除该扇区
+ * @param parent 父目录索引记录地址
+ * @param ref 引用字段地址(目录索引记录首簇地址或上一目录表的next字段)
+ * @return 目录表扇区地址, FFFFFFFF表示空间不足
+ * */
+static uint32_t dir_table_alloc(uint32_t parent, uint32_t ref) {
+    DirHeader header;
+    uint32_t table, handle;
+
+    if(find_free_sectors(&table, 1) != 1) {
+        return 0xFFFFFFFF;
+    }
+    handle = journal_begin(JOURNAL_ALLOC_LINK, ref, table, 0);
+    header.state = 0xFF00;
+    header.magic = DIR_MAGIC;
+    header.next = 0xFFFFFFFF;
+    header.parent = parent;
+    header.reserved = 0xFFFFFFFF;
+    statfs_table(table);
+    // 表头的state字段即占用标记
+    cluster_mark(table);
+    disk_write((table + SECTOR_STATE_SIZE), ((uint8_t *)&header + SECTOR_STATE_SIZE), (DIR_HEADER_SIZE - SECTOR_STATE_SIZE));
+    write_value(ref, table, 4);
+    journal_end(handle);
+    return table;
+}
+
+/**
+ * 在目录表中查找文件
+ * 探测到从未被占用的槽位即可结束当前目录表: 新文件只有在当前表已满时才会写入下一目录表
+ * @param table 首个目录表扇区地址
+ * @param *name 文件名+拓展名(12字节, 不足部分填充0xFF)
+ * @param *fb 输出文件索引记录
+ * @return 文件索引记录地址, FFFFFFFF表示未找到
+ * */
+static uint32_t dir_lookup(uint32_t table, uint8_t *name, FileBlock *fb) {
+    uint32_t home = hash_filename(name) % DIR_SLOT_SUM;
+    uint32_t addr, flags;
+
+    while(cluster_inuse(table)) {
+        for(uint32_t i = 0; i < DIR_SLOT_SUM; i++) {
+            addr = table + DIR_HEADER_SIZE + ((home + i) % DIR_SLOT_SUM) * FILEBLOCK_SIZE;
+            disk_read(addr, (uint8_t *)fb, FILEBLOCK_SIZE);
+            flags = FILE_FLAGS(fb->state);
+            if(fileblock_empty(fb)) {
+                if(flags & FSTATE_PROBE) {
+                    return 0xFFFFFFFF;
+                }
+                continue;
+            }
+            if((flags & FSTATE_DELETED) && array_equal(fb->filename, name, FILENAME_FULLSIZE)) {
+                return addr;
+            }
+        }
+        disk_read(table + 4, (uint8_t *)&table, 4);
+    }
+    return 0xFFFFFFFF;
+}
+
+/**
+ * 在目录表中插入文件索引记录, 目录表已满时链接新的目录表扇区
+ * @param table 首个目录表扇区地址
+ * @param *fb 文件索引记录
+ * @return 文件索引记录地址, FFFFFFFF表示空间不足
+ * */
+static uint32_t dir_insert(uint32_t table, FileBlock *fb) {
+    FileBlock slot;
+    uint32_t home = hash_filename(fb->filename) % DIR_SLOT_SUM;
+    uint32_t addr, next, parent;
+
+    while(1) {
+        for(uint32_t i = 0; i < DIR_SLOT_SUM; i++) {
+            addr = table + DIR_HEADER_SIZE + ((home + i) % DIR_SLOT_SUM) * FILEBLOCK_SIZE;
+            disk_read(addr, (uint8_t *)&slot, FILEBLOCK_SIZE);
+            if(fileblock_empty(&slot)) {
+                write_fileblock(addr, fb);
+                return addr;
+            }
+        }
+        disk_read(table + 4, (uint8_t *)&next, 4);
+        if(next == 0xFFFFFFFF) {
+            disk_read(table + 8, (uint8_t *)&parent, 4);
+            next = dir_table_alloc(parent, (table + 4));
+            if(next == 0xFFFFFFFF) {
+                return 0xFFFFFFFF;
+            }
+        }
+        table = next;
+    }
+}
+
+/**
+ * 校验目录下的全部文件
+ * @param table 首个目录表扇区地址
+ * @param *report 校验结果
+ * */
+void dir_scrub(uint32_t table, ScrubReport *report) {
+    uint32_t offset;
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+
+    while(cluster_inuse(table)) {
+        disk_read(table, sector_buffer, SECTOR_SIZE);
+        for(offset = DIR_HEADER_SIZE; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+            scrub_fileblock((FileBlock *)(sector_buffer + offset), (table + offset), report);
+        }
+        table = ((DirHeader *)sector_buffer)->next;
+    }
+    free(sector_buffer);
+}
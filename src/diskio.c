@@ -1,5 +1,475 @@
 #include "diskio.h"
 
+// Ŀ
+typedef struct cache_entry {
+    uint32_t sector;  // ַ, 0xFFFFFFFFʾ
+    uint32_t tick;   // (LRU)
+    uint8_t ahead;  // 1: Ԥδ
+    uint8_t *data;
+} CacheEntry;
+
+// δֱӶȡ
+typedef struct cache_ghost {
+    uint32_t sector;  // ַ, 0xFFFFFFFFʾ
+    uint32_t cost;   // ۼƶȡ(ֽ)
+} CacheGhost;
+
+// Ŷӵ
+typedef struct disk_command {
+    uint32_t address;         // ַ
+    uint32_t size;           // ֽ, 0ʾ
+    uint8_t data[PAGE_SIZE];
+} DiskCommand;
+
+// ˮ߶
+typedef struct pipeline_window {
+    uint32_t address;    // ʼַ, 0xFFFFFFFFʾ
+    uint32_t size;      // ֽ, 
+    uint8_t prefetched; // 1: Ԥδ
+    uint8_t *data;
+} PipelineWindow;
+
+// һصַڵƫ, ӱʽûһصַ, ʶش˳ȡ
+#ifdef SPIFS_LINK_TABLE
+#define CACHE_LINK_OFFSET SECTOR_SIZE
+#else
+#define CACHE_LINK_OFFSET (SECTOR_STATE_SIZE + DATA_AREA_SIZE)
+#endif
+// ÿζȡַָ(ֽ)
+#define CACHE_COMMAND_COST 4
+
+static CacheEntry *cache_entries = NULL;
+static uint8_t *cache_data = NULL;
+static uint32_t cache_sum = 0;
+static uint32_t cache_tick = 0;
+// δδ, ۼֱӶȡ۴ﵽĴʱ
+static CacheGhost *cache_ghost = NULL;
+static uint32_t cache_ghost_index = 0;
+// һη, һζȡһصֶַ(ֵ), ʶش˳ȡ
+static uint32_t cache_data_last = 0xFFFFFFFF;
+static uint32_t cache_link_from = 0xFFFFFFFF;
+static uint32_t cache_link_to = 0xFFFFFFFF;
+static DiskCacheStats cache_stats;
+// 豸, stripe_sumΪ0ʱʹw25q32ģ
+static DiskDevice *stripe_devices = NULL;
+static uint32_t stripe_sum = 0;
+// صıȴ
+static uint8_t stripe_overlap = 0;
+// 첽(), async_sumΪ0ʱִͬ
+static DiskCommand *async_queue = NULL;
+static uint32_t async_sum = 0;
+static uint32_t async_head = 0;
+static uint32_t async_count = 0;
+// : Ŷ, ѷ, ɵһ
+static uint32_t async_tail = 0;
+static uint32_t async_issued = 0;
+static uint32_t async_done = 0;
+static DiskAsyncStats async_stats;
+// ȡռ: ʱȼȡ, ι֮ٽsuspend_progress(us), 0ر
+static uint32_t suspend_progress = 0;
+static uint8_t suspend_priority = 1;
+// 󷢳Ĳ, ̺Ϊ0xFFFFFFFF; ϴλָʱ
+static uint32_t suspend_erase = 0xFFFFFFFF;
+static uint32_t suspend_resumed = 0;
+static DiskSuspendStats suspend_stats;
+// 1: ˮ߶дǰ豸(w25q32ģDMA豸)
+static uint8_t pipeline_enabled = 0;
+// ҳݴʹ, һҳڼݴһҳ
+static uint8_t *pipeline_stage = NULL;
+static uint32_t pipeline_stage_index = 0;
+// (һ)ʹ, ȡһڼԤһεһ
+static PipelineWindow pipeline_windows[2] = {{0xFFFFFFFF, 0, 0, NULL}, {0xFFFFFFFF, 0, 0, NULL}};
+static uint8_t *pipeline_window_data = NULL;
+static uint32_t pipeline_current = 0;
+// Ķ, ȡǰʹ
+static PipelineWindow *pipeline_inflight = NULL;
+// ϴζȡĽַ, ȡһصֶַεֵ, ʶ˳ȡ
+static uint32_t pipeline_read_end = 0xFFFFFFFF;
+static uint32_t pipeline_link_to = 0xFFFFFFFF;
+#ifdef SPIFS_LINK_TABLE
+// 1: ˳ȡһĩβ뱾
+static uint8_t pipeline_contiguous = 0;
+#endif
+static DiskPipelineStats pipeline_stats;
+
+static uint32_t device_read(uint32_t address, uint8_t *buffer, uint32_t size);
+static void cache_read(uint32_t address, uint8_t *buffer, uint32_t size);
+static CacheEntry *cache_lookup(uint32_t sector);
+static CacheEntry *cache_load(uint32_t sector, uint8_t ahead);
+static uint8_t cache_ghost_charge(uint32_t sector, uint32_t size);
+static uint32_t cache_next(uint32_t link);
+static void cache_readahead(CacheEntry *entry);
+static void cache_program(uint32_t address, uint8_t *buffer, uint32_t size);
+static DiskDevice *stripe_map(uint32_t address, uint32_t *physical);
+static void stripe_wait_all();
+static uint8_t stripe_ordered(uint32_t address);
+static uint8_t device_program(uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t device_erase(uint32_t address);
+static uint8_t async_push(uint32_t address, uint8_t *buffer, uint32_t size);
+static void async_issue();
+static void async_overlay(uint32_t address, uint8_t *buffer, uint32_t size);
+static void suspend_read(uint32_t address, uint32_t size);
+static void suspend_resume();
+static DiskDevice *pipeline_map(uint32_t address, uint32_t *physical);
+static uint8_t pipeline_busy();
+static void pipeline_idle();
+static void pipeline_transfer(uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t pipeline_program(uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t pipeline_erase(uint32_t address);
+static void pipeline_read(uint32_t address, uint8_t *buffer, uint32_t size);
+static PipelineWindow *pipeline_find(uint32_t address);
+static void pipeline_load(PipelineWindow *window, uint32_t address, uint32_t size, uint8_t prefetch);
+static uint32_t pipeline_span(uint32_t address, uint32_t size);
+static void pipeline_prefetch(PipelineWindow *window);
+static void pipeline_drop(uint32_t address, uint32_t size);
+static uint32_t pipeline_link(PipelineWindow *window);
+static uint32_t w25q32_device_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t w25q32_device_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t w25q32_device_sector_erase(void *context, uint32_t address);
+static uint8_t w25q32_device_chip_erase(void *context);
+static void w25q32_device_wait(void *context);
+static uint8_t w25q32_device_busy(void *context);
+
+// w25q32ģDMA豸, ˮδʱʹ
+static DiskDevice pipeline_w25q32 = {
+    NULL, w25q32_device_read, w25q32_device_write_page, w25q32_device_sector_erase,
+    w25q32_device_chip_erase, w25q32_device_wait, w25q32_device_busy
+};
+
+/**
+ * , ʵsectors(LRU), ͳ
+ * δеֻȡֽ, ۼƶȡ۴ﵽȡĴۻش˳ȡʱ;
+ * ˳ȡʱشԤ; ͬ»
+ * @param sectors , 0رջ
+ * @return 1:óɹ, 0:ڴ治(ر)
+ * */
+uint8_t disk_cache(uint32_t sectors) {
+    free(cache_entries);
+    free(cache_data);
+    free(cache_ghost);
+    cache_entries = NULL;
+    cache_data = NULL;
+    cache_ghost = NULL;
+    cache_sum = 0;
+    bulk_fill((uint8_t *)&cache_stats, 0x00, sizeof(DiskCacheStats));
+    if(sectors == 0) {
+        return 1;
+    }
+    cache_entries = (CacheEntry *)malloc(sizeof(CacheEntry) * sectors);
+    cache_data = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE * sectors);
+    cache_ghost = (CacheGhost *)malloc(sizeof(CacheGhost) * sectors);
+    if(cache_entries == NULL || cache_data == NULL || cache_ghost == NULL) {
+        free(cache_entries);
+        free(cache_data);
+        free(cache_ghost);
+        cache_entries = NULL;
+        cache_data = NULL;
+        cache_ghost = NULL;
+        return 0;
+    }
+    for(uint32_t i = 0; i < sectors; i++) {
+        (cache_entries + i)->data = cache_data + i * SECTOR_SIZE;
+    }
+    cache_sum = sectors;
+    disk_cache_invalidate();
+    return 1;
+}
+
+/**
+ * ˮ߶, 洢ƹdiskio޸(, ģ)
+ * */
+void disk_cache_invalidate() {
+    pipeline_drop(0, FLASH_SIZE);
+    pipeline_read_end = 0xFFFFFFFF;
+    pipeline_link_to = 0xFFFFFFFF;
+    for(uint32_t i = 0; i < cache_sum; i++) {
+        (cache_entries + i)->sector = 0xFFFFFFFF;
+        (cache_entries + i)->tick = 0;
+        (cache_entries + i)->ahead = 0;
+        (cache_ghost + i)->sector = 0xFFFFFFFF;
+    }
+    cache_tick = 0;
+    cache_ghost_index = 0;
+    cache_data_last = 0xFFFFFFFF;
+    cache_link_from = 0xFFFFFFFF;
+    cache_link_to = 0xFFFFFFFF;
+}
+
+/**
+ * ȡͳ
+ * @param *stats ͳ
+ * */
+void disk_cache_stats(DiskCacheStats *stats) {
+    *stats = cache_stats;
+}
+
+/**
+ * 첽, ͳ
+ * Ƶк, disk_async_stepʱ˳, д˳ִͬͬ;
+ * ȡʱӶδ, ʱȴһ󷢳
+ * ֻ֧w25q32ģ(δˮ), ֱģ
+ * @param commands г(ÿԼ264ֽ), 0ر; ǰеȫ
+ * @return 1:óɹ, 0:ڴ治, ˮ(йر)
+ * */
+uint8_t disk_async(uint32_t commands) {
+    disk_async_flush();
+    free(async_queue);
+    async_queue = NULL;
+    async_sum = 0;
+    bulk_fill((uint8_t *)&async_stats, 0x00, sizeof(DiskAsyncStats));
+    if(commands == 0) {
+        return 1;
+    }
+    if(stripe_sum != 0 || pipeline_enabled) {
+        return 0;
+    }
+    async_queue = (DiskCommand *)malloc(sizeof(DiskCommand) * commands);
+    if(async_queue == NULL) {
+        return 0;
+    }
+    async_sum = commands;
+    return 1;
+}
+
+/**
+ * ƽ첽, ȴ
+ * ʱ, ѷ, 󷢳
+ * ִļϵͳ, ļϵͳڼʱ(糤ʱļ϶)
+ * @return 1:æµ, 0:ȫ
+ * */
+uint8_t disk_async_step() {
+    suspend_resume();
+    if(w25q32_busy()) {
+        return 1;
+    }
+    async_done = async_issued;
+    if(async_count == 0) {
+        return 0;
+    }
+    async_issue();
+    return 1;
+}
+
+/**
+ * ȴеȫ
+ * */
+void disk_async_flush() {
+    while(disk_async_step()) {
+        w25q32_wait();
+    }
+}
+
+/**
+ * δ, ʱ(Ϊϵ)
+ * */
+void disk_async_discard() {
+    suspend_resume();
+    async_head = 0;
+    async_count = 0;
+    async_issued = async_tail;
+    async_done = async_tail;
+}
+
+/**
+ * һŶ, ÿŶһ1
+ * */
+uint32_t disk_async_queued() {
+    return async_tail;
+}
+
+/**
+ * һ, disk_async_queuedʱȫ
+ * */
+uint32_t disk_async_completed() {
+    return async_done;
+}
+
+/**
+ * ȡ첽ͳ
+ * @param *stats ͳ
+ * */
+void disk_async_stats(DiskAsyncStats *stats) {
+    *stats = async_stats;
+}
+
+/**
+ * öȡռ, ͳ
+ * 첽зʱ, ȼȡ(Erase Suspend)ִ, һdisk_async_step
+ * 򷢳һǰָ; ȡڲʱȴ; ҳԼ0.7ms, 
+ * ָٽprogress_usٴι, ڼ䵽Ķȡȴʱ, ɵĶȡӳٲprogress_usӹӳ
+ * ֻw25q32ģ(δˮ)
+ * @param progress_us ι֮ٽеʱ(us), СW25Q32_SUSPEND_US, 0ر
+ * */
+void disk_suspend(uint32_t progress_us) {
+    suspend_resume();
+    suspend_progress = (progress_us && progress_us < W25Q32_SUSPEND_US) ? W25Q32_SUSPEND_US : progress_us;
+    bulk_fill((uint8_t *)&suspend_stats, 0x00, sizeof(DiskSuspendStats));
+}
+
+/**
+ * ֮ȡȼ, ֻиȼȡ, ̨()ĶȡΪȼ
+ * @param high 1:ȼ(Ĭ), 0:ȼ
+ * @return ԭȼ
+ * */
+uint8_t disk_priority(uint8_t high) {
+    uint8_t previous = suspend_priority;
+    suspend_priority = high;
+    return previous;
+}
+
+/**
+ * ȡȡռͳ
+ * @param *stats ͳ
+ * */
+void disk_suspend_stats(DiskSuspendStats *stats) {
+    bulk_copy((uint8_t *)stats, (uint8_t *)&suspend_stats, sizeof(DiskSuspendStats));
+}
+
+/**
+ * ˮߴ, ͳ
+ * : ҳݸƵݴ֮һ, ȴһҳɼ, ׼һҳ(ѹ, һεַ)
+ * 뱾ҳĴͱص; , ֮Ĳȴ
+ * ȡ: ˳ȡ(ϴζȡĽϴζһؼ)֮һ(PIPELINE_WINDOWֽ, ĩβ),
+ * ֮ڻڵĶȡֱӸ, ͬʱһԤһ; ˳ȡֱӶ߻
+ * صĶ; ݴռ2ҳ + 2ڴ
+ * ǰ豸Ļص: δʱΪw25q32ģDMA(disk_device_w25q32), Ϊ豸;
+ * 豸busyΪNULLʱȡڻصʱ, ֻCPU̺Ͳص; ϵĲ˳
+ * 첽ͬʱʹ, ڹǰ
+ * @param enable 1:, 0:ر(ȵȴеĲ)
+ * @return 1:óɹ, 0:ڴ治첽(ˮ߹ر)
+ * */
+uint8_t disk_pipeline(uint8_t enable) {
+    disk_pipeline_flush();
+    free(pipeline_stage);
+    free(pipeline_window_data);
+    pipeline_stage = NULL;
+    pipeline_window_data = NULL;
+    pipeline_enabled = 0;
+    pipeline_drop(0, FLASH_SIZE);
+    bulk_fill((uint8_t *)&pipeline_stats, 0x00, sizeof(DiskPipelineStats));
+    if(enable == 0) {
+        return 1;
+    }
+    if(async_sum != 0) {
+        return 0;
+    }
+    pipeline_stage = (uint8_t *)malloc(sizeof(uint8_t) * PAGE_SIZE * 2);
+    pipeline_window_data = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE * 2);
+    if(pipeline_stage == NULL || pipeline_window_data == NULL) {
+        free(pipeline_stage);
+        free(pipeline_window_data);
+        pipeline_stage = NULL;
+        pipeline_window_data = NULL;
+        return 0;
+    }
+    for(uint32_t i = 0; i < 2; i++) {
+        pipeline_windows[i].data = pipeline_window_data + i * SECTOR_SIZE;
+    }
+    pipeline_read_end = 0xFFFFFFFF;
+    pipeline_link_to = 0xFFFFFFFF;
+    pipeline_enabled = 1;
+    return 1;
+}
+
+/**
+ * w25q32ģDMA豸, ȡ̾w25q32_dma_read/w25q32_dma_page, ڼæµ
+ * Ϊ豸򱻰װ(ʱ)󴫸disk_stripe
+ * */
+DiskDevice *disk_device_w25q32() {
+    return &pipeline_w25q32;
+}
+
+/**
+ * ȴˮнеĲ
+ * */
+void disk_pipeline_flush() {
+    if(pipeline_enabled) {
+        pipeline_idle();
+    }
+}
+
+/**
+ * ȡˮͳ
+ * @param *stats ͳ
+ * */
+void disk_pipeline_stats(DiskPipelineStats *stats) {
+    *stats = pipeline_stats;
+}
+
+/**
+ * 弶ֵ֧ĶȡʽѡĶȡָ(ǰʱȽ϶ȡһҳʱ), w25q32ģdisk_device_w25q32
+ * ֧ȡʱȡ󱣳CS, ϴνַĶȡ(˳ȡ, Ĵ)ֻ;
+ * ѡQuad I/Oʱͬʱȡģʽ, ֮Ķȡʡָ
+ * 豸ɸԵreadصѡȡָ; ʱ(w25q32_bus)֮
+ * @param supported DISK_READ_*, 0ֻʹRead Data
+ * @return ѡеĶȡָ
+ * */
+uint8_t disk_read_modes(uint8_t supported) {
+    static const uint8_t modes[4][2] = {
+        {DISK_READ_FAST, W25Q32_FAST_READ}, {DISK_READ_DUAL, W25Q32_DUAL_OUTPUT},
+        {DISK_READ_QUAD, W25Q32_QUAD_OUTPUT}, {DISK_READ_QUAD_IO, W25Q32_QUAD_IO}
+    };
+    uint8_t command = W25Q32_READ_DATA;
+    for(uint32_t i = 0; i < 4; i++) {
+        if((supported & modes[i][0]) && w25q32_read_ns(modes[i][1], PAGE_SIZE) <= w25q32_read_ns(command, PAGE_SIZE)) {
+            command = modes[i][1];
+        }
+    }
+    if(pipeline_enabled) {
+        pipeline_idle();
+    }
+    w25q32_read_mode(command, (supported & DISK_READ_CONTINUOUS) != 0);
+    return command;
+}
+
+/**
+ * : ߼ֲ豸, sλ豸s%countĵs/count,
+ * ÿ豸ֻ4MB/count, ռ벼ֲ
+ * صÿα豸к󷢳ȴ, 뵥豸д˳ͬ;
+ * ı, ͬ豸ϵĲִ
+ * ѿˮ߸豸; 첽йر; ڹǰ
+ * @param devices 豸, ʹڼ뱣Ч; NULLcountΪ0ʱָʹw25q32ģ
+ * @param count 豸, DISK_STRIPE_MAX
+ * @return 1:óɹ, 0:豸Ч
+ * */
+uint8_t disk_stripe(DiskDevice *devices, uint32_t count) {
+    if(count > DISK_STRIPE_MAX) {
+        return 0;
+    }
+    disk_overlap_end();
+    disk_async(0);
+    disk_pipeline_flush();
+    stripe_devices = (count) ? devices : NULL;
+    stripe_sum = (devices) ? count : 0;
+    disk_cache_invalidate();
+    statfs_invalidate();
+    return 1;
+}
+
+/**
+ * 豸
+ * @return 豸, δʱΪ1
+ * */
+uint32_t disk_stripes() {
+    return (stripe_sum) ? stripe_sum : 1;
+}
+
+/**
+ * ʼص, ֤߱ڵı֮ûе簲ȫȺ˳
+ * Ŀ¼, ־Ӱд뼰ύ԰˳ִ
+ * */
+void disk_overlap_begin() {
+    stripe_overlap = 1;
+}
+
+/**
+ * ص, ȴȫ豸
+ * */
+void disk_overlap_end() {
+    stripe_overlap = 0;
+    stripe_wait_all();
+}
+
 /**
  * ȡ
  * @param address ַ
@@ -8,7 +478,20 @@
  * @return ʵʶȡС(ֽ)
  **/
 uint32_t disk_read(uint32_t address, uint8_t *buffer, uint32_t size) {
-    return w25q32_read(address, buffer, size);
+    uint32_t read_size, offset = 0;
+    if(cache_sum == 0) {
+        device_read(address, buffer, size);
+    }else {
+        while(offset < size) {
+            read_size = SECTOR_SIZE - ((address + offset) % SECTOR_SIZE);
+            read_size = (read_size > (size - offset)) ? (size - offset) : read_size;
+            cache_read((address + offset), (buffer + offset), read_size);
+            offset += read_size;
+        }
+    }
+    // ݴ
+    batch_read(address, buffer, size);
+    return size;
 }
 
 /**
@@ -19,7 +502,24 @@ uint32_t disk_read(uint32_t address, uint8_t *buffer, uint32_t size) {
  * @return 0x2: дɹ
  * */
 uint8_t disk_write(uint32_t address, uint8_t *buffer, uint32_t size) {
-    return w25q32_write_page(address, buffer, size);
+    uint8_t state = 0x2;
+    uint32_t write_size;
+    // ̲ܿҳ, ҳ߽
+    while(size) {
+        write_size = PAGE_SIZE - (address % PAGE_SIZE);
+        write_size = (write_size > size) ? size : write_size;
+        // ݴֻд뾵
+        if(!batch_write(address, buffer, write_size)) {
+            trace_record(TRACE_PROGRAM, address, write_size);
+            state = device_program(address, buffer, write_size);
+            cache_program(address, buffer, write_size);
+            statfs_program(address, buffer, write_size);
+        }
+        address += write_size;
+        buffer += write_size;
+        size -= write_size;
+    }
+    return state;
 }
 
 /**
@@ -28,7 +528,22 @@ uint8_t disk_write(uint32_t address, uint8_t *buffer, uint32_t size) {
  * @return 0x2: ɹ
  * */
 uint8_t chip_erase() {
-    return w25q32_chip_erase();
+    trace_record(TRACE_CHIP_ERASE, 0, 0);
+    disk_async_flush();
+    disk_cache_invalidate();
+    statfs_invalidate();
+    bloom_invalidate();
+    if(pipeline_enabled) {
+        pipeline_idle();
+    }
+    if(stripe_sum == 0) {
+        return w25q32_chip_erase();
+    }
+    for(uint32_t i = 0; i < stripe_sum; i++) {
+        (stripe_devices + i)->chip_erase((stripe_devices + i)->context);
+    }
+    stripe_wait_all();
+    return 0x2;
 }
 
 /**
@@ -37,7 +552,21 @@ uint8_t chip_erase() {
  * @return 0x2: ɹ
  * */
 uint8_t sector_erase(uint32_t address) {
-    return w25q32_sector_erase(address);
+    CacheEntry *entry;
+    uint8_t state, overlap = stripe_overlap;
+    // ύд밴˳ִ
+    stripe_overlap = 0;
+    batch_erase(address);
+    stripe_overlap = overlap;
+    trace_record(TRACE_ERASE, address, SECTOR_SIZE);
+    state = device_erase(address);
+    statfs_erase(address);
+    entry = cache_lookup(address);
+    if(entry) {
+        bulk_fill(entry->data, 0xFF, SECTOR_SIZE);
+        entry->ahead = 0;
+    }
+    return state;
 }
 
 /**
@@ -46,8 +575,8 @@ uint8_t sector_erase(uint32_t address) {
  * @param *fb ļṹָ
  * */
 void write_fileblock(uint32_t addr, FileBlock *fb) {
-    uint8_t *slot_buffer = (uint8_t *)fb;
-    w25q32_write_page(addr, slot_buffer, 24);
+    batch_hold(addr);
+    disk_write(addr, (uint8_t *)fb, FILEBLOCK_SIZE);
 }
 
 /**
@@ -56,9 +585,7 @@ void write_fileblock(uint32_t addr, FileBlock *fb) {
  * @param offset ƫ
  * */
 void clear_fileblock(uint8_t *baseAddr, uint32_t offset) {
-    for(uint32_t i = 0; i < FILEBLOCK_SIZE; i++) {
-        *(baseAddr + offset + i) = 0xFF;
-    }
+    bulk_fill((baseAddr + offset), 0xFF, FILEBLOCK_SIZE);
 }
 
 /**
@@ -73,7 +600,7 @@ void write_value(uint32_t addr, uint32_t value, uint8_t bytes) {
     for(uint8_t i = 0; i < bytes; i++) {
         buffer[i] = (value >> (i << 3)) & 0xFF;
     }
-    w25q32_write_page(addr, buffer, bytes);
+    disk_write(addr, buffer, bytes);
 }
 
 /**
@@ -82,6 +609,7 @@ void write_value(uint32_t addr, uint32_t value, uint8_t bytes) {
  * @param cluster ״صַ
  * */
 void write_fileblock_cluster(uint32_t fbaddr, uint32_t cluster) {
+    batch_hold(fbaddr);
     write_value(fbaddr + 12, cluster, 4);
 }
 
@@ -91,6 +619,7 @@ void write_fileblock_cluster(uint32_t fbaddr, uint32_t cluster) {
  * @param length ļ
  * */
 void write_fileblock_length(uint32_t fbaddr, uint32_t length) {
+    batch_hold(fbaddr);
     write_value(fbaddr + 16, length, 4);
 }
 
@@ -100,5 +629,694 @@ void write_fileblock_length(uint32_t fbaddr, uint32_t length) {
  * @param state ļ״ֶ̬
  * */
 void write_fileblock_state(uint32_t fbaddr, uint8_t state) {
+    batch_hold(fbaddr);
     write_value(fbaddr + 23, state, 1);
 }
+
+/**
+ * Ӵ洢ȡ, 
+ * */
+static uint32_t device_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    DiskDevice *device;
+    uint32_t physical, read_size, offset = 0;
+    trace_record(TRACE_READ, address, size);
+    if(pipeline_enabled) {
+        pipeline_read(address, buffer, size);
+        return size;
+    }
+    if(stripe_sum == 0) {
+        suspend_read(address, size);
+        w25q32_read(address, buffer, size);
+        async_overlay(address, buffer, size);
+        return size;
+    }
+    while(offset < size) {
+        read_size = SECTOR_SIZE - ((address + offset) % SECTOR_SIZE);
+        read_size = (read_size > (size - offset)) ? (size - offset) : read_size;
+        device = stripe_map((address + offset), &physical);
+        device->read(device->context, physical, (buffer + offset), read_size);
+        if(device->busy) {
+            device->wait(device->context);
+        }
+        offset += read_size;
+    }
+    return size;
+}
+
+/**
+ * ȡ
+ * @param address ַ
+ * @param buffer 뻺
+ * @param size ȡС(ֽ), 
+ * */
+static void cache_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint32_t offset = address % SECTOR_SIZE;
+    uint32_t sector = address - offset;
+    uint8_t sequential = 0;
+    CacheEntry *entry = cache_lookup(sector);
+
+    // ȡ, ϴηһΪ
+    if(offset < CACHE_LINK_OFFSET) {
+        sequential = (sector != cache_data_last && cache_link_from == cache_data_last && cache_link_to == sector);
+        cache_data_last = sector;
+    }
+    if(entry) {
+        cache_stats.hits++;
+        if(entry->ahead) {
+            entry->ahead = 0;
+            cache_stats.prefetch_hits++;
+            sequential = 1;
+        }
+        // ֻȡһصֶַ()·, ʱ̭Ԥ
+        if(offset < CACHE_LINK_OFFSET) {
+            entry->tick = ++cache_tick;
+        }
+    }else {
+        cache_stats.misses++;
+        if(cache_ghost_charge(sector, size) || sequential) {
+            entry = cache_load(sector, 0);
+        }
+    }
+
+    if(entry) {
+        bulk_copy(buffer, (entry->data + offset), size);
+    }else {
+        device_read(address, buffer, size);
+    }
+    if(offset <= CACHE_LINK_OFFSET && (offset + size) >= (CACHE_LINK_OFFSET + 4)) {
+        cache_link_from = sector;
+        bulk_copy((uint8_t *)&cache_link_to, (buffer + CACHE_LINK_OFFSET - offset), 4);
+    }
+    if(entry && sequential) {
+        cache_readahead(entry);
+    }
+}
+
+/**
+ * һ, ·
+ * @param sector ַ
+ * @return Ŀ, δ淵NULL
+ * */
+static CacheEntry *cache_lookup(uint32_t sector) {
+    for(uint32_t i = 0; i < cache_sum; i++) {
+        if((cache_entries + i)->sector == sector) {
+            return (cache_entries + i);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * , 滻лδʵĿ
+ * @param sector ַ
+ * @param ahead 1:Ԥ
+ * @return Ŀ
+ * */
+static CacheEntry *cache_load(uint32_t sector, uint8_t ahead) {
+    CacheEntry *victim = cache_entries;
+    for(uint32_t i = 0; i < cache_sum; i++) {
+        if((cache_entries + i)->sector == 0xFFFFFFFF) {
+            victim = (cache_entries + i);
+            break;
+        }
+        if((cache_entries + i)->tick < victim->tick) {
+            victim = (cache_entries + i);
+        }
+    }
+    device_read(sector, victim->data, SECTOR_SIZE);
+    victim->sector = sector;
+    victim->tick = ++cache_tick;
+    victim->ahead = ahead;
+    return victim;
+}
+
+/**
+ * ۼδֱӶȡ, ۴ﵽȡĴʱƳ¼
+ * ¼ʱ滻ļ¼
+ * @param sector ַ
+ * @param size ζȡֽ
+ * @return 1:Ӧ
+ * */
+static uint8_t cache_ghost_charge(uint32_t sector, uint32_t size) {
+    CacheGhost *ghost = NULL;
+    for(uint32_t i = 0; i < cache_sum; i++) {
+        if((cache_ghost + i)->sector == sector) {
+            ghost = (cache_ghost + i);
+            break;
+        }
+    }
+    if(ghost == NULL) {
+        ghost = (cache_ghost + cache_ghost_index);
+        cache_ghost_index = (cache_ghost_index + 1) % cache_sum;
+        ghost->sector = sector;
+        ghost->cost = 0;
+    }
+    ghost->cost += CACHE_COMMAND_COST + size;
+    if(ghost->cost < (CACHE_COMMAND_COST + SECTOR_SIZE)) {
+        return 0;
+    }
+    ghost->sector = 0xFFFFFFFF;
+    return 1;
+}
+
+/**
+ * һصַ
+ * @param link һصֶַεֵ
+ * @return һصַ, Чݴصַʱ0xFFFFFFFF
+ * */
+static uint32_t cache_next(uint32_t link) {
+    if((link % SECTOR_SIZE) != 0 || link < (FB_SECTOR_END * SECTOR_SIZE) || link >= (DATA_SECTOR_END * SECTOR_SIZE)) {
+        return 0xFFFFFFFF;
+    }
+    return link;
+}
+
+/**
+ * شԤentry֮Ĵ, ԤȲ1/4
+ * @param *entry ǰʵĻĿ
+ * */
+static void cache_readahead(CacheEntry *entry) {
+    uint32_t depth = cache_sum / 4;
+    uint32_t link, next;
+    CacheEntry *ahead = entry;
+    depth = (depth > CACHE_READAHEAD) ? CACHE_READAHEAD : depth;
+    for(uint32_t i = 0; i < depth; i++) {
+        bulk_copy((uint8_t *)&link, (ahead->data + CACHE_LINK_OFFSET), 4);
+        next = cache_next(link);
+        if(next == 0xFFFFFFFF) {
+            break;
+        }
+        ahead = cache_lookup(next);
+        if(ahead == NULL) {
+            ahead = cache_load(next, 1);
+            cache_stats.prefetches++;
+        }
+    }
+}
+
+/**
+ * ̺», NORֻܽ1дΪ0, 水λ
+ * @param address ַ()
+ * @param buffer 
+ * @param size ֽ
+ * */
+static void cache_program(uint32_t address, uint8_t *buffer, uint32_t size) {
+    CacheEntry *entry = cache_lookup(address - (address % SECTOR_SIZE));
+    uint8_t *data;
+    if(entry == NULL) {
+        return;
+    }
+    data = entry->data + (address % SECTOR_SIZE);
+    for(uint32_t i = 0; i < size; i++) {
+        *(data + i) &= *(buffer + i);
+    }
+}
+
+/**
+ * ߼ַӳ䵽豸
+ * @param address ߼ַ
+ * @param *physical 豸ڵַ
+ * @return 豸
+ * */
+static DiskDevice *stripe_map(uint32_t address, uint32_t *physical) {
+    uint32_t sector = address / SECTOR_SIZE;
+    *physical = (sector / stripe_sum) * SECTOR_SIZE + (address % SECTOR_SIZE);
+    return stripe_devices + (sector % stripe_sum);
+}
+
+/**
+ * ȴȫ豸
+ * */
+static void stripe_wait_all() {
+    for(uint32_t i = 0; i < stripe_sum; i++) {
+        (stripe_devices + i)->wait((stripe_devices + i)->context);
+    }
+}
+
+/**
+ * ждǷ밴˳ִ: ȫд, ԼĿ¼, ӱ, ־Ӱд
+ * @param address ߼ַ
+ * @return 1:˳ִ, 0:豸ϵĲص
+ * */
+static uint8_t stripe_ordered(uint32_t address) {
+    uint32_t sector = address / SECTOR_SIZE;
+    return !stripe_overlap || sector < FB_SECTOR_END || sector >= DATA_SECTOR_END;
+}
+
+/**
+ * һҳڵ
+ * ˳ִʱȵȴȫ豸, ȴ豸
+ * */
+static uint8_t device_program(uint32_t address, uint8_t *buffer, uint32_t size) {
+    DiskDevice *device;
+    uint32_t physical;
+    uint8_t state;
+    if(async_sum) {
+        return async_push(address, buffer, size);
+    }
+    if(pipeline_enabled) {
+        return pipeline_program(address, buffer, size);
+    }
+    if(stripe_sum == 0) {
+        return w25q32_write_page(address, buffer, size);
+    }
+    device = stripe_map(address, &physical);
+    // 豸Ĵڷغʱ, ȴɲܽbuffer
+    if(!stripe_ordered(address) && device->busy == NULL) {
+        return device->write_page(device->context, physical, buffer, size);
+    }
+    stripe_wait_all();
+    state = device->write_page(device->context, physical, buffer, size);
+    device->wait(device->context);
+    return state;
+}
+
+/**
+ * һ, ˳ͬdevice_program
+ * */
+static uint8_t device_erase(uint32_t address) {
+    DiskDevice *device;
+    uint32_t physical;
+    uint8_t state;
+    if(async_sum) {
+        return async_push(address, NULL, 0);
+    }
+    if(pipeline_enabled) {
+        return pipeline_erase(address);
+    }
+    if(stripe_sum == 0) {
+        return w25q32_sector_erase(address);
+    }
+    device = stripe_map(address, &physical);
+    if(!stripe_ordered(address)) {
+        return device->sector_erase(device->context, physical);
+    }
+    stripe_wait_all();
+    state = device->sector_erase(device->context, physical);
+    device->wait(device->context);
+    return state;
+}
+
+/**
+ * 첽, ʱȴɺ󷢳
+ * @param address ַ
+ * @param buffer , ʱΪNULL
+ * @param size ֽ(ҳ), 0ʾ
+ * */
+static uint8_t async_push(uint32_t address, uint8_t *buffer, uint32_t size) {
+    DiskCommand *command;
+    if(async_count == async_sum) {
+        async_stats.stalls++;
+        suspend_resume();
+        w25q32_wait();
+        async_done = async_issued;
+        async_issue();
+    }
+    command = async_queue + ((async_head + async_count) % async_sum);
+    command->address = address;
+    command->size = size;
+    if(size) {
+        bulk_copy(command->data, buffer, size);
+    }
+    async_count++;
+    async_tail++;
+    async_stats.commands++;
+    return 0x2;
+}
+
+/**
+ * , 
+ * */
+static void async_issue() {
+    DiskCommand *command = async_queue + async_head;
+    // ȳ, ģʱѷ
+    async_head = (async_head + 1) % async_sum;
+    async_count--;
+    async_issued++;
+    suspend_resume();
+    if(command->size) {
+        w25q32_issue_page(command->address, command->data, command->size);
+        suspend_erase = 0xFFFFFFFF;
+    }else {
+        w25q32_issue_erase(command->address);
+        suspend_erase = command->address;
+        suspend_resumed = w25q32_clock();
+    }
+}
+
+/**
+ * ȡǰռԴеĲ: ڼֱӶȡ, ȡڲʱָȴ;
+ * ҶȡΪȼʱ, ȴٽsuspend_progress, ɶȡȴ
+ * */
+static void suspend_read(uint32_t address, uint32_t size) {
+    uint32_t elapsed;
+    uint8_t overlap;
+    if(suspend_progress == 0 || suspend_erase == 0xFFFFFFFF) {
+        return;
+    }
+    overlap = (address < (suspend_erase + SECTOR_SIZE)) && ((address + size) > suspend_erase);
+    if(w25q32_suspended()) {
+        if(overlap) {
+            suspend_resume();
+            suspend_stats.waits++;
+        }else {
+            suspend_stats.reads++;
+        }
+        return;
+    }
+    if(!w25q32_busy()) {
+        return;
+    }
+    if(overlap || !suspend_priority) {
+        suspend_stats.waits++;
+        return;
+    }
+    elapsed = w25q32_clock() - suspend_resumed;
+    if(elapsed < suspend_progress) {
+        w25q32_elapse(suspend_progress - elapsed);
+    }
+    if(w25q32_suspend()) {
+        suspend_stats.suspends += w25q32_suspended();
+        suspend_stats.reads += w25q32_suspended();
+    }
+}
+
+/**
+ * ָĲ
+ * */
+static void suspend_resume() {
+    if(w25q32_resume()) {
+        suspend_resumed = w25q32_clock();
+    }
+}
+
+/**
+ * ȡӶδ, 0xFF, ̰λ
+ * @param address ַ
+ * @param buffer ȡ
+ * @param size ֽ
+ * */
+static void async_overlay(uint32_t address, uint8_t *buffer, uint32_t size) {
+    DiskCommand *command;
+    uint32_t start, end;
+    for(uint32_t i = 0; i < async_count; i++) {
+        command = async_queue + ((async_head + i) % async_sum);
+        start = command->address;
+        end = start + ((command->size) ? command->size : SECTOR_SIZE);
+        if(end <= address || start >= (address + size)) {
+            continue;
+        }
+        start = (start > address) ? start : address;
+        end = (end < (address + size)) ? end : (address + size);
+        for(uint32_t j = start; j < end; j++) {
+            if(command->size) {
+                *(buffer + j - address) &= *(command->data + j - command->address);
+            }else {
+                *(buffer + j - address) = 0xFF;
+            }
+        }
+    }
+}
+
+/**
+ * ߼ַӳ䵽ˮʹõ豸
+ * @param address ߼ַ
+ * @param *physical 豸ڵַ
+ * @return 豸, δʱΪw25q32ģDMA豸
+ * */
+static DiskDevice *pipeline_map(uint32_t address, uint32_t *physical) {
+    if(stripe_sum) {
+        return stripe_map(address, physical);
+    }
+    *physical = address;
+    return &pipeline_w25q32;
+}
+
+/**
+ * ѯˮʹõ豸Ƿвڽ, ûbusyص豸Ϊ
+ * */
+static uint8_t pipeline_busy() {
+    DiskDevice *device;
+    for(uint32_t i = 0; i < disk_stripes(); i++) {
+        device = (stripe_sum) ? (stripe_devices + i) : &pipeline_w25q32;
+        if(device->busy && device->busy(device->context)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * ȴˮ߿
+ * */
+static void pipeline_idle() {
+    if(stripe_sum) {
+        stripe_wait_all();
+    }else {
+        pipeline_w25q32.wait(pipeline_w25q32.context);
+    }
+    pipeline_inflight = NULL;
+}
+
+/**
+ * ȡ, ȴ; ϰֵ豸
+ * @param address ߼ַ
+ * @param buffer 뻺, ǰ뱣Ч
+ * @param size ȡС(ֽ)
+ * */
+static void pipeline_transfer(uint32_t address, uint8_t *buffer, uint32_t size) {
+    DiskDevice *device;
+    uint32_t physical, read_size;
+    while(size) {
+        read_size = SECTOR_SIZE - (address % SECTOR_SIZE);
+        read_size = (stripe_sum == 0 || read_size > size) ? size : read_size;
+        device = pipeline_map(address, &physical);
+        device->read(device->context, physical, buffer, read_size);
+        address += read_size;
+        buffer += read_size;
+        size -= read_size;
+    }
+}
+
+/**
+ * ݴһҳ, ȴһҳɺ󷢳
+ * @param address ַ
+ * @param buffer , غ󼴿޸
+ * @param size ֽ(ҳ)
+ * */
+static uint8_t pipeline_program(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint8_t *stage = pipeline_stage + pipeline_stage_index * PAGE_SIZE;
+    uint32_t physical;
+    DiskDevice *device = pipeline_map(address, &physical);
+    // һݴڴ, ݴһҳ
+    pipeline_stage_index ^= 1;
+    bulk_copy(stage, buffer, size);
+    pipeline_drop(address, size);
+    if(pipeline_busy()) {
+        pipeline_stats.stalls++;
+    }
+    pipeline_idle();
+    pipeline_stats.programs++;
+    return device->write_page(device->context, physical, stage, size);
+}
+
+/**
+ * , ȴ
+ * @param address ׵ַ
+ * */
+static uint8_t pipeline_erase(uint32_t address) {
+    uint32_t physical;
+    DiskDevice *device = pipeline_map(address, &physical);
+    pipeline_drop(address, SECTOR_SIZE);
+    pipeline_idle();
+    return device->sector_erase(device->context, physical);
+}
+
+/**
+ * ȡ, ˳ȡʱԤһ
+ * ȡΧƴ, ڶеĲһ
+ * @param address ַ
+ * @param buffer 뻺
+ * @param size ȡС(ֽ)
+ * */
+static void pipeline_read(uint32_t address, uint8_t *buffer, uint32_t size) {
+    uint32_t link, copy;
+    uint8_t sequential = (address == pipeline_read_end || (address - (address % SECTOR_SIZE)) == pipeline_link_to);
+    PipelineWindow *window = NULL;
+
+#ifdef SPIFS_LINK_TABLE
+    if((address % SECTOR_SIZE) == 0) {
+        pipeline_contiguous = (address == pipeline_read_end);
+    }
+#endif
+    // ӱ, ־ӰĶȡݵ˳ȡ
+    if(address < (DATA_SECTOR_END * SECTOR_SIZE)) {
+        pipeline_read_end = address + size;
+    }
+    while(size) {
+        window = pipeline_find(address);
+        // ˳ȡĶȡֱӶ߻, 滻
+        if(window == NULL && (!sequential || ((address % SECTOR_SIZE) + size) > SECTOR_SIZE)) {
+            pipeline_idle();
+            pipeline_transfer(address, buffer, size);
+            pipeline_idle();
+            pipeline_stats.reads++;
+            return;
+        }
+        if(window == NULL) {
+            window = pipeline_windows + (pipeline_current ^ 1);
+            pipeline_load(window, address, pipeline_span(address, size), 0);
+        }
+        if(window == pipeline_inflight) {
+            pipeline_idle();
+        }
+        if(window->prefetched) {
+            window->prefetched = 0;
+            pipeline_stats.prefetch_hits++;
+            sequential = 1;
+        }
+        pipeline_current = (uint32_t)(window - pipeline_windows);
+        copy = window->address + window->size - address;
+        copy = (copy > size) ? size : copy;
+        bulk_copy(buffer, (window->data + (address - window->address)), copy);
+        address += copy;
+        buffer += copy;
+        size -= copy;
+        link = pipeline_link(window);
+        pipeline_link_to = (link != 0xFFFFFFFF) ? link : pipeline_link_to;
+    }
+    if(window && sequential) {
+        pipeline_prefetch(window);
+    }
+}
+
+/**
+ * ҰַĶ
+ * @return , ʱNULL
+ * */
+static PipelineWindow *pipeline_find(uint32_t address) {
+    PipelineWindow *window;
+    for(uint32_t i = 0; i < 2; i++) {
+        window = pipeline_windows + i;
+        if(window->address != 0xFFFFFFFF && address >= window->address && address < (window->address + window->size)) {
+            return window;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 
+ * @param *window 
+ * @param address ʼַ
+ * @param size ֽ()
+ * @param prefetch 1:Ԥ, 
+ * */
+static void pipeline_load(PipelineWindow *window, uint32_t address, uint32_t size, uint8_t prefetch) {
+    pipeline_idle();
+    window->address = address;
+    window->size = size;
+    window->prefetched = prefetch;
+    pipeline_transfer(address, window->data, size);
+    pipeline_stats.reads++;
+    if(prefetch) {
+        pipeline_inflight = window;
+        pipeline_stats.prefetches++;
+    }else {
+        pipeline_idle();
+    }
+}
+
+/**
+ * ˳ȡ볤, PIPELINE_WINDOWֽ, ĩβ
+ * @param address ʼַ
+ * @param size ֽ
+ * */
+static uint32_t pipeline_span(uint32_t address, uint32_t size) {
+    uint32_t limit = SECTOR_SIZE - (address % SECTOR_SIZE);
+    size = (size < PIPELINE_WINDOW) ? PIPELINE_WINDOW : size;
+    return (size > limit) ? limit : size;
+}
+
+/**
+ * Ԥwindow֮һεһ, æµ(̻)ʱԤ
+ * windowĩβʱشԤһ; ӱʽûһصַ, ˳ȡԽʱԤ
+ * @param *window ǰȡĻ
+ * */
+static void pipeline_prefetch(PipelineWindow *window) {
+    PipelineWindow *ahead = pipeline_windows + ((window - pipeline_windows) ^ 1);
+    uint32_t next = window->address + window->size;
+    if((next % SECTOR_SIZE) == 0) {
+#ifdef SPIFS_LINK_TABLE
+        next = (pipeline_contiguous && next < (DATA_SECTOR_END * SECTOR_SIZE)) ? next : 0xFFFFFFFF;
+#else
+        next = pipeline_link(window);
+#endif
+    }
+    if(next == 0xFFFFFFFF || ahead->address == next || pipeline_busy()) {
+        return;
+    }
+    pipeline_load(ahead, next, pipeline_span(next, window->size), 1);
+}
+
+/**
+ * ̻ΧصĶ
+ * @param address ַ
+ * @param size ֽ
+ * */
+static void pipeline_drop(uint32_t address, uint32_t size) {
+    PipelineWindow *window;
+    for(uint32_t i = 0; i < 2; i++) {
+        window = pipeline_windows + i;
+        if(window->address != 0xFFFFFFFF && window->address < (address + size) && (window->address + window->size) > address) {
+            window->address = 0xFFFFFFFF;
+            window->prefetched = 0;
+        }
+    }
+}
+
+/**
+ * еһصַ
+ * @return һصַ, һصֶַλЧݴصַʱ0xFFFFFFFF
+ * */
+static uint32_t pipeline_link(PipelineWindow *window) {
+    uint32_t link, offset = window->address % SECTOR_SIZE;
+    if(offset > CACHE_LINK_OFFSET || (offset + window->size) < (CACHE_LINK_OFFSET + 4)) {
+        return 0xFFFFFFFF;
+    }
+    bulk_copy((uint8_t *)&link, (window->data + CACHE_LINK_OFFSET - offset), 4);
+    return cache_next(link);
+}
+
+static uint32_t w25q32_device_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    w25q32_dma_read(address, buffer, size);
+    return size;
+}
+
+static uint8_t w25q32_device_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    w25q32_dma_page(address, buffer, size);
+    return 0x2;
+}
+
+static uint8_t w25q32_device_sector_erase(void *context, uint32_t address) {
+    (void)context;
+    w25q32_issue_erase(address);
+    return 0x2;
+}
+
+static uint8_t w25q32_device_chip_erase(void *context) {
+    (void)context;
+    return w25q32_chip_erase();
+}
+
+static void w25q32_device_wait(void *context) {
+    (void)context;
+    w25q32_wait();
+}
+
+static uint8_t w25q32_device_busy(void *context) {
+    (void)context;
+    return w25q32_busy();
+}
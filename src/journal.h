@@ -0,0 +1,65 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include "stdint.h"
+
+// 意图日志记录结构(16字节)
+typedef struct journal_record {
+    uint8_t type;    // 记录类型
+    uint8_t state;  // 记录状态, FF:进行中, 00:已完成
+    uint16_t check; // 记录校验(CRC-16, 不含state字段)
+    uint32_t arg0;
+    uint32_t arg1;
+    uint32_t arg2;
+} JournalRecord;
+
+#include "spifs.h"
+
+// 日志扇区头(arg0:序号, arg1:JOURNAL_MAGIC)
+#define JOURNAL_HEAD 0x01
+// 扇区重写, 新内容已完整写入影子扇区(arg0:目标扇区地址)
+#define JOURNAL_REWRITE 0x02
+// 新文件数据链(arg0:文件索引地址, arg1:首簇地址, arg2:文件大小)
+#define JOURNAL_ALLOC_NEW 0x03
+// 覆盖文件数据链(arg0:文件索引地址, arg1:新首簇地址, arg2:旧首簇地址)
+#define JOURNAL_ALLOC_REPLACE 0x04
+// 新扇区等待被引用(arg0:引用字段地址, arg1:扇区地址)
+#define JOURNAL_ALLOC_LINK 0x05
+// 追加写会话(arg0:文件索引地址, arg1:追加前文件大小, arg2:追加写起始地址)
+#define JOURNAL_APPEND 0x06
+// 释放簇链(arg0:首簇地址)
+#define JOURNAL_FREE 0x07
+// 索引扇区垃圾回收(arg0:扇区地址, arg1:0根目录索引扇区, 1目录表扇区)
+#define JOURNAL_GC 0x08
+// 替换簇链中的一段(arg0:引用字段地址, arg1:新段首簇地址, arg2:旧段首簇地址)
+#define JOURNAL_RELINK 0x09
+// 截断文件(arg0:文件索引地址, arg1:截断后文件大小, arg2:截断位置的物理地址)
+#define JOURNAL_TRUNCATE 0x0A
+// 条带卷上并行擦除的一组扇区(arg0~arg2: 每个参数3个10位扇区号, 未用为0x3FF)
+#define JOURNAL_ERASE 0x0B
+// 环形文件的首簇地址与文件大小, 保持进行中并代替文件块中的记录
+// (arg0:文件索引地址, arg1:首簇地址, 低12位为丢弃中的原首簇扇区号(0表示无), arg2:文件大小)
+#define JOURNAL_RING 0x0C
+
+// 每条JOURNAL_ERASE记录的最大扇区数
+#define JOURNAL_ERASE_SUM 9
+
+#define JOURNAL_MAGIC 0x4C4E524A
+// 每个日志扇区的记录数量(含扇区头)
+#define JOURNAL_RECORD_SUM (SECTOR_SIZE / sizeof(JournalRecord))
+// 进行中记录的最大数量
+#define JOURNAL_PENDING_MAX 32
+// 一次操作(含日志重放)中同时进行中的记录的最大层数, 不含扇区重写
+#define JOURNAL_NEST_MAX 4
+// 开始新的顶层操作时日志扇区至少保留的空记录数
+#define JOURNAL_RESERVE 16
+
+uint32_t journal_mount();
+uint32_t journal_begin(uint8_t type, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+void journal_end(uint32_t handle);
+uint32_t journal_room();
+uint32_t journal_find(uint8_t type, uint32_t arg0);
+
+uint8_t journal_rewrite_sector(uint32_t address, uint8_t *buffer);
+
+#endif // __JOURNAL_H__
@@ -1,15 +1,15 @@
 #include "misc.h"
 
 void array_fill(uint8_t *buffer, uint8_t ch, uint32_t size) {
-    for(uint32_t i = 0; i < size; i++) {
-        *(buffer + i) = ch;
-    }
+    bulk_fill(buffer, ch, size);
 }
 
 void array_copy(uint8_t *from, uint8_t *to, uint32_t size) {
-    for(uint32_t i = 0; i < size; i++) {
-        *(to + i) = *(from + i);
-    }
+    bulk_copy(to, from, size);
+}
+
+uint8_t array_equal(uint8_t *a, uint8_t *b, uint32_t size) {
+    return bulk_equal(a, b, size);
 }
 
 void copy_filename(char *src, uint8_t *target, uint32_t length, uint32_t max) {
@@ -3,9 +3,38 @@
 /**
  * 文件簇大小 = 扇区大小 = 4KB
  * 文件簇: 扇区标记字2字节, 数据区4090字节, 最后4字节为下一簇物理地址, FFFFFFFF表示文件结束
+ * 压缩文件的数据区依次存放压缩块: 原始大小2字节 + 压缩后大小2字节 + 压缩数据, 原始大小FFFF表示簇内无后续块
+ * 压缩块不跨簇, 按偏移读取时只解压涉及的压缩块
+ * 校验文件的数据区为4074字节, 其后为4个封存槽位, 存放数据区与下一簇地址的CRC-32C(以文件块地址为初值)
+ * 簇写满链接下一簇时写最后一个槽位, 覆盖写完成与追加写完成时依次写前3个槽位, 以最后写入的槽位为准
+ * 内联文件的数据存放在文件索引所在扇区的连续槽位中(数据槽位), 首簇地址字段记录首个数据槽位序号与槽位数
+ * 数据槽位从扇区末尾向前分配, 避开从前向后分配的根目录索引项; 读取内联文件只需一次索引扇区内的读取
  * */
 
 void update_fileblock_length(File *file);
+static Result append_data(File *file, uint8_t *buffer, uint32_t size);
+static Result pwrite_data(File *file, uint32_t offset, uint8_t *buffer, uint32_t size);
+static Result write_compressed(File *file, uint8_t *buffer, uint32_t size);
+static Result append_compressed(File *file, uint8_t *buffer, uint32_t size);
+static uint8_t read_compressed(File *file, uint8_t *buffer, uint32_t offset, uint32_t size, uint8_t *sector_buffer);
+static uint32_t compress_chain(File *file, uint32_t *cluster, uint32_t *position, uint8_t *buffer, uint32_t size);
+static uint32_t compressed_end(uint32_t cluster, uint32_t area);
+static uint8_t read_data(File *file, uint8_t *buffer, uint32_t offset, uint32_t size, uint8_t verify);
+static uint32_t erase_wave_begin(uint32_t *sectors, uint32_t count);
+static uint32_t cluster_crc(uint8_t *sector_buffer, uint32_t fbaddr);
+static uint32_t tail_cluster(uint32_t cluster);
+static void append_rollback(uint32_t fbaddr, uint32_t length, uint32_t address);
+static void clear_reference(uint32_t address);
+static Result write_inline(File *file, uint8_t *buffer, uint32_t size);
+static Result append_inline(File *file, uint8_t *buffer, uint32_t size);
+static void read_inline(File *file, uint8_t *buffer, uint32_t offset, uint32_t size);
+static uint32_t inline_base(uint32_t fbaddr);
+static uint32_t inline_find(uint8_t *sector_buffer, uint32_t base, uint32_t span, uint8_t erased);
+static void inline_fill(uint8_t *slot, uint8_t *buffer, uint32_t size);
+static Result pwrite_clusters(File *file, uint32_t offset, uint8_t *buffer, uint32_t size);
+static Result rewrite_whole(File *file, uint32_t offset, uint8_t *buffer, uint32_t size, uint32_t length);
+static void seal_image(uint8_t *sector_buffer, uint32_t fbaddr, uint8_t tail);
+static void relink_erase(uint32_t first, uint32_t other);
 
 /**
  * 创建文件状态字
@@ -31,6 +60,7 @@ void make_file(File *file, char *filename, char *extname) {
     file->block = 0xFFFFFFFF;
     file->cluster = 0xFFFFFFFF;
     file->length = 0xFFFFFFFF;
+    file->state = 0xFFFFFFFF;
     copy_filename(filename, file->filename, strlen(filename), sizeof(file->filename));
     copy_filename(extname, file->extname, strlen(extname), sizeof(file->extname));
 }
@@ -88,10 +118,12 @@ Result create_file(File *file, FileState fstate) {
     fb->state = *(uint32_t *)&fstate;
 
     write_fileblock(addr_start, fb);
+    bloom_insert(fb->filename);
 
     file->block = addr_start;
     file->cluster = fb->cluster;
     file->length = fb->length;
+    file->state = fb->state;
 
     free(slot_buffer);
     return CREATE_FILEBLOCK_SUCCESS;
@@ -100,85 +132,100 @@ Result create_file(File *file, FileState fstate) {
 /**
  * 覆盖写文件
  * 无数据文件:查找空扇区写入数据,更新文件块记录
- * 存在数据文件:擦除旧文件,查找空扇区写入数据,更新文件块记录
+ * 存在数据文件:查找空扇区写入新数据,重写文件块记录后擦除旧数据
+ * 空闲扇区不足时先擦除旧数据再写入(此时掉电将丢失旧数据)
  * @param *file 文件指针
  * @param *buffer 写入数据缓冲区
  * @param size 写入字节数
  * */
 Result write_file(File *file, uint8_t *buffer, uint32_t size) {
-    uint32_t addr_cluster;
-    uint8_t sector_inuse, *sector_buffer;
-    uint32_t sector_index, sectors, count, *sector_list;
+    Result result = write_data(file, buffer, size);
+    if(result == WRITE_FILE_SUCCESS) {
+        trace_record(TRACE_USER_WRITE, file->block, size);
+    }
+    return result;
+}
+
+/**
+ * 覆盖写文件数据, 内部调用不记录应用层写入
+ * */
+Result write_data(File *file, uint8_t *buffer, uint32_t size) {
+    uint8_t replace;
+    uint32_t old_cluster, handle, area;
+    uint32_t sectors, count, *sector_list;
 
     if(file->block == 0xFFFFFFFF) return FILE_UNALLOCATED;
-    // 文件存在数据则擦除数据扇区与文件索引表对应项
-    if(file->cluster != 0xFFFFFFFF || file->length != 0xFFFFFFFF) {
-        // 根据链表擦除文件占用扇区
-        while(file->cluster != 0xFFFFFFFF) {
-            disk_read(file->cluster + DATA_AREA_SIZE + 2, (uint8_t *)&addr_cluster, 4);
-            sector_erase(file->cluster);
-            file->cluster = addr_cluster;
-        }
-        // 更新文件索引表项,擦除扇区首地址与文件大小
-        sector_index = (file->block / SECTOR_SIZE) * SECTOR_SIZE;
-        addr_cluster = file->block % SECTOR_SIZE;
-        sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
-        disk_read(sector_index, sector_buffer, SECTOR_SIZE);
-        for(uint32_t i = 0; i < 8; i++) {
-            *(sector_buffer + addr_cluster + FILENAME_FULLSIZE + i) = 0xFF;
-        }
-        sector_erase(sector_index);
-        for(uint32_t i = 0 ; i < 16; i++) {
-            disk_write((sector_index * SECTOR_SIZE + i * PAGE_SIZE), (sector_buffer + i * PAGE_SIZE), PAGE_SIZE);
-        }
-        free(sector_buffer);
+    if((FILE_FLAGS(file->state) & FSTATE_DIRECTORY) == 0) return FILE_IS_DIRECTORY;
+    // 未完成的追加写会话随覆盖写结束
+    journal_end(journal_find(JOURNAL_APPEND, file->block));
+    ring_forget(file->block);
+    // 内联文件索引扇区内没有足够的连续槽位时按普通文件存放
+    if((FILE_FLAGS(file->state) & FSTATE_INLINE) == 0 && size <= INLINE_SIZE_MAX
+            && write_inline(file, buffer, size) == WRITE_FILE_SUCCESS) {
+        return WRITE_FILE_SUCCESS;
+    }
+    if((FILE_FLAGS(file->state) & FSTATE_COMPRESSED) == 0) {
+        return write_compressed(file, buffer, size);
     }
+
     // 计算buffer下数据需要占用的扇区数
-    sectors = size / DATA_AREA_SIZE;
-    if((size % DATA_AREA_SIZE) != 0) {
+    area = FILE_AREA_SIZE(file->state);
+    sectors = AREA_DIV(size, area);
+    if(AREA_MOD(size, area) != 0 || sectors == 0) {
         sectors += 1;
     }
 
-    count = 0;
     sector_list = (uint32_t *)malloc(sizeof(uint32_t) * sectors);
-    for(sector_index = FB_SECTOR_END; sector_index < SECTOR_SUM; sector_index++) {
-        disk_read(sector_index * SECTOR_SIZE, &sector_inuse, 1);
-        if(sector_inuse == 0xFF) {
-            *(sector_list + count) = sector_index * SECTOR_SIZE;
-            count++;
-        }
-        if(count >= sectors) {
-            break;
-        }
+    count = find_free_sectors(sector_list, sectors);
+
+    // 文件存在数据且空闲扇区不足, 先擦除数据扇区与文件索引表对应项
+    if((count != sectors) && (file->cluster != 0xFFFFFFFF || file->length != 0xFFFFFFFF)) {
+        old_cluster = file->cluster;
+        handle = journal_begin(JOURNAL_FREE, old_cluster, 0, 0);
+        update_fileblock(file->block, 0xFFFFFFFF, 0xFFFFFFFF);
+        erase_cluster_chain(old_cluster);
+        journal_end(handle);
+        file->cluster = 0xFFFFFFFF;
+        file->length = 0xFFFFFFFF;
+        count = find_free_sectors(sector_list, sectors);
+    }
+
+    if(count != sectors) {
+        free(sector_list);
+        return NO_SECTOR_SPACE;
     }
 
-    if(count != sectors) return NO_SECTOR_SPACE;
+    old_cluster = file->cluster;
+    replace = (file->cluster != 0xFFFFFFFF || file->length != 0xFFFFFFFF);
+    if(replace) {
+        handle = journal_begin(JOURNAL_ALLOC_REPLACE, file->block, *(sector_list + 0), old_cluster);
+    }else {
+        handle = journal_begin(JOURNAL_ALLOC_NEW, file->block, *(sector_list + 0), size);
+    }
 
     uint32_t write_size, write_addr, addr_position;
-    // 更新文件索引信息
-    write_fileblock_cluster(file->block, *(sector_list + 0));
-    write_fileblock_length(file->block, size);
     file->cluster = *(sector_list + 0);
     file->length = size;
+    // 先按簇链顺序写占用标记与下一扇区地址, 掉电后从首簇遍历可找到全部已占用的扇区
+    for(uint32_t i = 0; i < sectors; i++) {
+        cluster_mark(*(sector_list + i));
+        if((i + 1) < sectors) {
+            cluster_link(*(sector_list + i), *(sector_list + i + 1));
+        }
+    }
+    // 数据写入之间没有先后要求, 条带卷上不同设备的簇并行编程
     count = 0;
-    // sector loop
+    disk_overlap_begin();
     for(uint32_t i = 0; i < sectors; i++) {
-        // 写占用标记
-        write_value(*(sector_list + i), 0xFF00, 2);
-        // 扇区地址偏移2字节
-        write_addr = *(sector_list + i) + 2;
-        write_size = 0;
+        // 数据域在占用标记之后
+        write_addr = *(sector_list + i) + SECTOR_STATE_SIZE;
         addr_position = 0;
-        //page loop
-        while(size) {
-            if(addr_position >= DATA_AREA_SIZE) {
-                // 写下一扇区地址,跳出循环更换扇区
-                write_value((write_addr + DATA_AREA_SIZE), *(sector_list + i + 1), 4);
-                break;
-            }
-            write_size = (size >= PAGE_SIZE) ? PAGE_SIZE : (size % PAGE_SIZE);
-            if((addr_position + write_size) > DATA_AREA_SIZE) {
-                write_size = DATA_AREA_SIZE - addr_position;
+        //page loop, 按页边界分段, 每页只编程一次
+        while(size && addr_position < area) {
+            write_size = PAGE_SIZE - ((write_addr + addr_position) % PAGE_SIZE);
+            write_size = (write_size > size) ? size : write_size;
+            if((addr_position + write_size) > area) {
+                write_size = area - addr_position;
             }
 
             disk_write((write_addr + addr_position), (buffer + count), write_size);
@@ -187,6 +234,20 @@ Result write_file(File *file, uint8_t *buffer, uint32_t size) {
             addr_position += write_size;
         }
     }
+    disk_overlap_end();
+    for(uint32_t i = 0; i < sectors; i++) {
+        seal_cluster(*(sector_list + i), file, ((i + 1) < sectors));
+    }
+    // 更新文件索引信息, 新数据完整写入后才对文件可见
+    if(replace) {
+        update_fileblock(file->block, file->cluster, file->length);
+        erase_cluster_chain(old_cluster);
+    }else {
+        write_fileblock_cluster(file->block, file->cluster);
+        write_fileblock_length(file->block, file->length);
+    }
+    journal_end(handle);
+
     free(sector_list);
     return WRITE_FILE_SUCCESS;
 }
@@ -201,25 +262,39 @@ Result write_file(File *file, uint8_t *buffer, uint32_t size) {
  * @param size 写入字节数
  * */
 Result append_file(File *file, uint8_t *buffer, uint32_t size) {
+    Result result = append_data(file, buffer, size);
+    if(result == APPEND_FILE_SUCCESS) {
+        trace_record(TRACE_USER_WRITE, file->block, size);
+    }
+    return result;
+}
+
+/**
+ * 追加写文件数据, 内部调用不记录应用层写入
+ * */
+static Result append_data(File *file, uint8_t *buffer, uint32_t size) {
 
     if(file->cluster == 0xFFFFFFFF) return FILE_CANNOT_APPEND;
+    if((FILE_FLAGS(file->state) & FSTATE_DIRECTORY) == 0) return FILE_IS_DIRECTORY;
+    if(INLINE_STORED(file->state, file->cluster)) return append_inline(file, buffer, size);
+    if((FILE_FLAGS(file->state) & FSTATE_COMPRESSED) == 0) return append_compressed(file, buffer, size);
 
     uint8_t gc_flag = 0, zero_flag = 0;
-    uint32_t cursor, temp = 0;
+    uint32_t cursor, temp = 0, position;
     uint32_t next_addr = file->cluster;
 
     uint32_t sectors, *sector_list;
 
-    uint32_t left_size, write_addr;
-    uint32_t write_size = 0, addr_position = 0;
+    uint32_t left_size;
+    uint32_t area = FILE_AREA_SIZE(file->state);
 
     //计算文件结束位置(相对于扇区起始位置偏移量)
-    cursor = (file->length % DATA_AREA_SIZE) + SECTOR_STATE_SIZE;
+    cursor = AREA_MOD(file->length, area) + SECTOR_STATE_SIZE;
     // 遍历找到最后一个扇区首地址
-    if(file->length >= DATA_AREA_SIZE) {
-        sectors = file->length / DATA_AREA_SIZE;
+    if(file->length >= area) {
+        sectors = AREA_DIV(file->length, area);
         for(uint32_t i = 0; i < sectors; i++) {
-            disk_read((next_addr + (DATA_AREA_SIZE + SECTOR_STATE_SIZE)), (uint8_t *)&temp, 4);
+            temp = cluster_next(next_addr);
             if(temp == 0xFFFFFFFF) {
                 zero_flag = 1;
                 break;
@@ -230,49 +305,30 @@ Result append_file(File *file, uint8_t *buffer, uint32_t size) {
 
     if(zero_flag) {
         left_size = 0;
-        write_addr = next_addr + SECTOR_STATE_SIZE + DATA_AREA_SIZE;
+        position = SECTOR_STATE_SIZE + area;
     }else {
         // 计算结束扇区空余空间
-        left_size = (next_addr + SECTOR_STATE_SIZE + DATA_AREA_SIZE) - (next_addr + cursor);
-        // 追加模式写新内容起始地址
-        write_addr = next_addr + cursor;
+        left_size = (SECTOR_STATE_SIZE + area) - cursor;
+        position = cursor;
     }
 
     if(left_size >= size) {
         //结束扇区剩余空间足够写追加内容
-        cursor = 0;
-        file->length += size;
-        while(size) {
-            write_size = (size >= PAGE_SIZE) ? PAGE_SIZE : (size % PAGE_SIZE);
-            disk_write((write_addr + addr_position), (buffer + cursor), write_size);
-            cursor += write_size;
-            addr_position += write_size;
-            size -= write_size;
-        }
+        append_chain(file, &next_addr, 1, position, buffer, size);
         return APPEND_FILE_SUCCESS;
     }
     // 结束扇区剩余空间不够写追加内容
     temp = size - left_size;
     // 计算余下文件内容需要的扇区数量(当前最后扇区也计入)
-    sectors = (temp / DATA_AREA_SIZE) + 1;
-    sectors = (temp % DATA_AREA_SIZE) ? (sectors + 1) : sectors;
+    sectors = AREA_DIV(temp, area) + 1;
+    sectors = AREA_MOD(temp, area) ? (sectors + 1) : sectors;
 
     sector_list = (uint32_t *)malloc(sizeof(uint32_t) * sectors);
     *(sector_list + 0) = next_addr;
 
     // 查找空扇区
     FIND_SECTOR_APPEND:
-    cursor = 1;
-    for(uint32_t sector_index = FB_SECTOR_END; sector_index < SECTOR_SUM; sector_index++) {
-        disk_read(sector_index * SECTOR_SIZE, (uint8_t *)&temp, 1);
-        if((temp & 0xFF) == 0xFF) {
-            *(sector_list + cursor) = sector_index * SECTOR_SIZE;
-            cursor++;
-        }
-        if(cursor >= sectors) {
-            break;
-        }
-    }
+    cursor = find_free_sectors((sector_list + 1), (sectors - 1)) + 1;
 
     // 验证空闲扇区数量是否足以写入文件
     if(cursor != sectors) {
@@ -285,13 +341,36 @@ Result append_file(File *file, uint8_t *buffer, uint32_t size) {
         goto FIND_SECTOR_APPEND;
     }
 
-    cursor = 0;
+    append_chain(file, sector_list, sectors, position, buffer, size);
+    free(sector_list);
+    return APPEND_FILE_SUCCESS;
+}
+
+/**
+ * 从结束簇的指定位置起追加写入, 结束簇写满后依次标记并链接之后的簇
+ * 追加写会话开始时记录追加前的文件大小与写入起始位置, 掉电后回滚到该位置
+ * @param *file 文件指针, 文件大小随写入增加
+ * @param *sector_list 结束簇与之后的空闲簇地址
+ * @param sectors 簇数(含结束簇)
+ * @param position 结束簇内的写入起始位置(相对于扇区起始位置偏移量)
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数, 恰好需要sectors个簇
+ * */
+void append_chain(File *file, uint32_t *sector_list, uint32_t sectors, uint32_t position, uint8_t *buffer, uint32_t size) {
+    uint32_t cursor = 0, write_size, addr_position;
+    uint32_t area = FILE_AREA_SIZE(file->state);
+    uint32_t left_size = (SECTOR_STATE_SIZE + area) - position;
+    uint32_t write_addr = *(sector_list + 0) + position;
+
+    if(journal_find(JOURNAL_APPEND, file->block) == 0xFFFFFFFF) {
+        journal_begin(JOURNAL_APPEND, file->block, file->length, CLUSTER_POSITION(*(sector_list + 0), position));
+    }
     file->length += size;
     // sector loop
     for(uint32_t i = 0; i < sectors; i++) {
         if(i > 0) {
-            left_size = DATA_AREA_SIZE;
-            write_value(*(sector_list + i), 0xFF00, SECTOR_STATE_SIZE);
+            left_size = area;
+            cluster_mark(*(sector_list + i));
             write_addr = *(sector_list + i) + SECTOR_STATE_SIZE;
         }
         write_size = 0;
@@ -300,10 +379,12 @@ Result append_file(File *file, uint8_t *buffer, uint32_t size) {
         while(size) {
             if(addr_position >= left_size) {
                 // 写下一扇区地址,跳出循环更换扇区
-                write_value((write_addr + addr_position), *(sector_list + i + 1), 4);
+                cluster_link(*(sector_list + i), *(sector_list + i + 1));
+                seal_cluster(*(sector_list + i), file, 1);
                 break;
             }
-            write_size = (size >= PAGE_SIZE) ? PAGE_SIZE : (size % PAGE_SIZE);
+            write_size = PAGE_SIZE - ((write_addr + addr_position) % PAGE_SIZE);
+            write_size = (write_size > size) ? size : write_size;
             if((addr_position + write_size) > left_size) {
                 write_size = left_size - addr_position;
             }
@@ -313,24 +394,134 @@ Result append_file(File *file, uint8_t *buffer, uint32_t size) {
             addr_position += write_size;
         }
     }
-
-    free(sector_list);
-    return APPEND_FILE_SUCCESS;
 }
 
 /**
  * 追加写完成
  * 更新文件块记录信息
  * @param *file 文件指针
- * @return APPEND_FILE_FINISH 追加写完成,更新文件索引的length字段
+ * @return APPEND_FILE_FINISH 追加写完成,更新文件索引的length字段, FILE_CANNOT_APPEND 环形文件无法写入状态记录(追加写保持未提交)
  * */
 Result append_finish(File *file) {
-    update_fileblock_length(file);
+    // 内联文件的数据与大小已随每次追加写提交
+    if(INLINE_STORED(file->state, file->cluster)) {
+        return APPEND_FILE_FINISH;
+    }
+    // 校验文件先封存结束簇, 回滚时重新封存
+    if((FILE_FLAGS(file->state) & FSTATE_CHECKSUM) == 0) {
+        seal_cluster(tail_cluster(file->cluster), file, 0);
+    }
+    if((FILE_FLAGS(file->state) & FSTATE_RING) == 0 && file->cluster != 0xFFFFFFFF) {
+        // 环形文件的文件大小写入日志记录, 不改写文件块
+        if(!ring_commit(file)) {
+            return FILE_CANNOT_APPEND;
+        }
+    }else {
+        update_fileblock_length(file);
+    }
+    journal_end(journal_find(JOURNAL_APPEND, file->block));
     return APPEND_FILE_FINISH;
 }
 
+/**
+ * 按偏移覆盖写文件
+ * 只替换涉及的簇: 新内容写入空闲扇区, 重写前一簇的下一簇地址(或文件块首簇地址)后擦除旧簇, 掉电后整体回滚或完成
+ * 写入范围超出文件大小的部分按追加写处理; 压缩文件与内联文件读出全部数据修改后覆盖写
+ * 存在未完成的追加写时先完成追加写
+ * @param *file 文件指针
+ * @param offset 写入起始偏移(不超过文件大小)
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数
+ * @return WRITE_FILE_SUCCESS, FILE_OUT_OF_RANGE:偏移超出文件大小
+ * */
+Result spifs_pwrite(File *file, uint32_t offset, uint8_t *buffer, uint32_t size) {
+    Result result = pwrite_data(file, offset, buffer, size);
+    if(result == WRITE_FILE_SUCCESS) {
+        trace_record(TRACE_USER_WRITE, file->block, size);
+    }
+    return result;
+}
+
+/**
+ * 按偏移覆盖写文件数据, 内部调用不记录应用层写入
+ * */
+static Result pwrite_data(File *file, uint32_t offset, uint8_t *buffer, uint32_t size) {
+    Result result;
+    uint32_t inner;
+
+    if(file->block == 0xFFFFFFFF) return FILE_UNALLOCATED;
+    if((FILE_FLAGS(file->state) & FSTATE_DIRECTORY) == 0) return FILE_IS_DIRECTORY;
+    if(file->cluster == 0xFFFFFFFF) {
+        return (offset == 0) ? write_data(file, buffer, size) : FILE_OUT_OF_RANGE;
+    }
+    if(offset > file->length) return FILE_OUT_OF_RANGE;
+    if(journal_find(JOURNAL_APPEND, file->block) != 0xFFFFFFFF) {
+        append_finish(file);
+    }
+    if(size == 0) {
+        return WRITE_FILE_SUCCESS;
+    }
+    if(INLINE_STORED(file->state, file->cluster) || (FILE_FLAGS(file->state) & FSTATE_COMPRESSED) == 0) {
+        inner = ((offset + size) > file->length) ? (offset + size) : file->length;
+        return rewrite_whole(file, offset, buffer, size, inner);
+    }
+
+    inner = ((file->length - offset) < size) ? (file->length - offset) : size;
+    if(inner) {
+        result = pwrite_clusters(file, offset, buffer, inner);
+        if(result != WRITE_FILE_SUCCESS) {
+            return result;
+        }
+    }
+    if(size > inner) {
+        result = append_data(file, (buffer + inner), (size - inner));
+        append_finish(file);
+        if(result != APPEND_FILE_SUCCESS) {
+            return result;
+        }
+    }
+    return WRITE_FILE_SUCCESS;
+}
+
+/**
+ * 截断文件
+ * 先更新文件块记录的文件大小, 再清除结束簇中截断位置之后的内容并释放其后的簇链, 其余簇保持不变
+ * 压缩文件与内联文件读出保留部分后覆盖写
+ * 存在未完成的追加写时先完成追加写
+ * @param *file 文件指针
+ * @param length 截断后文件大小(不超过当前文件大小)
+ * @return WRITE_FILE_SUCCESS, FILE_OUT_OF_RANGE:超出文件大小
+ * */
+Result spifs_truncate(File *file, uint32_t length) {
+    uint32_t handle, address;
+
+    if(file->block == 0xFFFFFFFF) return FILE_UNALLOCATED;
+    if((FILE_FLAGS(file->state) & FSTATE_DIRECTORY) == 0) return FILE_IS_DIRECTORY;
+    if(file->cluster == 0xFFFFFFFF) {
+        return (length == 0) ? WRITE_FILE_SUCCESS : FILE_OUT_OF_RANGE;
+    }
+    if(journal_find(JOURNAL_APPEND, file->block) != 0xFFFFFFFF) {
+        append_finish(file);
+    }
+    if(length > file->length) return FILE_OUT_OF_RANGE;
+    if(length == file->length) return WRITE_FILE_SUCCESS;
+    if(INLINE_STORED(file->state, file->cluster) || (FILE_FLAGS(file->state) & FSTATE_COMPRESSED) == 0) {
+        return rewrite_whole(file, 0, NULL, 0, length);
+    }
+
+    ring_forget(file->block);
+    address = chain_position(file->cluster, length, FILE_AREA_SIZE(file->state));
+    handle = journal_begin(JOURNAL_TRUNCATE, file->block, length, address);
+    update_fileblock(file->block, file->cluster, length);
+    append_rollback(file->block, length, address);
+    journal_end(handle);
+    file->length = length;
+    return WRITE_FILE_SUCCESS;
+}
+
 /**
  * 根据文件名+拓展名打开文件
+ * 文件名与拓展名按完整的12字节比较(不足部分为0xFF), 布隆过滤器判定不存在时不扫描索引扇区
  * @param file 文件指针
  * @param filename 文件名
  * @param extname 拓展名
@@ -339,18 +530,27 @@ Result append_finish(File *file) {
 uint8_t open_file(File *file, char *filename, char *extname) {
     FileBlock *fb;
     uint32_t addr_start, addr_end;
-    uint8_t *slot_buffer = (uint8_t *)malloc(sizeof(uint8_t) * FILEBLOCK_SIZE);
+    uint8_t name[FILENAME_FULLSIZE];
+    uint8_t *slot_buffer;
 
+    copy_filename(filename, name, strlen(filename), 8);
+    copy_filename(extname, (name + 8), strlen(extname), 4);
+    if(!bloom_contains(name)) {
+        return 0;
+    }
+    slot_buffer = (uint8_t *)malloc(sizeof(uint8_t) * FILEBLOCK_SIZE);
     for(uint32_t i = FB_SECTOR_INIT; i < FB_SECTOR_END; ++i) {
         addr_start = i * SECTOR_SIZE;
         addr_end = addr_start + SECTOR_SIZE;
         while((addr_end - addr_start) >= FILEBLOCK_SIZE) {
             disk_read(addr_start, slot_buffer, FILEBLOCK_SIZE);
             fb = (FileBlock *)slot_buffer;
-            if(comp_filename(fb->extname, extname, strlen(extname)) && comp_filename(fb->filename, filename, strlen(filename))) {
+            if(bulk_equal(fb->filename, name, FILENAME_FULLSIZE)) {
                 file->block = addr_start;
                 file->cluster = fb->cluster;
                 file->length = fb->length;
+                file->state = fb->state;
+                ring_resolve(file->block, &file->cluster, &file->length);
                 copy_filename(filename, file->filename, strlen(filename), 8);
                 copy_filename(extname, file->extname, strlen(extname), 4);
                 free(slot_buffer);
@@ -360,6 +560,7 @@ uint8_t open_file(File *file, char *filename, char *extname) {
         }
     }
     free(slot_buffer);
+    bloom_miss();
     return 0;
 }
 
@@ -374,41 +575,16 @@ uint8_t read_state(File *file, FileState *state) {
 }
 
 uint8_t read_file(File *file, uint8_t *buffer, uint32_t offset, uint32_t size) {
-    uint32_t cursor = 0, read_size;
-    uint32_t addr_start = file->cluster;
-    uint32_t addr_cluster = 0, cluster_limit;
-    uint32_t sectors = offset / DATA_AREA_SIZE;
-    // 边界检查
-    if(offset >= file->length || (file->length - offset) < size) {
-        return 0;
-    }
-    for(uint32_t i = 0; i < sectors; i++) {
-        disk_read((addr_start + SECTOR_STATE_SIZE + DATA_AREA_SIZE), (uint8_t *)&addr_cluster, 4);
-        addr_start = addr_cluster;
-    }
-    // 扇区读写地址范围
-    cluster_limit = addr_start + SECTOR_STATE_SIZE + DATA_AREA_SIZE;
-    addr_start = addr_start + SECTOR_STATE_SIZE + (offset - sectors * DATA_AREA_SIZE);
+    return read_data(file, buffer, offset, size, 0);
+}
 
-    while(size) {
-        // 计算分块读取块大小
-        read_size = (size > 256) ? 256 : size;
-        read_size = ((addr_start + read_size) > cluster_limit) ? (cluster_limit - addr_start) : read_size;
-        // 切换下一扇区
-        if(read_size <= 0) {
-            disk_read(cluster_limit, (uint8_t *)&addr_cluster, 4);
-            cluster_limit = addr_cluster + SECTOR_STATE_SIZE + DATA_AREA_SIZE;
-            addr_start = addr_cluster + SECTOR_STATE_SIZE;
-            continue;
-        }
-        // 读取数据
-        disk_read(addr_start, (buffer + cursor), read_size);
-        // 更新地址偏移
-        addr_start += read_size;
-        cursor += read_size;
-        size -= read_size;
-    }
-    return 1;
+/**
+ * 读取文件并校验读取范围涉及的簇
+ * 非校验文件等同于read_file
+ * @return 0:超出文件范围或校验失败, 1:读取成功
+ * */
+uint8_t read_file_verify(File *file, uint8_t *buffer, uint32_t offset, uint32_t size) {
+    return read_data(file, buffer, offset, size, 1);
 }
 
 /**
@@ -419,8 +595,13 @@ uint8_t read_file(File *file, uint8_t *buffer, uint32_t offset, uint32_t size) {
 void delete_file(File *file) {
     uint8_t state = 0xFF;
     disk_read((file->block + 23), &state, 1);
-    state &= ~0x1;
+    state &= ~FSTATE_DELETED;
+    // 目录下的环形文件随目录回收, 全部写回文件块
+    ring_forget(((state & FSTATE_DIRECTORY) == 0) ? 0xFFFFFFFF : file->block);
+    statfs_delete(file->block);
     write_fileblock_state(file->block, state);
+    // 未完成的追加写无需回滚, 数据随文件一起回收
+    journal_end(journal_find(JOURNAL_APPEND, file->block));
 }
 
 /**
@@ -441,13 +622,15 @@ FileList *list_file() {
         while(addr_end - addr_start >= FILEBLOCK_SIZE) {
             disk_read(addr_start, cache, FILEBLOCK_SIZE);
             fb = (FileBlock *)cache;
-            if((fb->state != 0xFFFFFFFF) && (fb->length != 0xFFFFFFFF)) {
+            if(!fileblock_continuation(fb) && (fb->state != 0xFFFFFFFF) && (fb->length != 0xFFFFFFFF)) {
                 FileList *item = (FileList *)malloc(sizeof(FileList));
                 array_copy(fb->filename, item->File.filename, 8);
                 array_copy(fb->extname, item->File.extname, 4);
                 item->File.block = addr_start;
                 item->File.cluster = fb->cluster;
                 item->File.length = fb->length;
+                item->File.state = fb->state;
+                ring_resolve(addr_start, &item->File.cluster, &item->File.length);
                 item->prev = index;
                 index = item;
             }
@@ -471,23 +654,40 @@ void recycle_filelist(FileList *list) {
     }
 }
 
+/**
+ * 更新文件块记录的文件大小
+ * @param *file 文件指针
+ * */
 void update_fileblock_length(File *file) {
+    update_fileblock(file->block, file->cluster, file->length);
+}
+
+/**
+ * 重写文件块记录的首簇地址与文件大小
+ * 经影子扇区重写索引所在扇区, 掉电后挂载时完成重写
+ * @param fbaddr 文件块地址
+ * @param cluster 首簇地址
+ * @param length 文件大小
+ * */
+void update_fileblock(uint32_t fbaddr, uint32_t cluster, uint32_t length) {
     uint32_t fb_sector, write_addr;
     uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    batch_hold(fbaddr);
     // 文件块所在扇区首地址
-    fb_sector = (file->block / SECTOR_SIZE) * SECTOR_SIZE;
+    fb_sector = (fbaddr / SECTOR_SIZE) * SECTOR_SIZE;
     disk_read(fb_sector, sector_buffer, SECTOR_SIZE);
-    write_addr = (file->block - fb_sector);
-    //写新文件大小
-    for(uint32_t i = 0; i < 4; i++) {
-        *(sector_buffer + write_addr + 16 + i) = ((file->length >> (i << 3)) & 0xFF);
+    write_addr = (fbaddr - fb_sector);
+    // 记录未变化时无需重写
+    if(*(uint32_t *)(sector_buffer + write_addr + 12) == cluster && *(uint32_t *)(sector_buffer + write_addr + 16) == length) {
+        free(sector_buffer);
+        return;
     }
-    //擦除原扇区
-    sector_erase(fb_sector);
-    //回写数据
-    for(uint32_t i = 0; i < 16; i++) {
-        disk_write((fb_sector + i * 256), (sector_buffer + i * 256), 256);
+    //写首簇地址与新文件大小
+    for(uint32_t i = 0; i < 4; i++) {
+        *(sector_buffer + write_addr + 12 + i) = ((cluster >> (i << 3)) & 0xFF);
+        *(sector_buffer + write_addr + 16 + i) = ((length >> (i << 3)) & 0xFF);
     }
+    journal_rewrite_sector(fb_sector, sector_buffer);
     free(sector_buffer);
 }
 
@@ -498,53 +698,1199 @@ void update_fileblock_length(File *file) {
  * 当空间不足时才进行全盘扫描, 删除标记的文件数据
  * */
 void spifs_gc() {
+    for(uint32_t fb_index = FB_SECTOR_INIT; fb_index < FB_SECTOR_END; fb_index++) {
+        gc_fileblock_sector(fb_index * SECTOR_SIZE);
+    }
+}
 
+/**
+ * 回收单个文件索引扇区
+ * 先擦除被删除文件的数据扇区, 再经影子扇区重写索引扇区
+ * 不属于存活内联文件的数据槽位(文件已删除, 数据已移出或写入被打断)一并清除
+ * 回收过程记录于意图日志, 掉电后挂载时重新执行, 避免已擦除的扇区被重新分配后再次被擦除
+ * @param sector 文件索引扇区首地址
+ * */
+void gc_fileblock_sector(uint32_t sector) {
     FileBlock *fb = NULL;
 
-    uint8_t rewrite = 0;
-    uint32_t offset = 0, fb_index, addr_cluster;
+    uint8_t rewrite = 0, flags;
+    uint32_t offset, handle = 0xFFFFFFFF;
+    uint8_t live[SECTOR_SIZE / FILEBLOCK_SIZE];
 
-    uint8_t *slot_buffer = (uint8_t *)malloc(sizeof(uint8_t) * FILEBLOCK_SIZE);
     uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
 
-    for(fb_index = FB_SECTOR_INIT; fb_index < FB_SECTOR_END; fb_index++) {
+    disk_read(sector, sector_buffer, SECTOR_SIZE);
+    inline_mark(sector_buffer, 0, live);
+
+    for(offset = 0; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+        fb = (FileBlock *)(sector_buffer + offset);
+        if(fileblock_empty(fb)) {
+            continue;
+        }
+        if(fileblock_continuation(fb)) {
+            if(live[offset / FILEBLOCK_SIZE] == 0) {
+                if(handle == 0xFFFFFFFF) {
+                    handle = journal_begin(JOURNAL_GC, sector, 0, 0);
+                }
+                clear_fileblock(sector_buffer, offset);
+                rewrite = 1;
+            }
+            continue;
+        }
+        flags = FILE_FLAGS(fb->state);
+        // 文件被标识为删除, 或创建文件但未填充数据
+        if(((flags & FSTATE_DELETED) == 0) || (fb->cluster == 0xFFFFFFFF)) {
+            if(handle == 0xFFFFFFFF) {
+                handle = journal_begin(JOURNAL_GC, sector, 0, 0);
+            }
+            if(fb->cluster != 0xFFFFFFFF) {
+                if((flags & FSTATE_DIRECTORY) == 0) {
+                    // 回收目录下全部文件与目录表扇区
+                    dir_gc(fb->cluster, 1);
+                }else {
+                    // 根据链表擦除文件占用扇区
+                    erase_cluster_chain(fb->cluster);
+                }
+            }
+            // 清除文件索引信息
+            clear_fileblock(sector_buffer, offset);
+            rewrite = 1;
+        }else if((flags & FSTATE_DIRECTORY) == 0) {
+            // 目录自身未删除, 整理目录表中被删除的项
+            dir_gc(fb->cluster, 0);
+        }
+    }
+    // 擦除文件索引扇区，回写新文件索引表
+    if(rewrite == 1) {
+        journal_rewrite_sector(sector, sector_buffer);
+        // 被清除的文件名仍在过滤器中, 重新建立
+        bloom_build();
+    }
+    journal_end(handle);
+    free(sector_buffer);
+}
+
+/**
+ * 查找空闲扇区(未写占用标记)
+ * @param *sector_list 空闲扇区首地址输出列表
+ * @param sectors 需要的扇区数
+ * @return 实际找到的扇区数
+ * */
+uint32_t find_free_sectors(uint32_t *sector_list, uint32_t sectors) {
+    uint32_t count = 0;
+    for(uint32_t sector_index = FB_SECTOR_END; (sector_index < DATA_SECTOR_END) && (count < sectors); sector_index++) {
+        if(!cluster_inuse(sector_index * SECTOR_SIZE)) {
+            *(sector_list + count) = sector_index * SECTOR_SIZE;
+            count++;
+        }
+    }
+    return count;
+}
 
-        disk_read((fb_index * SECTOR_SIZE), sector_buffer, SECTOR_SIZE);
+/**
+ * 根据链表擦除文件占用扇区
+ * 先遍历簇链再逆序擦除, 掉电后从首簇重新遍历仍可找到剩余扇区
+ * 条带卷上每次从链尾取设备数量个扇区并行擦除, 擦除前记录JOURNAL_ERASE, 掉电后由重放擦除整组; 无法记录时逐个擦除
+ * @param cluster 文件首簇地址
+ * */
+void erase_cluster_chain(uint32_t cluster) {
+    uint32_t count = 0, wave, handle, *chain;
+    uint32_t stripes = (disk_stripes() < JOURNAL_ERASE_SUM) ? disk_stripes() : JOURNAL_ERASE_SUM;
+    chain = (uint32_t *)malloc(sizeof(uint32_t) * (DATA_SECTOR_END - FB_SECTOR_END));
+    while(cluster_inuse(cluster) && count < (DATA_SECTOR_END - FB_SECTOR_END)) {
+        *(chain + count) = cluster;
+        count++;
+        cluster = cluster_next(cluster);
+    }
+    while(count) {
+        wave = (count < stripes) ? count : stripes;
+        if(wave == 1) {
+            count--;
+            cluster_erase(*(chain + count));
+            continue;
+        }
+        count -= wave;
+        handle = erase_wave_begin((chain + count), wave);
+        if(handle == 0xFFFFFFFF) {
+            for(uint32_t i = wave; i > 0; i--) {
+                cluster_erase(*(chain + count + i - 1));
+            }
+            continue;
+        }
+        disk_overlap_begin();
+        for(uint32_t i = wave; i > 0; i--) {
+            sector_erase(*(chain + count + i - 1));
+        }
+        disk_overlap_end();
+        // 整组擦除完成后释放
+        for(uint32_t i = wave; i > 0; i--) {
+            cluster_release(*(chain + count + i - 1));
+        }
+        journal_end(handle);
+    }
+    free(chain);
+}
 
-        while((SECTOR_SIZE - offset) >= FILEBLOCK_SIZE) {
+/**
+ * 记录一组并行擦除的扇区
+ * @param *sectors 扇区地址
+ * @param count 扇区数, 不超过JOURNAL_ERASE_SUM
+ * @return 记录句柄
+ * */
+static uint32_t erase_wave_begin(uint32_t *sectors, uint32_t count) {
+    uint32_t args[3] = {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}, index;
+    for(uint32_t i = 0; i < JOURNAL_ERASE_SUM; i++) {
+        index = (i < count) ? (*(sectors + i) / SECTOR_SIZE) : 0x3FF;
+        args[i / 3] = (args[i / 3] & ~(0x3FFu << ((i % 3) * 10))) | (index << ((i % 3) * 10));
+    }
+    return journal_begin(JOURNAL_ERASE, args[0], args[1], args[2]);
+}
 
-            array_copy((sector_buffer + offset), slot_buffer, FILEBLOCK_SIZE);
-            fb = (FileBlock *)slot_buffer;
+/**
+ * 文件索引槽位未存放文件(文件名与拓展名均为0xFF)
+ * @param *fb 文件块指针
+ * */
+uint8_t fileblock_empty(FileBlock *fb) {
+    return bulk_erased((uint8_t *)fb, FILENAME_FULLSIZE);
+}
+
+/**
+ * 文件索引槽位为内联文件的数据槽位(首字节为0x00)
+ * @param *fb 文件块指针
+ * */
+uint8_t fileblock_continuation(FileBlock *fb) {
+    return (fb->filename[0] == 0x00);
+}
+
+/**
+ * 标记索引扇区中属于存活内联文件的数据槽位
+ * @param *sector_buffer 索引扇区内容(根目录索引扇区或目录表扇区)
+ * @param base 首个槽位在扇区内的偏移
+ * @param *live 输出: 每个槽位一字节, 1表示存活内联文件的数据槽位
+ * */
+void inline_mark(uint8_t *sector_buffer, uint32_t base, uint8_t *live) {
+    FileBlock *fb;
+    uint32_t slots = (SECTOR_SIZE - base) / FILEBLOCK_SIZE, index;
+
+    array_fill(live, 0, slots);
+    for(uint32_t i = 0; i < slots; i++) {
+        fb = (FileBlock *)(sector_buffer + base + i * FILEBLOCK_SIZE);
+        if(fileblock_empty(fb) || fileblock_continuation(fb) || (FILE_FLAGS(fb->state) & FSTATE_DELETED) == 0
+                || !INLINE_STORED(fb->state, fb->cluster)) {
+            continue;
+        }
+        index = fb->cluster >> 4;
+        for(uint32_t j = 0; j < (fb->cluster & 0x0F) && (index + j) < slots; j++) {
+            *(live + index + j) = 1;
+        }
+    }
+}
+
+/**
+ * 挂载文件系统
+ * 重放意图日志中未完成的操作, 使掉电时进行中的操作回滚或完成
+ * 耗时与掉电时进行中的操作数量成正比, 不扫描整个存储器
+ * 视为重新上电, 未完成的异步操作与排队的命令被丢弃
+ * @return 重放的日志记录数
+ * */
+uint32_t spifs_mount() {
+    uint32_t replayed;
+    async_discard();
+    batch_discard();
+    ring_invalidate();
+    disk_cache_invalidate();
+    statfs_invalidate();
+    replayed = journal_mount();
+    bloom_build();
+    return replayed;
+}
 
-            // 文件被标识为删除
-            if(((fb->state >> 24) & 0x1) == 0) {
-                // 根据链表擦除文件占用扇区
-                while(fb->cluster != 0xFFFFFFFF) {
-                    disk_read((fb->cluster + SECTOR_STATE_SIZE + DATA_AREA_SIZE), (uint8_t *)&addr_cluster, 4);
-                    sector_erase(fb->cluster);
-                    fb->cluster = addr_cluster;
+/**
+ * 重放单条未完成的日志记录, 由journal_mount调用
+ * 各类型的重放操作均可重复执行
+ * @param *record 日志记录
+ * */
+void spifs_recover(JournalRecord *record) {
+    uint32_t value[2];
+    switch(record->type) {
+        case JOURNAL_ALLOC_NEW:
+            // 首簇地址已写入则补写文件大小, 否则释放新数据链
+            disk_read(record->arg0 + 12, (uint8_t *)value, 8);
+            if(value[0] == record->arg1) {
+                // 文件大小未写入或写入不完整, 补写后与记录一致
+                if(value[1] != record->arg2) {
+                    write_fileblock_length(record->arg0, record->arg2);
+                }
+            }else {
+                erase_cluster_chain(record->arg1);
+                if(value[0] != 0xFFFFFFFF) {
+                    update_fileblock(record->arg0, 0xFFFFFFFF, 0xFFFFFFFF);
                 }
-                // 清除文件索引信息
-                clear_fileblock(sector_buffer, offset);
-                rewrite = 1;
             }
-            // 创建文件但未填充数据
-            if(fb->cluster == 0xFFFFFFFF) {
-                // 清除文件索引信息
-                clear_fileblock(sector_buffer, offset);
-                rewrite = 1;
+            break;
+        case JOURNAL_ALLOC_REPLACE:
+            // 文件块已指向新数据链则释放旧数据链, 否则释放新数据链
+            disk_read(record->arg0 + 12, (uint8_t *)value, 8);
+            ring_resolve(record->arg0, &value[0], &value[1]);
+            erase_cluster_chain((value[0] == record->arg1) ? record->arg2 : record->arg1);
+            break;
+        case JOURNAL_ALLOC_LINK:
+            disk_read(record->arg0, (uint8_t *)value, 4);
+            if(value[0] != record->arg1) {
+                cluster_erase(record->arg1);
+                // 引用字段写入不完整, 重写所在扇区将其恢复为FFFFFFFF
+                if(value[0] != 0xFFFFFFFF) {
+                    clear_reference(record->arg0);
+                }
+            }
+            break;
+        case JOURNAL_APPEND:
+            append_rollback(record->arg0, record->arg1, record->arg2);
+            break;
+        case JOURNAL_FREE:
+            erase_cluster_chain(record->arg0);
+            break;
+        case JOURNAL_GC:
+            if(record->arg1) {
+                dir_gc_table(record->arg0, 0);
+            }else {
+                gc_fileblock_sector(record->arg0);
+            }
+            break;
+        case JOURNAL_RELINK:
+            // 引用字段已指向新段则擦除旧段, 否则擦除新段
+            value[0] = reference_read(record->arg0);
+            if(value[0] == record->arg1) {
+                relink_erase(record->arg2, record->arg1);
+            }else {
+                relink_erase(record->arg1, record->arg2);
             }
-            offset += FILEBLOCK_SIZE;
-        }
-        // 擦除文件索引扇区，回写新文件索引表
-        if(rewrite == 1) {
-            rewrite = 0;
-            sector_erase(fb_index * SECTOR_SIZE);
-            for(uint32_t i = 0 ; i < 16; i++) {
-                disk_write((fb_index * SECTOR_SIZE + i * PAGE_SIZE), (sector_buffer + i * PAGE_SIZE), PAGE_SIZE);
+            break;
+        case JOURNAL_TRUNCATE:
+            // 文件块已记录截断后的大小则完成截断, 否则截断尚未开始
+            append_rollback(record->arg0, record->arg1, record->arg2);
+            break;
+        case JOURNAL_ERASE:
+            // 组内扇区的擦除顺序不确定, 全部重新擦除
+            for(uint32_t i = 0; i < JOURNAL_ERASE_SUM; i++) {
+                value[1] = (i < 3) ? record->arg0 : ((i < 6) ? record->arg1 : record->arg2);
+                value[0] = (value[1] >> ((i % 3) * 10)) & 0x3FF;
+                if(value[0] >= FB_SECTOR_END && value[0] < DATA_SECTOR_END) {
+                    cluster_erase(value[0] * SECTOR_SIZE);
+                }
             }
+            break;
+    }
+}
+
+/**
+ * 将引用字段(4字节)恢复为FFFFFFFF, 经影子扇区重写所在扇区
+ * @param address 引用字段地址
+ * */
+static void clear_reference(uint32_t address) {
+    uint32_t sector = (address / SECTOR_SIZE) * SECTOR_SIZE;
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    disk_read(sector, sector_buffer, SECTOR_SIZE);
+    array_fill((sector_buffer + (address - sector)), 0xFF, 4);
+    journal_rewrite_sector(sector, sector_buffer);
+    free(sector_buffer);
+}
+
+/**
+ * 回滚未完成的追加写, 同时用于完成截断
+ * 清除结束簇中追加写起始地址之后的内容与下一簇地址, 释放追加的簇链
+ * 校验文件的结束簇按恢复后的内容重新封存
+ * @param fbaddr 文件块地址
+ * @param length 追加前文件大小
+ * @param address 追加写起始位置(CLUSTER_POSITION, 位于追加前的结束簇内)
+ * */
+static void append_rollback(uint32_t fbaddr, uint32_t length, uint32_t address) {
+    FileBlock fb;
+    uint8_t dirty = 0, checked;
+    uint32_t cluster, offset, next, handle = 0xFFFFFFFF;
+    uint8_t *sector_buffer;
+
+    cluster = POSITION_CLUSTER(address);
+    offset = POSITION_OFFSET(address);
+    disk_read(fbaddr, (uint8_t *)&fb, FILEBLOCK_SIZE);
+    ring_resolve(fbaddr, &fb.cluster, &fb.length);
+    // append_finish已完成重写, 或簇已被回收
+    if(fb.length != length || !cluster_inuse(cluster)) {
+        return;
+    }
+
+    checked = ((FILE_FLAGS(fb.state) & FSTATE_CHECKSUM) == 0);
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    // 校验文件的封存值与恢复后的内容不一致时同样需要重写
+    if(checked && verify_cluster(cluster, fbaddr, sector_buffer) != 1) {
+        dirty = 1;
+    }
+    disk_read(cluster, sector_buffer, SECTOR_SIZE);
+    next = image_next(cluster, sector_buffer);
+    if(!dirty && checked) {
+        // 封存槽位单独判断
+        dirty = (offset < SEAL_SLOT_OFFSET && !bulk_erased((sector_buffer + offset), (SEAL_SLOT_OFFSET - offset)));
+    }else if(!dirty) {
+        dirty = !bulk_erased((sector_buffer + offset), (SECTOR_SIZE - offset));
+    }
+    dirty = dirty || (next != 0xFFFFFFFF);
+    if(dirty) {
+        if(next != 0xFFFFFFFF) {
+            handle = journal_begin(JOURNAL_FREE, next, 0, 0);
+        }
+        array_fill((sector_buffer + offset), 0xFF, (SECTOR_SIZE - offset));
+        if(checked) {
+            array_fill((sector_buffer + SEAL_SLOT_OFFSET), 0xFF, (SEAL_SLOT_SUM * 4));
+            *(uint32_t *)(sector_buffer + SEAL_SLOT_OFFSET) = cluster_crc(sector_buffer, fbaddr);
         }
+        journal_rewrite_sector(cluster, sector_buffer);
+#ifdef SPIFS_LINK_TABLE
+        cluster_relink(cluster, 0xFFFFFFFF);
+#endif
+        erase_cluster_chain(next);
+        journal_end(handle);
     }
     free(sector_buffer);
-    free(slot_buffer);
+}
+
+/**
+ * 覆盖写压缩文件
+ * 簇数由压缩结果决定, 按需查找空闲簇; 空闲扇区不足时释放新数据链,
+ * 文件存在数据则与非压缩文件相同先擦除旧数据再重试(此时掉电将丢失旧数据)
+ * @param *file 文件指针
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数
+ * */
+static Result write_compressed(File *file, uint8_t *buffer, uint32_t size) {
+    uint8_t replace;
+    uint32_t head, cluster, position, handle, old_cluster = file->cluster;
+
+    replace = (file->cluster != 0xFFFFFFFF || file->length != 0xFFFFFFFF);
+    while(1) {
+        if(find_free_sectors(&head, 1) == 1) {
+            if(replace) {
+                handle = journal_begin(JOURNAL_ALLOC_REPLACE, file->block, head, old_cluster);
+            }else {
+                handle = journal_begin(JOURNAL_ALLOC_NEW, file->block, head, size);
+            }
+            cluster_mark(head);
+            cluster = head;
+            position = SECTOR_STATE_SIZE;
+            if(compress_chain(file, &cluster, &position, buffer, size) == size) {
+                break;
+            }
+            erase_cluster_chain(head);
+            journal_end(handle);
+        }
+        if(!replace) {
+            return NO_SECTOR_SPACE;
+        }
+        handle = journal_begin(JOURNAL_FREE, old_cluster, 0, 0);
+        update_fileblock(file->block, 0xFFFFFFFF, 0xFFFFFFFF);
+        erase_cluster_chain(old_cluster);
+        journal_end(handle);
+        file->cluster = 0xFFFFFFFF;
+        file->length = 0xFFFFFFFF;
+        replace = 0;
+    }
+
+    seal_cluster(cluster, file, 0);
+    file->cluster = head;
+    file->length = size;
+    if(replace) {
+        update_fileblock(file->block, file->cluster, file->length);
+        erase_cluster_chain(old_cluster);
+    }else {
+        write_fileblock_cluster(file->block, file->cluster);
+        write_fileblock_length(file->block, file->length);
+    }
+    journal_end(handle);
+    return WRITE_FILE_SUCCESS;
+}
+
+/**
+ * 追加写压缩文件
+ * 每次调用的数据单独压缩, 频繁的小块追加宜先在内存中合并
+ * 空闲扇区不足时保留已写入的部分, file->length为实际写入后的大小
+ * @param *file 文件指针
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数
+ * */
+static Result append_compressed(File *file, uint8_t *buffer, uint32_t size) {
+    uint32_t cluster, position, written;
+
+    cluster = tail_cluster(file->cluster);
+    position = compressed_end(cluster, FILE_AREA_SIZE(file->state));
+
+    if(journal_find(JOURNAL_APPEND, file->block) == 0xFFFFFFFF) {
+        journal_begin(JOURNAL_APPEND, file->block, file->length, CLUSTER_POSITION(cluster, position));
+    }
+
+    written = compress_chain(file, &cluster, &position, buffer, size);
+    if(written != size) {
+        spifs_gc();
+        written += compress_chain(file, &cluster, &position, (buffer + written), (size - written));
+    }
+    file->length += written;
+    return (written == size) ? APPEND_FILE_SUCCESS : NO_SECTOR_SPACE;
+}
+
+/**
+ * 读取压缩文件
+ * 经压缩块头跳过偏移之前的数据, 只解压与读取范围重叠的压缩块
+ * @param *file 文件指针
+ * @param *buffer 读出数据缓冲区
+ * @param offset 读取起始偏移(压缩前)
+ * @param size 读取字节数
+ * @param *sector_buffer 非NULL时校验解压涉及的簇, 压缩数据从扇区缓存中读取
+ * @return 0:数据损坏或校验失败, 1:读取成功
+ * */
+static uint8_t read_compressed(File *file, uint8_t *buffer, uint32_t offset, uint32_t size, uint8_t *sector_buffer) {
+    uint16_t header[2];
+    uint32_t cluster = file->cluster, position = SECTOR_STATE_SIZE, verified = 0xFFFFFFFF;
+    uint32_t base = 0, cursor = 0, start, copy;
+    uint32_t area_end = SECTOR_STATE_SIZE + FILE_AREA_SIZE(file->state);
+    uint8_t result = 1;
+    uint8_t *packed = NULL, *block = NULL;
+
+    while(size) {
+        header[0] = 0xFFFF;
+        if((position + LZ_HEADER_SIZE) <= area_end) {
+            disk_read((cluster + position), (uint8_t *)header, LZ_HEADER_SIZE);
+        }
+        // 簇内无后续压缩块, 切换下一簇
+        if(header[0] == 0xFFFF) {
+            cluster = cluster_next(cluster);
+            position = SECTOR_STATE_SIZE;
+            if(!cluster_inuse(cluster)) {
+                result = 0;
+                break;
+            }
+            continue;
+        }
+        if(header[0] == 0 || header[0] > LZ_BLOCK_SIZE || (position + LZ_HEADER_SIZE + header[1]) > area_end) {
+            result = 0;
+            break;
+        }
+        if((base + header[0]) > offset) {
+            if(packed == NULL) {
+                packed = (uint8_t *)malloc(sizeof(uint8_t) * (DATA_AREA_SIZE + LZ_SLACK));
+                block = (uint8_t *)malloc(sizeof(uint8_t) * (LZ_BLOCK_SIZE + LZ_SLACK));
+            }
+            if(sector_buffer && verified != cluster) {
+                if(!verify_cluster(cluster, file->block, sector_buffer)) {
+                    result = 0;
+                    break;
+                }
+                verified = cluster;
+            }
+            if(sector_buffer) {
+                memcpy(packed, (sector_buffer + position + LZ_HEADER_SIZE), header[1]);
+            }else {
+                disk_read((cluster + position + LZ_HEADER_SIZE), packed, header[1]);
+            }
+            if(lz_decompress(packed, header[1], block, header[0]) != header[0]) {
+                result = 0;
+                break;
+            }
+            start = offset - base;
+            copy = ((header[0] - start) > size) ? size : (header[0] - start);
+            memcpy((buffer + cursor), (block + start), copy);
+            cursor += copy;
+            offset += copy;
+            size -= copy;
+        }
+        base += header[0];
+        position += LZ_HEADER_SIZE + header[1];
+    }
+    free(packed);
+    free(block);
+    return result;
+}
+
+/**
+ * 从簇内指定位置起压缩写入数据, 当前簇写满后查找空闲簇并链接
+ * 先写入下一簇地址再写新簇占用标记, 掉电时不会产生无法回收的扇区
+ * @param *file 文件指针
+ * @param *cluster 当前簇地址, 返回时为结束簇
+ * @param *position 簇内写入位置, 返回时为结束簇内的写入位置
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数
+ * @return 实际写入的字节数, 小于size表示空闲扇区不足
+ * */
+static uint32_t compress_chain(File *file, uint32_t *cluster, uint32_t *position, uint8_t *buffer, uint32_t size) {
+    uint32_t area_end = SECTOR_STATE_SIZE + FILE_AREA_SIZE(file->state);
+    uint32_t consumed = 0, used, packed_size, space, address, write_size;
+    uint32_t count = 0, index = 0, next, *sector_list = NULL;
+    uint8_t *packed = (uint8_t *)malloc(sizeof(uint8_t) * DATA_AREA_SIZE);
+
+    while(consumed < size) {
+        space = area_end - *position;
+        // 剩余空间过小时不再写入压缩块
+        if(space > (LZ_HEADER_SIZE + LZ_SLACK)) {
+            packed_size = lz_compress((buffer + consumed), (size - consumed), (packed + LZ_HEADER_SIZE),
+                                      (space - LZ_HEADER_SIZE), &used);
+            if(used > 0) {
+                *(uint16_t *)(packed + 0) = (uint16_t)used;
+                *(uint16_t *)(packed + 2) = (uint16_t)packed_size;
+                packed_size += LZ_HEADER_SIZE;
+                address = *cluster + *position;
+                for(uint32_t i = 0; i < packed_size; i += write_size) {
+                    // 按页边界分段写入
+                    write_size = PAGE_SIZE - ((address + i) % PAGE_SIZE);
+                    write_size = (write_size > (packed_size - i)) ? (packed_size - i) : write_size;
+                    disk_write((address + i), (packed + i), write_size);
+                }
+                *position += packed_size;
+                consumed += used;
+                continue;
+            }
+        }
+        if(index == count) {
+            free(sector_list);
+            // 按未压缩估算所需扇区数, 多找到的扇区保持空闲
+            count = (size - consumed) / DATA_AREA_SIZE + 1;
+            sector_list = (uint32_t *)malloc(sizeof(uint32_t) * count);
+            count = find_free_sectors(sector_list, count);
+            index = 0;
+            if(count == 0) {
+                break;
+            }
+        }
+        next = *(sector_list + index);
+        index++;
+        cluster_link(*cluster, next);
+        seal_cluster(*cluster, file, 1);
+        cluster_mark(next);
+        *cluster = next;
+        *position = SECTOR_STATE_SIZE;
+    }
+    free(sector_list);
+    free(packed);
+    return consumed;
+}
+
+/**
+ * 查找压缩文件簇内的写入位置
+ * @param cluster 簇地址
+ * @param area 簇内数据域大小
+ * @return 最后一个压缩块之后的簇内偏移
+ * */
+static uint32_t compressed_end(uint32_t cluster, uint32_t area) {
+    uint16_t header[2];
+    uint32_t position = SECTOR_STATE_SIZE;
+    while((position + LZ_HEADER_SIZE) <= (SECTOR_STATE_SIZE + area)) {
+        disk_read((cluster + position), (uint8_t *)header, LZ_HEADER_SIZE);
+        if(header[0] == 0xFFFF) {
+            break;
+        }
+        position += LZ_HEADER_SIZE + header[1];
+    }
+    // 压缩块头损坏时视为簇已写满
+    return (position > (SECTOR_STATE_SIZE + area)) ? (SECTOR_STATE_SIZE + area) : position;
+}
+
+/**
+ * 读取文件数据
+ * 校验时整簇读入并核对封存值, 数据从扇区缓存中复制
+ * @param verify 1:校验读取范围涉及的簇(仅校验文件)
+ * */
+static uint8_t read_data(File *file, uint8_t *buffer, uint32_t offset, uint32_t size, uint8_t verify) {
+    uint8_t result = 1;
+    uint32_t cursor = 0, read_size;
+    uint32_t cluster = file->cluster, addr_start, cluster_limit;
+    uint32_t area = FILE_AREA_SIZE(file->state);
+    uint32_t sectors = AREA_DIV(offset, area);
+    uint8_t *sector_buffer = NULL;
+    // 边界检查
+    if(offset >= file->length || (file->length - offset) < size) {
+        return 0;
+    }
+    if(INLINE_STORED(file->state, file->cluster)) {
+        read_inline(file, buffer, offset, size);
+        return 1;
+    }
+    if(verify && (FILE_FLAGS(file->state) & FSTATE_CHECKSUM) == 0) {
+        sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    }
+    if((FILE_FLAGS(file->state) & FSTATE_COMPRESSED) == 0) {
+        result = read_compressed(file, buffer, offset, size, sector_buffer);
+        free(sector_buffer);
+        return result;
+    }
+    for(uint32_t i = 0; i < sectors; i++) {
+        cluster = cluster_next(cluster);
+    }
+    // 扇区读写地址范围
+    cluster_limit = cluster + SECTOR_STATE_SIZE + area;
+    addr_start = cluster + SECTOR_STATE_SIZE + AREA_MOD(offset, area);
+    if(sector_buffer && !verify_cluster(cluster, file->block, sector_buffer)) {
+        size = 0;
+        result = 0;
+    }
+
+    while(size) {
+        // 计算分块读取块大小
+        read_size = (size > 256) ? 256 : size;
+        read_size = ((addr_start + read_size) > cluster_limit) ? (cluster_limit - addr_start) : read_size;
+        // 切换下一扇区
+        if(read_size <= 0) {
+            cluster = cluster_next(cluster);
+            cluster_limit = cluster + SECTOR_STATE_SIZE + area;
+            addr_start = cluster + SECTOR_STATE_SIZE;
+            if(sector_buffer && !verify_cluster(cluster, file->block, sector_buffer)) {
+                result = 0;
+                break;
+            }
+            continue;
+        }
+        // 读取数据
+        if(sector_buffer) {
+            memcpy((buffer + cursor), (sector_buffer + (addr_start - cluster)), read_size);
+        }else {
+            disk_read(addr_start, (buffer + cursor), read_size);
+        }
+        // 更新地址偏移
+        addr_start += read_size;
+        cursor += read_size;
+        size -= read_size;
+    }
+    free(sector_buffer);
+    return result;
+}
+
+/**
+ * 计算簇封存值
+ * 以文件块地址为初值, 指向其他文件簇的损坏链接也能被发现
+ * 簇链接表格式下下一簇地址不在簇内, 不计入封存值, 重新链接时无需重新封存;
+ * 指向其他文件簇的链接仍由初值发现, 指向空闲扇区的链接由cluster_inuse拦截
+ * @param *sector_buffer 簇内容(4096字节)
+ * @param fbaddr 文件块地址
+ * */
+static uint32_t cluster_crc(uint8_t *sector_buffer, uint32_t fbaddr) {
+    uint32_t crc = crc32c(0, (uint8_t *)&fbaddr, 4);
+    crc = crc32c(crc, (sector_buffer + SECTOR_STATE_SIZE), CHECKED_AREA_SIZE);
+#ifndef SPIFS_LINK_TABLE
+    crc = crc32c(crc, (sector_buffer + SECTOR_STATE_SIZE + DATA_AREA_SIZE), 4);
+#endif
+    // 0为作废标记, FFFFFFFF为空槽位
+    return (crc == 0 || crc == 0xFFFFFFFF) ? 1 : crc;
+}
+
+/**
+ * 封存簇, 非校验文件忽略
+ * 前3个槽位用尽时将第3个槽位写0作废, 该簇写满链接下一簇时再由最后一个槽位封存
+ * @param cluster 簇地址
+ * @param *file 文件指针
+ * @param close 1:簇已写满并链接下一簇
+ * */
+void seal_cluster(uint32_t cluster, File *file, uint8_t close) {
+    uint32_t crc, index, *slot;
+    uint8_t *sector_buffer;
+
+    if(FILE_FLAGS(file->state) & FSTATE_CHECKSUM) {
+        return;
+    }
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    disk_read(cluster, sector_buffer, SECTOR_SIZE);
+    slot = (uint32_t *)(sector_buffer + SEAL_SLOT_OFFSET);
+    crc = cluster_crc(sector_buffer, file->block);
+    if(close) {
+        index = SEAL_SLOT_SUM - 1;
+    }else {
+        for(index = 0; index < (SEAL_SLOT_SUM - 1) && *(slot + index) != 0xFFFFFFFF; index++);
+        if(index == (SEAL_SLOT_SUM - 1)) {
+            index--;
+            crc = (*(slot + index) == crc) ? crc : 0;
+        }
+    }
+    if(*(slot + index) != crc && (index == 0 || *(slot + index - 1) != crc)) {
+        write_value((cluster + SEAL_SLOT_OFFSET + index * 4), crc, 4);
+    }
+    free(sector_buffer);
+}
+
+/**
+ * 校验簇
+ * 结束簇尚未封存(封存已作废或追加写会话未完成)时无法校验
+ * @param cluster 簇地址
+ * @param fbaddr 文件块地址
+ * @param *sector_buffer 簇内容输出缓冲区(4096字节)
+ * @return 0:校验失败, 1:校验通过, 2:未封存的结束簇
+ * */
+uint8_t verify_cluster(uint32_t cluster, uint32_t fbaddr, uint8_t *sector_buffer) {
+    uint32_t seal = 0xFFFFFFFF, next, *slot;
+
+    if(!cluster_inuse(cluster)) {
+        return 0;
+    }
+    disk_read(cluster, sector_buffer, SECTOR_SIZE);
+    slot = (uint32_t *)(sector_buffer + SEAL_SLOT_OFFSET);
+    next = image_next(cluster, sector_buffer);
+    for(uint32_t i = SEAL_SLOT_SUM; i > 0; i--) {
+        if(*(slot + i - 1) != 0xFFFFFFFF) {
+            seal = *(slot + i - 1);
+            break;
+        }
+    }
+    if(seal != 0xFFFFFFFF && seal != 0 && seal == cluster_crc(sector_buffer, fbaddr)) {
+        return 1;
+    }
+    if(next == 0xFFFFFFFF && (seal == 0xFFFFFFFF || seal == 0 || journal_find(JOURNAL_APPEND, fbaddr) != 0xFFFFFFFF)) {
+        return 2;
+    }
+    return 0;
+}
+
+/**
+ * 遍历簇链找到结束簇
+ * @param cluster 首簇地址
+ * */
+static uint32_t tail_cluster(uint32_t cluster) {
+    uint32_t next = 0;
+    while(1) {
+        next = cluster_next(cluster);
+        if(!cluster_inuse(next)) {
+            break;
+        }
+        cluster = next;
+    }
+    return cluster;
+}
+
+/**
+ * 文件大小在簇链中对应的位置, 即追加写的起始位置
+ * 文件大小为数据域整数倍时为最后一簇的数据域末尾, 文件大小为0时为首簇数据域起始
+ * @param cluster 首簇地址
+ * @param length 文件大小
+ * @param area 每簇的数据域大小
+ * @return 簇内位置(CLUSTER_POSITION)
+ * */
+uint32_t chain_position(uint32_t cluster, uint32_t length, uint32_t area) {
+    uint32_t clusters = (length == 0) ? 1 : AREA_DIV((length + area - 1), area);
+    for(uint32_t i = 1; i < clusters; i++) {
+        cluster = cluster_next(cluster);
+    }
+    return CLUSTER_POSITION(cluster, (SECTOR_STATE_SIZE + (length - (clusters - 1) * area)));
+}
+
+/**
+ * 校验整个卷
+ * 遍历根目录与各级目录下的校验文件, 逐簇核对封存值, 非校验文件跳过
+ * 先清空扇区缓存, 校验存储器上的实际内容
+ * @param *report 校验结果输出
+ * @return 校验失败的簇数
+ * */
+uint32_t spifs_scrub(ScrubReport *report) {
+    uint32_t offset;
+    uint8_t *sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+
+    disk_cache_invalidate();
+
+    report->files = 0;
+    report->clusters = 0;
+    report->unsealed = 0;
+    report->errors = 0;
+    for(uint32_t fb_index = FB_SECTOR_INIT; fb_index < FB_SECTOR_END; fb_index++) {
+        disk_read(fb_index * SECTOR_SIZE, sector_buffer, SECTOR_SIZE);
+        for(offset = 0; (SECTOR_SIZE - offset) >= FILEBLOCK_SIZE; offset += FILEBLOCK_SIZE) {
+            scrub_fileblock((FileBlock *)(sector_buffer + offset), (fb_index * SECTOR_SIZE + offset), report);
+        }
+    }
+    free(sector_buffer);
+    return report->errors;
+}
+
+/**
+ * 校验单个文件索引项对应的数据, 目录递归校验其下文件
+ * 校验失败的簇其下一簇地址不可信, 停止遍历该文件
+ * @param *fb 文件块指针
+ * @param fbaddr 文件块地址
+ * @param *report 校验结果
+ * */
+void scrub_fileblock(FileBlock *fb, uint32_t fbaddr, ScrubReport *report) {
+    uint8_t flags, result;
+    uint32_t cluster, length, count = 0;
+    uint8_t *sector_buffer;
+
+    flags = FILE_FLAGS(fb->state);
+    if(fileblock_empty(fb) || fileblock_continuation(fb) || (flags & FSTATE_DELETED) == 0 || fb->cluster == 0xFFFFFFFF) {
+        return;
+    }
+    if((flags & FSTATE_DIRECTORY) == 0) {
+        dir_scrub(fb->cluster, report);
+        return;
+    }
+    if((flags & FSTATE_CHECKSUM) || INLINE_STORED(fb->state, fb->cluster)) {
+        return;
+    }
+    report->files++;
+    cluster = fb->cluster;
+    length = fb->length;
+    ring_resolve(fbaddr, &cluster, &length);
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    while(count < (DATA_SECTOR_END - FB_SECTOR_END)) {
+        result = verify_cluster(cluster, fbaddr, sector_buffer);
+        report->clusters++;
+        if(result == 0) {
+            report->errors++;
+            break;
+        }
+        if(result == 2) {
+            report->unsealed++;
+        }
+        cluster = image_next(cluster, sector_buffer);
+        if(cluster == 0xFFFFFFFF) {
+            break;
+        }
+        count++;
+    }
+    free(sector_buffer);
+}
+
+/**
+ * 覆盖写内联文件
+ * 首次写入且扇区内有连续的已擦除槽位时直接写入数据槽位, 再写首簇地址与文件大小
+ * 否则在扇区映像中释放旧数据槽位并重新分配, 经影子扇区重写索引扇区, 原有簇链随后擦除
+ * @param *file 文件指针
+ * @param *buffer 写入数据缓冲区
+ * @param size 写入字节数(不超过INLINE_SIZE_MAX)
+ * @return WRITE_FILE_SUCCESS, NO_FILEBLOCK_SPACE:索引扇区内没有足够的连续槽位
+ * */
+static Result write_inline(File *file, uint8_t *buffer, uint32_t size) {
+    uint32_t sector, base, index, span, cluster, old_cluster, handle = 0xFFFFFFFF;
+    uint8_t *sector_buffer;
+
+    span = (size + INLINE_DATA_SIZE - 1) / INLINE_DATA_SIZE;
+    sector = (file->block / SECTOR_SIZE) * SECTOR_SIZE;
+    base = inline_base(file->block);
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    disk_read(sector, sector_buffer, SECTOR_SIZE);
+
+    if(file->cluster == 0xFFFFFFFF && file->length == 0xFFFFFFFF) {
+        index = inline_find(sector_buffer, base, span, 1);
+        if(index != 0xFFFFFFFF) {
+            cluster = INLINE_CLUSTER(index, span);
+            inline_fill((sector_buffer + base + index * FILEBLOCK_SIZE), buffer, size);
+            // 首簇地址写入前掉电, 数据槽位在垃圾回收时清除
+            handle = journal_begin(JOURNAL_ALLOC_NEW, file->block, cluster, size);
+            disk_write((sector + base + index * FILEBLOCK_SIZE), (sector_buffer + base + index * FILEBLOCK_SIZE), (span * FILEBLOCK_SIZE));
+            write_fileblock_cluster(file->block, cluster);
+            write_fileblock_length(file->block, size);
+            journal_end(handle);
+            file->cluster = cluster;
+            file->length = size;
+            free(sector_buffer);
+            return WRITE_FILE_SUCCESS;
+        }
+    }
+
+    old_cluster = file->cluster;
+    if(INLINE_STORED(file->state, old_cluster)) {
+        // 释放旧数据槽位, 目录表中改写为墓碑以保持探测链
+        index = old_cluster >> 4;
+        for(uint32_t i = 0; i < (old_cluster & 0x0F); i++) {
+            clear_fileblock(sector_buffer, (base + (index + i) * FILEBLOCK_SIZE));
+            if(base != 0) {
+                *(sector_buffer + base + (index + i + 1) * FILEBLOCK_SIZE - 1) = (uint8_t)~FSTATE_PROBE;
+            }
+        }
+        old_cluster = 0xFFFFFFFF;
+    }
+    index = inline_find(sector_buffer, base, span, 0);
+    if(index == 0xFFFFFFFF) {
+        free(sector_buffer);
+        return NO_FILEBLOCK_SPACE;
+    }
+    cluster = INLINE_CLUSTER(index, span);
+    inline_fill((sector_buffer + base + index * FILEBLOCK_SIZE), buffer, size);
+    for(uint32_t i = 0; i < 4; i++) {
+        *(sector_buffer + (file->block - sector) + 12 + i) = ((cluster >> (i << 3)) & 0xFF);
+        *(sector_buffer + (file->block - sector) + 16 + i) = ((size >> (i << 3)) & 0xFF);
+    }
+    if(old_cluster != 0xFFFFFFFF) {
+        handle = journal_begin(JOURNAL_ALLOC_REPLACE, file->block, cluster, old_cluster);
+    }
+    journal_rewrite_sector(sector, sector_buffer);
+    erase_cluster_chain(old_cluster);
+    journal_end(handle);
+
+    file->cluster = cluster;
+    file->length = size;
+    free(sector_buffer);
+    return WRITE_FILE_SUCCESS;
+}
+
+/**
+ * 追加写内联文件
+ * 合并原有数据后覆盖写, 超出INLINE_SIZE_MAX时转为普通文件存放
+ * 每次追加都会重写索引扇区, 内联文件适合一次写入的小文件
+ * */
+static Result append_inline(File *file, uint8_t *buffer, uint32_t size) {
+    Result result;
+    uint8_t *merged = (uint8_t *)malloc(sizeof(uint8_t) * (file->length + size));
+
+    read_inline(file, merged, 0, file->length);
+    memcpy((merged + file->length), buffer, size);
+    result = write_data(file, merged, (file->length + size));
+    free(merged);
+    return (result == WRITE_FILE_SUCCESS) ? APPEND_FILE_SUCCESS : result;
+}
+
+/**
+ * 读取内联文件数据, 一次读入读取范围涉及的数据槽位
+ * @param *file 文件指针
+ * @param *buffer 读出缓冲区
+ * @param offset 读取起始偏移
+ * @param size 读取字节数
+ * */
+static void read_inline(File *file, uint8_t *buffer, uint32_t offset, uint32_t size) {
+    uint32_t first, slots, position, read_size, cursor = 0;
+    uint8_t slot_buffer[INLINE_SLOT_MAX * FILEBLOCK_SIZE];
+
+    if(size == 0) {
+        return;
+    }
+    first = offset / INLINE_DATA_SIZE;
+    slots = (offset + size - 1) / INLINE_DATA_SIZE - first + 1;
+    disk_read(((file->block / SECTOR_SIZE) * SECTOR_SIZE + inline_base(file->block) + ((file->cluster >> 4) + first) * FILEBLOCK_SIZE),
+              slot_buffer, (slots * FILEBLOCK_SIZE));
+    position = offset - first * INLINE_DATA_SIZE;
+    while(size) {
+        read_size = INLINE_DATA_SIZE - (position % INLINE_DATA_SIZE);
+        read_size = (read_size > size) ? size : read_size;
+        memcpy((buffer + cursor), (slot_buffer + (position / INLINE_DATA_SIZE) * FILEBLOCK_SIZE + 1 + (position % INLINE_DATA_SIZE)), read_size);
+        position += read_size;
+        cursor += read_size;
+        size -= read_size;
+    }
+}
+
+/**
+ * 文件索引所在扇区首个槽位的偏移, 根目录索引扇区为0, 目录表扇区跳过表头
+ * @param fbaddr 文件块地址
+ * */
+static uint32_t inline_base(uint32_t fbaddr) {
+    return (fbaddr < (FB_SECTOR_END * SECTOR_SIZE)) ? 0 : DIR_HEADER_SIZE;
+}
+
+/**
+ * 从扇区末尾向前查找连续的空闲槽位
+ * @param *sector_buffer 索引扇区内容
+ * @param base 首个槽位在扇区内的偏移
+ * @param span 需要的槽位数
+ * @param erased 1:槽位须为擦除状态(可直接写入), 0:文件名为空即可(扇区重写)
+ * @return 首个槽位序号, FFFFFFFF表示未找到
+ * */
+static uint32_t inline_find(uint8_t *sector_buffer, uint32_t base, uint32_t span, uint8_t erased) {
+    FileBlock *fb;
+    uint32_t count = 0, index = (SECTOR_SIZE - base) / FILEBLOCK_SIZE;
+    uint8_t blank;
+
+    if(span == 0) {
+        return 0;
+    }
+    while(index) {
+        index--;
+        fb = (FileBlock *)(sector_buffer + base + index * FILEBLOCK_SIZE);
+        blank = erased ? bulk_erased((uint8_t *)fb, FILEBLOCK_SIZE) : fileblock_empty(fb);
+        count = blank ? (count + 1) : 0;
+        if(count == span) {
+            return index;
+        }
+    }
+    return 0xFFFFFFFF;
+}
+
+/**
+ * 填充数据槽位: 首字节0x00, 其后为文件数据, 不足部分填充0xFF
+ * @param *slot 首个数据槽位
+ * @param *buffer 文件数据
+ * @param size 文件大小
+ * */
+static void inline_fill(uint8_t *slot, uint8_t *buffer, uint32_t size) {
+    uint32_t fill_size;
+    while(size) {
+        fill_size = (size > INLINE_DATA_SIZE) ? INLINE_DATA_SIZE : size;
+        array_fill(slot, 0xFF, FILEBLOCK_SIZE);
+        *slot = 0x00;
+        memcpy((slot + 1), buffer, fill_size);
+        slot += FILEBLOCK_SIZE;
+        buffer += fill_size;
+        size -= fill_size;
+    }
+}
+
+/**
+ * 按偏移覆盖写非压缩文件的簇
+ * 涉及的簇连同修改后的内容写入新扇区, 见relink_clusters
+ * @param offset 写入起始偏移
+ * @param size 写入字节数, 不超出文件大小
+ * */
+static Result pwrite_clusters(File *file, uint32_t offset, uint8_t *buffer, uint32_t size) {
+    uint8_t gc_flag = 0;
+    uint32_t area = FILE_AREA_SIZE(file->state);
+    uint32_t first = AREA_DIV(offset, area), count = AREA_DIV((offset + size - 1), area) - first + 1;
+    uint32_t cluster = file->cluster, prev = 0xFFFFFFFF;
+    uint32_t *old_list, *new_list;
+
+    if(size == 0 || count == 0) {
+        return WRITE_FILE_SUCCESS;
+    }
+    for(uint32_t i = 0; i < first; i++) {
+        prev = cluster;
+        cluster = cluster_next(cluster);
+    }
+    old_list = (uint32_t *)malloc(sizeof(uint32_t) * count);
+    new_list = (uint32_t *)malloc(sizeof(uint32_t) * count);
+    for(uint32_t i = 0; i < count; i++) {
+        *(old_list + i) = cluster;
+        cluster = cluster_next(cluster);
+    }
+
+    FIND_SECTOR_PWRITE:
+    if(find_free_sectors(new_list, count) != count) {
+        if(gc_flag == 0) {
+            gc_flag = 1;
+            spifs_gc();
+            goto FIND_SECTOR_PWRITE;
+        }
+        free(old_list);
+        free(new_list);
+        return NO_SECTOR_SPACE;
+    }
+
+    relink_clusters(file, prev, old_list, new_list, count, (offset - first * area), buffer, size);
+    free(old_list);
+    free(new_list);
+    return WRITE_FILE_SUCCESS;
+}
+
+/**
+ * 将簇链中的一段复制到新簇并替换原段, 复制时可修改段内数据
+ * 新段最后一簇链接原段的下一簇, 重写引用字段(前一簇的下一簇地址或文件块首簇地址)使新段生效, 再逆序擦除原段
+ * @param *file 文件指针, 段从首簇开始时更新其首簇地址
+ * @param prev 段的前一簇地址, FFFFFFFF表示段从首簇开始
+ * @param *old_list 原段各簇地址
+ * @param *new_list 新段各簇地址(空闲扇区)
+ * @param count 段的簇数
+ * @param offset 写入数据在段数据域中的起始偏移
+ * @param *buffer 写入数据, size为0时只复制
+ * @param size 写入字节数
+ * */
+void relink_clusters(File *file, uint32_t prev, uint32_t *old_list, uint32_t *new_list, uint32_t count,
+                     uint32_t offset, uint8_t *buffer, uint32_t size) {
+    uint32_t area = FILE_AREA_SIZE(file->state);
+    uint32_t start, end, next, handle, ref;
+    uint8_t *sector_buffer;
+
+    ring_forget(file->block);
+    ref = (prev == 0xFFFFFFFF) ? (file->block + 12) : CLUSTER_LINK_REF(prev);
+    handle = journal_begin(JOURNAL_RELINK, ref, *(new_list + 0), *(old_list + 0));
+    sector_buffer = (uint8_t *)malloc(sizeof(uint8_t) * SECTOR_SIZE);
+    for(uint32_t i = 0; i < count; i++) {
+        disk_read(*(old_list + i), sector_buffer, SECTOR_SIZE);
+        // 本簇内的写入范围
+        start = (offset > i * area) ? (offset - i * area) : 0;
+        end = ((offset + size) < (i + 1) * area) ? (offset + size - i * area) : area;
+        if(size && start < end) {
+            memcpy((sector_buffer + SECTOR_STATE_SIZE + start), (buffer + i * area + start - offset), (end - start));
+        }
+        next = image_next(*(old_list + i), sector_buffer);
+        if(i < (count - 1)) {
+            next = *(new_list + i + 1);
+            image_link(sector_buffer, next);
+        }
+        seal_image(sector_buffer, file->block, (next == 0xFFFFFFFF));
+        cluster_program(*(new_list + i), sector_buffer, next);
+    }
+
+    // 引用字段所在扇区经影子扇区重写, 新段在此之后生效
+    if(prev == 0xFFFFFFFF) {
+        update_fileblock(file->block, *(new_list + 0), file->length);
+        file->cluster = *(new_list + 0);
+    }else {
+#ifdef SPIFS_LINK_TABLE
+        // 下一簇地址不计入封存值, 只修改链接表
+        cluster_relink(prev, *(new_list + 0));
+#else
+        disk_read(prev, sector_buffer, SECTOR_SIZE);
+        image_link(sector_buffer, *(new_list + 0));
+        seal_image(sector_buffer, file->block, 0);
+        journal_rewrite_sector(prev, sector_buffer);
+#endif
+    }
+    for(uint32_t i = count; i > 0; i--) {
+        cluster_erase(*(old_list + i - 1));
+    }
+    journal_end(handle);
+    free(sector_buffer);
+}
+
+/**
+ * 读出全部数据, 修改后覆盖写, 用于压缩文件与内联文件
+ * @param offset 写入起始偏移
+ * @param *buffer 写入数据, size为0时可为NULL
+ * @param size 写入字节数
+ * @param length 写入后的文件大小, 小于原文件大小时截断
+ * */
+static Result rewrite_whole(File *file, uint32_t offset, uint8_t *buffer, uint32_t size, uint32_t length) {
+    Result result;
+    uint32_t keep = (file->length < length) ? file->length : length;
+    uint8_t *merged = (uint8_t *)malloc(sizeof(uint8_t) * (length ? length : 1));
+
+    if(keep && !read_file(file, merged, 0, keep)) {
+        free(merged);
+        return FILE_OUT_OF_RANGE;
+    }
+    if(size) {
+        memcpy((merged + offset), buffer, size);
+    }
+    result = write_data(file, merged, length);
+    free(merged);
+    return result;
+}
+
+/**
+ * 按簇内容重新计算封存值, 非校验文件不做处理
+ * @param *sector_buffer 簇内容(4096字节)
+ * @param fbaddr 文件块地址
+ * @param tail 1:结束簇, 封存值写入第一个槽位; 0:写入最后一个槽位
+ * */
+static void seal_image(uint8_t *sector_buffer, uint32_t fbaddr, uint8_t tail) {
+    FileBlock fb;
+    disk_read(fbaddr, (uint8_t *)&fb, FILEBLOCK_SIZE);
+    if(FILE_FLAGS(fb.state) & FSTATE_CHECKSUM) {
+        return;
+    }
+    array_fill((sector_buffer + SEAL_SLOT_OFFSET), 0xFF, (SEAL_SLOT_SUM * 4));
+    *(uint32_t *)(sector_buffer + SEAL_SLOT_OFFSET + (tail ? 0 : (SEAL_SLOT_SUM - 1) * 4)) = cluster_crc(sector_buffer, fbaddr);
+}
+
+/**
+ * 擦除被替换的簇链段
+ * 新旧两段长度相同且最后一簇链接同一下一簇, 两段同步遍历至下一簇地址相同为止
+ * 未写完的新段在首个未占用的簇处结束
+ * @param first 待擦除段首簇地址
+ * @param other 另一段首簇地址
+ * */
+static void relink_erase(uint32_t first, uint32_t other) {
+    uint32_t count = 0, next[2], *chain;
+    chain = (uint32_t *)malloc(sizeof(uint32_t) * (DATA_SECTOR_END - FB_SECTOR_END));
+    while(cluster_inuse(first) && count < (DATA_SECTOR_END - FB_SECTOR_END)) {
+        *(chain + count) = first;
+        count++;
+        next[0] = cluster_next(first);
+        next[1] = cluster_next(other);
+        if(next[0] == next[1]) {
+            break;
+        }
+        first = next[0];
+        other = next[1];
+    }
+    while(count) {
+        count--;
+        cluster_erase(*(chain + count));
+    }
+    free(chain);
 }
@@ -0,0 +1,495 @@
+#ifndef __SPIFS_HPP__
+#define __SPIFS_HPP__
+
+/**
+ * C++20头文件封装, 不引入额外的拷贝与内存分配
+ * file为只可移动的文件句柄, 析构时完成未结束的追加写(append_finish)
+ * 读写接口接受std::span或任意连续存储的平凡类型范围, 直接传递数据指针给C接口
+ * 目录遍历直接读取索引槽位, 不分配内存(list_file/list_dir为每个文件分配链表节点)
+ * 几何参数以模板参数给出, 须与编译C库时一致(static_assert检查), 容量与偏移换算在编译期完成
+ * 编译C库时定义了SPIFS_LINK_TABLE的, 包含本文件时也须定义
+ * */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "spifs.h"
+#include "dir.h"
+}
+
+namespace spifs {
+
+/**
+ * 存储器几何参数
+ * @param PageSize 页大小(字节)
+ * @param SectorSize 扇区大小(字节), 同簇大小
+ * @param SectorSum 扇区数量
+ * */
+template<std::uint32_t PageSize = PAGE_SIZE, std::uint32_t SectorSize = SECTOR_SIZE, std::uint32_t SectorSum = SECTOR_SUM>
+struct geometry {
+    static_assert(PageSize == PAGE_SIZE && SectorSize == SECTOR_SIZE && SectorSum == SECTOR_SUM,
+                  "geometry must match the one the C library was built with");
+
+    static constexpr std::uint32_t page_size = PageSize;
+    static constexpr std::uint32_t sector_size = SectorSize;
+    static constexpr std::uint32_t sector_sum = SectorSum;
+    static constexpr std::uint32_t flash_size = SectorSize * SectorSum;
+    // 数据簇数量
+    static constexpr std::uint32_t cluster_sum = DATA_SECTOR_END - FB_SECTOR_END;
+    // 每簇数据域大小(普通文件与校验文件)
+    static constexpr std::uint32_t data_area = DATA_AREA_SIZE;
+    static constexpr std::uint32_t checked_area = CHECKED_AREA_SIZE;
+
+    /**
+     * 每簇数据域大小
+     * @param checked 校验文件
+     * */
+    static constexpr std::uint32_t area(bool checked) noexcept {
+        return checked ? checked_area : data_area;
+    }
+
+    /**
+     * 偏移所在的簇序号(文件内第几个簇)
+     * @param offset 文件内偏移
+     * @param checked 校验文件
+     * */
+    static constexpr std::uint32_t cluster_index(std::uint32_t offset, bool checked = false) noexcept {
+        return offset / area(checked);
+    }
+
+    /**
+     * 保存length字节(非压缩非内联)所需的簇数量
+     * @param length 文件大小
+     * @param checked 校验文件
+     * */
+    static constexpr std::uint32_t clusters(std::uint32_t length, bool checked = false) noexcept {
+        return (length + area(checked) - 1) / area(checked);
+    }
+
+    // 整簇缓冲区
+    using sector_buffer = std::array<std::byte, SectorSize>;
+};
+
+// W25Q32(256字节/页, 4096字节/扇区, 1024扇区)
+using w25q32 = geometry<256, 4096, 1024>;
+
+// 统一的错误码, 由C接口的Result与uint8_t返回值转换
+enum class errc : std::uint8_t {
+    ok = 0,
+    no_fileblock_space,
+    no_sector_space,
+    unallocated,
+    cannot_append,
+    is_directory,
+    already_exists,
+    out_of_range,
+    not_found,
+    verify_failed,
+    closed
+};
+
+/**
+ * Result转换为errc, 各种成功值均为errc::ok
+ * @param result C接口返回值
+ * */
+constexpr errc to_errc(Result result) noexcept {
+    switch(result) {
+        case CREATE_FILEBLOCK_SUCCESS:
+        case WRITE_FILE_SUCCESS:
+        case APPEND_FILE_SUCCESS:
+        case APPEND_FILE_FINISH:
+        case CREATE_DIR_SUCCESS:
+            return errc::ok;
+        case NO_FILEBLOCK_SPACE: return errc::no_fileblock_space;
+        case NO_SECTOR_SPACE: return errc::no_sector_space;
+        case FILE_UNALLOCATED: return errc::unallocated;
+        case FILE_CANNOT_APPEND: return errc::cannot_append;
+        case FILE_IS_DIRECTORY: return errc::is_directory;
+        case FILE_ALREADY_EXISTS: return errc::already_exists;
+        case FILE_OUT_OF_RANGE: return errc::out_of_range;
+    }
+    return errc::unallocated;
+}
+
+// 可作为读写缓冲区的范围: 连续存储且元素为平凡类型
+template<class R>
+concept byte_range = std::ranges::contiguous_range<R> && std::ranges::sized_range<R>
+                     && std::is_trivially_copyable_v<std::ranges::range_value_t<R>>;
+
+struct async_access;
+
+namespace detail {
+
+// 文件名缓冲区, 8+4文件名以'\0'结尾后传给C接口, 超出部分截断(同copy_filename)
+struct name_buffer {
+    char filename[9];
+    char extname[5];
+
+    constexpr name_buffer(std::string_view name, std::string_view ext) noexcept : filename{}, extname{} {
+        name.copy(filename, 8);
+        ext.copy(extname, 4);
+    }
+};
+
+template<class R>
+inline std::uint8_t *bytes(R &&range) noexcept {
+    using value_type = std::remove_reference_t<std::ranges::range_reference_t<R>>;
+    return reinterpret_cast<std::uint8_t *>(const_cast<std::remove_const_t<value_type> *>(std::ranges::data(range)));
+}
+
+template<class R>
+constexpr std::uint32_t size_bytes(R &&range) noexcept {
+    return static_cast<std::uint32_t>(std::ranges::size(range) * sizeof(std::ranges::range_value_t<R>));
+}
+
+} // namespace detail
+
+/**
+ * 文件信息(目录遍历的元素), 只读视图
+ * */
+class entry {
+public:
+    constexpr entry() noexcept : native_{} {}
+    explicit constexpr entry(const File &native) noexcept : native_(native) {}
+
+    // 文件名与拓展名(不含填充的0xFF)
+    std::string_view name() const noexcept { return trimmed(native_.filename, 8); }
+    std::string_view extension() const noexcept { return trimmed(native_.extname, 4); }
+    std::uint32_t length() const noexcept { return native_.length; }
+    // 标记位低电平有效, 见FSTATE_*
+    std::uint8_t flags() const noexcept { return FILE_FLAGS(native_.state); }
+    bool deleted() const noexcept { return (flags() & FSTATE_DELETED) == 0; }
+    bool is_directory() const noexcept { return (flags() & FSTATE_DIRECTORY) == 0; }
+    bool compressed() const noexcept { return (flags() & FSTATE_COMPRESSED) == 0; }
+    bool checked() const noexcept { return (flags() & FSTATE_CHECKSUM) == 0; }
+    const File &native() const noexcept { return native_; }
+
+protected:
+    File native_;
+
+    // 由索引槽位填充
+    void assign(const FileBlock &fb, std::uint32_t block) noexcept {
+        array_copy(const_cast<std::uint8_t *>(fb.filename), native_.filename, 8);
+        array_copy(const_cast<std::uint8_t *>(fb.extname), native_.extname, 4);
+        native_.block = block;
+        native_.cluster = fb.cluster;
+        native_.length = fb.length;
+        native_.state = fb.state;
+    }
+
+    template<class Geometry>
+    friend class basic_directory;
+
+    static std::string_view trimmed(const std::uint8_t *name, std::size_t max) noexcept {
+        std::size_t size = 0;
+        while(size < max && name[size] != 0xFF) {
+            size++;
+        }
+        return std::string_view(reinterpret_cast<const char *>(name), size);
+    }
+};
+
+/**
+ * 只可移动的文件句柄
+ * 未打开(或已移出、已删除)的句柄上的操作返回errc::closed
+ * @param Geometry 存储器几何参数
+ * */
+template<class Geometry = w25q32>
+class basic_file : public entry {
+public:
+    using geometry_type = Geometry;
+
+    basic_file() noexcept {
+        native_.block = 0xFFFFFFFF;
+    }
+
+    basic_file(const basic_file &) = delete;
+    basic_file &operator=(const basic_file &) = delete;
+
+    basic_file(basic_file &&other) noexcept : entry(other.native_), appending_(other.appending_) {
+        other.release();
+    }
+
+    basic_file &operator=(basic_file &&other) noexcept {
+        if(this != &other) {
+            finish();
+            native_ = other.native_;
+            appending_ = other.appending_;
+            other.release();
+        }
+        return *this;
+    }
+
+    ~basic_file() {
+        finish();
+    }
+
+    /**
+     * 打开文件
+     * @param name 文件名
+     * @param ext 拓展名
+     * @param *dir 所在目录, NULL表示根目录
+     * @return 未找到时为空
+     * */
+    static std::optional<basic_file> open(std::string_view name, std::string_view ext, const basic_file *dir = nullptr) noexcept {
+        detail::name_buffer buffer(name, ext);
+        basic_file file;
+        if(!open_file_at(native_dir(dir), &file.native_, buffer.filename, buffer.extname)) {
+            return std::nullopt;
+        }
+        return std::optional<basic_file>(std::move(file));
+    }
+
+    /**
+     * 创建文件(或目录), 成功后句柄指向新文件
+     * @param name 文件名
+     * @param ext 拓展名
+     * @param fstate 文件状态字, 见make_fstate, 清除FSTATE_DIRECTORY位时创建目录
+     * @param *dir 所在目录, NULL表示根目录
+     * */
+    errc create(std::string_view name, std::string_view ext, FileState fstate, const basic_file *dir = nullptr) noexcept {
+        detail::name_buffer buffer(name, ext);
+        finish();
+        make_file(&native_, buffer.filename, buffer.extname);
+        if((fstate.state & FSTATE_DIRECTORY) == 0) {
+            return close_on_error(to_errc(create_dir(&native_, native_dir(dir), fstate)));
+        }
+        return close_on_error(to_errc(create_file_at(native_dir(dir), &native_, fstate)));
+    }
+
+    // 句柄已打开
+    bool is_open() const noexcept { return native_.block != 0xFFFFFFFF; }
+    explicit operator bool() const noexcept { return is_open(); }
+
+    /**
+     * 写入文件全部内容(仅能写入一次, 之后使用append/pwrite)
+     * @param data 文件内容
+     * */
+    template<byte_range R>
+    errc write(R &&data) noexcept {
+        if(!is_open()) return errc::closed;
+        return to_errc(write_file(&native_, detail::bytes(data), detail::size_bytes(data)));
+    }
+
+    /**
+     * 追加写, 句柄析构、移动赋值或调用finish时更新文件大小
+     * @param data 追加内容
+     * */
+    template<byte_range R>
+    errc append(R &&data) noexcept {
+        if(!is_open()) return errc::closed;
+        errc result = to_errc(append_file(&native_, detail::bytes(data), detail::size_bytes(data)));
+        appending_ = appending_ || (result == errc::ok);
+        return result;
+    }
+
+    // 完成追加写, 未追加时不做处理
+    errc finish() noexcept {
+        if(appending_) {
+            appending_ = false;
+            return to_errc(append_finish(&native_));
+        }
+        return errc::ok;
+    }
+
+    /**
+     * 按偏移覆盖写, 超出文件大小的部分追加
+     * @param offset 文件内偏移
+     * @param data 写入内容
+     * */
+    template<byte_range R>
+    errc pwrite(std::uint32_t offset, R &&data) noexcept {
+        if(!is_open()) return errc::closed;
+        finish();
+        return to_errc(spifs_pwrite(&native_, offset, detail::bytes(data), detail::size_bytes(data)));
+    }
+
+    /**
+     * 截断文件
+     * @param length 新的文件大小
+     * */
+    errc truncate(std::uint32_t length) noexcept {
+        if(!is_open()) return errc::closed;
+        finish();
+        return to_errc(spifs_truncate(&native_, length));
+    }
+
+    /**
+     * 读取文件, 填满data
+     * @param offset 文件内偏移
+     * @param data 输出缓冲区
+     * @param verify 校验文件同时校验涉及的簇, 失败返回errc::verify_failed
+     * */
+    template<byte_range R>
+    errc read(std::uint32_t offset, R &&data, bool verify = false) const noexcept {
+        std::uint32_t size = detail::size_bytes(data);
+        if(!is_open()) return errc::closed;
+        if(offset > native_.length || size > (native_.length - offset)) return errc::out_of_range;
+        if(verify) {
+            return read_file_verify(const_cast<File *>(&native_), detail::bytes(data), offset, size) ? errc::ok : errc::verify_failed;
+        }
+        return read_file(const_cast<File *>(&native_), detail::bytes(data), offset, size) ? errc::ok : errc::out_of_range;
+    }
+
+    /**
+     * 删除文件, 句柄随之关闭
+     * */
+    errc remove() noexcept {
+        if(!is_open()) return errc::closed;
+        finish();
+        delete_file(&native_);
+        release();
+        return errc::ok;
+    }
+
+    /**
+     * 文件占用的簇数量(非压缩非内联文件), 簇大小为编译期常量
+     * */
+    std::uint32_t clusters() const noexcept {
+        return Geometry::clusters(native_.length, checked());
+    }
+
+    File &native() noexcept { return native_; }
+    const File &native() const noexcept { return native_; }
+
+private:
+    friend struct async_access;
+
+    bool appending_ = false;
+
+    void release() noexcept {
+        native_.block = 0xFFFFFFFF;
+        appending_ = false;
+    }
+
+    errc close_on_error(errc result) noexcept {
+        if(result != errc::ok) {
+            release();
+        }
+        return result;
+    }
+
+    static File *native_dir(const basic_file *dir) noexcept {
+        return (dir == nullptr) ? nullptr : const_cast<File *>(&dir->native_);
+    }
+};
+
+using file = basic_file<>;
+
+/**
+ * 目录遍历, 按索引槽位顺序给出存活与已删除未回收的文件(同list_file/list_dir), 不分配内存
+ * 遍历期间不得修改该目录
+ * @param Geometry 存储器几何参数
+ * */
+template<class Geometry = w25q32>
+class basic_directory {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const entry *;
+        using reference = const entry &;
+
+        iterator() noexcept = default;
+
+        reference operator*() const noexcept { return current_; }
+        pointer operator->() const noexcept { return &current_; }
+
+        iterator &operator++() noexcept {
+            advance();
+            return *this;
+        }
+
+        void operator++(int) noexcept { advance(); }
+
+        friend bool operator==(const iterator &it, std::default_sentinel_t) noexcept {
+            return it.slot_ == 0xFFFFFFFF;
+        }
+
+    private:
+        friend class basic_directory;
+
+        entry current_;
+        std::uint32_t slot_ = 0xFFFFFFFF;   // 当前槽位地址, FFFFFFFF表示结束
+        std::uint32_t limit_ = 0;         // 当前扇区结束地址
+        std::uint32_t table_ = 0xFFFFFFFF; // 当前目录表扇区, FFFFFFFF表示根目录
+
+        iterator(std::uint32_t table) noexcept : table_(table) {
+            if(table == 0xFFFFFFFF) {
+                slot_ = FB_SECTOR_INIT * Geometry::sector_size;
+            }else {
+                slot_ = cluster_inuse(table) ? (table + DIR_HEADER_SIZE) : 0xFFFFFFFF;
+            }
+            limit_ = (slot_ / Geometry::sector_size + 1) * Geometry::sector_size;
+            seek();
+        }
+
+        void advance() noexcept {
+            slot_ += FILEBLOCK_SIZE;
+            seek();
+        }
+
+        // 从slot_开始找到下一个有效槽位, 空槽位的状态字为FFFFFFFF, 先行判断
+        void seek() noexcept {
+            FileBlock fb;
+            while(slot_ != 0xFFFFFFFF) {
+                if((slot_ + FILEBLOCK_SIZE) > limit_) {
+                    next_sector();
+                    continue;
+                }
+                disk_read(slot_, reinterpret_cast<std::uint8_t *>(&fb), FILEBLOCK_SIZE);
+                if(fb.state != 0xFFFFFFFF && fb.length != 0xFFFFFFFF && !fileblock_continuation(&fb) && !fileblock_empty(&fb)) {
+                    current_.assign(fb, slot_);
+                    return;
+                }
+                slot_ += FILEBLOCK_SIZE;
+            }
+        }
+
+        void next_sector() noexcept {
+            if(table_ == 0xFFFFFFFF) {
+                slot_ = limit_;
+                if(slot_ >= FB_SECTOR_END * Geometry::sector_size) {
+                    slot_ = 0xFFFFFFFF;
+                }
+            }else {
+                disk_read(table_ + 4, reinterpret_cast<std::uint8_t *>(&table_), 4);
+                slot_ = cluster_inuse(table_) ? (table_ + DIR_HEADER_SIZE) : 0xFFFFFFFF;
+            }
+            limit_ = (slot_ / Geometry::sector_size + 1) * Geometry::sector_size;
+        }
+    };
+
+    // 根目录
+    basic_directory() noexcept = default;
+
+    /**
+     * 子目录
+     * @param &dir 目录句柄, 非目录时遍历为空
+     * */
+    explicit basic_directory(const basic_file<Geometry> &dir) noexcept
+        : table_(dir.is_directory() ? dir.native().cluster : 0) {}
+
+    iterator begin() const noexcept { return iterator(table_); }
+    std::default_sentinel_t end() const noexcept { return std::default_sentinel; }
+
+private:
+    std::uint32_t table_ = 0xFFFFFFFF; // 首个目录表扇区, FFFFFFFF表示根目录
+};
+
+using directory = basic_directory<>;
+
+} // namespace spifs
+
+#endif // __SPIFS_HPP__
@@ -0,0 +1,61 @@
+#include "trace.h"
+
+/**
+ * 闪存操作跟踪
+ * 开启后diskio的每次读取/编程/擦除与应用层写入生成一条12字节记录, 交由sink输出(文件, 串口等)
+ * 未开启时每次操作只多一次判断
+ * */
+
+static void (*trace_sink)(uint8_t *data, uint32_t size) = 0;
+static uint32_t (*trace_clock)(void) = 0;
+static uint32_t trace_seq = 0;
+
+/**
+ * 开始跟踪, 先输出跟踪数据头
+ * @param sink 输出回调
+ * @param clock 时间戳回调, NULL时以记录序号为时间戳
+ * @param clock_hz 时间戳频率(clock为NULL时忽略)
+ * */
+void trace_start(void (*sink)(uint8_t *data, uint32_t size), uint32_t (*clock)(void), uint32_t clock_hz) {
+    TraceHeader header;
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.clock_hz = clock ? clock_hz : 0;
+    header.reserved = 0xFFFFFFFF;
+    trace_seq = 0;
+    trace_clock = clock;
+    trace_sink = sink;
+    trace_sink((uint8_t *)&header, sizeof(TraceHeader));
+}
+
+/**
+ * 停止跟踪
+ * */
+void trace_stop() {
+    trace_sink = 0;
+}
+
+/**
+ * 记录一次操作
+ * @param op 操作类型
+ * @param address 操作地址
+ * @param size 字节数
+ * */
+void trace_record(uint8_t op, uint32_t address, uint32_t size) {
+    TraceRecord record;
+    if(trace_sink == 0) {
+        return;
+    }
+    record.op = op;
+    record.reserved = 0xFF;
+    do {
+        record.time = trace_clock ? trace_clock() : trace_seq;
+        trace_seq++;
+        record.address = address;
+        record.size = (size > 0xFFFF) ? 0xFFFF : (uint16_t)size;
+        trace_sink((uint8_t *)&record, sizeof(TraceRecord));
+        address += record.size;
+        size -= record.size;
+    }while(size);
+}
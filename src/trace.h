@@ -0,0 +1,42 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "stdint.h"
+
+// 跟踪数据头(16字节)
+typedef struct trace_header {
+    uint32_t magic;        // TRACE_MAGIC
+    uint16_t version;     // TRACE_VERSION
+    uint16_t record_size; // 每条记录的大小(字节)
+    uint32_t clock_hz;   // 时间戳频率, 0表示时间戳为记录序号
+    uint32_t reserved;
+} TraceHeader;
+
+// 跟踪记录(12字节)
+typedef struct trace_record {
+    uint32_t time;      // 时间戳
+    uint32_t address;  // 操作地址
+    uint16_t size;    // 字节数, 超过65535字节的操作拆分为多条记录
+    uint8_t op;      // 操作类型
+    uint8_t reserved;
+} TraceRecord;
+
+#define TRACE_MAGIC 0x52545053
+#define TRACE_VERSION 1
+
+// 读取(地址, 字节数)
+#define TRACE_READ 0x01
+// 页编程(地址, 字节数), 不跨页
+#define TRACE_PROGRAM 0x02
+// 扇区擦除(扇区首地址, 4096)
+#define TRACE_ERASE 0x03
+// 整片擦除
+#define TRACE_CHIP_ERASE 0x04
+// 应用层写入(文件索引地址, 写入字节数), 由write_file/append_file/spifs_pwrite/spifs_ring_append记录
+#define TRACE_USER_WRITE 0x05
+
+void trace_start(void (*sink)(uint8_t *data, uint32_t size), uint32_t (*clock)(void), uint32_t clock_hz);
+void trace_stop();
+void trace_record(uint8_t op, uint32_t address, uint32_t size);
+
+#endif // __TRACE_H__
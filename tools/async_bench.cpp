@@ -0,0 +1,241 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "async.hpp"
+
+extern "C" {
+#include "w25q32.h"
+}
+
+/**
+ * 异步操作吞吐量测试
+ * 模拟器按W25Q32典型时序(页编程0.7ms, 扇区擦除45ms)在虚拟时钟上模拟忙状态, CPU工作以w25q32_elapse计时
+ * 两个记录任务各自生成记录(每条耗费固定的CPU时间)并追加到自己的文件, 每隔若干条覆盖写文件开头(触发擦除);
+ * 分别以同步接口, C回调状态机与C++协程执行, 比较虚拟时钟上的总耗时并校验文件内容
+ * 编译: gcc -O2 -c -Isrc src/[a-z]*.c && g++ -std=c++20 -O2 -Isrc tools/async_bench.cpp *.o -o async_bench
+ * 用法: async_bench [每个任务的记录数] [每条记录的CPU时间(us)]
+ * */
+
+// 每条记录的大小(字节)
+#define RECORD_SIZE 1024
+// 每隔多少条记录覆盖写一次文件开头
+#define REWRITE_INTERVAL 25
+// 轮询间隔(us), 无事可做时每次轮询的耗时
+#define POLL_US 20
+// 记录任务数
+#define LOGGER_SUM 2
+// 异步命令队列长度
+#define QUEUE_COMMANDS 32
+
+static uint32_t records = 100;
+static uint32_t work_us = 3000;
+static FileState fstate;
+
+// 记录任务
+typedef struct logger {
+    File file;
+    uint32_t index;       // 下一条记录序号
+    uint8_t rewrite;     // 1:完成追加写后覆盖写开头
+    uint8_t finished;   // 1:已提交最后的完成追加写
+    uint8_t record[RECORD_SIZE];
+    AsyncOp op;
+} Logger;
+
+static Logger loggers[LOGGER_SUM];
+
+/**
+ * 生成一条记录, 耗费work_us的CPU时间
+ * 计算分为POLL_US的小段, 段间调用disk_async_step使闪存空闲时即发出下一条命令(不执行文件系统代码, 可在回调中调用)
+ * @param *record 输出缓冲区
+ * @param logger 任务序号
+ * @param index 记录序号
+ * */
+static void make_record(uint8_t *record, uint32_t logger, uint32_t index) {
+    for(uint32_t i = 0; i < RECORD_SIZE; i++) {
+        record[i] = (uint8_t)(i * 7 + index * 13 + logger * 101);
+    }
+    for(uint32_t t = 0; t < work_us; t += POLL_US) {
+        w25q32_elapse(POLL_US);
+        disk_async_step();
+    }
+}
+
+/**
+ * 格式化存储器并创建各任务的文件
+ * */
+static void prepare() {
+    char name[9];
+    w25q32_timing(0, 0);
+    spifs_async(0);
+    w25q32_chip_erase();
+    spifs_mount();
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        snprintf(name, sizeof(name), "log%u", i);
+        make_file(&loggers[i].file, name, (char *)"dat");
+        create_file(&loggers[i].file, fstate);
+        loggers[i].index = 0;
+        loggers[i].rewrite = 0;
+        loggers[i].finished = 0;
+        make_record(loggers[i].record, i, 0xFFFF);
+        write_file(&loggers[i].file, loggers[i].record, RECORD_SIZE);
+    }
+    w25q32_timing(700, 45000);
+}
+
+/**
+ * 同步接口: 依次生成记录并等待写入完成
+ * */
+static void run_sync() {
+    for(uint32_t n = 0; n < records; n++) {
+        for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+            make_record(loggers[i].record, i, n);
+            append_file(&loggers[i].file, loggers[i].record, RECORD_SIZE);
+            if((n % REWRITE_INTERVAL) == (REWRITE_INTERVAL - 1)) {
+                append_finish(&loggers[i].file);
+                spifs_pwrite(&loggers[i].file, 0, loggers[i].record, 16);
+            }
+        }
+    }
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        append_finish(&loggers[i].file);
+    }
+}
+
+/**
+ * C回调状态机: 操作完成后生成下一条记录并提交, 记录的生成与其他任务的闪存忙碌时间重叠
+ * 步骤同run_sync: 追加记录, 每REWRITE_INTERVAL条完成追加写后覆盖写开头, 全部记录之后完成追加写
+ * */
+static void logger_step(AsyncOp *op) {
+    Logger *logger = (Logger *)op->context;
+    if(op->kind == ASYNC_APPEND && (logger->index % REWRITE_INTERVAL) == 0) {
+        op->kind = ASYNC_FINISH;
+        logger->rewrite = 1;
+    }else if(logger->rewrite) {
+        logger->rewrite = 0;
+        op->kind = ASYNC_PWRITE;
+        op->offset = 0;
+        op->size = 16;
+    }else if(logger->index < records) {
+        make_record(logger->record, (uint32_t)(logger - loggers), logger->index);
+        logger->index++;
+        op->kind = ASYNC_APPEND;
+        op->size = RECORD_SIZE;
+    }else if(!logger->finished) {
+        logger->finished = 1;
+        op->kind = ASYNC_FINISH;
+    }else {
+        return;
+    }
+    spifs_async_submit(op);
+}
+
+static void run_callback() {
+    spifs_async(QUEUE_COMMANDS);
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        Logger *logger = loggers + i;
+        memset(&logger->op, 0, sizeof(AsyncOp));
+        logger->op.kind = ASYNC_WRITE;
+        logger->op.file = &logger->file;
+        logger->op.buffer = logger->record;
+        logger->op.callback = logger_step;
+        logger->op.context = logger;
+        logger->op.state = ASYNC_DONE;
+        logger_step(&logger->op);
+    }
+    while(spifs_async_poll()) {
+        w25q32_elapse(POLL_US);
+    }
+    spifs_async(0);
+}
+
+/**
+ * C++协程: 每个任务一个协程, co_await挂起期间其他协程生成记录
+ * */
+static spifs::task logger_task(spifs::file &file, uint32_t id) {
+    uint8_t record[RECORD_SIZE];
+    for(uint32_t n = 0; n < records; n++) {
+        make_record(record, id, n);
+        co_await spifs::async_append(file, record);
+        if((n % REWRITE_INTERVAL) == (REWRITE_INTERVAL - 1)) {
+            co_await spifs::async_finish(file);
+            co_await spifs::async_pwrite(file, 0, std::span(record, 16));
+        }
+    }
+    co_await spifs::async_finish(file);
+}
+
+static void run_coroutine() {
+    std::vector<spifs::file> files;
+    std::vector<spifs::task> tasks;
+    spifs_async(QUEUE_COMMANDS);
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        char name[9];
+        snprintf(name, sizeof(name), "log%u", i);
+        files.push_back(std::move(*spifs::file::open(name, "dat")));
+    }
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        tasks.push_back(logger_task(files[i], i));
+    }
+    while(spifs::poll()) {
+        w25q32_elapse(POLL_US);
+    }
+    spifs_async(0);
+}
+
+/**
+ * 校验各任务的文件内容
+ * @return 1:内容正确
+ * */
+static uint8_t check() {
+    std::vector<uint8_t> expect(RECORD_SIZE * (records + 1)), actual(expect.size());
+    uint8_t record[RECORD_SIZE];
+    char name[9];
+    File file;
+    w25q32_timing(0, 0);
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        make_record(expect.data(), i, 0xFFFF);
+        for(uint32_t n = 0; n < records; n++) {
+            make_record(expect.data() + (n + 1) * RECORD_SIZE, i, n);
+            if((n % REWRITE_INTERVAL) == (REWRITE_INTERVAL - 1)) {
+                make_record(record, i, n);
+                memcpy(expect.data(), record, 16);
+            }
+        }
+        snprintf(name, sizeof(name), "log%u", i);
+        if(!open_file(&file, name, (char *)"dat") || file.length != expect.size()
+                || !read_file(&file, actual.data(), 0, file.length) || actual != expect) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *modes[3] = {"sync", "callback", "coroutine"};
+    uint32_t elapsed[3];
+    records = (argc > 1) ? (uint32_t)atoi(argv[1]) : records;
+    work_us = (argc > 2) ? (uint32_t)atoi(argv[2]) : work_us;
+    w25q32_allocate();
+    w25q32_strict(1, NULL);
+    disk_cache(16);
+    make_fstate(&fstate, 2024, 1, 1);
+
+    for(uint32_t mode = 0; mode < 3; mode++) {
+        uint32_t start;
+        prepare();
+        start = w25q32_clock();
+        if(mode == 0) {
+            run_sync();
+        }else if(mode == 1) {
+            run_callback();
+        }else {
+            run_coroutine();
+        }
+        elapsed[mode] = w25q32_clock() - start;
+        printf("%-10s %8.1f ms  %s\n", modes[mode], elapsed[mode] / 1000.0, check() ? "ok" : "CONTENT MISMATCH");
+    }
+    printf("cpu work   %8.1f ms, flash busy (sync - cpu) %.1f ms, strict violations %u\n",
+           (LOGGER_SUM * records * work_us) / 1000.0, (elapsed[0] - LOGGER_SUM * records * work_us) / 1000.0, w25q32_violations());
+    return 0;
+}
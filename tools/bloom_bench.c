@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 根目录文件名布隆过滤器测试
+ * 根目录中创建100/300/680(全满)个文件, 分别以256B/512B/1KB/2KB的过滤器查询MISSING_NAMES个不存在的文件名, 输出误判率;
+ * 之后比较不开启与开启1KB过滤器时每次open_file的存储器读取次数与字节数(trace_start统计), SPI 50MHz下的耗时(虚拟时钟)与主机耗时,
+ * 分别为查找不存在的文件(未命中)与已存在的文件(命中)
+ * 编译: gcc -O2 -Isrc tools/bloom_bench.c src/[a-z]*.c -o bloom_bench
+ * */
+
+// 查询的不存在的文件名数
+#define MISSING_NAMES 20000
+// 查询耗时测试的文件数
+#define LATENCY_FILES 300
+// 根目录全满时的文件数
+#define ROOT_FULL 680
+
+static uint32_t reads = 0, read_bytes = 0;
+
+static void count_read(uint8_t *trace_data, uint32_t size) {
+    TraceRecord *trace = (TraceRecord *)trace_data;
+    if(size == sizeof(TraceRecord) && trace->op == TRACE_READ) {
+        reads++;
+        read_bytes += trace->size;
+    }
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * 在空卷的根目录中创建文件f0, f1...
+ * */
+static void make_root(uint32_t files) {
+    FileState fstate;
+    File file;
+    char name[12];
+
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < files; i++) {
+        snprintf(name, sizeof(name), "f%u", i);
+        make_file(&file, name, "dat");
+        create_file(&file, fstate);
+    }
+}
+
+/**
+ * 查询count个文件名, missing为1时查询不存在的文件名m0, m1...
+ * @return 找到的文件数
+ * */
+static uint32_t lookup(uint32_t count, uint8_t missing) {
+    File file;
+    char name[12];
+    uint32_t found = 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), missing ? "m%u" : "f%u", i);
+        found += open_file(&file, name, "dat");
+    }
+    return found;
+}
+
+/**
+ * 测量每次查询的存储器读取与耗时
+ * */
+static void measure(const char *label, uint32_t count, uint8_t missing) {
+    uint32_t start;
+    double host;
+
+    reads = 0;
+    read_bytes = 0;
+    trace_start(count_read, NULL, 0);
+    w25q32_bus(160);
+    start = w25q32_clock();
+    lookup(count, missing);
+    start = w25q32_clock() - start;
+    w25q32_bus(0);
+    trace_stop();
+    host = now();
+    for(uint32_t round = 0; round < 10; round++) {
+        lookup(count, missing);
+    }
+    host = (now() - host) / 10 / count;
+    printf("  %-14s %8.1f %10.1f %10.3f %10.2f\n", label, (double)reads / count, (double)read_bytes / count,
+           start / 1000.0 / count, host * 1e6);
+}
+
+int main() {
+    const uint32_t files[3] = {100, 300, ROOT_FULL};
+    const uint32_t bytes[4] = {256, 512, 1024, 2048};
+    BloomStats before, after;
+    uint8_t ok = 1;
+
+    w25q32_allocate();
+    printf("false positive rate, %u missing names\n", MISSING_NAMES);
+    printf("  %-6s", "files");
+    for(uint32_t j = 0; j < 4; j++) {
+        printf(" %8uB", bytes[j]);
+    }
+    printf("\n");
+    for(uint32_t i = 0; i < 3; i++) {
+        make_root(files[i]);
+        printf("  %-6u", files[i]);
+        for(uint32_t j = 0; j < 4; j++) {
+            spifs_bloom(bytes[j]);
+            spifs_bloom_stats(&before);
+            ok &= (lookup(MISSING_NAMES, 1) == 0);
+            spifs_bloom_stats(&after);
+            printf(" %8.3f%%", 100.0 * (after.false_positives - before.false_positives) / (after.queries - before.queries));
+        }
+        printf("\n");
+    }
+
+    for(uint32_t i = 0; i < 2; i++) {
+        make_root(i ? ROOT_FULL : LATENCY_FILES);
+        printf("%u files, per open_file\n", i ? ROOT_FULL : LATENCY_FILES);
+        printf("  %-14s %8s %10s %10s %10s\n", "", "reads", "bytes", "SPI ms", "host us");
+        spifs_bloom(0);
+        measure("miss", MISSING_NAMES, 1);
+        measure("hit", LATENCY_FILES, 0);
+        spifs_bloom(1024);
+        measure("miss, 1KB", MISSING_NAMES, 1);
+        measure("hit, 1KB", LATENCY_FILES, 0);
+        ok &= (lookup(LATENCY_FILES, 0) == LATENCY_FILES);
+    }
+    spifs_bloom(0);
+    printf("lookups %s\n", ok ? "ok" : "WRONG");
+    return 0;
+}
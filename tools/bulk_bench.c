@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 批量内存操作测试
+ * 比较bulk_fill/bulk_copy/bulk_equal/bulk_erased与之前misc.c和w25q32.c中的逐字节循环的主机吞吐量,
+ * 以及模拟器的读取, 页编程, 扇区擦除与整片擦除(逐字节循环为改用bulk_*之前的实现)
+ * 逐字节循环禁止自动向量化与替换为库函数(gcc), 与之前在MCU上的行为相同
+ * 编译: gcc -O2 -Isrc tools/bulk_bench.c src/[a-z]*.c -o bulk_bench
+ * */
+
+// 计时的最短时间(s)
+#define MIN_SECONDS 0.2
+
+#define BYTE_LOOP __attribute__((noinline, optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+
+static uint8_t *a = NULL, *b = NULL;
+static volatile uint32_t sink = 0;
+
+static BYTE_LOOP void byte_fill(uint8_t *buffer, uint8_t value, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        *(buffer + i) = value;
+    }
+}
+
+static BYTE_LOOP void byte_copy(uint8_t *to, uint8_t *from, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        *(to + i) = *(from + i);
+    }
+}
+
+static BYTE_LOOP uint8_t byte_equal(uint8_t *x, uint8_t *y, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        if(*(x + i) != *(y + i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static BYTE_LOOP uint8_t byte_erased(uint8_t *data, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        if(*(data + i) != 0xFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 被测操作, 0为逐字节循环, 1为新实现
+typedef struct bench {
+    const char *name;
+    uint32_t size;
+    void (*run[2])(uint32_t size);
+} Bench;
+
+static void old_fill(uint32_t size) { byte_fill(a, 0xFF, size); }
+static void new_fill(uint32_t size) { bulk_fill(a, 0xFF, size); }
+static void old_copy(uint32_t size) { byte_copy(b, a, size); }
+static void new_copy(uint32_t size) { bulk_copy(b, a, size); }
+static void old_equal(uint32_t size) { sink += byte_equal(a, b, size); }
+static void new_equal(uint32_t size) { sink += bulk_equal(a, b, size); }
+static void old_erased(uint32_t size) { sink += byte_erased(a, size); }
+static void new_erased(uint32_t size) { sink += bulk_erased(a, size); }
+static void old_chip_erase(uint32_t size) { byte_fill(w25q32_getbuffer(), 0xFF, size); }
+static void new_chip_erase(uint32_t size) { (void)size; w25q32_chip_erase(); }
+static void old_read(uint32_t size) { byte_copy(b, w25q32_getbuffer() + 8192, size); }
+static void new_read(uint32_t size) { w25q32_read(8192, b, size); }
+static void old_page(uint32_t size) { byte_copy(w25q32_getbuffer() + 8192, a, size); }
+static void new_page(uint32_t size) { w25q32_write_page(8192, a, size); }
+static void old_sector_erase(uint32_t size) { byte_fill(w25q32_getbuffer() + 8192, 0xFF, size); }
+static void new_sector_erase(uint32_t size) { (void)size; w25q32_sector_erase(8192); }
+
+static const Bench benches[] = {
+    {"fill 4MB", 4194304, {old_fill, new_fill}},
+    {"copy 4KB", 4096, {old_copy, new_copy}},
+    {"equal 4KB", 4096, {old_equal, new_equal}},
+    {"erased 4KB", 4096, {old_erased, new_erased}},
+    {"erased 12B", 12, {old_erased, new_erased}},
+    {"w25q32_chip_erase", 4194304, {old_chip_erase, new_chip_erase}},
+    {"w25q32_read 4KB", 4096, {old_read, new_read}},
+    {"w25q32_write_page", 256, {old_page, new_page}},
+    {"w25q32_sector_erase", 4096, {old_sector_erase, new_sector_erase}},
+};
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * 重复运行至少MIN_SECONDS, 返回吞吐量(GB/s)
+ * */
+static double measure(void (*run)(uint32_t size), uint32_t size) {
+    uint64_t rounds = 0, batch = 1;
+    double start = now(), elapsed;
+    do {
+        for(uint64_t i = 0; i < batch; i++) {
+            run(size);
+        }
+        rounds += batch;
+        batch *= 2;
+        elapsed = now() - start;
+    } while(elapsed < MIN_SECONDS);
+    return (double)size * rounds / elapsed / 1e9;
+}
+
+int main() {
+    double old_rate, new_rate;
+
+    a = (uint8_t *)malloc(4194304);
+    b = (uint8_t *)malloc(4194304);
+    memset(a, 0xFF, 4194304);
+    memset(b, 0xFF, 4194304);
+    w25q32_allocate();
+
+    printf("%-20s %12s %12s %8s\n", "operation", "byte GB/s", "bulk GB/s", "speedup");
+    for(uint32_t i = 0; i < sizeof(benches) / sizeof(Bench); i++) {
+        old_rate = measure(benches[i].run[0], benches[i].size);
+        new_rate = measure(benches[i].run[1], benches[i].size);
+        printf("%-20s %12.2f %12.2f %7.1fx\n", benches[i].name, old_rate, new_rate, new_rate / old_rate);
+    }
+    free(a);
+    free(b);
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spifs.h"
+
+/**
+ * 扇区缓存测试
+ * 卷上有50个小文件, 400KB与32KB的文件各一个, 在不同的缓存容量(disk_cache)下运行:
+ *   打开: open_file打开最后创建的小文件2000次
+ *   顺序64B: 以64字节为单位顺序读取32KB文件, 共5遍
+ *   顺序256B: 以256字节为单位顺序读取400KB文件, 共5遍
+ *   整文件: 一次读取400KB文件, 共5遍
+ * 输出存储器读取次数与字节数(trace_start统计, 缓存命中不记录), SPI 50MHz下的读取耗时(虚拟时钟), 命中率与预读命中
+ * 编译: gcc -O2 -Isrc tools/cache_bench.c src/[a-z]*.c -o cache_bench
+ * */
+
+// 大文件与中等文件的大小(字节)
+#define BIG_SIZE 400000
+#define MID_SIZE 32000
+// 小文件数
+#define SMALL_FILES 50
+// 打开次数与读取遍数
+#define OPENS 2000
+#define PASSES 5
+
+static uint8_t data[BIG_SIZE];
+static uint8_t buffer[BIG_SIZE];
+static uint32_t reads = 0, read_bytes = 0;
+
+static void count_read(uint8_t *trace_data, uint32_t size) {
+    TraceRecord *trace = (TraceRecord *)trace_data;
+    if(size == sizeof(TraceRecord) && trace->op == TRACE_READ) {
+        reads++;
+        read_bytes += trace->size;
+    }
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+/**
+ * 运行一项测试
+ * @param workload 0:打开, 1:顺序64B, 2:顺序256B, 3:整文件
+ * @return 1:读出内容正确
+ * */
+static uint8_t run(uint32_t workload) {
+    File file;
+    uint32_t chunk;
+    uint8_t ok = 1;
+
+    if(workload == 0) {
+        for(uint32_t i = 0; i < OPENS; i++) {
+            ok &= open_file(&file, "f49", "dat");
+        }
+    }else if(workload == 1) {
+        open_file(&file, "mid", "bin");
+        for(uint32_t pass = 0; pass < PASSES; pass++) {
+            for(uint32_t offset = 0; offset < MID_SIZE; offset += 64) {
+                read_file(&file, buffer + offset, offset, 64);
+            }
+        }
+        ok &= (memcmp(buffer, data, MID_SIZE) == 0);
+    }else if(workload == 2) {
+        open_file(&file, "big", "bin");
+        for(uint32_t pass = 0; pass < PASSES; pass++) {
+            for(uint32_t offset = 0; offset < BIG_SIZE; offset += 256) {
+                chunk = ((BIG_SIZE - offset) < 256) ? (BIG_SIZE - offset) : 256;
+                read_file(&file, buffer + offset, offset, chunk);
+            }
+        }
+        ok &= (memcmp(buffer, data, BIG_SIZE) == 0);
+    }else {
+        open_file(&file, "big", "bin");
+        for(uint32_t pass = 0; pass < PASSES; pass++) {
+            read_file(&file, buffer, 0, BIG_SIZE);
+        }
+        ok &= (memcmp(buffer, data, BIG_SIZE) == 0);
+    }
+    return ok;
+}
+
+int main() {
+    const char *names[4] = {"open x2000", "seq 64B", "seq 256B", "whole 400KB"};
+    const uint32_t sizes[4] = {0, 4, 16, 64};
+    FileState fstate;
+    File file;
+    DiskCacheStats stats;
+    char name[9];
+    uint32_t seed = 2024, start, accesses;
+    uint8_t ok = 1;
+
+    w25q32_allocate();
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < SMALL_FILES; i++) {
+        snprintf(name, sizeof(name), "f%u", i);
+        make_file(&file, name, "dat");
+        create_file(&file, fstate);
+        write_file(&file, data, 100 + i);
+    }
+    for(uint32_t i = 0; i < BIG_SIZE; i++) {
+        data[i] = (uint8_t)next_random(&seed);
+    }
+    make_file(&file, "big", "bin");
+    create_file(&file, fstate);
+    write_file(&file, data, BIG_SIZE);
+    make_file(&file, "mid", "bin");
+    create_file(&file, fstate);
+    write_file(&file, data, MID_SIZE);
+
+    printf("%-12s %7s %9s %11s %10s %7s %10s\n", "workload", "sectors", "reads", "bytes", "SPI ms", "hit %", "prefetch");
+    for(uint32_t workload = 0; workload < 4; workload++) {
+        for(uint32_t i = 0; i < 4; i++) {
+            disk_cache(sizes[i]);
+            reads = 0;
+            read_bytes = 0;
+            trace_start(count_read, NULL, 0);
+            w25q32_bus(160);
+            start = w25q32_clock();
+            ok &= run(workload);
+            start = w25q32_clock() - start;
+            w25q32_bus(0);
+            trace_stop();
+            disk_cache_stats(&stats);
+            accesses = stats.hits + stats.misses;
+            printf("%-12s %7u %9u %11u %10.2f %7.1f %5u/%-5u\n", names[workload], sizes[i], reads, read_bytes, start / 1000.0,
+                   accesses ? 100.0 * stats.hits / accesses : 0.0, stats.prefetch_hits, stats.prefetches);
+        }
+    }
+    disk_cache(0);
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    return 0;
+}
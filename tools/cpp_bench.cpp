@@ -0,0 +1,132 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "spifs.hpp"
+
+extern "C" {
+#include "w25q32.h"
+}
+
+/**
+ * C++封装与C接口的开销对比
+ * 在模拟器上建立一组文件后, 交替以C接口与spifs.hpp执行同样的操作, 每项取多轮中的最短耗时:
+ * 打开文件并读取1KB, 遍历根目录(C接口为list_file), 覆盖写16字节
+ * 编译: gcc -O2 -c -Isrc src/[a-z]*.c && g++ -std=c++20 -O2 -Isrc tools/cpp_bench.cpp *.o -o cpp_bench
+ * 用法: cpp_bench [文件数] [轮数]
+ * */
+
+// 每个文件的大小(字节)
+#define BENCH_FILE_SIZE 6000
+// 读取与覆盖写的偏移
+#define BENCH_OFFSET 3000
+
+static char names[1024][9];
+
+using bench_clock = std::chrono::steady_clock;
+
+/**
+ * 执行一轮操作并返回耗时(纳秒)
+ * @param &body 操作
+ * */
+template<class F>
+static double timed(F &&body) {
+    bench_clock::time_point start = bench_clock::now();
+    body();
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    uint32_t files = (argc > 1) ? (uint32_t)atoi(argv[1]) : 160;
+    uint32_t rounds = (argc > 2) ? (uint32_t)atoi(argv[2]) : 60;
+    std::vector<uint8_t> content(BENCH_FILE_SIZE), data(1024);
+    FileState fstate;
+    double best[3][2] = {{1e30, 1e30}, {1e30, 1e30}, {1e30, 1e30}};
+    uint64_t sum[2] = {0, 0};
+
+    if(files > 1024) {
+        files = 1024;
+    }
+    w25q32_allocate();
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < BENCH_FILE_SIZE; i++) {
+        content[i] = (uint8_t)(i * 31);
+    }
+    for(uint32_t i = 0; i < files; i++) {
+        File file;
+        snprintf(names[i], sizeof(names[i]), "f%05u", i);
+        make_file(&file, names[i], (char *)"bin");
+        if(create_file(&file, fstate) != CREATE_FILEBLOCK_SUCCESS || write_file(&file, content.data(), BENCH_FILE_SIZE) != WRITE_FILE_SUCCESS) {
+            printf("create %s failed\n", names[i]);
+            return 1;
+        }
+    }
+
+    for(uint32_t round = 0; round < rounds; round++) {
+        double t;
+        // 打开并读取
+        t = timed([&] {
+            for(uint32_t i = 0; i < files; i++) {
+                File file;
+                if(open_file(&file, names[i], (char *)"bin")) {
+                    read_file(&file, data.data(), BENCH_OFFSET, 1024);
+                    sum[0] += data[7];
+                }
+            }
+        });
+        best[0][0] = (t < best[0][0]) ? t : best[0][0];
+        t = timed([&] {
+            for(uint32_t i = 0; i < files; i++) {
+                if(std::optional<spifs::file> file = spifs::file::open(names[i], "bin")) {
+                    file->read(BENCH_OFFSET, data);
+                    sum[1] += data[7];
+                }
+            }
+        });
+        best[0][1] = (t < best[0][1]) ? t : best[0][1];
+
+        // 遍历根目录
+        t = timed([&] {
+            FileList *list = list_file(), *item;
+            for(item = list; item != NULL; item = item->prev) {
+                sum[0] += item->File.length;
+            }
+            recycle_filelist(list);
+        });
+        best[1][0] = (t < best[1][0]) ? t : best[1][0];
+        t = timed([&] {
+            for(const spifs::entry &entry : spifs::directory()) {
+                sum[1] += entry.length();
+            }
+        });
+        best[1][1] = (t < best[1][1]) ? t : best[1][1];
+
+        // 覆盖写(只取前16个文件, 每次擦写一个簇)
+        t = timed([&] {
+            for(uint32_t i = 0; i < 16 && i < files; i++) {
+                File file;
+                if(open_file(&file, names[i], (char *)"bin")) {
+                    spifs_pwrite(&file, BENCH_OFFSET, data.data(), 16);
+                }
+            }
+        });
+        best[2][0] = (t < best[2][0]) ? t : best[2][0];
+        t = timed([&] {
+            for(uint32_t i = 0; i < 16 && i < files; i++) {
+                if(std::optional<spifs::file> file = spifs::file::open(names[i], "bin")) {
+                    file->pwrite(BENCH_OFFSET, std::span(data).first(16));
+                }
+            }
+        });
+        best[2][1] = (t < best[2][1]) ? t : best[2][1];
+    }
+
+    printf("%u files, best of %u rounds (us)        C       C++\n", files, rounds);
+    printf("open + read 1KB (per file)       %8.2f  %8.2f\n", best[0][0] / files / 1e3, best[0][1] / files / 1e3);
+    printf("list root directory              %8.2f  %8.2f\n", best[1][0] / 1e3, best[1][1] / 1e3);
+    printf("open + pwrite 16B (per file)     %8.2f  %8.2f\n", best[2][0] / 16 / 1e3, best[2][1] / 16 / 1e3);
+    printf("checksum %s\n", (sum[0] == sum[1]) ? "match" : "MISMATCH");
+    return 0;
+}
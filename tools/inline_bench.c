@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 内联文件测试
+ * 在一个目录中创建150个8至187字节的小文件(配置文件一类的语料), 分别按普通文件与内联文件(FSTATE_INLINE)存放, 比较:
+ *   占用的扇区数(含目录表), 内联存放的文件数
+ *   读取整个文件的闪存读取次数与字节数(trace_start统计), SPI 50MHz下的读取耗时(虚拟时钟)与主机耗时
+ * 编译: gcc -O2 -Isrc tools/inline_bench.c src/[a-z]*.c -o inline_bench
+ * */
+
+// 文件数, 最小长度与长度范围(字节)
+#define CORPUS_FILES 150
+#define CORPUS_MIN 8
+#define CORPUS_RANGE 180
+// 主机计时的读取轮数
+#define ROUNDS 2000
+
+static uint8_t data[CORPUS_MIN + CORPUS_RANGE];
+static uint8_t buffer[CORPUS_MIN + CORPUS_RANGE];
+static File files[CORPUS_FILES];
+static uint32_t reads = 0, read_bytes = 0;
+
+static void count_read(uint8_t *trace_data, uint32_t size) {
+    TraceRecord *trace = (TraceRecord *)trace_data;
+    if(size == sizeof(TraceRecord) && trace->op == TRACE_READ) {
+        reads++;
+        read_bytes += trace->size;
+    }
+}
+
+static void fill(uint32_t id, uint32_t size) {
+    for(uint32_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(id * 37 + i * 11);
+    }
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * 运行一次测试
+ * @param inline_files 1:内联文件
+ * @return 1:读出内容正确
+ * */
+static uint8_t run(uint8_t inline_files) {
+    FileState fstate, dstate;
+    File dir;
+    char name[9];
+    uint32_t size, sectors = 0, inlined = 0, start;
+    double host;
+    uint8_t ok = 1;
+
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&dstate, 2024, 1, 1);
+    make_file(&dir, "etc", "");
+    create_dir(&dir, NULL, dstate);
+    fstate = dstate;
+    if(inline_files) {
+        fstate.state &= ~FSTATE_INLINE;
+    }
+    for(uint32_t i = 0; i < CORPUS_FILES; i++) {
+        snprintf(name, sizeof(name), "f%u", i);
+        make_file(files + i, name, "cfg");
+        create_file_at(&dir, files + i, fstate);
+        size = CORPUS_MIN + (i * 37) % CORPUS_RANGE;
+        fill(i, size);
+        write_file(files + i, data, size);
+        open_file_at(&dir, files + i, name, "cfg");
+        inlined += INLINE_STORED(files[i].state, files[i].cluster);
+    }
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        sectors += cluster_inuse(sector * SECTOR_SIZE);
+    }
+
+    reads = 0;
+    read_bytes = 0;
+    trace_start(count_read, NULL, 0);
+    w25q32_bus(160);
+    start = w25q32_clock();
+    for(uint32_t i = 0; i < CORPUS_FILES; i++) {
+        read_file(files + i, buffer, 0, files[i].length);
+        fill(i, files[i].length);
+        ok &= (memcmp(buffer, data, files[i].length) == 0);
+    }
+    start = w25q32_clock() - start;
+    w25q32_bus(0);
+    trace_stop();
+
+    host = now();
+    for(uint32_t round = 0; round < ROUNDS; round++) {
+        for(uint32_t i = 0; i < CORPUS_FILES; i++) {
+            read_file(files + i, buffer, 0, files[i].length);
+        }
+    }
+    host = (now() - host) / ROUNDS / CORPUS_FILES;
+
+    printf("%-8s %7u %7u %6u KB %9.2f %9.1f %9.2f %8.1f\n", inline_files ? "inline" : "cluster", inlined, sectors, sectors * 4,
+           (double)reads / CORPUS_FILES, (double)read_bytes / CORPUS_FILES, (double)start / CORPUS_FILES, host * 1e9);
+    return ok;
+}
+
+int main() {
+    uint8_t ok = 1;
+
+    w25q32_allocate();
+    printf("%u files of %u..%u bytes in one directory\n", CORPUS_FILES, CORPUS_MIN, CORPUS_MIN + CORPUS_RANGE - 1);
+    printf("%-8s %7s %7s %9s %9s %9s %9s %8s\n", "storage", "inline", "sectors", "size", "reads", "bytes", "read us", "host ns");
+    ok &= run(0);
+    ok &= run(1);
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    return 0;
+}
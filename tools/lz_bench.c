@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 压缩文件测试
+ * 在模拟器上(主机内存, 不模拟闪存时序)比较普通文件与压缩文件(FSTATE_COMPRESSED)的占用簇数, 压缩比与主机吞吐量:
+ *   日志: 约1MB合成文本日志(时间戳, 级别, 任务号, 消息, 数值), 一次write_file写入
+ *   追加: 同一日志的前900000字节, 先写入4000字节, 之后每次append_file追加8KB
+ *   随机: 1MB随机数据(不可压缩)
+ * 输出占用簇数, 压缩比(原始大小/占用簇的数据域), 写入与整文件读取的吞吐量, 随机偏移读取(≤3KB)的平均耗时
+ * 编译: gcc -O2 -Isrc tools/lz_bench.c src/[a-z]*.c -o lz_bench
+ * */
+
+// 测试数据大小(字节)
+#define DATA_SIZE 1000000
+// 追加写的数据大小与每次追加的字节数
+#define APPEND_SIZE 900000
+#define APPEND_CHUNK 8000
+// 写入与整文件读取的重复次数
+#define ROUNDS 5
+// 随机读取次数与最大长度(字节)
+#define RANDOM_READS 2000
+#define RANDOM_READ_MAX 3000
+
+static uint8_t data[DATA_SIZE];
+static uint8_t buffer[DATA_SIZE];
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/**
+ * 生成合成文本日志
+ * */
+static void make_log(uint32_t size) {
+    const char *levels[4] = {"INFO", "WARN", "DEBUG", "ERROR"};
+    const char *messages[6] = {"sensor read ok", "battery level", "spi transfer done", "retry connect", "flash gc start", "uart rx overflow"};
+    char line[160];
+    uint32_t position = 0, sequence = 0, seed = 7;
+    int length;
+
+    while(position < size) {
+        length = snprintf(line, sizeof(line), "2024-03-%02u 12:%02u:%02u.%03u [%s] task%u: %s value=%u\n",
+                          1 + sequence / 86400 % 28, sequence / 60 % 60, sequence % 60, next_random(&seed) % 1000,
+                          levels[next_random(&seed) % 4], next_random(&seed) % 8, messages[next_random(&seed) % 6], next_random(&seed) % 5000);
+        for(int i = 0; i < length && position < size; i++) {
+            data[position++] = (uint8_t)line[i];
+        }
+        sequence += next_random(&seed) % 3;
+    }
+}
+
+static uint32_t used_clusters() {
+    uint32_t count = 0;
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        count += cluster_inuse(sector * SECTOR_SIZE);
+    }
+    return count;
+}
+
+/**
+ * 在空卷上新建文件
+ * */
+static void fresh_file(File *file, uint8_t compressed) {
+    FileState fstate;
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    if(compressed) {
+        fstate.state &= ~FSTATE_COMPRESSED;
+    }
+    make_file(file, "LOG", "txt");
+    create_file(file, fstate);
+}
+
+/**
+ * 运行一项测试
+ * @param name 测试名
+ * @param size 数据大小(字节)
+ * @param append 1:分块追加写, 0:一次写入
+ * @param compressed 1:压缩文件
+ * @return 1:读出内容正确
+ * */
+static uint8_t run(const char *name, uint32_t size, uint8_t append, uint8_t compressed) {
+    File file;
+    double start, write_time = 0, read_time, random_time;
+    uint32_t clusters, seed = 3, offset, length, chunk;
+    uint8_t ok = 1;
+
+    for(uint32_t round = 0; round < (append ? 1 : ROUNDS); round++) {
+        fresh_file(&file, compressed);
+        start = now();
+        if(append) {
+            write_file(&file, data, 4000);
+            for(offset = 4000; offset < size; offset += chunk) {
+                chunk = ((size - offset) < APPEND_CHUNK) ? (size - offset) : APPEND_CHUNK;
+                append_file(&file, data + offset, chunk);
+            }
+            append_finish(&file);
+        }else {
+            write_file(&file, data, size);
+        }
+        write_time += now() - start;
+    }
+    write_time /= (append ? 1 : ROUNDS);
+    clusters = used_clusters();
+
+    open_file(&file, "LOG", "txt");
+    start = now();
+    for(uint32_t round = 0; round < ROUNDS; round++) {
+        read_file(&file, buffer, 0, size);
+    }
+    read_time = (now() - start) / ROUNDS;
+    ok &= (file.length == size && memcmp(buffer, data, size) == 0);
+
+    start = now();
+    for(uint32_t i = 0; i < RANDOM_READS; i++) {
+        offset = next_random(&seed) % size;
+        length = 1 + next_random(&seed) % RANDOM_READ_MAX;
+        length = (length > (size - offset)) ? (size - offset) : length;
+        read_file(&file, buffer, offset, length);
+        ok &= (memcmp(buffer, data + offset, length) == 0);
+    }
+    random_time = (now() - start) / RANDOM_READS;
+
+    printf("%-8s %-4s %8u %7.2f %10.1f %10.1f %10.2f\n", name, compressed ? "lz" : "raw", clusters,
+           (double)size / (clusters * (double)FILE_AREA_SIZE(file.state)), size / write_time / 1e6, size / read_time / 1e6, random_time * 1e6);
+    return ok;
+}
+
+int main() {
+    uint32_t seed = 11;
+    uint8_t ok = 1;
+
+    w25q32_allocate();
+    printf("%-8s %-4s %8s %7s %10s %10s %10s\n", "data", "file", "clusters", "ratio", "write MB/s", "read MB/s", "rand us");
+    make_log(DATA_SIZE);
+    for(uint8_t compressed = 0; compressed < 2; compressed++) {
+        ok &= run("log", DATA_SIZE, 0, compressed);
+    }
+    for(uint8_t compressed = 0; compressed < 2; compressed++) {
+        ok &= run("append", APPEND_SIZE, 1, compressed);
+    }
+    for(uint32_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = (uint8_t)next_random(&seed);
+    }
+    for(uint8_t compressed = 0; compressed < 2; compressed++) {
+        ok &= run("random", DATA_SIZE, 0, compressed);
+    }
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 流水线传输吞吐量测试
+ * 模拟器按W25Q32典型时序(SPI 50MHz即160ns每字节, 页编程0.7ms, 扇区擦除45ms)在虚拟时钟上模拟总线与忙状态;
+ * 文件系统的CPU耗时在每次闪存操作前按主机线程CPU时间乘以降速倍数(模拟MCU)计入虚拟时钟
+ * 同步: 单设备条带卷, CPU收发数据并等待每个操作完成; 流水线: 包装disk_device_w25q32()的DMA设备作为单设备条带卷, 开启disk_pipeline
+ * 分别顺序写入与读取普通文件, 校验文件(读取时校验)与压缩文件, 每项取多轮中的最短耗时, 与闪存忙碌时间(设备极限)比较
+ * 编译: gcc -O2 -Isrc tools/pipeline_bench.c src/[a-z]*.c -o pipeline_bench
+ * 用法: pipeline_bench [文件大小(KB)] [CPU降速倍数] [轮数]
+ * */
+
+// 页编程时间(us)
+#define T_PROGRAM 700
+// 扇区擦除时间(us)
+#define T_ERASE 45000
+// 每字节传输时间(ns)
+#define T_BYTE 160
+
+static double cpu_scale = 30;
+static double cpu_overhead = 0;
+static double cpu_carry = 0;
+static struct timespec cpu_mark;
+// 闪存忙碌时间(us)
+static uint32_t device_busy = 0;
+static DiskDevice *emulated;
+
+/**
+ * 自上次闪存操作返回以来的CPU时间按降速倍数计入虚拟时钟, 扣除计时本身的开销
+ * */
+static void cpu_charge() {
+    struct timespec now;
+    double ns;
+    uint32_t us;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    ns = (now.tv_sec - cpu_mark.tv_sec) * 1e9 + (now.tv_nsec - cpu_mark.tv_nsec) - cpu_overhead;
+    cpu_carry += ((ns > 0) ? ns : 0) * cpu_scale / 1000.0;
+    us = (uint32_t)cpu_carry;
+    cpu_carry -= us;
+    w25q32_elapse(us);
+}
+
+static void cpu_resume() {
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_mark);
+}
+
+static uint32_t bus_us(uint32_t size) {
+    return ((size + 4) * T_BYTE + 999) / 1000;
+}
+
+// 同步: 单设备条带卷, 每个操作完成后返回
+static uint32_t sync_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(size);
+    w25q32_read(address, buffer, size);
+    cpu_resume();
+    return size;
+}
+
+static uint8_t sync_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(size) + T_PROGRAM;
+    w25q32_write_page(address, buffer, size);
+    cpu_resume();
+    return 0x2;
+}
+
+static uint8_t sync_sector_erase(void *context, uint32_t address) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(0) + T_ERASE;
+    w25q32_sector_erase(address);
+    cpu_resume();
+    return 0x2;
+}
+
+static uint8_t sync_chip_erase(void *context) {
+    (void)context;
+    return w25q32_chip_erase();
+}
+
+static void sync_wait(void *context) {
+    (void)context;
+}
+
+// 流水线: 包装模拟器的DMA设备
+static uint32_t dma_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(size);
+    emulated->read(emulated->context, address, buffer, size);
+    cpu_resume();
+    return size;
+}
+
+static uint8_t dma_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(size) + T_PROGRAM;
+    emulated->write_page(emulated->context, address, buffer, size);
+    cpu_resume();
+    return 0x2;
+}
+
+static uint8_t dma_sector_erase(void *context, uint32_t address) {
+    (void)context;
+    cpu_charge();
+    device_busy += bus_us(0) + T_ERASE;
+    emulated->sector_erase(emulated->context, address);
+    cpu_resume();
+    return 0x2;
+}
+
+static uint8_t dma_chip_erase(void *context) {
+    (void)context;
+    return emulated->chip_erase(emulated->context);
+}
+
+// 查询不计时, 查询本身计入下一次操作前的CPU时间
+static uint8_t dma_busy(void *context) {
+    (void)context;
+    return emulated->busy(emulated->context);
+}
+
+static void dma_wait(void *context) {
+    (void)context;
+    cpu_charge();
+    emulated->wait(emulated->context);
+    cpu_resume();
+}
+
+/**
+ * 写入并读取一个文件
+ * @param pipelined 1:流水线, 0:同步
+ * @param flags 文件标记位(低电平有效), 清除FSTATE_CHECKSUM或FSTATE_COMPRESSED
+ * @param *data 文件内容
+ * @param size 文件大小(字节)
+ * @param *elapsed 写入与读取的耗时(us)
+ * @param *busy 写入与读取期间的闪存忙碌时间(us)
+ * @return 1:读出内容正确
+ * */
+static uint8_t run(uint8_t pipelined, uint8_t flags, uint8_t *data, uint32_t size, uint32_t *elapsed, uint32_t *busy) {
+    static DiskDevice device = {NULL, sync_read, sync_write_page, sync_sector_erase, sync_chip_erase, sync_wait, NULL};
+    static DiskDevice dma = {NULL, dma_read, dma_write_page, dma_sector_erase, dma_chip_erase, dma_wait, dma_busy};
+    uint8_t *check = (uint8_t *)malloc(size), ok;
+    FileState fstate;
+    File file;
+    uint32_t start;
+
+    disk_pipeline(0);
+    disk_stripe(NULL, 0);
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    w25q32_chip_erase();
+    disk_stripe(pipelined ? &dma : &device, 1);
+    disk_pipeline(pipelined);
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    fstate.state &= ~flags;
+    make_file(&file, "bench", "bin");
+    create_file(&file, fstate);
+    w25q32_timing(T_PROGRAM, T_ERASE);
+    w25q32_bus(T_BYTE);
+
+    for(uint32_t i = 0; i < 2; i++) {
+        device_busy = 0;
+        cpu_carry = 0;
+        start = w25q32_clock();
+        cpu_resume();
+        if(i == 0) {
+            write_file(&file, data, size);
+        }else {
+            read_file_verify(&file, check, 0, size);
+        }
+        cpu_charge();
+        disk_pipeline_flush();
+        elapsed[i] = w25q32_clock() - start;
+        busy[i] = device_busy;
+    }
+    ok = (memcmp(data, check, size) == 0);
+    free(check);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *names[3] = {"plain", "checksum", "compressed"};
+    uint8_t flags[3] = {0, FSTATE_CHECKSUM, FSTATE_COMPRESSED};
+    uint32_t size = ((argc > 1) ? (uint32_t)atoi(argv[1]) : 256) * 1024;
+    uint32_t rounds = (argc > 3) ? (uint32_t)atoi(argv[3]) : 5;
+    uint32_t elapsed[2], busy[2], best[3][2][2], flash[3][2];
+    uint8_t *data = (uint8_t *)malloc(size), ok = 1;
+    DiskPipelineStats stats;
+    struct timespec calibrate;
+
+    cpu_scale = (argc > 2) ? atof(argv[2]) : cpu_scale;
+    // 计时开销: 一次cpu_resume与下一次cpu_charge之间的最短间隔
+    cpu_overhead = 1e9;
+    for(uint32_t i = 0; i < 1000; i++) {
+        cpu_resume();
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &calibrate);
+        double ns = (calibrate.tv_sec - cpu_mark.tv_sec) * 1e9 + (calibrate.tv_nsec - cpu_mark.tv_nsec);
+        cpu_overhead = (ns < cpu_overhead) ? ns : cpu_overhead;
+    }
+    // 可压缩约3倍的文本式数据
+    for(uint32_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)("spifs pipeline "[(i / 7) % 15] + ((i * 2654435761u) >> 29) % 3);
+    }
+    w25q32_allocate();
+    emulated = disk_device_w25q32();
+    memset(best, 0xFF, sizeof(best));
+
+    for(uint32_t round = 0; round < rounds; round++) {
+        for(uint32_t kind = 0; kind < 3; kind++) {
+            for(uint32_t mode = 0; mode < 2; mode++) {
+                ok &= run(mode, flags[kind], data, size, elapsed, busy);
+                for(uint32_t i = 0; i < 2; i++) {
+                    if(elapsed[i] < best[kind][mode][i]) {
+                        best[kind][mode][i] = elapsed[i];
+                        if(mode == 1) {
+                            // 设备极限: 流水线中的闪存忙碌时间
+                            flash[kind][i] = busy[i];
+                        }
+                    }
+                }
+            }
+        }
+    }
+    disk_pipeline_stats(&stats);
+    disk_pipeline(0);
+    disk_stripe(NULL, 0);
+
+    printf("%u KB file, CPU x%.0f, best of %u rounds (ms)\n", size / 1024, cpu_scale, rounds);
+    printf("%-11s %-6s %9s %9s %9s %6s\n", "file", "op", "sync", "pipeline", "flash", "busy");
+    for(uint32_t kind = 0; kind < 3; kind++) {
+        for(uint32_t i = 0; i < 2; i++) {
+            printf("%-11s %-6s %9.1f %9.1f %9.1f %5.1f%%\n", names[kind], (i == 0) ? "write" : "read",
+                   best[kind][0][i] / 1000.0, best[kind][1][i] / 1000.0, flash[kind][i] / 1000.0,
+                   flash[kind][i] * 100.0 / best[kind][1][i]);
+        }
+    }
+    printf("raw limit: write %.1f ms (pages x (transfer + program)), read %.1f ms (bytes x %u ns)\n",
+           ((size + 255) / 256) * (bus_us(256) + T_PROGRAM) / 1000.0, size * (double)T_BYTE / 1e6, T_BYTE);
+    printf("last run: %u programs, %u stalls, %u reads, %u prefetches, %u prefetch hits\n",
+           stats.programs, stats.stalls, stats.reads, stats.prefetches, stats.prefetch_hits);
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    free(data);
+    return 0;
+}
@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "spifs.h"
+
+/**
+ * 掉电测试
+ * 以固定的工作负载(创建目录与文件, 覆盖写, 追加写, 删除并回收)为准, 依次在第1, 2, 3...次编程或擦除的中途掉电(w25q32_power_cut),
+ * 直至工作负载不再被打断; 每次掉电后挂载, 检查:
+ *   各文件为掉电前已完成的状态或进行中的操作完成后的状态(存在性, 大小与内容)
+ *   簇链完整且互不交叉, 没有未被引用的已占用扇区, 校验文件通过校验
+ * 挂载按W25Q32典型时序(SPI 50MHz, 页编程0.7ms, 扇区擦除45ms)在虚拟时钟上计时, 输出每次挂载重放的日志记录数分布与恢复耗时
+ * 编译: gcc -O2 -Isrc tools/powercut_test.c src/[a-z]*.c -o powercut_test
+ * 用法: powercut_test [-z] [-k] [-i] [-d] [-f]
+ *   -z压缩文件, -k校验文件, -i内联文件, -d在每次恢复挂载的各次编程或擦除处再次掉电(另输出恢复挂载中的掉电点数),
+ *   -f工作负载开始前以空记录占满进行中记录表, 只留下JOURNAL_NEST_MAX个位置(如批处理推迟的记录与追加写会话占用记录表时)
+ * 有错误时返回1
+ * */
+
+// 工作负载涉及的文件数
+#define EXPECT_SUM 3
+// 文件的最大长度(字节)
+#define DATA_MAX 20000
+// 统计的最大重放记录数
+#define REPLAY_MAX 8
+
+// 文件的期望状态, [0]为已完成的状态, [1]为进行中的操作完成后的状态
+typedef struct expect {
+    char *name;            // 文件名(拓展名为"x")
+    uint8_t in_dir;       // 1:位于目录D
+    uint8_t exists[2];   // 1:文件存在
+    uint8_t version[2]; // 内容版本, 0表示未写入
+    uint32_t length[2];
+} Expect;
+
+static Expect expects[EXPECT_SUM];
+static FileState data_fstate;
+static jmp_buf cut_point;
+static uint8_t buffer[DATA_MAX], pattern[DATA_MAX];
+static uint8_t *referenced = NULL;
+static uint8_t *snapshot = NULL;
+static uint8_t crowded = 0;
+
+static void power_lost() {
+    longjmp(cut_point, 1);
+}
+
+/**
+ * 生成文件的内容, 同一版本的内容与长度无关, 追加写后仍为同一版本
+ * */
+static void fill(uint32_t id, uint32_t version, uint32_t size, uint8_t *out) {
+    for(uint32_t i = 0; i < size; i++) {
+        out[i] = (uint8_t)(id * 31 + version * 7 + i * 13 + (i >> 8));
+    }
+}
+
+static void expect_begin(uint32_t id, uint8_t exists, uint8_t version, uint32_t length) {
+    expects[id].exists[1] = exists;
+    expects[id].version[1] = version;
+    expects[id].length[1] = length;
+}
+
+static void expect_commit(uint32_t id) {
+    expects[id].exists[0] = expects[id].exists[1];
+    expects[id].version[0] = expects[id].version[1];
+    expects[id].length[0] = expects[id].length[1];
+}
+
+static void expect_reset() {
+    char *names[EXPECT_SUM] = {"A", "B", "C"};
+    memset(expects, 0, sizeof(expects));
+    for(uint32_t i = 0; i < EXPECT_SUM; i++) {
+        expects[i].name = names[i];
+    }
+    expects[1].in_dir = 1;
+}
+
+/**
+ * 工作负载, 每个操作前登记其完成后的状态, 完成后提交
+ * */
+static void workload() {
+    File dir, a, b, c;
+    FileState fstate;
+
+    make_fstate(&fstate, 2024, 1, 1);
+    make_file(&dir, "D", "");
+    create_dir(&dir, NULL, fstate);
+
+    make_file(&a, "A", "x");
+    expect_begin(0, 1, 0, 0);
+    create_file(&a, data_fstate);
+    expect_commit(0);
+    fill(0, 1, 11000, pattern);
+    expect_begin(0, 1, 1, 5000);
+    write_file(&a, pattern, 5000);
+    expect_commit(0);
+
+    make_file(&b, "B", "x");
+    expect_begin(1, 1, 0, 0);
+    create_file_at(&dir, &b, data_fstate);
+    expect_commit(1);
+    fill(1, 1, 100, buffer);
+    expect_begin(1, 1, 1, 100);
+    write_file(&b, buffer, 100);
+    expect_commit(1);
+
+    expect_begin(0, 1, 1, 11000);
+    append_file(&a, pattern + 5000, 3000);
+    append_file(&a, pattern + 8000, 3000);
+    append_finish(&a);
+    expect_commit(0);
+
+    fill(0, 2, 9000, pattern);
+    expect_begin(0, 1, 2, 9000);
+    write_file(&a, pattern, 9000);
+    expect_commit(0);
+    fill(1, 2, 20000, pattern);
+    expect_begin(1, 1, 2, 20000);
+    write_file(&b, pattern, 20000);
+    expect_commit(1);
+
+    expect_begin(0, 0, 0, 0);
+    delete_file(&a);
+    spifs_gc();
+    expect_commit(0);
+
+    make_file(&c, "C", "x");
+    expect_begin(2, 1, 0, 0);
+    create_file(&c, data_fstate);
+    expect_commit(2);
+    fill(2, 1, 310, pattern);
+    expect_begin(2, 1, 1, 10);
+    write_file(&c, pattern, 10);
+    expect_commit(2);
+    expect_begin(2, 1, 1, 210);
+    append_file(&c, pattern + 10, 200);
+    append_finish(&c);
+    expect_commit(2);
+    expect_begin(2, 1, 1, 310);
+    append_file(&c, pattern + 210, 100);
+    append_finish(&c);
+    expect_commit(2);
+
+    expect_begin(1, 0, 0, 0);
+    delete_file(&dir);
+    spifs_gc();
+    expect_commit(1);
+}
+
+/**
+ * 检查文件为两个期望状态之一
+ * @return 1:符合
+ * */
+static uint8_t check_expect(uint32_t id) {
+    Expect *expect = expects + id;
+    File dir, file;
+    uint8_t found;
+
+    if(expect->in_dir) {
+        found = open_file(&dir, "D", "") && (FILE_FLAGS(dir.state) & FSTATE_DELETED) && open_file_at(&dir, &file, expect->name, "x");
+    }else {
+        found = open_file(&file, expect->name, "x");
+    }
+    found = found && (FILE_FLAGS(file.state) & FSTATE_DELETED);
+    for(uint32_t k = 0; k < 2; k++) {
+        if(!expect->exists[k] || expect->version[k] == 0) {
+            if(!found || file.cluster == 0xFFFFFFFF) {
+                return 1;
+            }
+            continue;
+        }
+        if(!found || file.length != expect->length[k]) {
+            continue;
+        }
+        fill(id, expect->version[k], expect->length[k], pattern);
+        if(read_file_verify(&file, buffer, 0, file.length) && memcmp(buffer, pattern, file.length) == 0) {
+            return 1;
+        }
+    }
+    printf("  %s: unexpected state (found %u, length %u)\n", expect->name, found, found ? file.length : 0);
+    return 0;
+}
+
+/**
+ * 标记目录下文件与目录表占用的扇区, 已删除未回收的条目同样标记
+ * @return 错误数
+ * */
+static uint32_t mark_tree(File *dir) {
+    FileList *list = list_dir(dir), *item;
+    uint32_t errors = 0, cluster;
+
+    for(item = list; item; item = item->prev) {
+        if((FILE_FLAGS(item->File.state) & FSTATE_DIRECTORY) == 0) {
+            for(cluster = item->File.cluster; cluster_inuse(cluster); disk_read((cluster + 4), (uint8_t *)&cluster, 4)) {
+                errors += referenced[cluster / SECTOR_SIZE];
+                referenced[cluster / SECTOR_SIZE] = 1;
+            }
+            errors += mark_tree(&item->File);
+            continue;
+        }
+        if(item->File.cluster == 0xFFFFFFFF || INLINE_STORED(item->File.state, item->File.cluster)) {
+            continue;
+        }
+        for(cluster = item->File.cluster; cluster != 0xFFFFFFFF; cluster = cluster_next(cluster)) {
+            if(!cluster_inuse(cluster) || referenced[cluster / SECTOR_SIZE]) {
+                errors++;
+                break;
+            }
+            referenced[cluster / SECTOR_SIZE] = 1;
+        }
+    }
+    recycle_filelist(list);
+    return errors;
+}
+
+/**
+ * 检查卷与全部文件
+ * @return 1:一致
+ * */
+static uint8_t check_volume() {
+    ScrubReport scrub;
+    uint32_t errors, leaked = 0;
+    uint8_t ok = 1;
+
+    memset(referenced, 0, SECTOR_SUM);
+    errors = mark_tree(NULL);
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        leaked += (cluster_inuse(sector * SECTOR_SIZE) && !referenced[sector]);
+    }
+    errors += spifs_scrub(&scrub);
+    if(errors || leaked) {
+        printf("  %u chain/checksum errors, %u leaked sectors\n", errors, leaked);
+        ok = 0;
+    }
+    for(uint32_t i = 0; i < EXPECT_SUM; i++) {
+        ok &= check_expect(i);
+    }
+    return ok;
+}
+
+/**
+ * 按典型时序挂载
+ * @param *elapsed 挂载耗时(us)
+ * @return 重放的日志记录数
+ * */
+static uint32_t timed_mount(uint32_t *elapsed) {
+    uint32_t start, replayed;
+    w25q32_timing(700, 45000);
+    w25q32_bus(160);
+    start = w25q32_clock();
+    replayed = spifs_mount();
+    w25q32_wait();
+    *elapsed = w25q32_clock() - start;
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    return replayed;
+}
+
+/**
+ * 以释放空簇链的记录(重放时不修改卷)占满进行中记录表, 再结束其中JOURNAL_NEST_MAX条
+ * */
+static void fill_pending() {
+    uint32_t handles[JOURNAL_PENDING_MAX], count = 0;
+    while(count < JOURNAL_PENDING_MAX) {
+        handles[count] = journal_begin(JOURNAL_FREE, 0xFFFFFFFF, 0, 0);
+        if(handles[count] == 0xFFFFFFFF) {
+            break;
+        }
+        count++;
+    }
+    for(uint32_t i = 0; i < JOURNAL_NEST_MAX && i < count; i++) {
+        journal_end(handles[count - 1 - i]);
+    }
+}
+
+/**
+ * 运行一段操作, 在第cut次编程或擦除的中途掉电
+ * @param cut 掉电的操作序号
+ * @param recovery 1:运行挂载, 0:运行工作负载
+ * @return 1:运行完毕未被打断, 0:已掉电
+ * */
+static uint8_t run_until_cut(uint32_t cut, uint8_t recovery) {
+    if(setjmp(cut_point) != 0) {
+        w25q32_power_cut(0, NULL);
+        return 0;
+    }
+    w25q32_power_cut(cut, power_lost);
+    if(recovery) {
+        spifs_mount();
+    }else {
+        workload();
+    }
+    w25q32_power_cut(0, NULL);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    uint32_t cut, failures = 0, mounts = 0, replayed, elapsed, longest = 0, recuts = 0;
+    uint32_t replays[REPLAY_MAX + 1];
+    uint64_t total = 0;
+    uint8_t twice = 0;
+
+    make_fstate(&data_fstate, 2024, 1, 1);
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-z") == 0) {
+            data_fstate.state &= ~FSTATE_COMPRESSED;
+        }else if(strcmp(argv[i], "-k") == 0) {
+            data_fstate.state &= ~FSTATE_CHECKSUM;
+        }else if(strcmp(argv[i], "-i") == 0) {
+            data_fstate.state &= ~FSTATE_INLINE;
+        }else if(strcmp(argv[i], "-d") == 0) {
+            twice = 1;
+        }else if(strcmp(argv[i], "-f") == 0) {
+            crowded = 1;
+        }
+    }
+    memset(replays, 0, sizeof(replays));
+    referenced = (uint8_t *)malloc(SECTOR_SUM);
+    snapshot = (uint8_t *)malloc(SECTOR_SUM * SECTOR_SIZE);
+    w25q32_allocate();
+
+    for(cut = 1; ; cut++) {
+        w25q32_chip_erase();
+        spifs_mount();
+        if(crowded) {
+            fill_pending();
+        }
+        expect_reset();
+        if(run_until_cut(cut, 0)) {
+            break;
+        }
+        // 恢复挂载本身再次掉电, 之后的挂载须同样恢复
+        if(twice) {
+            memcpy(snapshot, w25q32_getbuffer(), SECTOR_SUM * SECTOR_SIZE);
+            for(uint32_t recut = 1; ; recut++) {
+                memcpy(w25q32_getbuffer(), snapshot, SECTOR_SUM * SECTOR_SIZE);
+                if(run_until_cut(recut, 1)) {
+                    break;
+                }
+                recuts++;
+                spifs_mount();
+                if(!check_volume()) {
+                    printf("cut at operation %u, again at recovery operation %u: FAIL\n", cut, recut);
+                    failures++;
+                }
+            }
+            memcpy(w25q32_getbuffer(), snapshot, SECTOR_SUM * SECTOR_SIZE);
+        }
+        replayed = timed_mount(&elapsed);
+        replays[(replayed > REPLAY_MAX) ? REPLAY_MAX : replayed]++;
+        longest = (elapsed > longest) ? elapsed : longest;
+        total += elapsed;
+        mounts++;
+        if(!check_volume()) {
+            printf("cut at operation %u: FAIL\n", cut);
+            failures++;
+        }
+    }
+
+    printf("%u cut points", cut - 1);
+    if(twice) {
+        printf(", %u recovery cut points", recuts);
+    }
+    printf(", %u failures\n", failures);
+    printf("records replayed per mount:");
+    for(uint32_t i = 0; i <= REPLAY_MAX; i++) {
+        if(replays[i]) {
+            printf(" %u%s: %u", i, (i == REPLAY_MAX) ? "+" : "", replays[i]);
+        }
+    }
+    printf("\nrecovery mount: average %.2f ms, longest %.2f ms\n", mounts ? (double)total / mounts / 1000.0 : 0.0, longest / 1000.0);
+    free(referenced);
+    free(snapshot);
+    return (failures != 0);
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spifs.h"
+
+/**
+ * 读取指令吞吐量测试
+ * 模拟器按各读取指令的总线周期在虚拟时钟上计时(w25q32_read_mode), 分别在50MHz与104MHz SPI下测量:
+ * 顺序读取256KB文件的吞吐量, 在该文件内随机位置读取64字节(沿簇链查找, 多为4字节的链接读取)与打开文件(查找根目录)的平均耗时
+ * 编译: gcc -O2 -Isrc tools/read_bench.c src/[a-z]*.c -o read_bench
+ * 用法: read_bench [文件大小(KB)] [随机读取次数]
+ * */
+
+// 打开的文件数
+#define OPEN_FILES 64
+// 随机读取的长度(字节)
+#define RANDOM_SIZE 64
+
+typedef struct read_mode {
+    const char *name;
+    uint8_t command;
+    uint8_t continuous;
+} ReadMode;
+
+static const ReadMode modes[] = {
+    {"read 0x03", W25Q32_READ_DATA, 0},
+    {"read 0x03 cs", W25Q32_READ_DATA, 1},
+    {"fast 0x0B", W25Q32_FAST_READ, 0},
+    {"dual 0x3B", W25Q32_DUAL_OUTPUT, 0},
+    {"quad 0x6B", W25Q32_QUAD_OUTPUT, 0},
+    {"quad io 0xEB", W25Q32_QUAD_IO, 0},
+    {"quad io cont", W25Q32_QUAD_IO, 1},
+};
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+/**
+ * 以当前读取指令测量
+ * @param *seq 顺序读取耗时(us)
+ * @param *random 随机读取总耗时(us)
+ * @param *open 打开文件总耗时(us)
+ * @return 1:读出内容正确
+ * */
+static uint8_t measure(uint8_t *data, uint8_t *check, uint32_t size, uint32_t reads,
+                       uint32_t *seq, uint32_t *random, uint32_t *open) {
+    File file;
+    char name[9];
+    uint32_t start, offset, seed = 2024;
+    uint8_t ok = 1;
+
+    open_file(&file, "bench", "bin");
+    start = w25q32_clock();
+    read_file(&file, check, 0, size);
+    *seq = w25q32_clock() - start;
+    ok &= (memcmp(data, check, size) == 0);
+
+    start = w25q32_clock();
+    for(uint32_t i = 0; i < reads; i++) {
+        offset = next_random(&seed) % (size - RANDOM_SIZE);
+        read_file(&file, check, offset, RANDOM_SIZE);
+        ok &= (memcmp(data + offset, check, RANDOM_SIZE) == 0);
+    }
+    *random = w25q32_clock() - start;
+
+    start = w25q32_clock();
+    for(uint32_t i = 0; i < OPEN_FILES; i++) {
+        snprintf(name, sizeof(name), "f%u", i);
+        ok &= open_file(&file, name, "dat");
+    }
+    *open = w25q32_clock() - start;
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t clocks[2] = {160, 77};
+    const char *clock_names[2] = {"50MHz", "104MHz"};
+    uint32_t size = ((argc > 1) ? (uint32_t)atoi(argv[1]) : 256) * 1024;
+    uint32_t reads = (argc > 2) ? (uint32_t)atoi(argv[2]) : 200;
+    uint8_t *data = (uint8_t *)malloc(size), *check = (uint8_t *)malloc(size), ok = 1;
+    uint32_t seq, random, open;
+    FileState fstate;
+    File file;
+    char name[9];
+
+    for(uint32_t i = 0; i < size; i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    w25q32_allocate();
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < OPEN_FILES; i++) {
+        snprintf(name, sizeof(name), "f%u", i);
+        make_file(&file, name, "dat");
+        create_file(&file, fstate);
+        write_file(&file, data, 64);
+    }
+    make_file(&file, "bench", "bin");
+    create_file(&file, fstate);
+    write_file(&file, data, size);
+
+    printf("%u KB sequential read, %u random %u-byte reads, %u open_file\n", size / 1024, reads, RANDOM_SIZE, OPEN_FILES);
+    for(uint32_t c = 0; c < 2; c++) {
+        w25q32_bus(clocks[c]);
+        printf("SPI %s (%u ns/byte)\n", clock_names[c], clocks[c]);
+        printf("%-13s %10s %10s %10s\n", "mode", "seq MB/s", "random us", "open us");
+        for(uint32_t m = 0; m < sizeof(modes) / sizeof(ReadMode); m++) {
+            w25q32_read_mode(modes[m].command, modes[m].continuous);
+            ok &= measure(data, check, size, reads, &seq, &random, &open);
+            printf("%-13s %10.2f %10.2f %10.2f\n", modes[m].name, size / (double)seq,
+                   random / (double)reads, open / (double)OPEN_FILES);
+        }
+        printf("disk_read_modes: fast|dual -> 0x%02X, all -> 0x%02X\n",
+               disk_read_modes(DISK_READ_FAST | DISK_READ_DUAL),
+               disk_read_modes(DISK_READ_FAST | DISK_READ_DUAL | DISK_READ_QUAD | DISK_READ_QUAD_IO | DISK_READ_CONTINUOUS));
+    }
+    w25q32_bus(0);
+    w25q32_read_mode(W25Q32_READ_DATA, 0);
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    free(data);
+    free(check);
+    return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spifs.h"
+
+/**
+ * 环形文件测试
+ * 模拟器按W25Q32典型时序(SPI 50MHz, 页编程0.7ms, 扇区擦除45ms)在虚拟时钟上模拟忙状态
+ * 记录任务不停地追加128字节记录, 每32条记录调用一次append_finish, 只保留最近约RING_CLUSTERS簇的数据:
+ * 轮换: 两个普通文件交替追加, 当前文件达到预算的一半时删除较早的文件并回收(spifs_gc), 再新建文件
+ * 环形: 一个环形文件经spifs_ring_append追加, 簇预算RING_CLUSTERS
+ * 输出每条记录的追加延迟分布(含append_finish), 以及各扇区的擦除次数(数据扇区最少/最多, 文件索引扇区合计, 影子扇区, 日志扇区合计)
+ * 编译: gcc -O2 -Isrc tools/ring_bench.c src/[a-z]*.c -o ring_bench
+ * 用法: ring_bench [记录数]
+ * */
+
+// 记录长度(字节)与每次提交的记录数
+#define RECORD_SIZE 128
+#define FINISH_RECORDS 32
+// 保留的簇数
+#define RING_CLUSTERS 8
+
+static uint32_t records = 20000;
+static uint8_t record[RECORD_SIZE];
+static uint32_t erases[SECTOR_SUM];
+static uint32_t *latency;
+
+static int compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void count_erase(uint8_t *data, uint32_t size) {
+    TraceRecord *trace = (TraceRecord *)data;
+    if(size == sizeof(TraceRecord) && trace->op == TRACE_ERASE) {
+        erases[trace->address / SECTOR_SIZE]++;
+    }
+}
+
+/**
+ * 运行一次测试
+ * @param ring 1:环形文件, 0:两个文件轮换
+ * @return 1:保留的数据正确
+ * */
+static uint8_t run(uint8_t ring) {
+    FileState fstate;
+    File files[2], *file;
+    char name[9];
+    uint32_t start, current = 0, created = 0, area, length, verified = 0;
+    uint8_t *buffer;
+
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    if(ring) {
+        fstate.state &= ~FSTATE_RING;
+    }
+    make_file(files, "log0", "dat");
+    create_file(files, fstate);
+    area = FILE_AREA_SIZE(files->state);
+    memset(erases, 0, sizeof(erases));
+    trace_start(count_erase, NULL, 0);
+    w25q32_timing(700, 45000);
+    w25q32_bus(160);
+
+    for(uint32_t i = 0; i < records; i++) {
+        memset(record, (int)(i & 0xFF), RECORD_SIZE);
+        start = w25q32_clock();
+        file = files + current;
+        if(ring) {
+            spifs_ring_append(file, record, RECORD_SIZE, RING_CLUSTERS);
+        }else {
+            if(file->cluster != 0xFFFFFFFF && (file->length + RECORD_SIZE) > (RING_CLUSTERS / 2) * area) {
+                append_finish(file);
+                current ^= 1;
+                file = files + current;
+                if(created) {
+                    delete_file(file);
+                    spifs_gc();
+                }
+                snprintf(name, sizeof(name), "log%u", current);
+                make_file(file, name, "dat");
+                create_file(file, fstate);
+                created = 1;
+            }
+            if(file->cluster == 0xFFFFFFFF) {
+                write_file(file, record, RECORD_SIZE);
+            }else {
+                append_file(file, record, RECORD_SIZE);
+            }
+        }
+        if((i + 1) % FINISH_RECORDS == 0) {
+            append_finish(file);
+        }
+        latency[i] = w25q32_clock() - start;
+    }
+    append_finish(files + current);
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    trace_stop();
+
+    // 最新的记录位于当前文件末尾
+    file = files + current;
+    length = file->length;
+    buffer = (uint8_t *)malloc(length);
+    read_file(file, buffer, 0, length);
+    for(uint32_t i = 0; i < length / RECORD_SIZE; i++) {
+        if(buffer[length - (i + 1) * RECORD_SIZE] == (uint8_t)((records - 1 - i) & 0xFF)) {
+            verified++;
+        }
+    }
+    free(buffer);
+    printf("  kept %u bytes in the current file\n", length);
+    return verified == length / RECORD_SIZE && length > 0;
+}
+
+static void print_erases() {
+    uint32_t used = 0, least = 0xFFFFFFFF, most = 0, index = 0;
+    for(uint32_t i = FB_SECTOR_INIT; i < FB_SECTOR_END; i++) {
+        index += erases[i];
+    }
+    for(uint32_t i = FB_SECTOR_END; i < DATA_SECTOR_END; i++) {
+        if(erases[i] == 0) {
+            continue;
+        }
+        used++;
+        least = (erases[i] < least) ? erases[i] : least;
+        most = (erases[i] > most) ? erases[i] : most;
+    }
+    printf("  erases: %u data sectors (min %u, max %u), index sectors %u, shadow sector %u, journal sectors %u\n",
+           used, used ? least : 0, most, index, erases[SHADOW_SECTOR],
+           erases[JOURNAL_SECTOR_INIT] + erases[JOURNAL_SECTOR_INIT + 1]);
+}
+
+int main(int argc, char **argv) {
+    const char *names[2] = {"rotate (two files, delete + gc)", "ring (spifs_ring_append)"};
+    uint8_t ok = 1;
+
+    records = (argc > 1) ? (uint32_t)atoi(argv[1]) : records;
+    latency = (uint32_t *)malloc(sizeof(uint32_t) * records);
+    w25q32_allocate();
+
+    printf("%u records of %u bytes, append_finish every %u records, keeping about %u clusters\n",
+           records, RECORD_SIZE, FINISH_RECORDS, RING_CLUSTERS);
+    for(uint32_t mode = 0; mode < 2; mode++) {
+        printf("%s\n", names[mode]);
+        ok &= run(mode);
+        qsort(latency, records, sizeof(uint32_t), compare);
+        printf("  append (ms)  p50 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n", latency[records / 2] / 1000.0,
+               latency[records * 99 / 100] / 1000.0, latency[records * 999 / 1000] / 1000.0, latency[records - 1] / 1000.0);
+        print_erases();
+    }
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    free(latency);
+    return 0;
+}
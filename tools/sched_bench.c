@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spifs.h"
+
+/**
+ * 异步操作调度测试
+ * 模拟器按W25Q32典型时序(SPI 50MHz, 页编程0.7ms, 扇区擦除45ms)在虚拟时钟上模拟忙状态
+ * 前台: 读取请求按随机间隔到达, 同步读取随机文件的256字节; 两个记录任务按随机间隔追加128字节记录(截止时刻为到达后20ms)
+ * 后台: 维护任务不停地写入16KB文件, 删除并回收(ASYNC_WRITE, ASYNC_DELETE, ASYNC_GC)
+ * 分别以全部按前台提交(原有的先后顺序), 后台类别, 后台类别加读取抢占(disk_suspend)运行, 输出各类请求的延迟分布
+ * 编译: gcc -O2 -Isrc tools/sched_bench.c src/[a-z]*.c -o sched_bench
+ * 用法: sched_bench [测试时长(s)]
+ * */
+
+// 被读取的文件数与大小(字节)
+#define DATA_FILES 32
+#define DATA_SIZE 8192
+// 读取长度(字节)与平均到达间隔(us)
+#define READ_SIZE 256
+#define READ_INTERVAL 5000
+// 记录任务数, 记录长度(字节), 平均到达间隔(us)与截止时间(us)
+#define LOGGER_SUM 2
+#define RECORD_SIZE 128
+#define RECORD_INTERVAL 20000
+#define RECORD_DEADLINE 20000
+// 每个记录任务未完成记录的最大数量
+#define RECORD_SLOTS 64
+// 维护任务每轮写入并删除的文件大小(字节)
+#define GARBAGE_SIZE 16384
+// 轮询间隔(us)
+#define POLL_US 20
+// 异步命令队列长度
+#define QUEUE_COMMANDS 64
+
+// 延迟记录
+typedef struct samples {
+    uint32_t *values;
+    uint32_t count;
+} Samples;
+
+// 记录任务
+typedef struct logger {
+    File file;
+    uint32_t arrival;              // 下一条记录的到达时刻
+    uint32_t next;                // 下一个使用的槽位
+    AsyncOp ops[RECORD_SLOTS];
+    uint32_t arrivals[RECORD_SLOTS];
+    uint8_t records[RECORD_SLOTS][RECORD_SIZE];
+} Logger;
+
+static uint32_t duration = 20000000;
+static uint8_t data[DATA_SIZE];
+static uint8_t garbage[GARBAGE_SIZE];
+static Logger loggers[LOGGER_SUM];
+static Samples reads, appends, maintenance;
+static uint32_t dropped = 0;
+static uint32_t cycles = 0;
+
+// 维护任务: 0写入, 1删除, 2回收
+static AsyncOp background;
+static File garbage_file;
+static uint32_t background_step = 0;
+static uint32_t background_start = 0;
+static uint8_t background_priority = ASYNC_BACKGROUND;
+static uint8_t background_stop = 0;
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static int compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void record_done(AsyncOp *op) {
+    Logger *logger = (Logger *)op->context;
+    appends.values[appends.count++] = w25q32_clock() - logger->arrivals[op - logger->ops];
+}
+
+/**
+ * 维护任务的下一步, 一轮结束时记录耗时
+ * */
+static void background_next(AsyncOp *op) {
+    FileState fstate;
+    if(op != NULL && background_step == 2) {
+        maintenance.values[maintenance.count++] = w25q32_clock() - background_start;
+        cycles++;
+    }
+    background_step = (op == NULL) ? 0 : (background_step + 1) % 3;
+    if(background_stop && background_step == 0) {
+        return;
+    }
+    memset(&background, 0, sizeof(AsyncOp));
+    background.priority = background_priority;
+    background.callback = background_next;
+    if(background_step == 0) {
+        background_start = w25q32_clock();
+        make_fstate(&fstate, 2024, 1, 1);
+        make_file(&garbage_file, "garbage", "tmp");
+        create_file(&garbage_file, fstate);
+        background.kind = ASYNC_WRITE;
+        background.file = &garbage_file;
+        background.buffer = garbage;
+        background.size = GARBAGE_SIZE;
+    }else if(background_step == 1) {
+        background.kind = ASYNC_DELETE;
+        background.file = &garbage_file;
+    }else {
+        background.kind = ASYNC_GC;
+    }
+    spifs_async_submit(&background);
+}
+
+static void print_samples(const char *name, Samples *samples) {
+    uint32_t n = samples->count;
+    qsort(samples->values, n, sizeof(uint32_t), compare);
+    if(n == 0) {
+        printf("  %-12s none\n", name);
+        return;
+    }
+    printf("  %-12s %6u %9.2f %9.2f %9.2f %9.2f\n", name, n, samples->values[n / 2] / 1000.0,
+           samples->values[n * 99 / 100] / 1000.0, samples->values[n * 999 / 1000] / 1000.0, samples->values[n - 1] / 1000.0);
+}
+
+/**
+ * 运行一次测试
+ * @param priority 维护任务的优先级类别
+ * @param suspend_us disk_suspend的参数, 0不挂起
+ * @return 1:读出内容正确
+ * */
+static uint8_t run(uint8_t priority, uint32_t suspend_us) {
+    FileState fstate;
+    File files[DATA_FILES];
+    uint8_t buffer[READ_SIZE];
+    char name[9];
+    uint32_t seed = 2024, start, arrival, index, offset;
+    DiskAsyncStats stats;
+    Logger *logger;
+    AsyncOp *op;
+
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    spifs_async(0);
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < DATA_FILES; i++) {
+        snprintf(name, sizeof(name), "d%u", i);
+        make_file(files + i, name, "dat");
+        create_file(files + i, fstate);
+        write_file(files + i, data, DATA_SIZE);
+    }
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        logger = loggers + i;
+        snprintf(name, sizeof(name), "log%u", i);
+        make_file(&logger->file, name, "dat");
+        create_file(&logger->file, fstate);
+        logger->next = 0;
+        for(uint32_t j = 0; j < RECORD_SLOTS; j++) {
+            logger->ops[j].state = ASYNC_DONE;
+            memset(logger->records[j], (int)(i + j), RECORD_SIZE);
+        }
+    }
+    reads.count = 0;
+    appends.count = 0;
+    maintenance.count = 0;
+    dropped = 0;
+    cycles = 0;
+    spifs_async(QUEUE_COMMANDS);
+    disk_suspend(suspend_us);
+    w25q32_timing(700, 45000);
+    w25q32_bus(160);
+
+    start = w25q32_clock();
+    arrival = start + next_random(&seed) % (READ_INTERVAL * 2);
+    for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+        loggers[i].arrival = start + next_random(&seed) % (RECORD_INTERVAL * 2);
+    }
+    background_priority = priority;
+    background_stop = 0;
+    background_next(NULL);
+    while((w25q32_clock() - start) < duration) {
+        if((int32_t)(w25q32_clock() - arrival) >= 0) {
+            index = next_random(&seed) % DATA_FILES;
+            offset = next_random(&seed) % (DATA_SIZE - READ_SIZE);
+            read_file(files + index, buffer, offset, READ_SIZE);
+            if(memcmp(buffer, data + offset, READ_SIZE) != 0) {
+                return 0;
+            }
+            reads.values[reads.count++] = w25q32_clock() - arrival;
+            arrival += next_random(&seed) % (READ_INTERVAL * 2);
+            continue;
+        }
+        for(uint32_t i = 0; i < LOGGER_SUM; i++) {
+            logger = loggers + i;
+            if((int32_t)(w25q32_clock() - logger->arrival) < 0) {
+                continue;
+            }
+            op = logger->ops + logger->next;
+            if(op->state != ASYNC_DONE) {
+                dropped++;
+            }else {
+                memset(op, 0, sizeof(AsyncOp));
+                op->kind = ASYNC_APPEND;
+                op->file = &logger->file;
+                op->buffer = logger->records[logger->next];
+                op->size = RECORD_SIZE;
+                op->callback = record_done;
+                op->context = logger;
+                op->deadline = logger->arrival + RECORD_DEADLINE;
+                logger->arrivals[logger->next] = logger->arrival;
+                logger->next = (logger->next + 1) % RECORD_SLOTS;
+                spifs_async_submit(op);
+            }
+            logger->arrival += next_random(&seed) % (RECORD_INTERVAL * 2);
+        }
+        spifs_async_poll();
+        w25q32_elapse(POLL_US);
+    }
+    // 维护任务在本轮结束后停止
+    disk_async_stats(&stats);
+    background_stop = 1;
+    while(spifs_async_poll()) {
+        w25q32_wait();
+    }
+    disk_suspend(0);
+    spifs_async(0);
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    printf("  %u maintenance cycles, %u records dropped, %u flash commands\n", cycles, dropped, stats.commands);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    const char *names[3] = {"fifo (all foreground)", "background class", "background class + suspend(1000us)"};
+    const uint8_t priorities[3] = {ASYNC_FOREGROUND, ASYNC_BACKGROUND, ASYNC_BACKGROUND};
+    const uint32_t suspends[3] = {0, 0, 1000};
+    uint8_t ok = 1;
+
+    duration = ((argc > 1) ? (uint32_t)atoi(argv[1]) : 20) * 1000000;
+    reads.values = (uint32_t *)malloc(sizeof(uint32_t) * (duration / 1000 + 16));
+    appends.values = (uint32_t *)malloc(sizeof(uint32_t) * (duration / 1000 + 16));
+    maintenance.values = (uint32_t *)malloc(sizeof(uint32_t) * (duration / 1000 + 16));
+    for(uint32_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    memset(garbage, 0x5A, GARBAGE_SIZE);
+    w25q32_allocate();
+
+    printf("%u s: %u-byte reads every %u us, %u loggers appending %u bytes every %u us, background write/delete/gc of %u KB\n",
+           duration / 1000000, READ_SIZE, READ_INTERVAL, LOGGER_SUM, RECORD_SIZE, RECORD_INTERVAL, GARBAGE_SIZE / 1024);
+    for(uint32_t mode = 0; mode < 3; mode++) {
+        printf("%s\n", names[mode]);
+        ok &= run(priorities[mode], suspends[mode]);
+        printf("  %-12s %6s %9s %9s %9s %9s\n", "class (ms)", "count", "p50", "p99", "p99.9", "max");
+        print_samples("read", &reads);
+        print_samples("append", &appends);
+        print_samples("maintenance", &maintenance);
+    }
+    printf("content %s\n", ok ? "ok" : "MISMATCH");
+    free(reads.values);
+    free(appends.values);
+    free(maintenance.values);
+    return 0;
+}
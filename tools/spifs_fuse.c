@@ -0,0 +1,671 @@
+#define FUSE_USE_VERSION 31
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <fuse.h>
+#include "spifs.h"
+#include "w25q32.h"
+
+/**
+ * FUSE前端
+ * 将4MB镜像挂载为目录, 供fio等标准工具与应用程序直接访问:
+ * open/create -> open_file/create_file, read -> read_file, 尾部write -> append_file(flush/release时append_finish),
+ * 其他位置write -> spifs_pwrite, truncate -> spifs_truncate, unlink/rmdir -> delete_file, readdir -> list_file/list_dir
+ * 任意路径的扩展属性user.spifs.*给出闪存操作计数, 设置user.spifs.reset清零
+ * 文件系统不可重入, 固定以单线程(-s)运行
+ * 编译: gcc -O2 -Isrc tools/spifs_fuse.c src/[a-z]*.c $(pkg-config --cflags --libs fuse3) -o spifs_fuse
+ * 用法: spifs_fuse [--w25q32] <镜像> <挂载点> [FUSE选项]
+ *   默认以mmap映射镜像(修改直接写回); --w25q32时载入w25q32模拟器, 卸载时写回镜像
+ * */
+
+// 同时打开的文件数
+#define FUSE_OPEN_MAX 64
+// 路径最大层数
+#define FUSE_DEPTH_MAX 16
+
+// 已打开的文件, 同一文件的多次打开共享, 追加写会话期间文件大小以此为准
+typedef struct open_entry {
+    File file;
+    uint32_t refs;     // 打开次数, 0表示空闲
+    uint8_t append;   // 1:追加写会话未结束
+} OpenEntry;
+
+// 闪存操作计数
+typedef struct flash_counter {
+    uint64_t reads;
+    uint64_t read_bytes;
+    uint64_t programs;
+    uint64_t program_bytes;
+    uint64_t erases;
+} FlashCounter;
+
+static uint8_t *image = NULL;
+static const char *image_path = NULL;
+static uint8_t emulator = 0;
+static OpenEntry opened[FUSE_OPEN_MAX];
+static FlashCounter counter;
+
+static uint32_t image_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t image_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t image_sector_erase(void *context, uint32_t address);
+static uint8_t image_chip_erase(void *context);
+static void image_wait(void *context);
+static int image_load(const char *path);
+static int split_name(const char *host, char *name, char *ext);
+static int lookup_child(File *dir, const char *host, File *file);
+static int resolve(const char *path, File *file, File *parent);
+static void reclaim(uint32_t size);
+static OpenEntry *open_find(uint32_t block);
+static void open_finish(OpenEntry *entry);
+static void format_name(File *file, char *out);
+
+static DiskDevice image_device = {
+    NULL, image_read, image_write_page, image_sector_erase, image_chip_erase, image_wait, NULL
+};
+
+static uint32_t image_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    counter.reads++;
+    counter.read_bytes += size;
+    if(emulator) {
+        return w25q32_read(address, buffer, size);
+    }
+    memcpy(buffer, (image + address), size);
+    return size;
+}
+
+static uint8_t image_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    counter.programs++;
+    counter.program_bytes += size;
+    if(emulator) {
+        return w25q32_write_page(address, buffer, size);
+    }
+    for(uint32_t i = 0; i < size; i++) {
+        *(image + address + i) &= *(buffer + i);
+    }
+    return 0x2;
+}
+
+static uint8_t image_sector_erase(void *context, uint32_t address) {
+    counter.erases++;
+    if(emulator) {
+        return w25q32_sector_erase(address);
+    }
+    memset((image + address), 0xFF, SECTOR_SIZE);
+    return 0x2;
+}
+
+static uint8_t image_chip_erase(void *context) {
+    if(emulator) {
+        return w25q32_chip_erase();
+    }
+    memset(image, 0xFF, FLASH_SIZE);
+    return 0x2;
+}
+
+static void image_wait(void *context) {
+}
+
+/**
+ * 映射或载入镜像, 不存在时创建空镜像
+ * @return 0:成功, 否则为负的错误码
+ * */
+static int image_load(const char *path) {
+    struct stat info;
+    uint8_t created = 0;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+        return -errno;
+    }
+    if(fstat(fd, &info) == 0 && info.st_size == 0) {
+        created = (ftruncate(fd, FLASH_SIZE) == 0);
+        info.st_size = created ? FLASH_SIZE : 0;
+    }
+    if(info.st_size != FLASH_SIZE) {
+        close(fd);
+        return -EINVAL;
+    }
+    if(emulator) {
+        w25q32_allocate();
+        if(pread(fd, w25q32_buffer, FLASH_SIZE, 0) != FLASH_SIZE) {
+            close(fd);
+            return -EIO;
+        }
+    }else {
+        image = (uint8_t *)mmap(NULL, FLASH_SIZE, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+        if(image == MAP_FAILED) {
+            close(fd);
+            return -errno;
+        }
+    }
+    close(fd);
+    disk_stripe(&image_device, 1);
+    if(created) {
+        image_chip_erase(NULL);
+    }
+    spifs_mount();
+    return 0;
+}
+
+/**
+ * 主机文件名拆分为文件名(最多8字节)与拓展名(最多4字节)
+ * @return 0:成功, -ENAMETOOLONG:超出长度
+ * */
+static int split_name(const char *host, char *name, char *ext) {
+    const char *dot = strrchr(host, '.');
+    size_t length = (dot && dot != host) ? (size_t)(dot - host) : strlen(host);
+    if(length == 0 || length > 8 || (dot && dot != host && strlen(dot + 1) > 4)) {
+        return -ENAMETOOLONG;
+    }
+    memcpy(name, host, length);
+    *(name + length) = 0;
+    strcpy(ext, (dot && dot != host) ? (dot + 1) : "");
+    return 0;
+}
+
+static void format_name(File *file, char *out) {
+    uint32_t length = 0;
+    for(uint32_t i = 0; i < 8 && file->filename[i] != 0xFF && file->filename[i] != 0; i++) {
+        out[length++] = (char)file->filename[i];
+    }
+    for(uint32_t i = 0; i < 4 && file->extname[i] != 0xFF && file->extname[i] != 0; i++) {
+        if(i == 0) {
+            out[length++] = '.';
+        }
+        out[length++] = (char)file->extname[i];
+    }
+    out[length] = 0;
+}
+
+/**
+ * 在目录下按完整文件名查找存活文件(根目录的open_file不跳过已删除的文件, 根目录在文件列表中查找)
+ * @param *dir 目录, NULL表示根目录
+ * @return 0:找到, -ENOENT, -ENAMETOOLONG
+ * */
+static int lookup_child(File *dir, const char *host, File *file) {
+    char name[9], ext[5];
+    FileList *list, *item;
+    int result = split_name(host, name, ext);
+    if(result) {
+        return result;
+    }
+    if(dir) {
+        return (open_file_at(dir, file, name, ext) && (FILE_FLAGS(file->state) & FSTATE_DELETED)) ? 0 : -ENOENT;
+    }
+    make_file(file, name, ext);
+    list = list_file();
+    result = -ENOENT;
+    for(item = list; item && result; item = item->prev) {
+        if((FILE_FLAGS(item->File.state) & FSTATE_DELETED)
+                && memcmp(item->File.filename, file->filename, FILENAME_FULLSIZE) == 0) {
+            *file = item->File;
+            result = 0;
+        }
+    }
+    recycle_filelist(list);
+    return result;
+}
+
+/**
+ * 解析路径
+ * @param *file 输出: 路径指向的文件, 根目录时block为FFFFFFFF; 末级不存在时为make_file生成的待创建文件
+ * @param *parent 输出: 所在目录(可为NULL), 所在目录为根目录时block为FFFFFFFF
+ * @return 0:找到, 1:末级不存在(parent有效), 负数:错误码
+ * */
+static int resolve(const char *path, File *file, File *parent) {
+    char part[FUSE_DEPTH_MAX * 16], *token, *next;
+    File dir, current;
+    OpenEntry *entry;
+    int result;
+
+    dir.block = 0xFFFFFFFF;
+    current.block = 0xFFFFFFFF;
+    strncpy(part, path, sizeof(part) - 1);
+    part[sizeof(part) - 1] = 0;
+    for(token = strtok_r(part, "/", &next); token; token = strtok_r(NULL, "/", &next)) {
+        if(current.block != 0xFFFFFFFF) {
+            if(FILE_FLAGS(current.state) & FSTATE_DIRECTORY) {
+                return -ENOTDIR;
+            }
+            dir = current;
+        }
+        result = lookup_child(((dir.block == 0xFFFFFFFF) ? NULL : &dir), token, &current);
+        if(result == -ENOENT && *next == 0) {
+            *file = current;
+            if(parent) {
+                *parent = dir;
+            }
+            return 1;
+        }
+        if(result) {
+            return result;
+        }
+    }
+    if(parent) {
+        *parent = dir;
+    }
+    // 追加写会话中的文件以打开记录为准
+    entry = (current.block == 0xFFFFFFFF) ? NULL : open_find(current.block);
+    *file = entry ? entry->file : current;
+    return 0;
+}
+
+/**
+ * 空闲扇区不足以写入size字节且存在已删除的文件时执行垃圾回收
+ * */
+static void reclaim(uint32_t size) {
+    SpifsStat stat;
+    spifs_statfs(&stat);
+    if(stat.deleted && ((uint64_t)stat.erased * CHECKED_AREA_SIZE) < ((uint64_t)size + SECTOR_SIZE)) {
+        spifs_gc();
+    }
+}
+
+static OpenEntry *open_find(uint32_t block) {
+    for(uint32_t i = 0; i < FUSE_OPEN_MAX; i++) {
+        if(opened[i].refs && opened[i].file.block == block) {
+            return &opened[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 结束追加写会话, 更新文件块记录
+ * */
+static void open_finish(OpenEntry *entry) {
+    if(entry->append) {
+        append_finish(&entry->file);
+        entry->append = 0;
+    }
+}
+
+static int spifs_getattr(const char *path, struct stat *info, struct fuse_file_info *fi) {
+    File file;
+    int result = resolve(path, &file, NULL);
+    if(result) {
+        return (result > 0) ? -ENOENT : result;
+    }
+    memset(info, 0, sizeof(struct stat));
+    info->st_nlink = 1;
+    if(file.block == 0xFFFFFFFF || (FILE_FLAGS(file.state) & FSTATE_DIRECTORY) == 0) {
+        info->st_mode = S_IFDIR | 0755;
+        info->st_nlink = 2;
+        return 0;
+    }
+    info->st_mode = S_IFREG | 0644;
+    info->st_size = (file.length == 0xFFFFFFFF) ? 0 : file.length;
+    info->st_blksize = SECTOR_SIZE;
+    info->st_blocks = (info->st_size + 511) / 512;
+    return 0;
+}
+
+static int spifs_readdir(const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset,
+                         struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+    File dir;
+    FileList *list, *item;
+    char name[16];
+    int result = resolve(path, &dir, NULL);
+    if(result) {
+        return (result > 0) ? -ENOENT : result;
+    }
+    if(dir.block != 0xFFFFFFFF && (FILE_FLAGS(dir.state) & FSTATE_DIRECTORY)) {
+        return -ENOTDIR;
+    }
+    filler(buffer, ".", NULL, 0, 0);
+    filler(buffer, "..", NULL, 0, 0);
+    list = list_dir((dir.block == 0xFFFFFFFF) ? NULL : &dir);
+    for(item = list; item; item = item->prev) {
+        if(FILE_FLAGS(item->File.state) & FSTATE_DELETED) {
+            format_name(&item->File, name);
+            filler(buffer, name, NULL, 0, 0);
+        }
+    }
+    recycle_filelist(list);
+    return 0;
+}
+
+static int spifs_open(const char *path, struct fuse_file_info *fi) {
+    File file;
+    OpenEntry *entry;
+    int result = resolve(path, &file, NULL);
+    if(result) {
+        return (result > 0) ? -ENOENT : result;
+    }
+    if(file.block == 0xFFFFFFFF || (FILE_FLAGS(file.state) & FSTATE_DIRECTORY) == 0) {
+        return -EISDIR;
+    }
+    entry = open_find(file.block);
+    if(entry == NULL) {
+        for(uint32_t i = 0; i < FUSE_OPEN_MAX && entry == NULL; i++) {
+            entry = (opened[i].refs == 0) ? &opened[i] : NULL;
+        }
+        if(entry == NULL) {
+            return -ENFILE;
+        }
+        entry->file = file;
+        entry->append = 0;
+    }
+    entry->refs++;
+    fi->fh = (uint64_t)(entry - opened);
+    if((fi->flags & O_TRUNC) && file.length != 0) {
+        open_finish(entry);
+        if(write_file(&entry->file, NULL, 0) != WRITE_FILE_SUCCESS) {
+            return -ENOSPC;
+        }
+    }
+    return 0;
+}
+
+static int spifs_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    File file, parent;
+    FileState fstate;
+    Result created;
+    int result = resolve(path, &file, &parent);
+    if(result == 0) {
+        return spifs_open(path, fi);
+    }
+    if(result < 0) {
+        return result;
+    }
+    make_fstate(&fstate, 2024, 1, 1);
+    fstate.state &= ~FSTATE_INLINE;
+    created = (parent.block == 0xFFFFFFFF) ? create_file(&file, fstate) : create_file_at(&parent, &file, fstate);
+    if(created != CREATE_FILEBLOCK_SUCCESS) {
+        return (created == FILE_ALREADY_EXISTS) ? -EEXIST : -ENOSPC;
+    }
+    // 未写入数据的文件不出现在文件列表中, 写入空内容
+    if(write_file(&file, NULL, 0) != WRITE_FILE_SUCCESS) {
+        return -ENOSPC;
+    }
+    return spifs_open(path, fi);
+}
+
+static int spifs_read(const char *path, char *buffer, size_t size, off_t offset, struct fuse_file_info *fi) {
+    OpenEntry *entry = &opened[fi->fh];
+    uint32_t length = (entry->file.length == 0xFFFFFFFF) ? 0 : entry->file.length;
+    if((uint64_t)offset >= length) {
+        return 0;
+    }
+    size = (((uint64_t)offset + size) > length) ? (size_t)(length - (uint32_t)offset) : size;
+    if(!read_file(&entry->file, (uint8_t *)buffer, (uint32_t)offset, (uint32_t)size)) {
+        return -EIO;
+    }
+    return (int)size;
+}
+
+static int spifs_write(const char *path, const char *buffer, size_t size, off_t offset, struct fuse_file_info *fi) {
+    OpenEntry *entry = &opened[fi->fh];
+    uint32_t length = (entry->file.length == 0xFFFFFFFF) ? 0 : entry->file.length;
+    Result result;
+
+    if((uint64_t)offset + size > FLASH_SIZE) {
+        return -EFBIG;
+    }
+    reclaim((offset > length) ? ((uint32_t)offset + size - length) : (uint32_t)size);
+    if((uint32_t)offset == length && length != 0) {
+        result = append_file(&entry->file, (uint8_t *)buffer, (uint32_t)size);
+        entry->append = 1;
+        if(result != APPEND_FILE_SUCCESS) {
+            open_finish(entry);
+            return -ENOSPC;
+        }
+        return (int)size;
+    }
+    open_finish(entry);
+    if((uint32_t)offset > length) {
+        // 空洞以0填充
+        uint8_t *zero = (uint8_t *)calloc(((uint32_t)offset - length), 1);
+        result = spifs_pwrite(&entry->file, length, zero, ((uint32_t)offset - length));
+        free(zero);
+        if(result != WRITE_FILE_SUCCESS) {
+            return -ENOSPC;
+        }
+    }
+    result = (length == 0 && offset == 0) ? write_file(&entry->file, (uint8_t *)buffer, (uint32_t)size)
+             : spifs_pwrite(&entry->file, (uint32_t)offset, (uint8_t *)buffer, (uint32_t)size);
+    return (result == WRITE_FILE_SUCCESS) ? (int)size : -ENOSPC;
+}
+
+static int spifs_flush(const char *path, struct fuse_file_info *fi) {
+    open_finish(&opened[fi->fh]);
+    return 0;
+}
+
+static int spifs_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    open_finish(&opened[fi->fh]);
+    return 0;
+}
+
+static int spifs_release(const char *path, struct fuse_file_info *fi) {
+    OpenEntry *entry = &opened[fi->fh];
+    open_finish(entry);
+    entry->refs--;
+    return 0;
+}
+
+static int spifs_truncate_path(const char *path, off_t length, struct fuse_file_info *fi) {
+    File file;
+    OpenEntry *entry;
+    Result result;
+    uint32_t current;
+    int found = resolve(path, &file, NULL);
+    if(found) {
+        return (found > 0) ? -ENOENT : found;
+    }
+    entry = open_find(file.block);
+    if(entry) {
+        open_finish(entry);
+        file = entry->file;
+    }
+    current = (file.length == 0xFFFFFFFF) ? 0 : file.length;
+    if((uint64_t)length > FLASH_SIZE) {
+        return -EFBIG;
+    }
+    if((uint32_t)length <= current) {
+        result = (length == 0) ? write_file(&file, NULL, 0) : spifs_truncate(&file, (uint32_t)length);
+    }else {
+        uint8_t *zero = (uint8_t *)calloc(((uint32_t)length - current), 1);
+        reclaim((uint32_t)length - current);
+        result = spifs_pwrite(&file, current, zero, ((uint32_t)length - current));
+        free(zero);
+    }
+    if(entry) {
+        entry->file = file;
+    }
+    return (result == WRITE_FILE_SUCCESS) ? 0 : -ENOSPC;
+}
+
+static int spifs_unlink(const char *path) {
+    File file;
+    int result = resolve(path, &file, NULL);
+    if(result) {
+        return (result > 0) ? -ENOENT : result;
+    }
+    if(file.block == 0xFFFFFFFF || (FILE_FLAGS(file.state) & FSTATE_DIRECTORY) == 0) {
+        return -EISDIR;
+    }
+    if(open_find(file.block)) {
+        return -EBUSY;
+    }
+    delete_file(&file);
+    return 0;
+}
+
+static int spifs_mkdir(const char *path, mode_t mode) {
+    File dir, parent;
+    FileState fstate;
+    Result created;
+    int result = resolve(path, &dir, &parent);
+    if(result == 0) {
+        return -EEXIST;
+    }
+    if(result < 0) {
+        return result;
+    }
+    make_fstate(&fstate, 2024, 1, 1);
+    created = create_dir(&dir, ((parent.block == 0xFFFFFFFF) ? NULL : &parent), fstate);
+    return (created == CREATE_DIR_SUCCESS) ? 0 : ((created == FILE_ALREADY_EXISTS) ? -EEXIST : -ENOSPC);
+}
+
+static int spifs_rmdir(const char *path) {
+    File dir;
+    FileList *list, *item;
+    int result = resolve(path, &dir, NULL);
+    if(result) {
+        return (result > 0) ? -ENOENT : result;
+    }
+    if(dir.block == 0xFFFFFFFF) {
+        return -EBUSY;
+    }
+    if(FILE_FLAGS(dir.state) & FSTATE_DIRECTORY) {
+        return -ENOTDIR;
+    }
+    list = list_dir(&dir);
+    for(item = list; item && result == 0; item = item->prev) {
+        result = (FILE_FLAGS(item->File.state) & FSTATE_DELETED) ? -ENOTEMPTY : 0;
+    }
+    recycle_filelist(list);
+    if(result == 0) {
+        delete_file(&dir);
+    }
+    return result;
+}
+
+static int spifs_utimens(const char *path, const struct timespec time[2], struct fuse_file_info *fi) {
+    File file;
+    int result = resolve(path, &file, NULL);
+    return (result > 0) ? -ENOENT : result;
+}
+
+static int spifs_statvfs(const char *path, struct statvfs *info) {
+    SpifsStat stat;
+    spifs_statfs(&stat);
+    memset(info, 0, sizeof(struct statvfs));
+    info->f_bsize = SECTOR_SIZE;
+    info->f_frsize = SECTOR_SIZE;
+    info->f_blocks = stat.sectors;
+    info->f_bfree = stat.free;
+    info->f_bavail = stat.free;
+    info->f_files = stat.slots;
+    info->f_ffree = stat.slots - stat.slots_used + stat.slots_deleted;
+    info->f_namemax = 13;
+    return 0;
+}
+
+// 闪存操作计数的扩展属性名, 以\0分隔
+static const char counter_names[] = "user.spifs.reads\0user.spifs.read_bytes\0user.spifs.programs\0"
+                                    "user.spifs.program_bytes\0user.spifs.erases\0";
+
+static int spifs_getxattr(const char *path, const char *name, char *value, size_t size) {
+    uint64_t values[5] = {counter.reads, counter.read_bytes, counter.programs, counter.program_bytes, counter.erases};
+    const char *item = counter_names;
+    char text[24];
+    int length;
+    for(uint32_t i = 0; i < 5; i++, item += strlen(item) + 1) {
+        if(strcmp(item, name) != 0) {
+            continue;
+        }
+        length = snprintf(text, sizeof(text), "%llu", (unsigned long long)values[i]);
+        if(size == 0) {
+            return length;
+        }
+        if(size < (size_t)length) {
+            return -ERANGE;
+        }
+        memcpy(value, text, length);
+        return length;
+    }
+    return -ENODATA;
+}
+
+static int spifs_listxattr(const char *path, char *list, size_t size) {
+    if(size == 0) {
+        return sizeof(counter_names) - 1;
+    }
+    if(size < sizeof(counter_names) - 1) {
+        return -ERANGE;
+    }
+    memcpy(list, counter_names, sizeof(counter_names) - 1);
+    return sizeof(counter_names) - 1;
+}
+
+static int spifs_setxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
+    if(strcmp(name, "user.spifs.reset") != 0) {
+        return -ENOTSUP;
+    }
+    memset(&counter, 0, sizeof(counter));
+    return 0;
+}
+
+static void spifs_destroy(void *data) {
+    for(uint32_t i = 0; i < FUSE_OPEN_MAX; i++) {
+        if(opened[i].refs) {
+            open_finish(&opened[i]);
+        }
+    }
+    disk_stripe(NULL, 0);
+    if(emulator) {
+        w25q32_output(image_path, "wb", FLASH_SIZE);
+        w25q32_destory();
+    }else {
+        munmap(image, FLASH_SIZE);
+    }
+}
+
+static const struct fuse_operations spifs_operations = {
+    .getattr = spifs_getattr,
+    .readdir = spifs_readdir,
+    .open = spifs_open,
+    .create = spifs_create,
+    .read = spifs_read,
+    .write = spifs_write,
+    .flush = spifs_flush,
+    .fsync = spifs_fsync,
+    .release = spifs_release,
+    .truncate = spifs_truncate_path,
+    .unlink = spifs_unlink,
+    .mkdir = spifs_mkdir,
+    .rmdir = spifs_rmdir,
+    .utimens = spifs_utimens,
+    .statfs = spifs_statvfs,
+    .getxattr = spifs_getxattr,
+    .listxattr = spifs_listxattr,
+    .setxattr = spifs_setxattr,
+    .destroy = spifs_destroy,
+};
+
+int main(int argc, char **argv) {
+    char *fuse_argv[64];
+    int fuse_argc = 0, first = 1, result;
+
+    if(argc > 1 && strcmp(argv[1], "--w25q32") == 0) {
+        emulator = 1;
+        first = 2;
+    }
+    if(argc < first + 2) {
+        puts("usage: spifs_fuse [--w25q32] <image> <mountpoint> [fuse options]");
+        return 2;
+    }
+    image_path = argv[first];
+    result = image_load(image_path);
+    if(result) {
+        printf("%s: %s\n", image_path, strerror(-result));
+        return 1;
+    }
+    // 文件系统不可重入, 单线程运行
+    fuse_argv[fuse_argc++] = argv[0];
+    fuse_argv[fuse_argc++] = "-s";
+    for(int i = first + 1; i < argc && fuse_argc < 63; i++) {
+        fuse_argv[fuse_argc++] = argv[i];
+    }
+    fuse_argv[fuse_argc] = NULL;
+    return fuse_main(fuse_argc, fuse_argv, &spifs_operations, NULL);
+}
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "spifs.h"
+
+/**
+ * 镜像工具
+ * 在主机上直接操作4MB镜像文件(mmap映射为单个条带设备), 用于生产时批量生成预置文件的镜像
+ * 编译: gcc -O2 -Isrc tools/spifs_image.c src/[a-z]*.c -o spifs_image
+ * 用法:
+ *   spifs_image mkfs <镜像>                    创建已擦除并完成挂载初始化的镜像
+ *   spifs_image import <镜像> <目录> [-z] [-k]  导入目录树, -z压缩文件, -k校验文件
+ *   spifs_image clone <模板> <镜像> [目录]       复制模板镜像后导入目录树(逐台个性化)
+ *   spifs_image ls <镜像>                      列出全部文件
+ *   spifs_image extract <镜像> <目录>          导出全部文件
+ *   spifs_image check <镜像>                   检查一致性, 有错误时返回1
+ * 只读命令以私有映射打开, 挂载时的日志重放不写回镜像
+ * */
+
+// 镜像内的路径最大长度
+#define IMAGE_PATH_MAX 512
+// 导入的最大文件数
+#define IMPORT_ENTRY_MAX 4096
+// 导入后碎片整理每次移动的最大簇数
+#define IMPORT_DEFRAG_BUDGET 256
+
+// 待导入的文件
+typedef struct import_entry {
+    char path[IMAGE_PATH_MAX];  // 主机路径
+    File dir;                  // 所在目录, block为FFFFFFFF表示根目录
+    char name[9];
+    char ext[5];
+    uint32_t size;
+} ImportEntry;
+
+// 一致性检查结果
+typedef struct check_report {
+    uint32_t files;      // 存活文件数
+    uint32_t dirs;      // 目录数
+    uint32_t errors;   // 错误数
+} CheckReport;
+
+static uint8_t *image = NULL;
+static uint8_t *referenced = NULL;
+
+static uint32_t image_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t image_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t image_sector_erase(void *context, uint32_t address);
+static uint8_t image_chip_erase(void *context);
+static void image_wait(void *context);
+static uint8_t image_open(const char *path, uint8_t create, uint8_t writable);
+static void image_close();
+static uint8_t split_name(const char *host, char *name, char *ext);
+static void format_name(File *file, char *out);
+static void host_fstate(struct stat *info, FileState *fstate);
+static uint8_t open_alive(File *dir, File *file, char *name, char *ext);
+static uint8_t import_tree(const char *path, File *dir, ImportEntry *entries, uint32_t *count);
+static int import_compare(const void *a, const void *b);
+static uint32_t import_files(const char *path, uint8_t flags);
+static void list_tree(File *dir, const char *prefix);
+static uint32_t extract_tree(File *dir, const char *path);
+static void check_chain(File *file, const char *name, CheckReport *report);
+static void check_tree(File *dir, const char *prefix, CheckReport *report);
+static int check_image();
+
+static DiskDevice image_device = {
+    NULL, image_read, image_write_page, image_sector_erase, image_chip_erase, image_wait, NULL
+};
+
+int main(int argc, char **argv) {
+    uint8_t flags = 0;
+    int result = 0;
+    uint32_t count;
+    if(argc < 3) {
+        puts("usage: spifs_image mkfs|import|clone|ls|extract|check <image> ...");
+        return 2;
+    }
+    if(strcmp(argv[1], "mkfs") == 0) {
+        if(!image_open(argv[2], 1, 1)) return 1;
+        memset(image, 0xFF, FLASH_SIZE);
+        spifs_mount();
+        image_close();
+    }else if(strcmp(argv[1], "import") == 0 && argc >= 4) {
+        for(int i = 4; i < argc; i++) {
+            flags |= (strcmp(argv[i], "-z") == 0) ? FSTATE_COMPRESSED : 0;
+            flags |= (strcmp(argv[i], "-k") == 0) ? FSTATE_CHECKSUM : 0;
+        }
+        if(!image_open(argv[2], 0, 1)) return 1;
+        spifs_mount();
+        count = import_files(argv[3], flags);
+        result = (count == 0xFFFFFFFF);
+        image_close();
+    }else if(strcmp(argv[1], "clone") == 0 && argc >= 4) {
+        uint8_t *template;
+        if(!image_open(argv[2], 0, 0)) return 1;
+        template = image;
+        image = NULL;
+        if(!image_open(argv[3], 1, 1)) return 1;
+        memcpy(image, template, FLASH_SIZE);
+        munmap(template, FLASH_SIZE);
+        spifs_mount();
+        if(argc >= 5) {
+            result = (import_files(argv[4], 0) == 0xFFFFFFFF);
+        }
+        image_close();
+    }else if(strcmp(argv[1], "ls") == 0) {
+        if(!image_open(argv[2], 0, 0)) return 1;
+        spifs_mount();
+        list_tree(NULL, "");
+        image_close();
+    }else if(strcmp(argv[1], "extract") == 0 && argc >= 4) {
+        if(!image_open(argv[2], 0, 0)) return 1;
+        spifs_mount();
+        mkdir(argv[3], 0755);
+        count = extract_tree(NULL, argv[3]);
+        printf("%u files extracted\n", count);
+        image_close();
+    }else if(strcmp(argv[1], "check") == 0) {
+        if(!image_open(argv[2], 0, 0)) return 1;
+        spifs_mount();
+        result = check_image();
+        image_close();
+    }else {
+        puts("usage: spifs_image mkfs|import|clone|ls|extract|check <image> ...");
+        return 2;
+    }
+    return result;
+}
+
+static uint32_t image_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    memcpy(buffer, (image + address), size);
+    return size;
+}
+
+static uint8_t image_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    (void)context;
+    for(uint32_t i = 0; i < size; i++) {
+        *(image + address + i) &= *(buffer + i);
+    }
+    return 0x2;
+}
+
+static uint8_t image_sector_erase(void *context, uint32_t address) {
+    (void)context;
+    memset((image + address), 0xFF, SECTOR_SIZE);
+    return 0x2;
+}
+
+static uint8_t image_chip_erase(void *context) {
+    (void)context;
+    memset(image, 0xFF, FLASH_SIZE);
+    return 0x2;
+}
+
+static void image_wait(void *context) {
+    (void)context;
+}
+
+/**
+ * 映射镜像文件并接入diskio, 之后由调用者挂载
+ * @param path 镜像文件路径
+ * @param create 1:创建(截断为4MB, 内容由调用者填充)
+ * @param writable 1:修改写回镜像, 0:私有映射, 修改不写回
+ * @return 1:成功, 0:失败
+ * */
+static uint8_t image_open(const char *path, uint8_t create, uint8_t writable) {
+    struct stat info;
+    int fd = open(path, (create ? (O_RDWR | O_CREAT | O_TRUNC) : (writable ? O_RDWR : O_RDONLY)), 0644);
+    if(fd < 0) {
+        printf("%s: cannot open\n", path);
+        return 0;
+    }
+    if(create && ftruncate(fd, FLASH_SIZE) != 0) {
+        close(fd);
+        printf("%s: cannot resize\n", path);
+        return 0;
+    }
+    if(fstat(fd, &info) != 0 || info.st_size != FLASH_SIZE) {
+        close(fd);
+        printf("%s: not a %u byte image\n", path, FLASH_SIZE);
+        return 0;
+    }
+    image = (uint8_t *)mmap(NULL, FLASH_SIZE, (PROT_READ | PROT_WRITE), (writable ? MAP_SHARED : MAP_PRIVATE), fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) {
+        image = NULL;
+        printf("%s: cannot map\n", path);
+        return 0;
+    }
+    disk_stripe(&image_device, 1);
+    return 1;
+}
+
+static void image_close() {
+    spifs_batch_commit();
+    disk_stripe(NULL, 0);
+    munmap(image, FLASH_SIZE);
+    image = NULL;
+}
+
+/**
+ * 主机文件名拆分为文件名(最多8字节)与拓展名(最多4字节)
+ * @return 1:成功, 0:超出长度
+ * */
+static uint8_t split_name(const char *host, char *name, char *ext) {
+    const char *dot = strrchr(host, '.');
+    size_t length = (dot && dot != host) ? (size_t)(dot - host) : strlen(host);
+    if(length == 0 || length > 8 || (dot && dot != host && strlen(dot + 1) > 4)) {
+        return 0;
+    }
+    memcpy(name, host, length);
+    *(name + length) = 0;
+    strcpy(ext, (dot && dot != host) ? (dot + 1) : "");
+    return 1;
+}
+
+static void format_name(File *file, char *out) {
+    uint32_t length = 0;
+    for(uint32_t i = 0; i < 8 && file->filename[i] != 0xFF && file->filename[i] != 0; i++) {
+        out[length++] = (char)file->filename[i];
+    }
+    for(uint32_t i = 0; i < 4 && file->extname[i] != 0xFF && file->extname[i] != 0; i++) {
+        if(i == 0) {
+            out[length++] = '.';
+        }
+        out[length++] = (char)file->extname[i];
+    }
+    out[length] = 0;
+}
+
+/**
+ * 以主机文件的修改日期生成文件状态字
+ * */
+static void host_fstate(struct stat *info, FileState *fstate) {
+    struct tm *date = localtime(&info->st_mtime);
+    make_fstate(fstate, (uint32_t)(date->tm_year + 1900), (uint8_t)(date->tm_mon + 1), (uint8_t)date->tm_mday);
+}
+
+/**
+ * 打开目录下的存活文件
+ * 根目录的open_file不跳过已删除的文件, 根目录按完整文件名在文件列表中查找
+ * @param *dir 目录, NULL表示根目录
+ * */
+static uint8_t open_alive(File *dir, File *file, char *name, char *ext) {
+    FileList *list, *item;
+    uint8_t found = 0;
+    if(dir) {
+        return open_file_at(dir, file, name, ext) && (FILE_FLAGS(file->state) & FSTATE_DELETED);
+    }
+    make_file(file, name, ext);
+    list = list_file();
+    for(item = list; item && !found; item = item->prev) {
+        if((FILE_FLAGS(item->File.state) & FSTATE_DELETED)
+                && memcmp(item->File.filename, file->filename, FILENAME_FULLSIZE) == 0) {
+            *file = item->File;
+            found = 1;
+        }
+    }
+    recycle_filelist(list);
+    return found;
+}
+
+/**
+ * 遍历主机目录, 创建目录并收集待导入的文件
+ * @return 1:成功, 0:文件名超长, 目录创建失败或文件过多
+ * */
+static uint8_t import_tree(const char *path, File *dir, ImportEntry *entries, uint32_t *count) {
+    DIR *host;
+    struct dirent *item;
+    struct stat info;
+    char child[IMAGE_PATH_MAX], name[9], ext[5];
+    File sub;
+    FileState fstate;
+    uint8_t ok = 1;
+
+    host = opendir(path);
+    if(host == NULL) {
+        printf("%s: cannot open\n", path);
+        return 0;
+    }
+    while((item = readdir(host)) != NULL) {
+        if(strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", path, item->d_name);
+        if(stat(child, &info) != 0) {
+            continue;
+        }
+        if(!split_name(item->d_name, name, ext)) {
+            printf("%s: name exceeds 8.4\n", child);
+            ok = 0;
+            continue;
+        }
+        if(S_ISDIR(info.st_mode)) {
+            make_file(&sub, name, ext);
+            if(!open_alive(dir, &sub, name, ext)) {
+                host_fstate(&info, &fstate);
+                if(create_dir(&sub, dir, fstate) != CREATE_DIR_SUCCESS) {
+                    printf("%s: cannot create directory\n", child);
+                    ok = 0;
+                    continue;
+                }
+            }
+            ok &= import_tree(child, &sub, entries, count);
+        }else if(S_ISREG(info.st_mode)) {
+            if(*count >= IMPORT_ENTRY_MAX) {
+                printf("%s: too many files\n", child);
+                ok = 0;
+                continue;
+            }
+            strcpy(entries[*count].path, child);
+            strcpy(entries[*count].name, name);
+            strcpy(entries[*count].ext, ext);
+            entries[*count].size = (uint32_t)info.st_size;
+            if(dir) {
+                entries[*count].dir = *dir;
+            }else {
+                entries[*count].dir.block = 0xFFFFFFFF;
+            }
+            (*count)++;
+        }
+    }
+    closedir(host);
+    return ok;
+}
+
+static int import_compare(const void *a, const void *b) {
+    uint32_t size_a = ((ImportEntry *)a)->size, size_b = ((ImportEntry *)b)->size;
+    return (size_a < size_b) ? 1 : ((size_a > size_b) ? -1 : 0);
+}
+
+/**
+ * 导入目录树: 先创建全部目录, 再按文件大小降序写入文件, 大文件优先占用连续空闲区,
+ * 索引修改经批处理合并写入, 仍有不连续的簇链时整理碎片
+ * @param path 主机目录
+ * @param flags 文件标记位(FSTATE_COMPRESSED, FSTATE_CHECKSUM), 不超过内联大小的文件内联存放
+ * @return 导入的文件数, FFFFFFFF表示出错
+ * */
+static uint32_t import_files(const char *path, uint8_t flags) {
+    ImportEntry *entries = (ImportEntry *)malloc(sizeof(ImportEntry) * IMPORT_ENTRY_MAX);
+    ImportEntry *entry;
+    File file;
+    FileState fstate;
+    SpifsStat volume;
+    struct stat info;
+    FILE *host;
+    Result result;
+    uint8_t *buffer, ok;
+    uint32_t count = 0, bytes = 0, moved = 0;
+
+    spifs_batch_begin();
+    ok = import_tree(path, NULL, entries, &count);
+    qsort(entries, count, sizeof(ImportEntry), import_compare);
+    for(uint32_t i = 0; i < count && ok; i++) {
+        entry = entries + i;
+        buffer = (uint8_t *)malloc(entry->size ? entry->size : 1);
+        host = fopen(entry->path, "rb");
+        if(host == NULL || fread(buffer, 1, entry->size, host) != entry->size) {
+            printf("%s: cannot read\n", entry->path);
+            ok = 0;
+        }
+        if(host) {
+            fclose(host);
+        }
+        make_file(&file, entry->name, entry->ext);
+        if(ok && !open_alive(((entry->dir.block == 0xFFFFFFFF) ? NULL : &entry->dir), &file, entry->name, entry->ext)) {
+            if(stat(entry->path, &info) != 0) {
+                info.st_mtime = time(NULL);
+            }
+            host_fstate(&info, &fstate);
+            fstate.state &= ~(flags | FSTATE_INLINE);
+            result = (entry->dir.block == 0xFFFFFFFF) ? create_file(&file, fstate) : create_file_at(&entry->dir, &file, fstate);
+            if(result != CREATE_FILEBLOCK_SUCCESS) {
+                printf("%s: no index slot\n", entry->path);
+                ok = 0;
+            }
+        }
+        if(ok && write_file(&file, buffer, entry->size) != WRITE_FILE_SUCCESS) {
+            printf("%s: no space\n", entry->path);
+            ok = 0;
+        }
+        bytes += entry->size;
+        free(buffer);
+    }
+    spifs_batch_commit();
+    free(entries);
+
+    spifs_statfs(&volume);
+    for(uint32_t i = 0; ok && volume.fragments > 100 && i < SECTOR_SUM; i++) {
+        moved = spifs_defrag(NULL, IMPORT_DEFRAG_BUDGET);
+        if(moved == 0) {
+            break;
+        }
+        spifs_statfs(&volume);
+    }
+    printf("%u files, %u bytes, %u sectors used, %u free, fragments %u.%02u\n", count, bytes,
+           volume.used, volume.free, volume.fragments / 100, volume.fragments % 100);
+    return ok ? count : 0xFFFFFFFF;
+}
+
+/**
+ * 列出目录下的存活文件, 子目录递归列出
+ * @param *dir 目录, NULL表示根目录
+ * @param prefix 路径前缀
+ * */
+static void list_tree(File *dir, const char *prefix) {
+    FileList *list = list_dir(dir), *item;
+    char name[16], path[IMAGE_PATH_MAX];
+    for(item = list; item; item = item->prev) {
+        if((FILE_FLAGS(item->File.state) & FSTATE_DELETED) == 0) {
+            continue;
+        }
+        format_name(&item->File, name);
+        snprintf(path, sizeof(path), "%s%s", prefix, name);
+        if((FILE_FLAGS(item->File.state) & FSTATE_DIRECTORY) == 0) {
+            printf("%-40s/\n", path);
+            strcat(path, "/");
+            list_tree(&item->File, path);
+        }else {
+            printf("%-40s %8u %c%c%c\n", path, item->File.length,
+                   INLINE_STORED(item->File.state, item->File.cluster) ? 'i' : '-',
+                   (FILE_FLAGS(item->File.state) & FSTATE_COMPRESSED) ? '-' : 'z',
+                   (FILE_FLAGS(item->File.state) & FSTATE_CHECKSUM) ? '-' : 'k');
+        }
+    }
+    recycle_filelist(list);
+}
+
+/**
+ * 导出目录下的存活文件, 子目录递归导出
+ * @return 导出的文件数
+ * */
+static uint32_t extract_tree(File *dir, const char *path) {
+    FileList *list = list_dir(dir), *item;
+    char name[16], child[IMAGE_PATH_MAX];
+    uint32_t count = 0;
+    uint8_t *buffer;
+    FILE *host;
+
+    for(item = list; item; item = item->prev) {
+        if((FILE_FLAGS(item->File.state) & FSTATE_DELETED) == 0) {
+            continue;
+        }
+        format_name(&item->File, name);
+        snprintf(child, sizeof(child), "%s/%s", path, name);
+        if((FILE_FLAGS(item->File.state) & FSTATE_DIRECTORY) == 0) {
+            mkdir(child, 0755);
+            count += extract_tree(&item->File, child);
+            continue;
+        }
+        buffer = (uint8_t *)malloc(item->File.length ? item->File.length : 1);
+        host = fopen(child, "wb");
+        if(host && (item->File.length == 0 || read_file(&item->File, buffer, 0, item->File.length))) {
+            fwrite(buffer, 1, item->File.length, host);
+            count++;
+        }else {
+            printf("%s: cannot extract\n", child);
+        }
+        if(host) {
+            fclose(host);
+        }
+        free(buffer);
+    }
+    recycle_filelist(list);
+    return count;
+}
+
+/**
+ * 遍历文件的簇链, 检查断链, 交叉引用与簇数
+ * @param *file 文件(存活或已删除未回收)
+ * @param name 文件路径
+ * */
+static void check_chain(File *file, const char *name, CheckReport *report) {
+    uint32_t cluster = file->cluster, clusters = 0, expected, area;
+    uint8_t alive = ((FILE_FLAGS(file->state) & FSTATE_DELETED) != 0);
+
+    if(file->cluster == 0xFFFFFFFF || INLINE_STORED(file->state, file->cluster)) {
+        return;
+    }
+    while(cluster != 0xFFFFFFFF) {
+        if(!cluster_inuse(cluster)) {
+            printf("%s: broken chain at %08X\n", name, cluster);
+            report->errors++;
+            return;
+        }
+        if(referenced[cluster / SECTOR_SIZE]) {
+            printf("%s: cluster %08X cross-linked\n", name, cluster);
+            report->errors++;
+            return;
+        }
+        referenced[cluster / SECTOR_SIZE] = 1;
+        clusters++;
+        cluster = cluster_next(cluster);
+    }
+    area = FILE_AREA_SIZE(file->state);
+    expected = (file->length == 0) ? 1 : ((file->length + area - 1) / area);
+    if(alive && (FILE_FLAGS(file->state) & FSTATE_COMPRESSED) && clusters != expected) {
+        printf("%s: %u clusters, expected %u\n", name, clusters, expected);
+        report->errors++;
+    }
+}
+
+/**
+ * 检查目录下的文件与子目录, 已删除未回收的条目同样标记其占用的扇区
+ * */
+static void check_tree(File *dir, const char *prefix, CheckReport *report) {
+    FileList *list = list_dir(dir), *item;
+    char name[16], path[IMAGE_PATH_MAX];
+    uint32_t table;
+
+    for(item = list; item; item = item->prev) {
+        format_name(&item->File, name);
+        snprintf(path, sizeof(path), "%s%s", prefix, name);
+        if((FILE_FLAGS(item->File.state) & FSTATE_DIRECTORY) == 0) {
+            report->dirs += ((FILE_FLAGS(item->File.state) & FSTATE_DELETED) != 0);
+            for(table = item->File.cluster; cluster_inuse(table); disk_read((table + 4), (uint8_t *)&table, 4)) {
+                if(referenced[table / SECTOR_SIZE]) {
+                    printf("%s: directory table %08X cross-linked\n", path, table);
+                    report->errors++;
+                    break;
+                }
+                referenced[table / SECTOR_SIZE] = 1;
+            }
+            strcat(path, "/");
+            check_tree(&item->File, path, report);
+        }else {
+            report->files += ((FILE_FLAGS(item->File.state) & FSTATE_DELETED) != 0);
+            check_chain(&item->File, path, report);
+        }
+    }
+    recycle_filelist(list);
+}
+
+/**
+ * 一致性检查: 簇链完整且互不交叉, 没有未被引用的已占用扇区, 校验文件通过校验
+ * @return 0:一致, 1:存在错误
+ * */
+static int check_image() {
+    CheckReport report = {0, 0, 0};
+    ScrubReport scrub;
+    SpifsStat volume;
+
+    referenced = (uint8_t *)calloc(SECTOR_SUM, 1);
+    check_tree(NULL, "", &report);
+    for(uint32_t sector = FB_SECTOR_END; sector < DATA_SECTOR_END; sector++) {
+        if(cluster_inuse(sector * SECTOR_SIZE) && !referenced[sector]) {
+            printf("sector %u allocated but unreferenced\n", sector);
+            report.errors++;
+        }
+    }
+    free(referenced);
+    referenced = NULL;
+    report.errors += spifs_scrub(&scrub);
+    spifs_statfs(&volume);
+    printf("%u files, %u directories, %u sectors used, %u deleted, %u free, fragments %u.%02u\n",
+           report.files, report.dirs, volume.used, volume.deleted, volume.free, volume.fragments / 100, volume.fragments % 100);
+    printf("%u checksum clusters verified, %u errors\n", scrub.clusters, report.errors);
+    return (report.errors != 0);
+}
@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "spifs.h"
+
+/**
+ * 条带卷吞吐量测试
+ * 每个设备是一个独立线程上的闪存模拟器实例, 按W25Q32典型时序休眠模拟编程与擦除的忙状态,
+ * 分别以1, 2, 4个设备组成条带卷, 测量写入新文件与覆盖写(写入新数据链并擦除旧数据链)的耗时
+ * 编译: gcc -Isrc tools/stripe_bench.c src/[a-z]*.c -lpthread -o stripe_bench
+ * 用法: stripe_bench [文件数] [文件大小(KB)]
+ * */
+
+// 扇区大小(字节)
+#define CHIP_SECTOR_SIZE 4096
+// 条带卷的扇区总数
+#define CHIP_SECTOR_SUM 1024
+// 每个设备排队的最大操作数
+#define CHIP_QUEUE_SIZE 64
+
+// W25Q32典型时序
+// 页编程首字节时间(s)
+#define T_BP1 30e-6
+// 页编程后续每字节时间(s)
+#define T_BP2 2.5e-6
+// 扇区擦除时间(s)
+#define T_SE 45e-3
+
+// 排队的设备操作
+typedef struct chip_op {
+    uint8_t erase;     // 1:扇区擦除, 0:页编程
+    uint32_t address; // 设备内地址
+    uint32_t size;   // 编程字节数
+    uint8_t data[256];
+} ChipOp;
+
+// 闪存模拟器实例
+typedef struct chip {
+    uint8_t *memory;
+    uint32_t size;
+    ChipOp queue[CHIP_QUEUE_SIZE];
+    uint32_t head;    // 下一个执行的操作
+    uint32_t count;  // 排队(含执行中)的操作数
+    uint8_t stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} Chip;
+
+static void chip_delay(double seconds);
+static void *chip_worker(void *argument);
+static void chip_open(Chip *chip, uint32_t size);
+static void chip_close(Chip *chip);
+static void chip_push(Chip *chip, ChipOp *op);
+static uint32_t chip_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t chip_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size);
+static uint8_t chip_sector_erase(void *context, uint32_t address);
+static uint8_t chip_erase_all(void *context);
+static void chip_wait(void *context);
+static double elapsed(struct timespec *start);
+static uint8_t run(uint32_t devices, uint32_t files, uint32_t file_size, double *write_time, double *overwrite_time);
+
+int main(int argc, char **argv) {
+    uint32_t files = (argc > 1) ? (uint32_t)atoi(argv[1]) : 4;
+    uint32_t file_size = ((argc > 2) ? (uint32_t)atoi(argv[2]) : 64) * 1024;
+    uint32_t device_list[] = {1, 2, 4};
+    double write_time, overwrite_time, base_write = 0, base_overwrite = 0;
+
+    printf("%u files x %u KB\n", files, file_size / 1024);
+    printf("devices  write(s)  MB/s   speedup  overwrite(s)  MB/s   speedup\n");
+    for(uint32_t i = 0; i < sizeof(device_list) / sizeof(device_list[0]); i++) {
+        if(!run(device_list[i], files, file_size, &write_time, &overwrite_time)) {
+            printf("%u devices: verify failed\n", device_list[i]);
+            return 1;
+        }
+        if(i == 0) {
+            base_write = write_time;
+            base_overwrite = overwrite_time;
+        }
+        printf("%7u  %8.3f  %5.3f  %6.2fx  %12.3f  %5.3f  %6.2fx\n", device_list[i],
+               write_time, (files * file_size) / write_time / 1e6, base_write / write_time,
+               overwrite_time, (files * file_size) / overwrite_time / 1e6, base_overwrite / overwrite_time);
+    }
+    return 0;
+}
+
+/**
+ * 组成条带卷, 写入并覆盖写文件后校验内容
+ * @return 1:校验通过, 0:内容不一致
+ * */
+static uint8_t run(uint32_t devices, uint32_t files, uint32_t file_size, double *write_time, double *overwrite_time) {
+    Chip chips[4];
+    DiskDevice device[4];
+    File file;
+    FileState fstate;
+    struct timespec start;
+    char name[12];
+    uint8_t ok = 1;
+    uint8_t *buffer = (uint8_t *)malloc(file_size), *check = (uint8_t *)malloc(file_size);
+
+    for(uint32_t i = 0; i < devices; i++) {
+        chip_open(&chips[i], (CHIP_SECTOR_SUM + devices - 1) / devices * CHIP_SECTOR_SIZE);
+        device[i].context = &chips[i];
+        device[i].read = chip_read;
+        device[i].write_page = chip_write_page;
+        device[i].sector_erase = chip_sector_erase;
+        device[i].chip_erase = chip_erase_all;
+        device[i].wait = chip_wait;
+        device[i].busy = NULL;
+    }
+    disk_stripe(device, devices);
+    spifs_mount();
+
+    for(uint32_t round = 0; round < 2; round++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(uint32_t i = 0; i < files; i++) {
+            sprintf(name, "f%u", i);
+            make_file(&file, name, "bin");
+            memset(buffer, (uint8_t)(round * 16 + i), file_size);
+            if(round == 0) {
+                make_fstate(&fstate, 2020, 2, 9);
+                fstate.state &= ~FSTATE_INLINE;
+                create_file(&file, fstate);
+            }else {
+                open_file(&file, name, "bin");
+            }
+            write_file(&file, buffer, file_size);
+        }
+        *((round == 0) ? write_time : overwrite_time) = elapsed(&start);
+    }
+    for(uint32_t i = 0; i < files; i++) {
+        sprintf(name, "f%u", i);
+        make_file(&file, name, "bin");
+        memset(buffer, (uint8_t)(16 + i), file_size);
+        if(!open_file(&file, name, "bin") || !read_file(&file, check, 0, file_size) || memcmp(buffer, check, file_size)) {
+            ok = 0;
+        }
+    }
+
+    disk_stripe(NULL, 0);
+    for(uint32_t i = 0; i < devices; i++) {
+        chip_close(&chips[i]);
+    }
+    free(buffer);
+    free(check);
+    return ok;
+}
+
+static double elapsed(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void chip_delay(double seconds) {
+    struct timespec time;
+    time.tv_sec = (time_t)seconds;
+    time.tv_nsec = (long)((seconds - time.tv_sec) * 1e9);
+    nanosleep(&time, NULL);
+}
+
+/**
+ * 设备线程, 按顺序执行排队的操作, 执行期间设备忙
+ * */
+static void *chip_worker(void *argument) {
+    Chip *chip = (Chip *)argument;
+    ChipOp *op;
+
+    pthread_mutex_lock(&chip->lock);
+    while(1) {
+        while(chip->count == 0 && !chip->stop) {
+            pthread_cond_wait(&chip->changed, &chip->lock);
+        }
+        if(chip->count == 0) {
+            break;
+        }
+        op = &chip->queue[chip->head];
+        pthread_mutex_unlock(&chip->lock);
+        if(op->erase) {
+            chip_delay(T_SE);
+            memset((chip->memory + op->address), 0xFF, CHIP_SECTOR_SIZE);
+        }else {
+            chip_delay(T_BP1 + T_BP2 * (op->size - 1));
+            for(uint32_t i = 0; i < op->size; i++) {
+                *(chip->memory + op->address + i) &= op->data[i];
+            }
+        }
+        pthread_mutex_lock(&chip->lock);
+        chip->head = (chip->head + 1) % CHIP_QUEUE_SIZE;
+        chip->count--;
+        pthread_cond_broadcast(&chip->changed);
+    }
+    pthread_mutex_unlock(&chip->lock);
+    return NULL;
+}
+
+static void chip_open(Chip *chip, uint32_t size) {
+    chip->memory = (uint8_t *)malloc(size);
+    memset(chip->memory, 0xFF, size);
+    chip->size = size;
+    chip->head = 0;
+    chip->count = 0;
+    chip->stop = 0;
+    pthread_mutex_init(&chip->lock, NULL);
+    pthread_cond_init(&chip->changed, NULL);
+    pthread_create(&chip->thread, NULL, chip_worker, chip);
+}
+
+static void chip_close(Chip *chip) {
+    pthread_mutex_lock(&chip->lock);
+    chip->stop = 1;
+    pthread_cond_broadcast(&chip->changed);
+    pthread_mutex_unlock(&chip->lock);
+    pthread_join(chip->thread, NULL);
+    pthread_mutex_destroy(&chip->lock);
+    pthread_cond_destroy(&chip->changed);
+    free(chip->memory);
+}
+
+/**
+ * 排队一个操作, 队列满时等待
+ * */
+static void chip_push(Chip *chip, ChipOp *op) {
+    pthread_mutex_lock(&chip->lock);
+    while(chip->count == CHIP_QUEUE_SIZE) {
+        pthread_cond_wait(&chip->changed, &chip->lock);
+    }
+    chip->queue[(chip->head + chip->count) % CHIP_QUEUE_SIZE] = *op;
+    chip->count++;
+    pthread_cond_broadcast(&chip->changed);
+    pthread_mutex_unlock(&chip->lock);
+}
+
+static uint32_t chip_read(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    Chip *chip = (Chip *)context;
+    chip_wait(chip);
+    memcpy(buffer, (chip->memory + address), size);
+    return size;
+}
+
+static uint8_t chip_write_page(void *context, uint32_t address, uint8_t *buffer, uint32_t size) {
+    ChipOp op;
+    op.erase = 0;
+    op.address = address;
+    op.size = size;
+    memcpy(op.data, buffer, size);
+    chip_push((Chip *)context, &op);
+    return 0x2;
+}
+
+static uint8_t chip_sector_erase(void *context, uint32_t address) {
+    ChipOp op;
+    op.erase = 1;
+    op.address = address;
+    op.size = 0;
+    chip_push((Chip *)context, &op);
+    return 0x2;
+}
+
+static uint8_t chip_erase_all(void *context) {
+    Chip *chip = (Chip *)context;
+    chip_wait(chip);
+    memset(chip->memory, 0xFF, chip->size);
+    return 0x2;
+}
+
+static void chip_wait(void *context) {
+    Chip *chip = (Chip *)context;
+    pthread_mutex_lock(&chip->lock);
+    while(chip->count) {
+        pthread_cond_wait(&chip->changed, &chip->lock);
+    }
+    pthread_mutex_unlock(&chip->lock);
+}
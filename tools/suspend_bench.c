@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spifs.h"
+
+/**
+ * 读取抢占延迟测试
+ * 模拟器按W25Q32典型时序(SPI 50MHz, 页编程0.7ms, 扇区擦除45ms)在虚拟时钟上模拟忙状态, 命令经异步命令队列发出
+ * 后台回收任务反复写入并删除一个文件后回收(disk_priority(0)), 擦除在队列中逐条发出;
+ * 读取请求按随机间隔到达, 读取随机文件的一段, 延迟为到达至读取完成的时间
+ * 分别在不挂起与挂起(不同的最短擦除进行时间)时测量读取延迟分布与完成的回收次数
+ * 编译: gcc -O2 -Isrc tools/suspend_bench.c src/[a-z]*.c -o suspend_bench
+ * 用法: suspend_bench [测试时长(s)] [平均读取间隔(us)]
+ * */
+
+// 被读取的文件数与大小(字节)
+#define DATA_FILES 32
+#define DATA_SIZE 8192
+// 每次读取的长度(字节)
+#define READ_SIZE 256
+// 每次回收前写入并删除的文件大小(字节)
+#define GARBAGE_SIZE 16384
+// 轮询间隔(us)
+#define POLL_US 20
+// 异步命令队列长度, 容纳一次回收的全部命令
+#define QUEUE_COMMANDS 256
+
+static uint32_t duration = 20000000;
+static uint32_t interval = 5000;
+static uint8_t data[DATA_SIZE];
+static uint8_t garbage[GARBAGE_SIZE];
+
+static uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245u + 12345u;
+    return *seed >> 8;
+}
+
+static int compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * 后台回收任务的一轮: 写入并删除一个文件后回收, 命令进入队列后返回
+ * */
+static void collect() {
+    FileState fstate;
+    File file;
+    uint8_t priority = disk_priority(0);
+    make_fstate(&fstate, 2024, 1, 1);
+    make_file(&file, "garbage", "tmp");
+    create_file(&file, fstate);
+    write_file(&file, garbage, GARBAGE_SIZE);
+    delete_file(&file);
+    spifs_gc();
+    disk_priority(priority);
+}
+
+/**
+ * 运行一次测试
+ * @param progress_us disk_suspend的参数, 0不挂起
+ * @param *latency 输出各次读取的延迟(us)
+ * @param *gcs 完成的回收次数
+ * @param *stats 读取抢占统计
+ * @return 读取次数, 内容错误时返回0
+ * */
+static uint32_t run(uint32_t progress_us, uint32_t *latency, uint32_t *gcs, DiskSuspendStats *stats) {
+    FileState fstate;
+    File files[DATA_FILES];
+    uint8_t buffer[READ_SIZE];
+    char name[9];
+    uint32_t seed = 2024, reads = 0, start, arrival, index, offset;
+
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    disk_async(0);
+    w25q32_chip_erase();
+    spifs_mount();
+    make_fstate(&fstate, 2024, 1, 1);
+    for(uint32_t i = 0; i < DATA_FILES; i++) {
+        snprintf(name, sizeof(name), "d%u", i);
+        make_file(files + i, name, "dat");
+        create_file(files + i, fstate);
+        write_file(files + i, data, DATA_SIZE);
+    }
+    disk_async(QUEUE_COMMANDS);
+    disk_suspend(progress_us);
+    w25q32_timing(700, 45000);
+    w25q32_bus(160);
+
+    *gcs = 0;
+    start = w25q32_clock();
+    arrival = start + next_random(&seed) % (interval * 2);
+    while((w25q32_clock() - start) < duration) {
+        if((int32_t)(w25q32_clock() - arrival) >= 0) {
+            index = next_random(&seed) % DATA_FILES;
+            offset = next_random(&seed) % (DATA_SIZE - READ_SIZE);
+            read_file(files + index, buffer, offset, READ_SIZE);
+            if(memcmp(buffer, data + offset, READ_SIZE) != 0) {
+                return 0;
+            }
+            latency[reads++] = w25q32_clock() - arrival;
+            arrival += next_random(&seed) % (interval * 2);
+            continue;
+        }
+        if(disk_async_queued() == disk_async_completed()) {
+            if(disk_async_queued() != 0) {
+                (*gcs)++;
+            }
+            collect();
+            continue;
+        }
+        w25q32_elapse(POLL_US);
+        disk_async_step();
+    }
+    disk_async_flush();
+    disk_suspend_stats(stats);
+    disk_suspend(0);
+    disk_async(0);
+    w25q32_timing(0, 0);
+    w25q32_bus(0);
+    return reads;
+}
+
+int main(int argc, char **argv) {
+    const uint32_t progress[4] = {0, 5000, 1000, 200};
+    uint32_t *latency, reads, gcs;
+    DiskSuspendStats stats;
+
+    duration = ((argc > 1) ? (uint32_t)atoi(argv[1]) : 20) * 1000000;
+    interval = (argc > 2) ? (uint32_t)atoi(argv[2]) : interval;
+    latency = (uint32_t *)malloc(sizeof(uint32_t) * (duration / (interval / 4 + 1) + 16));
+    for(uint32_t i = 0; i < DATA_SIZE; i++) {
+        data[i] = (uint8_t)(i * 2654435761u >> 24);
+    }
+    memset(garbage, 0x5A, GARBAGE_SIZE);
+    w25q32_allocate();
+
+    printf("%u s, one %u-byte read every %u us on average, background gc of a %u KB file\n",
+           duration / 1000000, READ_SIZE, interval, GARBAGE_SIZE / 1024);
+    printf("%-14s %7s %8s %8s %8s %8s %6s %8s %6s\n", "suspend", "reads", "p50 us", "p99 us", "p99.9 us", "max us", "gcs", "suspends", "waits");
+    for(uint32_t i = 0; i < 4; i++) {
+        reads = run(progress[i], latency, &gcs, &stats);
+        if(reads == 0) {
+            printf("content MISMATCH\n");
+            return 1;
+        }
+        qsort(latency, reads, sizeof(uint32_t), compare);
+        if(progress[i] == 0) {
+            printf("%-14s", "off");
+        }else {
+            printf("on, %5u us ", progress[i]);
+        }
+        printf(" %7u %8u %8u %8u %8u %6u %8u %6u\n", reads, latency[reads / 2], latency[reads * 99 / 100],
+               latency[reads * 999 / 1000], latency[reads - 1], gcs, stats.suspends, stats.waits);
+    }
+    printf("content ok\n");
+    free(latency);
+    return 0;
+}
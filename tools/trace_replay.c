@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "w25q32.h"
+#include "trace.h"
+
+/**
+ * 跟踪回放工具
+ * 在w25q32模拟器上按顺序回放trace_start采集的闪存操作, 统计:
+ * 按W25Q32典型时序估算的耗时, 写放大(编程/擦除字节数与应用层写入字节数之比), 各扇区擦除次数分布
+ * 跟踪记录不含数据内容, 编程统一写入0x00, 目标字节未擦除时记为重复编程
+ * 编译: gcc -Isrc tools/trace_replay.c src/w25q32.c src/bulk.c -lm -o trace_replay
+ * 用法: trace_replay <跟踪文件> [-c 擦除分布.csv]
+ * */
+
+// 扇区大小(字节)
+#define SECTOR_SIZE 4096
+// 扇区总数
+#define SECTOR_SUM 1024
+// 擦除次数最多的扇区输出数量
+#define TOP_SECTORS 8
+
+// W25Q32典型时序
+// SPI时钟频率(Hz)
+#define SPI_CLOCK_HZ 50000000.0
+// 指令+24位地址(字节)
+#define CMD_ADDR_BYTES 4
+// 页编程首字节时间(s)
+#define T_BP1 30e-6
+// 页编程后续每字节时间(s)
+#define T_BP2 2.5e-6
+// 扇区擦除时间(s)
+#define T_SE 45e-3
+// 整片擦除时间(s)
+#define T_CE 10.0
+
+typedef struct op_stat {
+    uint32_t count;   // 操作次数
+    uint64_t bytes;  // 字节数
+    double time;    // 估算耗时(s)
+} OpStat;
+
+static OpStat stats[TRACE_USER_WRITE + 1];
+static uint32_t erase_count[SECTOR_SUM];
+static uint64_t reprogrammed = 0;
+static uint32_t page_wraps = 0;
+// 首次页回绕的编程地址
+static uint32_t first_wrap = 0xFFFFFFFF;
+static uint32_t unknown = 0;
+
+static void on_violation(uint32_t address, uint8_t kind);
+static void replay(TraceRecord *record, uint8_t *scratch);
+static void report(uint32_t records, uint32_t first, uint32_t last, uint32_t clock_hz, const char *csv);
+
+int main(int argc, char **argv) {
+    FILE *file;
+    TraceHeader header;
+    TraceRecord record;
+    uint8_t *scratch;
+    uint8_t *padding;
+    const char *csv = NULL;
+    uint32_t records = 0, first = 0, last = 0;
+
+    if(argc < 2) {
+        printf("usage: %s <trace file> [-c erase.csv]\n", argv[0]);
+        return 1;
+    }
+    if(argc >= 4 && strcmp(argv[2], "-c") == 0) {
+        csv = argv[3];
+    }
+
+    file = fopen(argv[1], "rb");
+    if(file == NULL) {
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+    if(fread(&header, sizeof(TraceHeader), 1, file) != 1 || header.magic != TRACE_MAGIC
+       || header.version != TRACE_VERSION || header.record_size < sizeof(TraceRecord)) {
+        printf("%s is not a spifs trace\n", argv[1]);
+        fclose(file);
+        return 1;
+    }
+
+    w25q32_allocate();
+    w25q32_chip_erase();
+    w25q32_strict(1, on_violation);
+    scratch = (uint8_t *)malloc(sizeof(uint8_t) * 65536);
+    padding = (uint8_t *)malloc(sizeof(uint8_t) * header.record_size);
+
+    while(fread(&record, sizeof(TraceRecord), 1, file) == 1) {
+        // 新版本记录可能更长, 跳过多出的部分
+        if(header.record_size > sizeof(TraceRecord)) {
+            if(fread(padding, (header.record_size - sizeof(TraceRecord)), 1, file) != 1) {
+                break;
+            }
+        }
+        if(records == 0) {
+            first = record.time;
+        }
+        last = record.time;
+        records++;
+        replay(&record, scratch);
+    }
+    fclose(file);
+
+    report(records, first, last, header.clock_hz, csv);
+
+    free(padding);
+    free(scratch);
+    w25q32_destory();
+    return 0;
+}
+
+static void on_violation(uint32_t address, uint8_t kind) {
+    if(kind == W25Q32_PAGE_WRAP) {
+        if(page_wraps == 0) {
+            first_wrap = address;
+        }
+        page_wraps++;
+    }
+}
+
+/**
+ * 回放一条记录并累计统计
+ * @param record 跟踪记录
+ * @param scratch 读取/编程缓冲区(65536字节)
+ * */
+static void replay(TraceRecord *record, uint8_t *scratch) {
+    uint32_t i, end;
+    OpStat *stat;
+
+    if(record->op == 0 || record->op > TRACE_USER_WRITE) {
+        unknown++;
+        return;
+    }
+    stat = &stats[record->op];
+    stat->count++;
+    stat->bytes += record->size;
+    end = record->address + record->size;
+    if(record->op != TRACE_USER_WRITE && record->op != TRACE_CHIP_ERASE && end > (SECTOR_SIZE * SECTOR_SUM)) {
+        unknown++;
+        return;
+    }
+
+    switch(record->op) {
+        case TRACE_READ:
+            w25q32_read(record->address, scratch, record->size);
+            stat->time += (CMD_ADDR_BYTES + record->size) * 8 / SPI_CLOCK_HZ;
+            break;
+        case TRACE_PROGRAM:
+            for(i = record->address; i < end; i++) {
+                if(w25q32_buffer[i] != 0xFF) {
+                    reprogrammed++;
+                }
+            }
+            memset(scratch, 0x00, record->size);
+            w25q32_write_page(record->address, scratch, record->size);
+            stat->time += (CMD_ADDR_BYTES + record->size) * 8 / SPI_CLOCK_HZ;
+            stat->time += (record->size) ? (T_BP1 + (record->size - 1) * T_BP2) : 0;
+            break;
+        case TRACE_ERASE:
+            w25q32_sector_erase(record->address);
+            erase_count[record->address / SECTOR_SIZE]++;
+            stat->time += T_SE;
+            break;
+        case TRACE_CHIP_ERASE:
+            w25q32_chip_erase();
+            for(i = 0; i < SECTOR_SUM; i++) {
+                erase_count[i]++;
+            }
+            stat->bytes += SECTOR_SIZE * SECTOR_SUM;
+            stat->time += T_CE;
+            break;
+        default:
+            break;
+    }
+}
+
+static void report(uint32_t records, uint32_t first, uint32_t last, uint32_t clock_hz, const char *csv) {
+    const char *names[] = {"", "read", "program", "sector erase", "chip erase", "user write"};
+    uint32_t i, j, erased = 0, min = 0xFFFFFFFF, max = 0;
+    uint32_t top[TOP_SECTORS];
+    double modeled = 0, mean = 0, var = 0;
+    uint64_t user = stats[TRACE_USER_WRITE].bytes;
+    FILE *file;
+
+    printf("records: %u", records);
+    if(unknown) {
+        printf(" (%u skipped)", unknown);
+    }
+    putchar('\n');
+    for(i = TRACE_READ; i <= TRACE_USER_WRITE; i++) {
+        printf("%-13s %10u ops %12llu bytes", names[i], stats[i].count, (unsigned long long)stats[i].bytes);
+        if(i != TRACE_USER_WRITE) {
+            printf(" %12.3f ms", stats[i].time * 1e3);
+            modeled += stats[i].time;
+        }
+        putchar('\n');
+    }
+
+    printf("modeled time: %.3f ms", modeled * 1e3);
+    if(clock_hz && records) {
+        printf(", recorded time: %.3f ms", (double)(uint32_t)(last - first) * 1e3 / clock_hz);
+    }
+    putchar('\n');
+    printf("reprogrammed bytes: %llu, page wraps: %u", (unsigned long long)reprogrammed, page_wraps);
+    if(page_wraps) {
+        printf(" (first at 0x%06X)", first_wrap);
+    }
+    putchar('\n');
+
+    if(user) {
+        printf("write amplification: program %.2f, erase %.2f\n",
+               (double)stats[TRACE_PROGRAM].bytes / user,
+               (double)(stats[TRACE_ERASE].bytes + stats[TRACE_CHIP_ERASE].bytes) / user);
+    }else {
+        puts("write amplification: no user writes recorded");
+    }
+
+    for(i = 0; i < SECTOR_SUM; i++) {
+        min = (erase_count[i] < min) ? erase_count[i] : min;
+        max = (erase_count[i] > max) ? erase_count[i] : max;
+        mean += erase_count[i];
+        erased += (erase_count[i] > 0);
+    }
+    mean /= SECTOR_SUM;
+    for(i = 0; i < SECTOR_SUM; i++) {
+        var += (erase_count[i] - mean) * (erase_count[i] - mean);
+    }
+    printf("sector erases: min %u, max %u, mean %.2f, stddev %.2f, %u/%u sectors erased\n",
+           min, max, mean, sqrt(var / SECTOR_SUM), erased, SECTOR_SUM);
+
+    // 选出擦除次数最多的扇区
+    for(j = 0; j < TOP_SECTORS; j++) {
+        top[j] = 0xFFFFFFFF;
+        for(i = 0; i < SECTOR_SUM; i++) {
+            if(erase_count[i] == 0 || (j > 0 && (erase_count[i] > erase_count[top[j - 1]]
+               || (erase_count[i] == erase_count[top[j - 1]] && i <= top[j - 1])))) {
+                continue;
+            }
+            if(top[j] == 0xFFFFFFFF || erase_count[i] > erase_count[top[j]]) {
+                top[j] = i;
+            }
+        }
+        if(top[j] == 0xFFFFFFFF) {
+            break;
+        }
+        printf("\tsector %4u: %u erases\n", top[j], erase_count[top[j]]);
+    }
+
+    if(csv) {
+        file = fopen(csv, "w");
+        if(file == NULL) {
+            printf("cannot open %s\n", csv);
+            return;
+        }
+        fputs("sector,erases\n", file);
+        for(i = 0; i < SECTOR_SUM; i++) {
+            fprintf(file, "%u,%u\n", i, erase_count[i]);
+        }
+        fclose(file);
+    }
+}